@@ -1,31 +1,16 @@
 #ifndef APPROXIMATEBDI_CACHE_H_
 #define APPROXIMATEBDI_CACHE_H_
 
-#include "timing_cache.h"
+#include "compressed_cache.h"
 #include "stats.h"
 
-class aHitWritebackEvent;
+class ApproximateBDICache : public CompressedCacheEngine<ApproximateBDICache, ApproximateBDITagArray, ApproximateBDIDataArray> {
+    friend class CompressedCacheEngine<ApproximateBDICache, ApproximateBDITagArray, ApproximateBDIDataArray>;
 
-class ApproximateBDICache : public TimingCache {
     protected:
-        // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
-
-        ApproximateBDITagArray* tagArray;
-        ApproximateBDIDataArray* dataArray;
-
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
-
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* bdiStats;
         RunningStats* mutStats;
 
-        uint64_t tagCausedEv;
         uint64_t TM_bdiCausedEv;
         uint64_t WD_TH_bdiCausedEv;
 
@@ -33,23 +18,28 @@ class ApproximateBDICache : public TimingCache {
         ApproximateBDICache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateBDITagArray* _tagArray, ApproximateBDIDataArray* _dataArray, ReplPolicy* tagRP, ReplPolicy* dataRP, uint32_t _accLat, uint32_t _invLat,
                         uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
 
-        uint64_t access(MemReq& req);
+        void warm(Address lineAddr, AccessType type, DataLine data);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(aHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
 
-class aHitWritebackEvent : public TimingEvent {
-    private:
-        ApproximateBDICache* cache;
-        HitEvent* he;
-    public:
-        aHitWritebackEvent(ApproximateBDICache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Engine hooks (see CompressedCacheEngine)
+        void fill(CompressedAccess& a, int32_t victimTagId);
+        void hit(CompressedAccess& a, int32_t tagId);
+
+        // Samples the compression ratio and array utilization stats; after every access, and every
+        // warmSamplePeriod warm() calls when warm stats are enabled (shadow LLCs), so fast-forward
+        // warming leaves them alone
+        void sampleArrayStats();
+
+        // Lines of lineAddr's set that must go, besides the ones already in victims, to fit lineSize bytes;
+        // appended to victims, and their addresses to wbLineAddrs. Shared by access() and warm().
+        void findSizeVictims(Address lineAddr, const MemReq* req, uint16_t lineSize, g_vector<uint32_t>& victims, g_vector<Address>& wbLineAddrs);
+
+        // Evicts the size victims of a lineSize-byte line that keeps keptTagId's space, one cycle
+        // apart from evBeginCycle, and frees their tags
+        void evictSizeVictims(CompressedAccess& a, uint16_t lineSize, int32_t keptTagId, uint64_t evBeginCycle, uint64_t& bdiCausedEv);
 };
 
 #endif // APPROXIMATEBDI_CACHE_H_
@@ -1,29 +1,94 @@
 #ifndef APPROXIMATEDEDUP_CACHE_H_
 #define APPROXIMATEDEDUP_CACHE_H_
 
-#include "timing_cache.h"
+#include "compressed_cache.h"
+#include "locks.h"
 #include "stats.h"
 
-class dHitWritebackEvent;
+class ApproximateDedupCache;
 
-class ApproximateDedupCache : public TimingCache {
-    protected:
-        // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
+/* Global dedup directory (globalDedup = true): the banks of an LLC keep their own tag arrays and
+ * coherence controllers, and share one hash array and one data array, so identical lines that map
+ * to different banks are stored once. The data array is the banks' data arrays laid end to end,
+ * so data line d lives in bank d / bankDataLines.
+ *
+ * Banks only lock what they share, once they hold their own locks: the hash array set they look up,
+ * then the data lines they read or change (see DedupLocks). No bank touches another's tags: evicting
+ * a data line drops the lists other banks keep on it and bumps its generation, and their tags find
+ * out they were orphaned the next time their bank uses them (see ApproximateDedupCache::isOrphan).
+ */
+class DedupDirectory : public GlobAlloc {
+    public:
+        g_vector<ApproximateDedupCache*> banks; // indexed by bank
+        const uint32_t bankDataLines;
+        const uint32_t latency; // round trip to another bank's part of the data array
+        lock_t* hashLocks; // one per hash array set
+        lock_t* dataLocks; // one per data line
+        uint32_t* dataGens; // per data line, bumped when its eviction drops other banks' lists
+
+        DedupDirectory(uint32_t _bankDataLines, uint32_t numBanks, uint32_t hashSets, uint32_t _latency) : bankDataLines(_bankDataLines), latency(_latency) {
+            hashLocks = gm_calloc<lock_t>(hashSets);
+            for (uint32_t i = 0; i < hashSets; i++) futex_init(&hashLocks[i]);
+            dataLocks = gm_calloc<lock_t>(bankDataLines*numBanks);
+            for (uint32_t i = 0; i < bankDataLines*numBanks; i++) futex_init(&dataLocks[i]);
+            dataGens = gm_calloc<uint32_t>(bankDataLines*numBanks);
+        }
+};
+
+/* Directory locks held by one access or warm(): at most one hash set, taken first, then data lines
+ * in ascending order. Locking a line below one already held drops the higher ones and retakes them
+ * in order, so callers must not act on what they read under those before. Everything is released
+ * when this goes out of scope. Does nothing without a directory.
+ */
+class DedupLocks {
+    private:
+        static const uint32_t MAX_DATA_LOCKS = 4;
+        DedupDirectory* dir;
+        lock_t* hashLock;
+        int32_t dataIds[MAX_DATA_LOCKS]; // ascending
+        uint32_t numDataLocks;
+
+    public:
+        explicit DedupLocks(DedupDirectory* _dir) : dir(_dir), hashLock(nullptr), numDataLocks(0) {}
+        ~DedupLocks() {unlockAll();}
+
+        void lockHash(uint32_t set) {
+            if (!dir) return;
+            assert(!hashLock && !numDataLocks);
+            hashLock = &dir->hashLocks[set];
+            futex_lock(hashLock);
+        }
+
+        void lockData(int32_t dataId) {
+            if (!dir || dataId < 0) return;
+            uint32_t pos = 0;
+            while (pos < numDataLocks && dataIds[pos] < dataId) pos++;
+            if (pos < numDataLocks && dataIds[pos] == dataId) return;
+            assert(numDataLocks < MAX_DATA_LOCKS);
+            for (uint32_t i = numDataLocks; i > pos; i--) {
+                futex_unlock(&dir->dataLocks[dataIds[i-1]]);
+                dataIds[i] = dataIds[i-1];
+            }
+            dataIds[pos] = dataId;
+            numDataLocks++;
+            for (uint32_t i = pos; i < numDataLocks; i++) futex_lock(&dir->dataLocks[dataIds[i]]);
+        }
+
+        void unlockAll() {
+            while (numDataLocks) futex_unlock(&dir->dataLocks[dataIds[--numDataLocks]]);
+            if (hashLock) futex_unlock(hashLock);
+            hashLock = nullptr;
+        }
+};
 
-        ApproximateDedupTagArray* tagArray;
-        ApproximateDedupDataArray* dataArray;
+class ApproximateDedupCache : public CompressedCacheEngine<ApproximateDedupCache, ApproximateDedupTagArray, ApproximateDedupDataArray> {
+    friend class CompressedCacheEngine<ApproximateDedupCache, ApproximateDedupTagArray, ApproximateDedupDataArray>;
+
+    protected:
         ApproximateDedupHashArray* hashArray;
 
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
         ReplPolicy* hashRP;
 
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* hutStats;
         RunningStats* dupStats;
         RunningStats* mutStats;
@@ -40,34 +105,62 @@ class ApproximateDedupCache : public TimingCache {
         uint64_t WD_TH_HH_DD_M;
         uint64_t WSR_TH;
 
-        uint64_t tagCausedEv;
         uint64_t TM_HH_DD_dedupCausedEv;
         uint64_t TM_HM_dedupCausedEv;
         uint64_t WD_TH_HH_DD_M_dedupCausedEv;
         uint64_t WD_TH_HM_M_dedupCausedEv;
 
+        uint64_t ORPHAN_TH;
+
+        DedupDirectory* dir; // nullptr unless the banks share a global dedup directory
+        uint32_t dedupBank;  // our index in dir->banks and in the data array's list heads
+        uint32_t* tagGens;   // with a directory, the generation of the data line each tag was bound to
+
     public:
         ApproximateDedupCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateDedupTagArray* _tagArray, ApproximateDedupDataArray* _dataArray, ApproximateDedupHashArray* _hashArray, ReplPolicy* tagRP, 
                         ReplPolicy* dataRP, ReplPolicy* hashRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats, 
                         RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
 
-        uint64_t access(MemReq& req);
+        void warm(Address lineAddr, AccessType type, DataLine data);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(dHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
+        // Joins a global dedup directory as its next bank
+        void setDedupDirectory(DedupDirectory* _dir);
 
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
 
-class dHitWritebackEvent : public TimingEvent {
-    private:
-        ApproximateDedupCache* cache;
-        HitEvent* he;
-    public:
-        dHitWritebackEvent(ApproximateDedupCache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Engine hooks (see CompressedCacheEngine)
+        void releaseTag(CompressedAccess& a, int32_t victimTagId);
+        void fill(CompressedAccess& a, int32_t victimTagId);
+        void hit(CompressedAccess& a, int32_t tagId);
+
+        // Compression ratio, utilization and dedup samples (see ApproximateBDICache::sampleArrayStats)
+        void sampleArrayStats();
+
+        // Shared by access() and warm(). These lock the data lines they use in locks.
+        bool releaseData(int32_t tagId, const MemReq* req, DedupLocks& locks);  // drops tagId's reference to its data line, true if that freed it
+        void evictDataTags(int32_t listHeadId, int32_t keepTagId, const MemReq* req, g_vector<EvictionReq>& evictions);  // invalidates the list's tags but keepTagId
+        void detachRemoteDataTags(int32_t dataId);  // drops the lists other banks keep on dataId, orphaning their tags
+        // Picks a victim data line other than avoidDataId and evicts its tags but keepTagId, once the
+        // victim is read at evictCycle; returns it
+        int32_t evictDataLine(CompressedAccess& a, DedupLocks& locks, int32_t keepTagId, int32_t avoidDataId, uint64_t evictCycle, uint64_t& dedupCausedEv);
+
+        // With a directory, a tag whose data line another bank evicted still points to it, but is no
+        // longer on its lists. It keeps its coherence state, and drops the stale reference the next
+        // time we use it. Both need the data line locked.
+        inline void bindData(int32_t tagId, int32_t dataId) {
+            if (dir) tagGens[tagId] = dir->dataGens[dataId];
+        }
+        inline bool isOrphan(int32_t tagId) const {
+            int32_t dataId = tagArray->readDataId(tagId);
+            return dir && dataId != -1 && tagGens[tagId] != dir->dataGens[dataId];
+        }
+
+        // Directory hop to reach dataId, 0 if it lives in this bank
+        inline uint32_t dataLatency(int32_t dataId) const {
+            return (dir && dataId / dir->bankDataLines != dedupBank)? dir->latency : 0;
+        }
 };
 
 #endif // APPROXIMATEDEDUP_CACHE_H_
@@ -1,29 +1,17 @@
 #ifndef APPROXIMATEIDEALDEDUP_CACHE_H_
 #define APPROXIMATEIDEALDEDUP_CACHE_H_
 
-#include "timing_cache.h"
+#include "compressed_cache.h"
 #include "stats.h"
 
-class idHitWritebackEvent;
+class ApproximateIdealDedupCache : public CompressedCacheEngine<ApproximateIdealDedupCache, ApproximateDedupTagArray, ApproximateDedupDataArray> {
+    friend class CompressedCacheEngine<ApproximateIdealDedupCache, ApproximateDedupTagArray, ApproximateDedupDataArray>;
 
-class ApproximateIdealDedupCache : public TimingCache {
     protected:
-        // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
-
-        ApproximateDedupTagArray* tagArray;
-        ApproximateDedupDataArray* dataArray;
         ApproximateDedupHashArray* hashArray;
 
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
         ReplPolicy* hashRP;
 
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* dupStats;
 
         uint64_t TM_DS;
@@ -43,23 +31,24 @@ class ApproximateIdealDedupCache : public TimingCache {
         ApproximateIdealDedupCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateDedupTagArray* _tagArray, ApproximateDedupDataArray* _dataArray, ApproximateDedupHashArray* _hashArray, ReplPolicy* tagRP,
                         ReplPolicy* dataRP, ReplPolicy* hashRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats,
                         RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
-        uint64_t access(MemReq& req);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(idHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
 
-class idHitWritebackEvent : public TimingEvent {
-    private:
-        ApproximateIdealDedupCache* cache;
-        HitEvent* he;
-    public:
-        idHitWritebackEvent(ApproximateIdealDedupCache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Engine hooks (see CompressedCacheEngine). The victim tag goes as soon as the tag array is read.
+        uint64_t tagEvictionCycle(const CompressedAccess& a) const {return a.respCycle;}
+        void releaseTag(CompressedAccess& a, int32_t victimTagId);
+        void fill(CompressedAccess& a, int32_t victimTagId);
+        void hit(CompressedAccess& a, int32_t tagId);
+        void sampleArrayStats();
+
+        void releaseData(int32_t tagId, const MemReq* req);  // drops tagId's reference to its data line
+        int32_t findSameData(const DataLine data);  // ideal dedup: any valid data line with this data, -1 if none
+        // Points the hash at dataId, which holds the data (shared) or is about to; counts the DS_/DD_ hash outcomes
+        void indexData(uint64_t hash, int32_t hashId, int32_t dataId, bool shared, const MemReq* req);
+        // Picks a victim data line other than avoidDataId and evicts its tags but keepTagId at evictCycle; returns it
+        int32_t evictDataLine(CompressedAccess& a, int32_t keepTagId, int32_t avoidDataId, uint64_t evictCycle);
 };
 
 #endif // APPROXIMATEIDEALDEDUP_CACHE_H_
@@ -1,30 +1,19 @@
 #ifndef APPROXIMATEIDEALDEDUPBDI_CACHE_H_
 #define APPROXIMATEIDEALDEDUPBDI_CACHE_H_
 
-#include "timing_cache.h"
+#include "compressed_cache.h"
 #include "stats.h"
 
-class idbHitWritebackEvent;
+class ApproximateIdealDedupBDICache : public CompressedCacheEngine<ApproximateIdealDedupBDICache, ApproximateDedupBDITagArray, ApproximateDedupBDIDataArray> {
+    friend class CompressedCacheEngine<ApproximateIdealDedupBDICache, ApproximateDedupBDITagArray, ApproximateDedupBDIDataArray>;
 
-class ApproximateIdealDedupBDICache : public TimingCache {
     protected:
-        // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
         uint32_t dataAssoc;
 
-        ApproximateDedupBDITagArray* tagArray;
-        ApproximateDedupBDIDataArray* dataArray;
         ApproximateDedupBDIHashArray* hashArray;
 
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
         ReplPolicy* hashRP;
 
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* dupStats;
         RunningStats* bdiStats;
 
@@ -46,23 +35,22 @@ class ApproximateIdealDedupBDICache : public TimingCache {
                         ReplPolicy* dataRP, ReplPolicy* hashRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats,
                         RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _all_misses);
 
-        uint64_t access(MemReq& req);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(idbHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
 
-class idbHitWritebackEvent : public TimingEvent {
-    private:
-        ApproximateIdealDedupBDICache* cache;
-        HitEvent* he;
-    public:
-        idbHitWritebackEvent(ApproximateIdealDedupBDICache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Engine hooks (see CompressedCacheEngine)
+        void releaseTag(CompressedAccess& a, int32_t victimTagId);
+        void fill(CompressedAccess& a, int32_t victimTagId);
+        void hit(CompressedAccess& a, int32_t tagId);
+        void sampleArrayStats();
+
+        bool releaseData(int32_t tagId, const MemReq* req);  // drops tagId's reference to its segment, true if that freed it
+        // Ideal dedup: a valid segment with this data, the first of the last set that has one; false if none
+        bool findSameData(const DataLine data, int32_t* dataId, int32_t* segmentId);
+        // Points the hash at the segment, which holds the data (shared) or just got it; counts the DS_/DD_ hash outcomes
+        void indexData(uint64_t hash, int32_t hashId, int32_t dataId, int32_t segmentId, bool shared, const MemReq* req);
 };
 
 #endif // APPROXIMATEIDEALDEDUPBDI_CACHE_H_
@@ -31,7 +31,7 @@
 #include "zsim.h"
 
 Cache::Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all)
-    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name), tag_hits(_tag_hits), tag_misses(_tag_misses), tag_all(_tag_all) {}
+    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name), tag_hits(_tag_hits), tag_misses(_tag_misses), tag_all(_tag_all), warmStats(false), warmSamplePeriod(0), warmSampleCount(0) {}
 
 const char* Cache::getName() {
     return name.c_str();
@@ -56,6 +56,17 @@ void Cache::initCacheStats(AggregateStat* cacheStat) {
     cc->initStats(cacheStat);
     array->initStats(cacheStat);
     rp->initStats(cacheStat);
+    initWarmStats(cacheStat);
+}
+
+void Cache::initWarmStats(AggregateStat* cacheStat) {
+    if (!zinfo->ffWarm && !warmStats) return;
+    profWarmHits.init("warmHits", "Fast-forward warming accesses that hit");
+    profWarmMisses.init("warmMisses", "Fast-forward warming accesses that missed and filled");
+    profWarmSkips.init("warmSkips", "Fast-forward warming fills dropped to avoid evicting lines held by children");
+    cacheStat->append(&profWarmHits);
+    cacheStat->append(&profWarmMisses);
+    cacheStat->append(&profWarmSkips);
 }
 
 uint64_t Cache::access(MemReq& req) {
@@ -129,13 +140,39 @@ uint64_t Cache::access(MemReq& req) {
     return respCycle;
 }
 
+void Cache::warm(Address lineAddr, AccessType type, DataLine data) {
+    assert(array);
+    assert((type == GETS) || (type == GETX));
+    MESIState dummyState = I;
+    MemReq req = {lineAddr, type, 0, &dummyState, zinfo->globPhaseCycles, nullptr, I, 0, 0};
+    cc->startWarm();
+    int32_t lineId = array->lookup(lineAddr, &req, true);
+    if (lineId != -1) {
+        profWarmHits.inc();
+        cc->processWarmAccess(type, lineId);
+    } else {
+        Address wbLineAddr;
+        lineId = array->preinsert(lineAddr, &req, &wbLineAddr);
+        if (cc->numSharers(lineId)) {
+            //Would need to invalidate children, which warming cannot do
+            profWarmSkips.inc();
+        } else {
+            profWarmMisses.inc();
+            cc->processWarmEviction(lineId);
+            array->postinsert(lineAddr, &req, lineId);
+            cc->processWarmAccess(type, lineId);
+        }
+    }
+    cc->endWarm();
+}
+
 void Cache::startInvalidate() {
     cc->startInv(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
 }
 
 uint64_t Cache::finishInvalidate(const InvReq& req) {
     int32_t lineId = array->lookup(req.lineAddr, nullptr, false);
-    assert_msg(lineId != -1, "[%s] Invalidate on non-existing address 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
+    assert_msg(lineId != -1 || req.coarse, "[%s] Invalidate on non-existing address 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
     uint64_t respCycle = req.cycle + invLat;
     trace(Cache, "[%s] Invalidate start 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
     respCycle = cc->processInv(req, lineId, respCycle); //send invalidates or downgrades to children, and adjust our own state
@@ -58,6 +58,12 @@ class Cache : public BaseCache {
         Counter* tag_misses;
         Counter* tag_all;
 
+        //Functional warming counters, only registered when sim.ffWarm is set or on shadow LLCs
+        Counter profWarmHits, profWarmMisses, profWarmSkips;
+        bool warmStats;
+        uint32_t warmSamplePeriod; //warm() samples the array stats every warmSamplePeriod calls (0: never)
+        uint32_t warmSampleCount;
+
     public:
         Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name, Counter* _tag_hits = NULL, Counter* _tag_misses = NULL, Counter* _tag_all = NULL);
 
@@ -69,6 +75,17 @@ class Cache : public BaseCache {
         virtual void dumpStats() {}
         virtual uint64_t access(MemReq& req);
 
+        //Functional warming (used during fast-forward): updates tags, replacement and
+        //coherence state as a fill would, but without timing or requests to other levels.
+        //Lines held by children are never evicted; the fill is dropped instead.
+        //data holds the line's contents, read by the caller when the access happened (warm() may run
+        //later, on another thread); compressed caches may approximate it in place.
+        virtual void warm(Address lineAddr, AccessType type, DataLine data);
+        void enableWarmStats(uint32_t samplePeriod = 1) { //must be called before initStats
+            warmStats = true;
+            warmSamplePeriod = samplePeriod;
+        }
+
         //NOTE: reqWriteback is pulled up to true, but not pulled down to false.
         virtual uint64_t invalidate(const InvReq& req) {
             startInvalidate();
@@ -76,7 +93,16 @@ class Cache : public BaseCache {
         }
 
     protected:
-        void initCacheStats(AggregateStat* cacheStat);
+        virtual void initCacheStats(AggregateStat* cacheStat);
+        void initWarmStats(AggregateStat* cacheStat);
+
+        // True on every warmSamplePeriod-th warm(); the array stats cost O(lines) to sample.
+        // Racy across threads, which only shifts when a sample is taken.
+        inline bool sampleWarmStats() {
+            if (!warmSamplePeriod || ++warmSampleCount < warmSamplePeriod) return false;
+            warmSampleCount = 0;
+            return true;
+        }
 
         void startInvalidate(); // grabs cc's downLock
         uint64_t finishInvalidate(const InvReq& req); // performs inv and releases downLock
@@ -88,6 +88,7 @@ uniDoppelgangerTagArray::uniDoppelgangerTagArray(uint32_t _numLines, uint32_t _a
     setMask = numSets - 1;
     validLines = 0;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+    pfTracker.init(numLines);
 }
 
 uniDoppelgangerTagArray::~uniDoppelgangerTagArray() {
@@ -103,7 +104,10 @@ int32_t uniDoppelgangerTagArray::lookup(Address lineAddr, const MemReq* req, boo
     uint32_t first = set*assoc;
     for (uint32_t id = first; id < first + assoc; id++) {
         if (tagArray[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
+            if (updateReplacement) {
+                pfTracker.hit(id, req);
+                if (!PrefetchTracker::isPrefetch(req)) rp->update(id, req);
+            }
             return id;
         }
     }
@@ -144,6 +148,7 @@ void uniDoppelgangerTagArray::postinsert(Address lineAddr, const MemReq* req, in
         validLines--;
     }
     rp->replaced(tagId);
+    bool pfInsert = pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     mapPointerArray[tagId] = mapId;
     approximateArray[tagId] = approximate;
@@ -157,7 +162,7 @@ void uniDoppelgangerTagArray::postinsert(Address lineAddr, const MemReq* req, in
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head is not actually a list head!");
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !pfInsert) rp->update(tagId, req);  // prefetched lines stay at the lowest priority
 }
 
 void uniDoppelgangerTagArray::changeInPlace(Address lineAddr, const MemReq* req, int32_t tagId, int32_t mapId, int32_t listHead, bool approximate, bool updateReplacement) {
@@ -167,6 +172,7 @@ void uniDoppelgangerTagArray::changeInPlace(Address lineAddr, const MemReq* req,
     //     validLines--;
     // }
     // rp->replaced(tagId);
+    pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     mapPointerArray[tagId] = mapId;
     approximateArray[tagId] = approximate;
@@ -180,7 +186,7 @@ void uniDoppelgangerTagArray::changeInPlace(Address lineAddr, const MemReq* req,
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head is not actually a list head!");
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !PrefetchTracker::isPrefetch(req)) rp->update(tagId, req);
 }
 
 int32_t uniDoppelgangerTagArray::readMapId(const int32_t tagId) {
@@ -221,7 +227,9 @@ void uniDoppelgangerTagArray::print() {
     }
 }
 
-uniDoppelgangerDataArray::uniDoppelgangerDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
+uniDoppelgangerDataArray::uniDoppelgangerDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _mapSize)
+    : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), mapSize(_mapSize)  {
+    LINE_SIZE_BIND(zinfo->lineSize, calculateMapFn, uniDoppelgangerDataArray::calculateMap);
     mtagArray = gm_calloc<int32_t>(numLines);
     tagPointerArray = gm_calloc<int32_t>(numLines);
     approximateArray = gm_calloc<bool>(numLines);
@@ -253,6 +261,11 @@ int32_t uniDoppelgangerDataArray::lookup(uint32_t map, const MemReq* req, bool u
     return -1;
 }
 
+uint32_t uniDoppelgangerDataArray::calculateMap(const DataLine data, DataType type, DataValue minValue, DataValue maxValue) {
+    return (this->*calculateMapFn)(data, type, minValue, maxValue);
+}
+
+template <uint32_t LINE_SIZE>
 uint32_t uniDoppelgangerDataArray::calculateMap(const DataLine data, DataType type, DataValue minValue, DataValue maxValue) {
     // Get hash and map values
     int64_t intAvgHash = 0, intRangeHash = 0;
@@ -269,211 +282,211 @@ uint32_t uniDoppelgangerDataArray::calculateMap(const DataLine data, DataType ty
     switch (type)
     {
         case ZSIM_UINT8:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint8_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint8_t); i++) {
                 intSum += ((uint8_t*) data)[i];
                 if (((uint8_t*) data)[i] > intMax)
                     intMax = ((uint8_t*) data)[i];
                 if (((uint8_t*) data)[i] < intMin)
                     intMin = ((uint8_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint8_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint8_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.UINT8)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.UINT8)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(uint8_t)) {
+            if (mapSize > sizeof(uint8_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.UINT8 - minValue.UINT8)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.UINT8 - minValue.UINT8)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_INT8:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int8_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int8_t); i++) {
                 intSum += ((int8_t*) data)[i];
                 if (((int8_t*) data)[i] > intMax)
                     intMax = ((int8_t*) data)[i];
                 if (((int8_t*) data)[i] < intMin)
                     intMin = ((int8_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int8_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int8_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT8)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT8)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(int8_t)) {
+            if (mapSize > sizeof(int8_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.INT8 - minValue.INT8)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.INT8 - minValue.INT8)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_UINT16:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint16_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint16_t); i++) {
                 intSum += ((uint16_t*) data)[i];
                 if (((uint16_t*) data)[i] > intMax)
                     intMax = ((uint16_t*) data)[i];
                 if (((uint16_t*) data)[i] < intMin)
                     intMin = ((uint16_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint16_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint16_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.UINT16)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.UINT16)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(uint16_t)) {
+            if (mapSize > sizeof(uint16_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.UINT16 - minValue.UINT16)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.UINT16 - minValue.UINT16)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_INT16:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int16_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int16_t); i++) {
                 intSum += ((int16_t*) data)[i];
                 if (((int16_t*) data)[i] > intMax)
                     intMax = ((int16_t*) data)[i];
                 if (((int16_t*) data)[i] < intMin)
                     intMin = ((int16_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int16_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int16_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT16)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT16)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(int16_t)) {
+            if (mapSize > sizeof(int16_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.INT16 - minValue.INT16)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.INT16 - minValue.INT16)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_UINT32:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint32_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint32_t); i++) {
                 intSum += ((uint32_t*) data)[i];
                 if (((uint32_t*) data)[i] > intMax)
                     intMax = ((uint32_t*) data)[i];
                 if (((uint32_t*) data)[i] < intMin)
                     intMin = ((uint32_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint32_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint32_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.UINT32)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.UINT32)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.UINT32 - minValue.UINT32)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.UINT32 - minValue.UINT32)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_INT32:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int32_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int32_t); i++) {
                 intSum += ((int32_t*) data)[i];
                 if (((int32_t*) data)[i] > intMax)
                     intMax = ((int32_t*) data)[i];
                 if (((int32_t*) data)[i] < intMin)
                     intMin = ((int32_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int32_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int32_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT32)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT32)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.INT32 - minValue.INT32)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.INT32 - minValue.INT32)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_UINT64:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint64_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint64_t); i++) {
                 intSum += ((uint64_t*) data)[i];
                 if ((int64_t)(((uint64_t*) data)[i]) > intMax)
                     intMax = ((uint64_t*) data)[i];
                 if ((int64_t)(((uint64_t*) data)[i]) < intMin)
                     intMin = ((uint64_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint64_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint64_t));
             intRangeHash = intMax - intMin;
             if (intMax > (int64_t)maxValue.UINT64)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < (int64_t)minValue.UINT64)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.UINT64 - minValue.UINT64)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.UINT64 - minValue.UINT64)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_INT64:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int64_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int64_t); i++) {
                 intSum += ((int64_t*) data)[i];
                 if (((int64_t*) data)[i] > intMax)
                     intMax = ((int64_t*) data)[i];
                 if (((int64_t*) data)[i] < intMin)
                     intMin = ((int64_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int64_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int64_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT64)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT64)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.INT64 - minValue.INT64)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.INT64 - minValue.INT64)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_FLOAT:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(float); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(float); i++) {
                 floatSum += ((float*) data)[i];
                 if (((float*) data)[i] > floatMax)
                     floatMax = ((float*) data)[i];
                 if (((float*) data)[i] < floatMin)
                     floatMin = ((float*) data)[i];
             }
-            floatAvgHash = floatSum/(zinfo->lineSize/sizeof(float));
+            floatAvgHash = floatSum/(LINE_SIZE/sizeof(float));
             floatRangeHash = floatMax - floatMin;
             // if (floatMax > maxValue.FLOAT)
                 // warn("Received a value bigger than the annotation's Max!! %.10f, %.10f", floatMax, maxValue.FLOAT);
             // if (floatMin < minValue.FLOAT)
                 // warn("Received a value lower than the annotation's Min!! %.10f, %.10f", floatMin, minValue.FLOAT);
-            mapStep = (maxValue.FLOAT - minValue.FLOAT)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.FLOAT - minValue.FLOAT)/std::pow(2,mapSize-1);
             avgMap = floatAvgHash/mapStep;
             rangeMap = floatRangeHash/mapStep;
             break;
         case ZSIM_DOUBLE:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(double); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(double); i++) {
                 floatSum += ((double*) data)[i];
                 if (((double*) data)[i] > floatMax)
                     floatMax = ((double*) data)[i];
                 if (((double*) data)[i] < floatMin)
                     floatMin = ((double*) data)[i];
             }
-            floatAvgHash = floatSum/(zinfo->lineSize/sizeof(double));
+            floatAvgHash = floatSum/(LINE_SIZE/sizeof(double));
             floatRangeHash = floatMax - floatMin;
             // if (floatMax > maxValue.DOUBLE)
                 // warn("Received a value bigger than the annotation's Max!! %.10f, %.10f", floatMax, maxValue.DOUBLE);
             // if (floatMin < minValue.DOUBLE)
                 // warn("Received a value lower than the annotation's Min!! %.10f, %.10f", floatMin, minValue.DOUBLE);
-            mapStep = (maxValue.DOUBLE - minValue.DOUBLE)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.DOUBLE - minValue.DOUBLE)/std::pow(2,mapSize-1);
             avgMap = floatAvgHash/mapStep;
             rangeMap = floatRangeHash/mapStep;
             break;
         default:
             panic("Wrong Data Type!!");
     }
-    map = ((uint32_t)avgMap << (32 - zinfo->mapSize)) >> (32 - zinfo->mapSize);
-    rangeMap = ((uint32_t)rangeMap << (32 - zinfo->mapSize/2)) >> (32 - zinfo->mapSize/2);
-    rangeMap = (rangeMap << zinfo->mapSize);
+    map = ((uint32_t)avgMap << (32 - mapSize)) >> (32 - mapSize);
+    rangeMap = ((uint32_t)rangeMap << (32 - mapSize/2)) >> (32 - mapSize/2);
+    rangeMap = (rangeMap << mapSize);
     map |= rangeMap;
     return map;
 }
@@ -541,6 +554,7 @@ uint32_t uniDoppelgangerDataArray::countValidLines() {
 // BDI Begin
 ApproximateBDITagArray::ApproximateBDITagArray(uint32_t _numLines, uint32_t _assoc, uint32_t _dataAssoc, ReplPolicy* _rp, HashFamily* _hf) : 
 rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), dataAssoc(_dataAssoc) {
+    LINE_SIZE_BIND(zinfo->lineSize, needEvictionFn, ApproximateBDITagArray::needEviction);
     tagArray = gm_calloc<Address>(numLines);
     segmentPointerArray = gm_malloc<int32_t>(numLines);
     compressionEncodingArray = gm_malloc<BDICompressionEncoding>(numLines);
@@ -555,6 +569,7 @@ rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), dataAssoc(_dataAssoc) {
     dataValidSegments = 0;
     info("BDI Tag Array: %i lines and %i sets", numLines, numSets);
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+    pfTracker.init(numLines);
 }
 
 ApproximateBDITagArray::~ApproximateBDITagArray() {
@@ -569,7 +584,10 @@ int32_t ApproximateBDITagArray::lookup(Address lineAddr, const MemReq* req, bool
     uint32_t first = set*assoc;
     for (uint32_t id = first; id < first + assoc; id++) {
         if (tagArray[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
+            if (updateReplacement) {
+                pfTracker.hit(id, req);
+                if (!PrefetchTracker::isPrefetch(req)) rp->update(id, req);
+            }
             return id;
         }
     }
@@ -586,6 +604,11 @@ int32_t ApproximateBDITagArray::preinsert(Address lineAddr, const MemReq* req, A
     return candidate;
 }
 
+int32_t ApproximateBDITagArray::needEviction(Address lineAddr, const MemReq* req, uint16_t size, g_vector<uint32_t>& alreadyEvicted, Address* wbLineAddr) {
+    return (this->*needEvictionFn)(lineAddr, req, size, alreadyEvicted, wbLineAddr);
+}
+
+template <uint32_t LINE_SIZE>
 int32_t ApproximateBDITagArray::needEviction(Address lineAddr, const MemReq* req, uint16_t size, g_vector<uint32_t>& alreadyEvicted, Address* wbLineAddr) {
     uint32_t set = hf->hash(0, lineAddr) & setMask;
     uint32_t first = set*assoc;
@@ -596,10 +619,10 @@ int32_t ApproximateBDITagArray::needEviction(Address lineAddr, const MemReq* req
             if (alreadyEvicted[i] == id) {found = true; break;}
         }
         if (segmentPointerArray[id] != -1 && !found) {
-            occupiedSpace += BDICompressionToSize(compressionEncodingArray[id], zinfo->lineSize);
+            occupiedSpace += BDICompressionToSize(compressionEncodingArray[id], LINE_SIZE);
         }
     }
-    if (dataAssoc*zinfo->lineSize - occupiedSpace >= size)
+    if (dataAssoc*LINE_SIZE - occupiedSpace >= size)
         return -1;
     else {
         uint32_t candidate = rp->rank(req, SetAssocCands(first, first+assoc), alreadyEvicted);
@@ -622,11 +645,12 @@ void ApproximateBDITagArray::postinsert(Address lineAddr, const MemReq* req, int
         dataValidSegments+=BDICompressionToSize(compression, zinfo->lineSize)/8;
     }
     rp->replaced(tagId);
+    bool pfInsert = pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     segmentPointerArray[tagId] = segmentId;
     compressionEncodingArray[tagId] = compression;
     approximateArray[tagId] = approximate;
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !pfInsert) rp->update(tagId, req);  // prefetched lines stay at the lowest priority
 }
 
 BDICompressionEncoding ApproximateBDITagArray::readCompressionEncoding(int32_t tagId) {
@@ -676,343 +700,44 @@ void ApproximateBDITagArray::print() {
     }
 }
 
-// // TODO: This was copied varbatim from https://github.com/CMU-SAFARI/BDICompression/blob/master/compression.c
-// // optimize for our purposes later.
-// uint64_t ApproximateBDIDataArray::my_llabs(int64_t x) {
-//     uint64_t t = x >> 63;
-//     return (x ^ t) - t;
-// }
-
-// // TODO: This was copied varbatim from https://github.com/CMU-SAFARI/BDICompression/blob/master/compression.c
-// // and/or Amin. optimize for our purposes later.
-// uint8_t ApproximateBDIDataArray::multiBaseCompression(uint64_t * values, uint8_t size, uint8_t blimit, uint8_t bsize) {
-//     uint64_t limit = 0;
-//     uint8_t numBase = 2;
-
-//     //define the appropriate size for the mask
-//     switch(blimit){
-//         case 1:
-//             limit = 0xFF;
-//             break;
-//         case 2:
-//             limit = 0xFFFF;
-//             break;
-//         case 4:
-//             limit = 0xFFFFFFFF;
-//             break;
-//         default:
-//             panic("Wrong BDI Size");
-//             return 0;
-//     }
-
-//     uint64_t mnumBase [64];
-//     uint8_t baseCount = 1;
-//     mnumBase[0] = 0;// values[0];
-
-//     uint8_t i,j;
-//     for (i = 0; i < size; i++) {
-//         bool isFound=0;
-//         for(j = 0; j <  baseCount; j++) {
-//             if(my_llabs((int64_t)(mnumBase[j] -  values[i])) <= limit) {
-//                 isFound = 1;
-//                 break;
-//             }
-//         }
-//         if(isFound == 0)
-//             mnumBase[baseCount++] = values[i];
-//         if(baseCount >= numBase)
-//             break;
-//     }
-//     uint8_t compCount = 0;
-//     for (i = 0; i < size; i++) {
-//         for(j = 0; j <  baseCount; j++) {
-//             if(my_llabs((int64_t)(mnumBase[j] -  values[i])) <= limit) {
-//                 compCount++;
-//                 break;
-//             }
-//         }
-//     }
-
-//     //return compressed size
-//     uint8_t mCompSize = blimit * compCount + bsize * (numBase-1) + (size - compCount) * bsize; // implicit zero base gozashtim
-
-//     uint8_t retVal = mCompSize;
-//     if(compCount < size) {
-//         retVal =  size * bsize;
-//     }
-
-//     return retVal;
-// }
-
-static unsigned long long my_llabs ( long long x )
-{
-   unsigned long long t = x >> 63;
-   return (x ^ t) - t;
+ApproximateBDIDataArray::ApproximateBDIDataArray(uint32_t _floatCutSize, uint32_t _doubleCutSize) : floatCutSize(_floatCutSize), doubleCutSize(_doubleCutSize) {
+    LINE_SIZE_BIND(zinfo->lineSize, compressFn, ApproximateBDIDataArray::compress);
+    LINE_SIZE_BIND(zinfo->lineSize, approximateFn, ApproximateBDIDataArray::approximate);
 }
 
-long long unsigned * convertBuffer2Array (char * buffer, unsigned size, unsigned step)
-{
-      long long unsigned * values = (long long unsigned *) malloc(sizeof(long long unsigned) * size/step);
-//      std::cout << std::dec << "ConvertBuffer = " << size/step << std::endl;
-     //init
-     unsigned int i,j; 
-     for (i = 0; i < size / step; i++) {
-          values[i] = 0;    // Initialize all elements to zero.
-      }
-      //SIM_printf("Element Size = %d \n", step);
-      for (i = 0; i < size; i += step ){
-          for (j = 0; j < step; j++){
-              //SIM_printf("Buffer = %02x \n", (unsigned char) buffer[i + j]);
-              values[i / step] += (long long unsigned)((unsigned char)buffer[i + j]) << (8*j);
-              //SIM_printf("step %d value = ", j);
-              //printLLwithSize(values[i / step], step);  
-          }
-          //std::cout << "Current value = " << values[i / step] << std::endl;
-          //printLLwithSize(values[i / step], step);
-          //SIM_printf("\n");
-      }
-      //std::cout << "End ConvertBuffer = " << size/step << std::endl;
-      return values;
-}
-
-///
-/// Check if the cache line consists of only zero values
-///
-int isZeroPackable ( long long unsigned * values, unsigned size){
-  int nonZero = 0;
-  unsigned int i;
-  for (i = 0; i < size; i++) {
-      if( values[i] != 0){
-          nonZero = 1;
-          break;
-      }
-  }
-  return !nonZero;
-}
-
-///
-/// Check if the cache line consists of only same values
-///
-int isSameValuePackable ( long long unsigned * values, unsigned size){
-  int notSame = 0;
-  unsigned int i;
-  for (i = 0; i < size; i++) {
-      if( values[0] != values[i]){
-          notSame = 1;
-          break;
-      }
-  }
-  return !notSame;
-}
-
-///
-/// Check if the cache line values can be compressed with multiple base + 1,2,or 4-byte offset 
-/// Returns size after compression 
-///
-unsigned doubleExponentCompression ( long long unsigned * values, unsigned size, unsigned blimit, unsigned bsize){
-  unsigned long long limit = 0;
-  //define the appropriate size for the mask
-  switch(blimit){
-    case 1:
-      limit = 56;
-      break;
-    case 2:
-      limit = 48;
-      break;
-    default:
-      // std::cout << "Wrong blimit value = " <<  blimit << std::endl;
-      exit(1);
-  }
-  // finding bases: # BASES
-  // find how many elements can be compressed with mbases
-  unsigned compCount = 0;
-  unsigned int i;
-  for (i = 0; i < size; i++) {
-         if( (values[0] >> limit) ==  (values[i] >> limit))  {
-             compCount++;
-         }
-  }
-  //return compressed size
-  if(compCount != size )
-     return size * bsize;
-  return size * bsize - (compCount - 1) * blimit;
-}
-
-
-///
-/// Check if the cache line values can be compressed with multiple base + 1,2,or 4-byte offset 
-/// Returns size after compression 
-///
-unsigned multBaseCompression ( long long unsigned * values, unsigned size, unsigned blimit, unsigned bsize){
-  unsigned long long limit = 0;
-  unsigned BASES = 2;
-  //define the appropriate size for the mask
-  switch(blimit){
-    case 1:
-      limit = 0xFF;
-      break;
-    case 2:
-      limit = 0xFFFF;
-      break;
-    case 4:
-      limit = 0xFFFFFFFF;
-      break;
-    default:
-      //std::cout << "Wrong blimit value = " <<  blimit << std::endl;
-      exit(1);
-  }
-  // finding bases: # BASES
-  //std::vector<unsigned long long> mbases;
-  //mbases.push_back(values[0]); //add the first base
-  unsigned long long mbases [64];
-  unsigned baseCount = 1;
-  mbases[0] = 0;
-  unsigned int i,j;
-  for (i = 0; i < size; i++) {
-      for(j = 0; j <  baseCount; j++){
-         if( my_llabs((long long int)(mbases[j] -  values[i])) > limit ){
-             //mbases.push_back(values[i]); // add new base
-             mbases[baseCount++] = values[i];  
-         }
-     }
-     if(baseCount >= BASES) //we don't have more bases
-       break;
-  }
-  // find how many elements can be compressed with mbases
-  unsigned compCount = 0;
-  for (i = 0; i < size; i++) {
-      //ol covered = 0;
-      for(j = 0; j <  baseCount; j++){
-         if( my_llabs((long long int)(mbases[j] -  values[i])) <= limit ){
-             compCount++;
-             break;
-         }
-     }
-  }
-  //return compressed size
-  unsigned mCompSize = blimit * compCount + bsize * (BASES-1) + (size - compCount) * bsize;
-  if(compCount < size)
-     return size * bsize;
-  //VG_(printf)("%d-bases bsize = %d osize = %d CompCount = %d CompSize = %d\n", BASES, bsize, blimit, compCount, mCompSize);
-  return mCompSize;
-}
-
-unsigned BDICompress (char * buffer, unsigned _blockSize)
-{
-  //char * dst = new char [_blockSize];
-//  print_value(buffer, _blockSize);
- 
-  long long unsigned * values = convertBuffer2Array( buffer, _blockSize, 8);
-  unsigned bestCSize = _blockSize;
-  unsigned currCSize = _blockSize;
-  if( isZeroPackable( values, _blockSize / 8))
-      bestCSize = 1;
-  if( isSameValuePackable( values, _blockSize / 8))
-      currCSize = 8;
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 8, 1, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 8, 2, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize =  multBaseCompression( values, _blockSize / 8, 4, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  free(values);
-  values = convertBuffer2Array( buffer, _blockSize, 4);
-  // if( isSameValuePackable( values, _blockSize / 4))
-  //    currCSize = 4;
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 4, 1, 4);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 4, 2, 4);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  free(values);
-  values = convertBuffer2Array( buffer, _blockSize, 2);
-  currCSize = multBaseCompression( values, _blockSize / 2, 1, 2);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  free(values);
-
-  //exponent base compression
-  /*values = convertBuffer2Array( buffer, _blockSize, 8);
-  currCSize = doubleExponentCompression( values, _blockSize / 8, 2, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = doubleExponentCompression( values, _blockSize / 8, 1, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  VG_(free)(values);*/
- 
-  //delete [] buffer;
-  buffer = NULL;
-  values = NULL;
-  //SIM_printf(" BestCSize = %d \n", bestCSize);
-  return bestCSize;
-
+BDICompressionEncoding ApproximateBDIDataArray::compress(const DataLine data, uint16_t* size) {
+    return (this->*compressFn)(data, size);
 }
 
+template <uint32_t LINE_SIZE>
 BDICompressionEncoding ApproximateBDIDataArray::compress(const DataLine data, uint16_t* size) {
     // info("\tApproximate Data: %lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", ((uint64_t*)data)[0], ((uint64_t*)data)[1], ((uint64_t*)data)[2], ((uint64_t*)data)[3], ((uint64_t*)data)[4], ((uint64_t*)data)[5], ((uint64_t*)data)[6], ((uint64_t*)data)[7]);
-    *size = BDICompress((char*)data, 64);
-    if (*size == 1){                                                                               // Size 1
-        *size = 8;
-        // info("Compression: ZERO, %i segments", 1);
-        return ZERO;
-    }
-    if (*size == 8){                                                                               // Size 8
-        *size = 8;
-        // info("Compression: REPETITIVE, %i segments", 1);
-        return REPETITIVE;
-    }
-    if (*size == 16){                                                                              // Size 16
-        *size = 16;
-        // info("Compression: BASE8DELTA1, %i segments", 2);
-        return BASE8DELTA1;
-    }
-    if (*size == 20){        // Size 20
-        *size = 24;
-        // info("Compression: BASE4DELTA1, %i segments", 3);
-        return BASE4DELTA1;
-    }
-    if (*size == 24){        // Size 24
-        *size = 24;
-        // info("Compression: BASE8DELTA2, %i segments", 3);
-        return BASE8DELTA2;
-    }
-    if (*size == 34){        // Size 34
-        *size = 40;
-        // info("Compression: BASE2DELTA1, %i segments", 5);
-        return BASE2DELTA1;
-    }
-    if (*size == 36){        // Size 36
-        *size = 40;
-        // info("Compression: BASE4DELTA2, %i segments", 5);
-        return BASE4DELTA2;
-    }
-    if (*size == 40){        // Size 40
-        *size = 40;
-        // info("Compression: BASE8DELTA4, %i segments", 5);
-        return BASE8DELTA4;
-    }
-    if (*size == zinfo->lineSize){
-        return NONE;
-    }
-    panic("impossible compress size %i", *size);
+    const uint32_t lineSize = LINE_SIZE;
+    uint16_t rawSize = LineKernelsImpl<LINE_SIZE>::bdiCompress(data);
+    BDICompressionEncoding encoding;
+    // Raw sizes are base + one delta per value; for 32B lines B8D1 and B4D1 coincide and round up alike
+    if (rawSize == 1) encoding = ZERO;
+    else if (rawSize == 8) encoding = REPETITIVE;
+    else if (rawSize == 8 + lineSize/8) encoding = BASE8DELTA1;
+    else if (rawSize == 4 + lineSize/4) encoding = BASE4DELTA1;
+    else if (rawSize == 8 + lineSize/4) encoding = BASE8DELTA2;
+    else if (rawSize == 2 + lineSize/2) encoding = BASE2DELTA1;
+    else if (rawSize == 4 + lineSize/2) encoding = BASE4DELTA2;
+    else if (rawSize == 8 + lineSize/2) encoding = BASE8DELTA4;
+    else if (rawSize == lineSize) encoding = NONE;
+    else panic("impossible compress size %i", rawSize);
+    *size = BDICompressionToSize(encoding, lineSize);
+    // info("Compression: %s, %i segments", BDICompressionName(encoding), *size/8);
+    return encoding;
 }
 
 void ApproximateBDIDataArray::approximate(const DataLine data, DataType type) {
-    // info("\tExact Data: %lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", ((uint64_t*)data)[0], ((uint64_t*)data)[1], ((uint64_t*)data)[2], ((uint64_t*)data)[3], ((uint64_t*)data)[4], ((uint64_t*)data)[5], ((uint64_t*)data)[6], ((uint64_t*)data)[7]);
-    if (type == ZSIM_FLOAT) {
-        for (uint16_t i = 0; i < zinfo->lineSize/4; i++)
-        {
-            ((uint32_t*) data)[i] = ((uint32_t*) data)[i] >> zinfo->floatCutSize;
-            // ((uint32_t*) data)[i] = ((uint32_t*) data)[i] << zinfo->floatCutSize;
-        }
-    } else if (type == ZSIM_DOUBLE) {
-        for (uint16_t i = 0; i < zinfo->lineSize/8; i++)
-        {
-            ((uint64_t*) data)[i] = ((uint64_t*) data)[i] >> zinfo->doubleCutSize;
-            // ((uint64_t*) data)[i] = ((uint64_t*) data)[i] << zinfo->doubleCutSize;
-        }
-    } else {
-        panic("We only approximate floats and doubles");
-    }
+    (this->*approximateFn)(data, type);
+}
+
+template <uint32_t LINE_SIZE>
+void ApproximateBDIDataArray::approximate(const DataLine data, DataType type) {
+    LineKernelsImpl<LINE_SIZE>::approximate(data, type, floatCutSize, doubleCutSize);
 }
 // BDI end
 
@@ -1033,6 +758,7 @@ ApproximateDedupTagArray::ApproximateDedupTagArray(uint32_t _numLines, uint32_t
     validLines = 0;
     info("Dedup Tag Array: %i lines and %i sets", numLines, numSets);
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+    pfTracker.init(numLines);
 }
 
 ApproximateDedupTagArray::~ApproximateDedupTagArray() {
@@ -1048,7 +774,10 @@ int32_t ApproximateDedupTagArray::lookup(Address lineAddr, const MemReq* req, bo
     uint32_t first = set*assoc;
     for (uint32_t id = first; id < first + assoc; id++) {
         if (tagArray[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
+            if (updateReplacement) {
+                pfTracker.hit(id, req);
+                if (!PrefetchTracker::isPrefetch(req)) rp->update(id, req);
+            }
             return id;
         }
     }
@@ -1086,6 +815,7 @@ void ApproximateDedupTagArray::postinsert(Address lineAddr, const MemReq* req, i
         validLines--;
     }
     rp->replaced(tagId);
+    bool pfInsert = pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     dataPointerArray[tagId] = dataId;
     approximateArray[tagId] = approximate;
@@ -1099,7 +829,7 @@ void ApproximateDedupTagArray::postinsert(Address lineAddr, const MemReq* req, i
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head %i is not actually a list head! %i is.", listHead, prevPointerArray[listHead]);
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !pfInsert) rp->update(tagId, req);  // prefetched lines stay at the lowest priority
     // info("Tag %i: %lu, %i, %i, %i, %s", tagId, tagArray[tagId] << lineBits, prevPointerArray[tagId], nextPointerArray[tagId], dataPointerArray[tagId], approximateArray[tagId]? "approximate":"exact");
     // if (prevPointerArray[tagId] != -1)
     //     info("Tag %i: %lu, %i, %i, %i, %s", prevPointerArray[tagId], tagArray[prevPointerArray[tagId]] << lineBits, prevPointerArray[prevPointerArray[tagId]], nextPointerArray[prevPointerArray[tagId]], dataPointerArray[prevPointerArray[tagId]], approximateArray[prevPointerArray[tagId]]? "approximate":"exact");
@@ -1108,6 +838,7 @@ void ApproximateDedupTagArray::postinsert(Address lineAddr, const MemReq* req, i
 }
 
 void ApproximateDedupTagArray::changeInPlace(Address lineAddr, const MemReq* req, int32_t tagId, int32_t dataId, int32_t listHead, bool approximate, bool updateReplacement) {
+    pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     dataPointerArray[tagId] = dataId;
     approximateArray[tagId] = approximate;
@@ -1121,7 +852,7 @@ void ApproximateDedupTagArray::changeInPlace(Address lineAddr, const MemReq* req
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head %i is not actually a list head! %i is.", listHead, prevPointerArray[listHead]);
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !PrefetchTracker::isPrefetch(req)) rp->update(tagId, req);
     // info("Tag %i: %lu, %i, %i, %i, %s", tagId, tagArray[tagId] << lineBits, prevPointerArray[tagId], nextPointerArray[tagId], dataPointerArray[tagId], approximateArray[tagId]? "approximate":"exact");
     // if (prevPointerArray[tagId] != -1)
     //     info("Tag %i: %lu, %i, %i, %i, %s", prevPointerArray[tagId], tagArray[prevPointerArray[tagId]] << lineBits, prevPointerArray[prevPointerArray[tagId]], nextPointerArray[prevPointerArray[tagId]], dataPointerArray[prevPointerArray[tagId]], approximateArray[prevPointerArray[tagId]]? "approximate":"exact");
@@ -1167,13 +898,16 @@ void ApproximateDedupTagArray::print() {
     }
 }
 
-ApproximateDedupDataArray::ApproximateDedupDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
+ApproximateDedupDataArray::ApproximateDedupDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _banks) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), banks(_banks)  {
+    LINE_SIZE_BIND(zinfo->lineSize, isSameFn, ApproximateDedupDataArray::isSame);
     tagCounterArray = gm_calloc<int32_t>(numLines);
-    tagPointerArray = gm_malloc<int32_t>(numLines);
+    tagPointerArray = gm_malloc<int32_t>(numLines*banks);
     approximateArray = gm_calloc<bool>(numLines);
     dataArray = gm_calloc<DataLine>(numLines);
-    for (uint32_t i = 0; i < numLines; i++) {
+    for (uint32_t i = 0; i < numLines*banks; i++) {
         tagPointerArray[i] = -1;
+    }
+    for (uint32_t i = 0; i < numLines; i++) {
         dataArray[i] = gm_calloc<uint8_t>(zinfo->lineSize);
         freeList.push_back(i);
     }
@@ -1184,6 +918,7 @@ ApproximateDedupDataArray::ApproximateDedupDataArray(uint32_t _numLines, uint32_
     std::random_device rd;
     RNG = new std::mt19937(rd());
     DIST = new std::uniform_int_distribution<>(0, numLines-1);
+    futex_init(&lock);
     info("Dedup Data Array: %i lines and %i sets", numLines, numSets);
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
 }
@@ -1199,43 +934,51 @@ ApproximateDedupDataArray::~ApproximateDedupDataArray() {
 }
 
 void ApproximateDedupDataArray::lookup(int32_t dataId, const MemReq* req, bool updateReplacement) {
-    if (updateReplacement) rp->update(dataId, req);
+    if (!updateReplacement) return;
+    futex_lock(&lock);
+    rp->update(dataId, req);
+    futex_unlock(&lock);
 }
 
-int32_t ApproximateDedupDataArray::preinsert(int32_t* tagPointer) {
+int32_t ApproximateDedupDataArray::preinsert(int32_t* tagPointer, uint32_t bank) {
     int32_t leastValue = 999999;
     int32_t leastId = 0;
+    futex_lock(&lock);
     if (freeList.size()) {
         leastId = freeList.back();
         freeList.pop_back();
-        *tagPointer = tagPointerArray[leastId];
-        return leastId;
-    }
-    for (uint32_t i = 0; i < 4; i++) {
-        int32_t id = DIST->operator()(*RNG);
-        if (tagPointerArray[id] == -1) {
-            *tagPointer = tagPointerArray[id];
-            panic("Shouldn't happen");
-            return id;
-        }
-        if (tagCounterArray[id] < leastValue) {
-            leastValue = tagCounterArray[id];
-            leastId = id;
+    } else {
+        for (uint32_t i = 0; i < 4; i++) {
+            int32_t id = DIST->operator()(*RNG);
+            // Only with a global dedup directory: a line another bank took off the free list and
+            // has not filled yet. Whichever bank locks it second evicts the first one's fill.
+            if (!isValid(id)) {
+                leastId = id;
+                break;
+            }
+            if (tagCounterArray[id] < leastValue) {
+                leastValue = tagCounterArray[id];
+                leastId = id;
+            }
         }
     }
-    *tagPointer = tagPointerArray[leastId];
+    futex_unlock(&lock);
+    *tagPointer = readListHead(leastId, bank);
     return leastId;
 }
 
-void ApproximateDedupDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement) {
-    if (tagPointerArray[dataId] == -1 && tagId != -1) {
+void ApproximateDedupDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement, uint32_t bank) {
+    futex_lock(&lock);
+    bool wasValid = isValid(dataId);
+    tagPointerArray[dataId*banks + bank] = tagId;
+    if (!wasValid && tagId != -1) {
         validLines++;
         auto it = std::find(freeList.begin(), freeList.end(), dataId);
         if(it != freeList.end()) {
             auto index = std::distance(freeList.begin(), it);
             freeList.erase(freeList.begin() + index);
         }
-    } else if (tagPointerArray[dataId] != -1 && tagId == -1) {
+    } else if (wasValid && !isValid(dataId)) {
         validLines--;
         freeList.push_back(dataId);
         assert(validLines);
@@ -1244,16 +987,19 @@ void ApproximateDedupDataArray::postinsert(int32_t tagId, const MemReq* req, int
         PIN_SafeCopy(dataArray[dataId], data, zinfo->lineSize);
     rp->replaced(dataId);
     tagCounterArray[dataId] = counter;
-    tagPointerArray[dataId] = tagId;
     approximateArray[dataId] = approximate;
     if(updateReplacement) rp->update(dataId, req);
-    // info("Data %i: %i, %i, %s", dataId, tagCounterArray[dataId], tagPointerArray[dataId], approximateArray[dataId]? "approximate":"exact");
+    futex_unlock(&lock);
+    // info("Data %i: %i, %i, %s", dataId, tagCounterArray[dataId], tagPointerArray[dataId*banks + bank], approximateArray[dataId]? "approximate":"exact");
 }
 
-void ApproximateDedupDataArray::changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement) {
-    if (tagPointerArray[dataId] == -1 && tagId != -1) {
+void ApproximateDedupDataArray::changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement, uint32_t bank) {
+    futex_lock(&lock);
+    bool wasValid = isValid(dataId);
+    tagPointerArray[dataId*banks + bank] = tagId;
+    if (!wasValid && tagId != -1) {
         validLines++;
-    } else if (tagPointerArray[dataId] != -1 && tagId == -1) {
+    } else if (wasValid && !isValid(dataId)) {
         validLines--;
         assert(validLines);
     }
@@ -1261,21 +1007,49 @@ void ApproximateDedupDataArray::changeInPlace(int32_t tagId, const MemReq* req,
         PIN_SafeCopy(dataArray[dataId], data, zinfo->lineSize);
     // rp->replaced(dataId);
     tagCounterArray[dataId] = counter;
-    tagPointerArray[dataId] = tagId;
     approximateArray[dataId] = approximate;
     if(updateReplacement) rp->update(dataId, req);
-    // info("Data %i: %i, %i, %s", dataId, tagCounterArray[dataId], tagPointerArray[dataId], approximateArray[dataId]? "approximate":"exact");
+    futex_unlock(&lock);
+    // info("Data %i: %i, %i, %s", dataId, tagCounterArray[dataId], tagPointerArray[dataId*banks + bank], approximateArray[dataId]? "approximate":"exact");
+}
+
+void ApproximateDedupDataArray::clearListHead(int32_t dataId, uint32_t bank) {
+    if (tagPointerArray[dataId*banks + bank] == -1) return;
+    futex_lock(&lock);
+    tagPointerArray[dataId*banks + bank] = -1;
+    if (!isValid(dataId)) {
+        assert(validLines);
+        validLines--;
+        freeList.push_back(dataId);
+    }
+    futex_unlock(&lock);
 }
 
 bool ApproximateDedupDataArray::isSame(int32_t dataId, DataLine data) {
-    for (uint32_t i = 0; i < zinfo->lineSize/8; i++)
-        if (((uint64_t*)data)[i] != ((uint64_t*)dataArray[dataId])[i])
-            return false;
-    return true;
+    return (this->*isSameFn)(dataId, data);
+}
+
+template <uint32_t LINE_SIZE>
+bool ApproximateDedupDataArray::isSame(int32_t dataId, DataLine data) {
+    return LineKernelsImpl<LINE_SIZE>::isSame(data, dataArray[dataId]);
 }
 
-int32_t ApproximateDedupDataArray::readListHead(int32_t dataId) {
-    return tagPointerArray[dataId];
+bool ApproximateDedupDataArray::isValid(int32_t dataId) {
+    for (uint32_t b = 0; b < banks; b++) {
+        if (tagPointerArray[dataId*banks + b] != -1) return true;
+    }
+    return false;
+}
+
+bool ApproximateDedupDataArray::isHeldByOtherBanks(int32_t dataId, uint32_t bank) {
+    for (uint32_t b = 0; b < banks; b++) {
+        if (b != bank && tagPointerArray[dataId*banks + b] != -1) return true;
+    }
+    return false;
+}
+
+int32_t ApproximateDedupDataArray::readListHead(int32_t dataId, uint32_t bank) {
+    return tagPointerArray[dataId*banks + bank];
 }
 
 int32_t ApproximateDedupDataArray::readCounter(int32_t dataId) {
@@ -1288,7 +1062,7 @@ DataLine ApproximateDedupDataArray::readData(int32_t dataId) {
 
 void ApproximateDedupDataArray::writeData(int32_t dataId, DataLine data, const MemReq* req, bool updateReplacement) {
     PIN_SafeCopy(dataArray[dataId], data, zinfo->lineSize);
-    if(updateReplacement) rp->update(dataId, req);
+    lookup(dataId, req, updateReplacement);
 }
 
 uint32_t ApproximateDedupDataArray::getValidLines() {
@@ -1297,21 +1071,28 @@ uint32_t ApproximateDedupDataArray::getValidLines() {
 
 uint32_t ApproximateDedupDataArray::countValidLines() {
     uint32_t Counter = 0;
+    futex_lock(&lock);
     for (uint32_t i = 0; i < numLines; i++) {
-        if (tagPointerArray[i] != -1)
+        if (isValid(i))
             Counter++;
     }
+    futex_unlock(&lock);
     return Counter;
 }
 
 void ApproximateDedupDataArray::print() {
     for (uint32_t i = 0; i < this->numLines; i++) {
-        if (tagPointerArray[i] != -1)
-            info("%i: %i, %i, %s", i, tagCounterArray[i], tagPointerArray[i], approximateArray[i]? "approximate":"exact");
+        for (uint32_t b = 0; b < banks; b++) {
+            if (tagPointerArray[i*banks + b] != -1)
+                info("%i: %i, %i, %s", i, tagCounterArray[i], tagPointerArray[i*banks + b], approximateArray[i]? "approximate":"exact");
+        }
     }
 }
 
-ApproximateDedupHashArray::ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash) : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc)  {
+ApproximateDedupHashArray::ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash, uint32_t _hashSize, uint32_t _floatCutSize, uint32_t _doubleCutSize)
+    : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc), hashSize(_hashSize), floatCutSize(_floatCutSize), doubleCutSize(_doubleCutSize)  {
+    LINE_SIZE_BIND(zinfo->lineSize, approximateFn, ApproximateDedupHashArray::approximate);
+    LINE_SIZE_BIND(zinfo->lineSize, hashFn, ApproximateDedupHashArray::hash);
     hashArray = gm_malloc<uint64_t>(numLines);
     dataPointerArray = gm_malloc<int32_t>(numLines);
     for (uint32_t i = 0; i < numLines; i++) {
@@ -1344,6 +1125,14 @@ int32_t ApproximateDedupHashArray::lookup(uint64_t hash, const MemReq* req, bool
     return -1;
 }
 
+uint32_t ApproximateDedupHashArray::getSet(uint64_t hash) {
+    return hf->hash(0, hash) & setMask;
+}
+
+uint32_t ApproximateDedupHashArray::getNumSets() {
+    return numSets;
+}
+
 int32_t ApproximateDedupHashArray::preinsert(uint64_t hash, const MemReq* req) {
     uint32_t set = hf->hash(0, hash) & setMask;
     uint32_t first = set*assoc;
@@ -1375,59 +1164,21 @@ int32_t ApproximateDedupHashArray::readDataPointer(int32_t hashId) {
 }
 
 void ApproximateDedupHashArray::approximate(const DataLine data, DataType type) {
-    if (type == ZSIM_FLOAT) {
-        for (uint16_t i = 0; i < zinfo->lineSize/4; i++)
-        {
-            ((uint32_t*) data)[i] = ((uint32_t*) data)[i] >> zinfo->floatCutSize;
-            // ((uint32_t*) data)[i] = ((uint32_t*) data)[i] << zinfo->floatCutSize;
-        }
-    } else if (type == ZSIM_DOUBLE) {
-        for (uint16_t i = 0; i < zinfo->lineSize/8; i++)
-        {
-            ((uint64_t*) data)[i] = ((uint64_t*) data)[i] >> zinfo->doubleCutSize;
-            // ((uint64_t*) data)[i] = ((uint64_t*) data)[i] << zinfo->doubleCutSize;
-        }
-    } else {
-        panic("We only approximate floats and doubles");
-    }
+    (this->*approximateFn)(data, type);
 }
 
-uint64_t ApproximateDedupHashArray::hash(const DataLine data)
-{
-    uint8_t _0;
-    uint8_t _1;
-    uint8_t _2;
-    uint8_t _3;
-    uint8_t _4;
-    uint8_t _5;
-    uint8_t _6;
-    uint8_t _7;
-    uint8_t* dataLine = (uint8_t*) data;
-
-    uint64_t XORs =0;
-    uint8_t xorNeeded = zinfo->lineSize/8;
-
-    if ((xorNeeded == 2) || (xorNeeded == 4) || (xorNeeded == 8)) {
-        for (int i=0; i < xorNeeded; i++) {
-            _0 =  dataLine[0+8*i];
-            _1 =  dataLine[1+8*i];
-            _2 =  dataLine[2+8*i];
-            _3 =  dataLine[3+8*i];
-            _4 =  dataLine[4+8*i];
-            _5 =  dataLine[5+8*i];
-            _6 =  dataLine[6+8*i];
-            _7 =  dataLine[7+8*i];
-
-            uint64_t step_64B = ((uint64_t) _0) + (((uint64_t) _1) << 8)  + (((uint64_t) _2) << 16) + (((uint64_t) _3) << 24)
-                            + (((uint64_t) _4) << 32) + (((uint64_t) _5) << 40) + (((uint64_t) _6) << 48) + (((uint64_t) _7) << 56);
-
-            XORs = XORs ^ dataHash->hash(0, step_64B);
-        }
-    } else {
-        panic("not implemented yet for lines other than 16B/32B/64B");
-    }
+template <uint32_t LINE_SIZE>
+void ApproximateDedupHashArray::approximate(const DataLine data, DataType type) {
+    LineKernelsImpl<LINE_SIZE>::approximate(data, type, floatCutSize, doubleCutSize);
+}
 
-    return XORs & ((uint64_t)std::pow(2, (zinfo->hashSize))-1);
+uint64_t ApproximateDedupHashArray::hash(const DataLine data) {
+    return (this->*hashFn)(data);
+}
+
+template <uint32_t LINE_SIZE>
+uint64_t ApproximateDedupHashArray::hash(const DataLine data) {
+    return LineKernelsImpl<LINE_SIZE>::xorHash(data, dataHash, hashSize);
 }
 
 uint32_t ApproximateDedupHashArray::countValidLines() {
@@ -1467,6 +1218,7 @@ ApproximateDedupBDITagArray::ApproximateDedupBDITagArray(uint32_t _numLines, uin
     validLines = 0;
     dataValidSegments = 0;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+    pfTracker.init(numLines);
 }
 
 ApproximateDedupBDITagArray::~ApproximateDedupBDITagArray() {
@@ -1483,7 +1235,10 @@ int32_t ApproximateDedupBDITagArray::lookup(Address lineAddr, const MemReq* req,
     uint32_t first = set*assoc;
     for (uint32_t id = first; id < first + assoc; id++) {
         if (tagArray[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
+            if (updateReplacement) {
+                pfTracker.hit(id, req);
+                if (!PrefetchTracker::isPrefetch(req)) rp->update(id, req);
+            }
             return id;
         }
     }
@@ -1539,6 +1294,7 @@ void ApproximateDedupBDITagArray::postinsert(Address lineAddr, const MemReq* req
         dataValidSegments+=BDICompressionToSize(encoding, zinfo->lineSize)/8;
     }
     if(replace) rp->replaced(tagId);
+    bool pfInsert = pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     dataPointerArray[tagId] = dataId;
     segmentPointerArray[tagId] = segmentId;
@@ -1553,7 +1309,7 @@ void ApproximateDedupBDITagArray::postinsert(Address lineAddr, const MemReq* req
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head is not actually a list head!");
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !pfInsert) rp->update(tagId, req);  // prefetched lines stay at the lowest priority
     // info("Tag is %i: %lu, %i, %i, %i, %i, %i", tagId, tagArray[tagId] << lineBits, prevPointerArray[tagId], nextPointerArray[tagId], dataPointerArray[tagId], segmentPointerArray[tagId], BDICompressionToSize(compressionEncodingArray[tagId], zinfo->lineSize));
     // if (prevPointerArray[tagId] != -1)
     //     info("Tag is %i: %lu, %i, %i, %i, %i, %i", prevPointerArray[tagId], tagArray[prevPointerArray[tagId]] << lineBits, prevPointerArray[prevPointerArray[tagId]], nextPointerArray[prevPointerArray[tagId]], dataPointerArray[prevPointerArray[tagId]], segmentPointerArray[prevPointerArray[tagId]], BDICompressionToSize(compressionEncodingArray[prevPointerArray[tagId]], zinfo->lineSize));
@@ -1577,6 +1333,7 @@ void ApproximateDedupBDITagArray::changeInPlace(Address lineAddr, const MemReq*
         dataValidSegments-=BDICompressionToSize(compressionEncodingArray[tagId], zinfo->lineSize)/8;
         dataValidSegments+=BDICompressionToSize(encoding, zinfo->lineSize)/8;
     }
+    pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     dataPointerArray[tagId] = dataId;
     segmentPointerArray[tagId] = segmentId;
@@ -1591,7 +1348,7 @@ void ApproximateDedupBDITagArray::changeInPlace(Address lineAddr, const MemReq*
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head is not actually a list head!");
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !PrefetchTracker::isPrefetch(req)) rp->update(tagId, req);
 }
 
 BDICompressionEncoding ApproximateDedupBDITagArray::readCompressionEncoding(int32_t tagId) {
@@ -1654,7 +1411,11 @@ void ApproximateDedupBDITagArray::print() {
     }
 }
 
-ApproximateDedupBDIDataArray::ApproximateDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf) : hf(_hf), numLines(_numLines), assoc(_assoc)  {
+ApproximateDedupBDIDataArray::ApproximateDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf) : ApproximateBDIDataArray(0, 0), hf(_hf), numLines(_numLines), assoc(_assoc)  {
+    LINE_SIZE_BIND(zinfo->lineSize, preinsertSetFn, ApproximateDedupBDIDataArray::preinsert);
+    LINE_SIZE_BIND(zinfo->lineSize, preinsertSegmentFn, ApproximateDedupBDIDataArray::preinsert);
+    LINE_SIZE_BIND(zinfo->lineSize, postinsertFn, ApproximateDedupBDIDataArray::postinsert);
+    LINE_SIZE_BIND(zinfo->lineSize, isSameFn, ApproximateDedupBDIDataArray::isSame);
     numSets = numLines/assoc;
     tagCounterArray = gm_calloc<int32_t*>(numSets);
     tagPointerArray = gm_malloc<int32_t*>(numSets);
@@ -1662,14 +1423,14 @@ ApproximateDedupBDIDataArray::ApproximateDedupBDIDataArray(uint32_t _numLines, u
     compressedDataArray = gm_malloc<DataLine*>(numSets);
     rp = gm_calloc<DataLRUReplPolicy*>(numSets);
     // notice that you will always need to access freeList by [size-1]
-    g_vector<g_vector<int32_t>> tmp(8);
+    g_vector<g_vector<int32_t>> tmp(zinfo->lineSize/8);
     freeList = tmp;
     for (uint32_t i = 0; i < numSets; i++) {
         tagCounterArray[i] = gm_calloc<int32_t>(assoc*zinfo->lineSize/8);
         tagPointerArray[i] = gm_calloc<int32_t>(assoc*zinfo->lineSize/8);
         compressedDataArray[i] = gm_calloc<DataLine>(assoc*zinfo->lineSize/8);
         rp[i] = new DataLRUReplPolicy(assoc*zinfo->lineSize/8);
-        freeList[7].push_back(i);
+        freeList[zinfo->lineSize/8-1].push_back(i);
         for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
             tagPointerArray[i][j] = -1;
             compressedDataArray[i][j] = gm_calloc<uint8_t>(zinfo->lineSize);
@@ -1708,10 +1469,15 @@ void ApproximateDedupBDIDataArray::assignTagArray(ApproximateDedupBDITagArray* _
         tagArray = _tagArray;
 }
 
+int32_t ApproximateDedupBDIDataArray::preinsert(uint16_t lineSize) {
+    return (this->*preinsertSetFn)(lineSize);
+}
+
+template <uint32_t LINE_SIZE>
 int32_t ApproximateDedupBDIDataArray::preinsert(uint16_t lineSize) {
     float leastValue = 999999;
     int32_t leastId = 0;
-    for (uint32_t i = (lineSize/8)-1; i < 8; i++) {
+    for (uint32_t i = (lineSize/8)-1; i < LINE_SIZE/8; i++) {
         if (freeList[i].size()) {
             leastId = freeList[i].back();
             freeList[i].pop_back();
@@ -1724,24 +1490,24 @@ int32_t ApproximateDedupBDIDataArray::preinsert(uint16_t lineSize) {
         int32_t id = DIST->operator()(*RNG);
         int32_t counts = 0;
         int32_t sizes = 0;
-        for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
+        for (uint32_t j = 0; j < assoc*LINE_SIZE/8; j++) {
             counts += tagCounterArray[id][j];
             if (tagCounterArray[id][j])
-                sizes += BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[id][j]), zinfo->lineSize);
+                sizes += BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[id][j]), LINE_SIZE);
         }
         if (counts == 0)
             panic("Cannot happen");
-        if ((assoc*zinfo->lineSize - sizes) >= lineSize)
+        if ((assoc*LINE_SIZE - sizes) >= lineSize)
             return id;
         g_vector<uint32_t> keptFromEvictions;
         counts = 0;
         do {
-            int32_t candidate = rp[id]->rank(NULL, SetAssocCands(0, (assoc*zinfo->lineSize/8)), keptFromEvictions);
+            int32_t candidate = rp[id]->rank(NULL, SetAssocCands(0, (assoc*LINE_SIZE/8)), keptFromEvictions);
             if (tagCounterArray[id][candidate])
-                sizes -= BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[id][candidate]), zinfo->lineSize);
+                sizes -= BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[id][candidate]), LINE_SIZE);
             counts += tagCounterArray[id][candidate];
             keptFromEvictions.push_back(candidate);
-        } while((assoc*zinfo->lineSize-sizes) < lineSize);
+        } while((assoc*LINE_SIZE-sizes) < lineSize);
         if (counts <= leastValue) {
             leastId = id;
             leastValue = counts;
@@ -1752,9 +1518,14 @@ int32_t ApproximateDedupBDIDataArray::preinsert(uint16_t lineSize) {
     return leastId;
 }
 
+int32_t ApproximateDedupBDIDataArray::preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions) {
+    return (this->*preinsertSegmentFn)(dataId, tagId, exceptions);
+}
+
+template <uint32_t LINE_SIZE>
 int32_t ApproximateDedupBDIDataArray::preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions) {
     int32_t candidate = 0;
-    for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
+    for (uint32_t j = 0; j < assoc*LINE_SIZE/8; j++) {
         bool Found = false;
         for (uint32_t i = 0; i < exceptions.size(); i++)
             if (j == exceptions[i]) {
@@ -1763,18 +1534,23 @@ int32_t ApproximateDedupBDIDataArray::preinsert(int32_t dataId, int32_t* tagId,
             }
         if (Found)
             continue;
-        candidate = rp[dataId]->rank(NULL, SetAssocCands(0, (assoc*zinfo->lineSize/8)), exceptions);
+        candidate = rp[dataId]->rank(NULL, SetAssocCands(0, (assoc*LINE_SIZE/8)), exceptions);
         break;
     }
     *tagId = tagPointerArray[dataId][candidate];
     return candidate;
 }
 
+void ApproximateDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
+    (this->*postinsertFn)(tagId, req, counter, dataId, segmentId, data, updateReplacement);
+}
+
+template <uint32_t LINE_SIZE>
 void ApproximateDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
     rp[dataId]->replaced(segmentId);
 
     if (!popped) {
-        for (uint32_t i = 0; i < 8; i++) {
+        for (uint32_t i = 0; i < LINE_SIZE/8; i++) {
             auto it = std::find(freeList[i].begin(), freeList[i].end(), dataId);
             if(it != freeList[i].end()) {
                 auto index = std::distance(freeList[i].begin(), it);
@@ -1792,15 +1568,15 @@ void ApproximateDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req,
     }
     tagPointerArray[dataId][segmentId] = tagId;
     if (data)
-        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, zinfo->lineSize);
+        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, LINE_SIZE);
     if (updateReplacement) rp[dataId]->update(segmentId, req);
 
-    int count = assoc*zinfo->lineSize/8;
-    for (uint32_t i = 0; i < assoc*zinfo->lineSize/8; i++)
+    int count = assoc*LINE_SIZE/8;
+    for (uint32_t i = 0; i < assoc*LINE_SIZE/8; i++)
         if (tagPointerArray[dataId][i] != -1)
-            count -= BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[dataId][i]), zinfo->lineSize)/8;
-    if (count > 8)
-        count = 8;
+            count -= BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[dataId][i]), LINE_SIZE)/8;
+    if (count > (int)LINE_SIZE/8)
+        count = LINE_SIZE/8;
     if (count)
         freeList[count-1].push_back(dataId);
     popped = false;
@@ -1819,10 +1595,12 @@ void ApproximateDedupBDIDataArray::changeInPlace(int32_t tagId, const MemReq* re
 }
 
 bool ApproximateDedupBDIDataArray::isSame(int32_t dataId, int32_t segmentId, DataLine data) {
-    for (uint32_t i = 0; i < zinfo->lineSize/8; i++)
-        if (((uint64_t*)data)[i] != ((uint64_t*)compressedDataArray[dataId][segmentId])[i])
-            return false;
-    return true;
+    return (this->*isSameFn)(dataId, segmentId, data);
+}
+
+template <uint32_t LINE_SIZE>
+bool ApproximateDedupBDIDataArray::isSame(int32_t dataId, int32_t segmentId, DataLine data) {
+    return LineKernelsImpl<LINE_SIZE>::isSame(data, compressedDataArray[dataId][segmentId]);
 }
 
 int32_t ApproximateDedupBDIDataArray::readListHead(int32_t dataId, int32_t segmentId) {
@@ -1855,7 +1633,10 @@ void ApproximateDedupBDIDataArray::print() {
     }
 }
 
-ApproximateDedupBDIHashArray::ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash) : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc)  {
+ApproximateDedupBDIHashArray::ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash, uint32_t _hashSize, uint32_t _floatCutSize, uint32_t _doubleCutSize)
+    : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc), hashSize(_hashSize), floatCutSize(_floatCutSize), doubleCutSize(_doubleCutSize)  {
+    LINE_SIZE_BIND(zinfo->lineSize, approximateFn, ApproximateDedupBDIHashArray::approximate);
+    LINE_SIZE_BIND(zinfo->lineSize, hashFn, ApproximateDedupBDIHashArray::hash);
     hashArray = gm_malloc<uint64_t>(numLines);
     dataPointerArray = gm_malloc<int32_t>(numLines);
     segmentPointerArray = gm_malloc<int32_t>(numLines);
@@ -1935,59 +1716,21 @@ int32_t ApproximateDedupBDIHashArray::readSegmentPointer(int32_t hashId) {
 }
 
 void ApproximateDedupBDIHashArray::approximate(const DataLine data, DataType type) {
-    if (type == ZSIM_FLOAT) {
-        for (uint16_t i = 0; i < zinfo->lineSize/4; i++)
-        {
-            ((uint32_t*) data)[i] = ((uint32_t*) data)[i] >> zinfo->floatCutSize;
-            // ((uint32_t*) data)[i] = ((uint32_t*) data)[i] << zinfo->floatCutSize;
-        }
-    } else if (type == ZSIM_DOUBLE) {
-        for (uint16_t i = 0; i < zinfo->lineSize/8; i++)
-        {
-            ((uint64_t*) data)[i] = ((uint64_t*) data)[i] >> zinfo->doubleCutSize;
-            // ((uint64_t*) data)[i] = ((uint64_t*) data)[i] << zinfo->doubleCutSize;
-        }
-    } else {
-        panic("We only approximate floats and doubles");
-    }
+    (this->*approximateFn)(data, type);
 }
 
-uint64_t ApproximateDedupBDIHashArray::hash(const DataLine data)
-{
-    uint8_t _0;
-    uint8_t _1;
-    uint8_t _2;
-    uint8_t _3;
-    uint8_t _4;
-    uint8_t _5;
-    uint8_t _6;
-    uint8_t _7;
-    uint8_t* dataLine = (uint8_t*) data;
-
-    uint64_t XORs =0;
-    uint8_t xorNeeded = zinfo->lineSize/8;
-
-    if ((xorNeeded == 2) || (xorNeeded == 4) || (xorNeeded == 8)) {
-        for (int i=0; i < xorNeeded; i++) {
-            _0 =  dataLine[0+8*i];
-            _1 =  dataLine[1+8*i];
-            _2 =  dataLine[2+8*i];
-            _3 =  dataLine[3+8*i];
-            _4 =  dataLine[4+8*i];
-            _5 =  dataLine[5+8*i];
-            _6 =  dataLine[6+8*i];
-            _7 =  dataLine[7+8*i];
-
-            uint64_t step_64B = ((uint64_t) _0) + (((uint64_t) _1) << 8)  + (((uint64_t) _2) << 16) + (((uint64_t) _3) << 24)
-                            + (((uint64_t) _4) << 32) + (((uint64_t) _5) << 40) + (((uint64_t) _6) << 48) + (((uint64_t) _7) << 56);
-
-            XORs = XORs ^ dataHash->hash(0, step_64B);
-        }
-    } else {
-        panic("not implemented yet for lines other than 16B/32B/64B");
-    }
+template <uint32_t LINE_SIZE>
+void ApproximateDedupBDIHashArray::approximate(const DataLine data, DataType type) {
+    LineKernelsImpl<LINE_SIZE>::approximate(data, type, floatCutSize, doubleCutSize);
+}
+
+uint64_t ApproximateDedupBDIHashArray::hash(const DataLine data) {
+    return (this->*hashFn)(data);
+}
 
-    return XORs & ((uint64_t)std::pow(2, (zinfo->hashSize))-1);
+template <uint32_t LINE_SIZE>
+uint64_t ApproximateDedupBDIHashArray::hash(const DataLine data) {
+    return LineKernelsImpl<LINE_SIZE>::xorHash(data, dataHash, hashSize);
 }
 
 uint32_t ApproximateDedupBDIHashArray::countValidLines() {
@@ -2008,6 +1751,9 @@ void ApproximateDedupBDIHashArray::print() {
 // BDI and ApproximateBDI End
 
 ApproximateNaiiveDedupBDIDataArray::ApproximateNaiiveDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf) : ApproximateDedupBDIDataArray(_numLines, _assoc, _hf) {
+    LINE_SIZE_BIND(zinfo->lineSize, preinsertSetFn, ApproximateNaiiveDedupBDIDataArray::preinsert);
+    LINE_SIZE_BIND(zinfo->lineSize, preinsertSegmentFn, ApproximateNaiiveDedupBDIDataArray::preinsert);
+    LINE_SIZE_BIND(zinfo->lineSize, postinsertFn, ApproximateNaiiveDedupBDIDataArray::postinsert);
     for (uint32_t i = 0; i < numSets; i++) {
         freeList.push_back(i);
     }
@@ -2027,6 +1773,11 @@ ApproximateNaiiveDedupBDIDataArray::~ApproximateNaiiveDedupBDIDataArray() {
     gm_free(compressedDataArray);
 }
 
+int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(uint16_t lineSize) {
+    return (this->*preinsertSetFn)(lineSize);
+}
+
+template <uint32_t LINE_SIZE>
 int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(uint16_t lineSize) {
     float leastValue = 999999;
     int32_t leastId = 0;
@@ -2038,7 +1789,7 @@ int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(uint16_t lineSize) {
     for (uint32_t i = 0; i < zinfo->randomLoopTrial; i++) {
         int32_t id = DIST->operator()(*RNG);
         int32_t counts = 0;
-        for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
+        for (uint32_t j = 0; j < assoc*LINE_SIZE/8; j++) {
             counts += tagCounterArray[id][j];
         }
         if (counts == 0)
@@ -2051,9 +1802,14 @@ int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(uint16_t lineSize) {
     return leastId;
 }
 
+int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions) {
+    return (this->*preinsertSegmentFn)(dataId, tagId, exceptions);
+}
+
+template <uint32_t LINE_SIZE>
 int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions) {
     int32_t candidate = 0;
-    for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
+    for (uint32_t j = 0; j < assoc*LINE_SIZE/8; j++) {
         bool Found = false;
         for (uint32_t i = 0; i < exceptions.size(); i++)
             if (j == exceptions[i]) {
@@ -2062,13 +1818,18 @@ int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(int32_t dataId, int32_t* t
             }
         if (Found)
             continue;
-        candidate = rp[dataId]->rank(NULL, SetAssocCands(0, (assoc*zinfo->lineSize/8)), exceptions);
+        candidate = rp[dataId]->rank(NULL, SetAssocCands(0, (assoc*LINE_SIZE/8)), exceptions);
         break;
     }
     *tagId = tagPointerArray[dataId][candidate];
     return candidate;
 }
 
+void ApproximateNaiiveDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
+    (this->*postinsertFn)(tagId, req, counter, dataId, segmentId, data, updateReplacement);
+}
+
+template <uint32_t LINE_SIZE>
 void ApproximateNaiiveDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
     rp[dataId]->replaced(segmentId);
 
@@ -2086,13 +1847,13 @@ void ApproximateNaiiveDedupBDIDataArray::postinsert(int32_t tagId, const MemReq*
     }
     tagPointerArray[dataId][segmentId] = tagId;
     if (data)
-        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, zinfo->lineSize);
+        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, LINE_SIZE);
     if (updateReplacement) rp[dataId]->update(segmentId, req);
 
     int count = 0;
-    for (uint32_t i = 0; i < assoc*zinfo->lineSize/8; i++)
+    for (uint32_t i = 0; i < assoc*LINE_SIZE/8; i++)
         if (tagPointerArray[dataId][i] != -1)
-            count += BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[dataId][i]), zinfo->lineSize)/8;
+            count += BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[dataId][i]), LINE_SIZE)/8;
     if (!count)
         freeList.push_back(dataId);
     // info("Data was %i,%i: %i, %i", dataId, segmentId, tagCounterArray[dataId][segmentId], tagPointerArray[dataId][segmentId]);
@@ -2117,6 +1878,7 @@ uniDoppelgangerBDITagArray::uniDoppelgangerBDITagArray(uint32_t _numLines, uint3
     setMask = numSets - 1;
     validLines = 0;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+    pfTracker.init(numLines);
 }
 
 uniDoppelgangerBDITagArray::~uniDoppelgangerBDITagArray() {
@@ -2133,7 +1895,10 @@ int32_t uniDoppelgangerBDITagArray::lookup(Address lineAddr, const MemReq* req,
     uint32_t first = set*assoc;
     for (uint32_t id = first; id < first + assoc; id++) {
         if (tagArray[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
+            if (updateReplacement) {
+                pfTracker.hit(id, req);
+                if (!PrefetchTracker::isPrefetch(req)) rp->update(id, req);
+            }
             return id;
         }
     }
@@ -2174,6 +1939,7 @@ void uniDoppelgangerBDITagArray::postinsert(Address lineAddr, const MemReq* req,
         validLines--;
     }
     rp->replaced(tagId);
+    bool pfInsert = pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     mapPointerArray[tagId] = mapId;
     segmentPointerArray[tagId] = segmentId;
@@ -2188,7 +1954,7 @@ void uniDoppelgangerBDITagArray::postinsert(Address lineAddr, const MemReq* req,
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head is not actually a list head!");
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !pfInsert) rp->update(tagId, req);  // prefetched lines stay at the lowest priority
 }
 
 void uniDoppelgangerBDITagArray::changeInPlace(Address lineAddr, const MemReq* req, int32_t tagId, int32_t mapId, int32_t segmentId, int32_t listHead, bool approximate, bool updateReplacement) {
@@ -2198,6 +1964,7 @@ void uniDoppelgangerBDITagArray::changeInPlace(Address lineAddr, const MemReq* r
     //     validLines--;
     // }
     // rp->replaced(tagId);
+    pfTracker.replaced(tagId, tagArray[tagId], lineAddr, req);
     tagArray[tagId] = lineAddr;
     mapPointerArray[tagId] = mapId;
     segmentPointerArray[tagId] = segmentId;
@@ -2212,7 +1979,7 @@ void uniDoppelgangerBDITagArray::changeInPlace(Address lineAddr, const MemReq* r
         if(prevPointerArray[listHead] == -1) prevPointerArray[listHead] = tagId;
         else panic("List head is not actually a list head!");
     }
-    if(updateReplacement) rp->update(tagId, req);
+    if (updateReplacement && !PrefetchTracker::isPrefetch(req)) rp->update(tagId, req);
 }
 
 int32_t uniDoppelgangerBDITagArray::readMapId(const int32_t tagId) {
@@ -2258,7 +2025,9 @@ void uniDoppelgangerBDITagArray::print() {
     }
 }
 
-uniDoppelgangerBDIDataArray::uniDoppelgangerBDIDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _tagRatio) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), tagRatio(_tagRatio) {
+uniDoppelgangerBDIDataArray::uniDoppelgangerBDIDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _tagRatio, uint32_t _mapSize)
+    : ApproximateBDIDataArray(0, 0), rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), tagRatio(_tagRatio), mapSize(_mapSize) {
+    LINE_SIZE_BIND(zinfo->lineSize, calculateMapFn, uniDoppelgangerBDIDataArray::calculateMap);
     numSets = numLines/assoc;
     tagCounterArray = gm_calloc<int32_t*>(numSets);
     tagPointerArray = gm_malloc<int32_t*>(numSets);
@@ -2311,6 +2080,11 @@ int32_t uniDoppelgangerBDIDataArray::lookup(uint32_t map, uint32_t set, const Me
     return -1;
 }
 
+uint32_t uniDoppelgangerBDIDataArray::calculateMap(const DataLine data, DataType type, DataValue minValue, DataValue maxValue) {
+    return (this->*calculateMapFn)(data, type, minValue, maxValue);
+}
+
+template <uint32_t LINE_SIZE>
 uint32_t uniDoppelgangerBDIDataArray::calculateMap(const DataLine data, DataType type, DataValue minValue, DataValue maxValue) {
     // Get hash and map values
     int64_t intAvgHash = 0, intRangeHash = 0;
@@ -2327,211 +2101,211 @@ uint32_t uniDoppelgangerBDIDataArray::calculateMap(const DataLine data, DataType
     switch (type)
     {
         case ZSIM_UINT8:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint8_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint8_t); i++) {
                 intSum += ((uint8_t*) data)[i];
                 if (((uint8_t*) data)[i] > intMax)
                     intMax = ((uint8_t*) data)[i];
                 if (((uint8_t*) data)[i] < intMin)
                     intMin = ((uint8_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint8_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint8_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.UINT8)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.UINT8)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(uint8_t)) {
+            if (mapSize > sizeof(uint8_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.UINT8 - minValue.UINT8)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.UINT8 - minValue.UINT8)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_INT8:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int8_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int8_t); i++) {
                 intSum += ((int8_t*) data)[i];
                 if (((int8_t*) data)[i] > intMax)
                     intMax = ((int8_t*) data)[i];
                 if (((int8_t*) data)[i] < intMin)
                     intMin = ((int8_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int8_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int8_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT8)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT8)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(int8_t)) {
+            if (mapSize > sizeof(int8_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.INT8 - minValue.INT8)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.INT8 - minValue.INT8)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_UINT16:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint16_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint16_t); i++) {
                 intSum += ((uint16_t*) data)[i];
                 if (((uint16_t*) data)[i] > intMax)
                     intMax = ((uint16_t*) data)[i];
                 if (((uint16_t*) data)[i] < intMin)
                     intMin = ((uint16_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint16_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint16_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.UINT16)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.UINT16)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(uint16_t)) {
+            if (mapSize > sizeof(uint16_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.UINT16 - minValue.UINT16)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.UINT16 - minValue.UINT16)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_INT16:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int16_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int16_t); i++) {
                 intSum += ((int16_t*) data)[i];
                 if (((int16_t*) data)[i] > intMax)
                     intMax = ((int16_t*) data)[i];
                 if (((int16_t*) data)[i] < intMin)
                     intMin = ((int16_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int16_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int16_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT16)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT16)
                 panic("Received a value lower than the annotation's Min!!");
-            if (zinfo->mapSize > sizeof(int16_t)) {
+            if (mapSize > sizeof(int16_t)) {
                 avgMap = intAvgHash;
                 rangeMap = intRangeHash;
             } else {
-                mapStep = (maxValue.INT16 - minValue.INT16)/std::pow(2,zinfo->mapSize-1);
+                mapStep = (maxValue.INT16 - minValue.INT16)/std::pow(2,mapSize-1);
                 avgMap = intAvgHash/mapStep;
                 rangeMap = intRangeHash/mapStep;
             }
             break;
         case ZSIM_UINT32:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint32_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint32_t); i++) {
                 intSum += ((uint32_t*) data)[i];
                 if (((uint32_t*) data)[i] > intMax)
                     intMax = ((uint32_t*) data)[i];
                 if (((uint32_t*) data)[i] < intMin)
                     intMin = ((uint32_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint32_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint32_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.UINT32)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.UINT32)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.UINT32 - minValue.UINT32)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.UINT32 - minValue.UINT32)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_INT32:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int32_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int32_t); i++) {
                 intSum += ((int32_t*) data)[i];
                 if (((int32_t*) data)[i] > intMax)
                     intMax = ((int32_t*) data)[i];
                 if (((int32_t*) data)[i] < intMin)
                     intMin = ((int32_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int32_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int32_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT32)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT32)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.INT32 - minValue.INT32)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.INT32 - minValue.INT32)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_UINT64:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(uint64_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(uint64_t); i++) {
                 intSum += ((uint64_t*) data)[i];
                 if ((int64_t)(((uint64_t*) data)[i]) > intMax)
                     intMax = ((uint64_t*) data)[i];
                 if ((int64_t)(((uint64_t*) data)[i]) < intMin)
                     intMin = ((uint64_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(uint64_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(uint64_t));
             intRangeHash = intMax - intMin;
             if (intMax > (int64_t)maxValue.UINT64)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < (int64_t)minValue.UINT64)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.UINT64 - minValue.UINT64)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.UINT64 - minValue.UINT64)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_INT64:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(int64_t); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(int64_t); i++) {
                 intSum += ((int64_t*) data)[i];
                 if (((int64_t*) data)[i] > intMax)
                     intMax = ((int64_t*) data)[i];
                 if (((int64_t*) data)[i] < intMin)
                     intMin = ((int64_t*) data)[i];
             }
-            intAvgHash = intSum/(zinfo->lineSize/sizeof(int64_t));
+            intAvgHash = intSum/(LINE_SIZE/sizeof(int64_t));
             intRangeHash = intMax - intMin;
             if (intMax > maxValue.INT64)
                 panic("Received a value bigger than the annotation's Max!!");
             if (intMin < minValue.INT64)
                 panic("Received a value lower than the annotation's Min!!");
-            mapStep = (maxValue.INT64 - minValue.INT64)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.INT64 - minValue.INT64)/std::pow(2,mapSize-1);
             avgMap = intAvgHash/mapStep;
             rangeMap = intRangeHash/mapStep;
             break;
         case ZSIM_FLOAT:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(float); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(float); i++) {
                 floatSum += ((float*) data)[i];
                 if (((float*) data)[i] > floatMax)
                     floatMax = ((float*) data)[i];
                 if (((float*) data)[i] < floatMin)
                     floatMin = ((float*) data)[i];
             }
-            floatAvgHash = floatSum/(zinfo->lineSize/sizeof(float));
+            floatAvgHash = floatSum/(LINE_SIZE/sizeof(float));
             floatRangeHash = floatMax - floatMin;
             // if (floatMax > maxValue.FLOAT)
                 // warn("Received a value bigger than the annotation's Max!! %.10f, %.10f", floatMax, maxValue.FLOAT);
             // if (floatMin < minValue.FLOAT)
                 // warn("Received a value lower than the annotation's Min!! %.10f, %.10f", floatMin, minValue.FLOAT);
-            mapStep = (maxValue.FLOAT - minValue.FLOAT)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.FLOAT - minValue.FLOAT)/std::pow(2,mapSize-1);
             avgMap = floatAvgHash/mapStep;
             rangeMap = floatRangeHash/mapStep;
             break;
         case ZSIM_DOUBLE:
-            for (uint32_t i = 0; i < zinfo->lineSize/sizeof(double); i++) {
+            for (uint32_t i = 0; i < LINE_SIZE/sizeof(double); i++) {
                 floatSum += ((double*) data)[i];
                 if (((double*) data)[i] > floatMax)
                     floatMax = ((double*) data)[i];
                 if (((double*) data)[i] < floatMin)
                     floatMin = ((double*) data)[i];
             }
-            floatAvgHash = floatSum/(zinfo->lineSize/sizeof(double));
+            floatAvgHash = floatSum/(LINE_SIZE/sizeof(double));
             floatRangeHash = floatMax - floatMin;
             // if (floatMax > maxValue.DOUBLE)
                 // warn("Received a value bigger than the annotation's Max!! %.10f, %.10f", floatMax, maxValue.DOUBLE);
             // if (floatMin < minValue.DOUBLE)
                 // warn("Received a value lower than the annotation's Min!! %.10f, %.10f", floatMin, minValue.DOUBLE);
-            mapStep = (maxValue.DOUBLE - minValue.DOUBLE)/std::pow(2,zinfo->mapSize-1);
+            mapStep = (maxValue.DOUBLE - minValue.DOUBLE)/std::pow(2,mapSize-1);
             avgMap = floatAvgHash/mapStep;
             rangeMap = floatRangeHash/mapStep;
             break;
         default:
             panic("Wrong Data Type!!");
     }
-    map = ((uint32_t)avgMap << (32 - zinfo->mapSize)) >> (32 - zinfo->mapSize);
-    rangeMap = ((uint32_t)rangeMap << (32 - zinfo->mapSize/2)) >> (32 - zinfo->mapSize/2);
-    rangeMap = (rangeMap << zinfo->mapSize);
+    map = ((uint32_t)avgMap << (32 - mapSize)) >> (32 - mapSize);
+    rangeMap = ((uint32_t)rangeMap << (32 - mapSize/2)) >> (32 - mapSize/2);
+    rangeMap = (rangeMap << mapSize);
     map |= rangeMap;
     return map;
 }
@@ -26,6 +26,8 @@
 #ifndef CACHE_ARRAYS_H_
 #define CACHE_ARRAYS_H_
 
+#include "galloc.h"
+#include "line_kernels.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
 #include <random>
@@ -53,6 +55,50 @@ class CacheArray : public GlobAlloc {
         virtual void initStats(AggregateStat* parent) {}
 };
 
+/* Tracks the lines of a compressed tag array that were filled by a prefetch (MemReq::PREFETCH at this level, or
+ * PREFETCH_FILL from a prefetch issued below), until a demand access reaches them here. Prefetch fills don't
+ * update the replacement policy, and neither do prefetches that hit, so under LRU prefetched lines are inserted
+ * at the lowest priority and only promoted by demand accesses. Demand hits to lines still held in the levels
+ * below don't reach this cache, so pollution includes prefetched lines that were only used there.
+ */
+class PrefetchTracker {
+    private:
+        bool* prefetched;
+        Counter profFills, profHits, profPollution;
+
+    public:
+        PrefetchTracker() : prefetched(nullptr) {}
+        ~PrefetchTracker() {if (prefetched) gm_free(prefetched);}
+
+        void init(uint32_t numLines) {prefetched = gm_calloc<bool>(numLines);}
+
+        static inline bool isPrefetch(const MemReq* req) {
+            return req && (req->is(MemReq::PREFETCH) || req->is(MemReq::PREFETCH_FILL));
+        }
+
+        inline void hit(uint32_t id, const MemReq* req) {
+            if (prefetched[id] && !isPrefetch(req)) {
+                prefetched[id] = false;
+                profHits.inc();
+            }
+        }
+
+        // id goes from oldLineAddr to newLineAddr (0 if invalidated); returns true if it now holds a newly prefetched line
+        inline bool replaced(uint32_t id, Address oldLineAddr, Address newLineAddr, const MemReq* req) {
+            if (oldLineAddr == newLineAddr) return false;
+            if (prefetched[id] && oldLineAddr) profPollution.inc();
+            prefetched[id] = newLineAddr && isPrefetch(req);
+            if (prefetched[id]) profFills.inc();
+            return prefetched[id];
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            profFills.init("pfFills", "Lines filled by prefetches"); parentStat->append(&profFills);
+            profHits.init("pfHits", "Demand accesses to prefetched lines"); parentStat->append(&profHits);
+            profPollution.init("pfPollution", "Prefetched lines evicted before any demand access reached this cache"); parentStat->append(&profPollution);
+        }
+};
+
 class ReplPolicy;
 class DataLRUReplPolicy;
 class HashFamily;
@@ -87,6 +133,7 @@ class uniDoppelgangerTagArray {
         int32_t* nextPointerArray;
         int32_t* mapPointerArray; // Or directly data array.
         ReplPolicy* rp;
+        PrefetchTracker pfTracker;
         HashFamily* hf;
         uint32_t numLines;
         uint32_t numSets;
@@ -117,7 +164,7 @@ class uniDoppelgangerTagArray {
         int32_t readNextLL(int32_t tagId);
         uint32_t getValidLines();
         uint32_t countValidLines();
-        void initStats(AggregateStat* parent) {}
+        void initStats(AggregateStat* parent) {pfTracker.initStats(parent);}
         void print();
 };
 
@@ -133,9 +180,10 @@ class uniDoppelgangerDataArray {
         uint32_t assoc;
         uint32_t setMask;
         uint32_t validLines;
+        uint32_t mapSize; // bits per map
 
     public:
-        uniDoppelgangerDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
+        uniDoppelgangerDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _mapSize);
         ~uniDoppelgangerDataArray();
         // Returns the Index of the matching map, Must find.
         int32_t lookup(uint32_t map, const MemReq* req, bool updateReplacement);
@@ -152,8 +200,14 @@ class uniDoppelgangerDataArray {
         int32_t readMap(int32_t mapId);
         uint32_t getValidLines();
         uint32_t countValidLines();
+        uint32_t getMapSize() const {return mapSize;}
         void initStats(AggregateStat* parent) {}
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> uint32_t calculateMap(const DataLine data, DataType type, DataValue minValue, DataValue maxValue);
+        uint32_t (uniDoppelgangerDataArray::*calculateMapFn)(const DataLine data, DataType type, DataValue minValue, DataValue maxValue);
 };
 // uniDoppelganger End
 
@@ -165,6 +219,7 @@ class ApproximateBDITagArray {
         int32_t* segmentPointerArray;    // NOTE: doesn't actually reflect segmentPointer. It's just valid or invalid.
         BDICompressionEncoding* compressionEncodingArray;
         ReplPolicy* rp;
+        PrefetchTracker pfTracker;
         HashFamily* hf;
         uint32_t numLines;
         uint32_t numSets;
@@ -193,18 +248,32 @@ class ApproximateBDITagArray {
         uint32_t countValidLines();
         uint32_t getDataValidSegments();
         uint32_t countDataValidSegments();
-        void initStats(AggregateStat* parent) {}
+        void initStats(AggregateStat* parent) {pfTracker.initStats(parent);}
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> int32_t needEviction(Address lineAddr, const MemReq* req, uint16_t size, g_vector<uint32_t>& alreadyEvicted, Address* wbLineAddr);
+        int32_t (ApproximateBDITagArray::*needEvictionFn)(Address lineAddr, const MemReq* req, uint16_t size, g_vector<uint32_t>& alreadyEvicted, Address* wbLineAddr);
 };
 
 class ApproximateBDIDataArray {
     protected:
-        // uint64_t my_llabs(int64_t x);
-        // uint8_t multiBaseCompression(uint64_t* values, uint8_t size, uint8_t blimit, uint8_t bsize);
+        uint32_t floatCutSize; // low-order bits dropped from approximate floats
+        uint32_t doubleCutSize; // and doubles
+
     public:
+        ApproximateBDIDataArray(uint32_t _floatCutSize, uint32_t _doubleCutSize);
         // We can also generate bit masks here, but it will not affect the timing.
         BDICompressionEncoding compress(const DataLine data, uint16_t* size);
         void approximate(const DataLine data, DataType type);
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> BDICompressionEncoding compress(const DataLine data, uint16_t* size);
+        template <uint32_t LINE_SIZE> void approximate(const DataLine data, DataType type);
+        BDICompressionEncoding (ApproximateBDIDataArray::*compressFn)(const DataLine data, uint16_t* size);
+        void (ApproximateBDIDataArray::*approximateFn)(const DataLine data, DataType type);
 };
 // BDI Begin
 
@@ -218,6 +287,7 @@ class ApproximateDedupTagArray {
         int32_t* nextPointerArray;
         int32_t* dataPointerArray;
         ReplPolicy* rp;
+        PrefetchTracker pfTracker;
         HashFamily* hf;
         uint32_t numLines;
         uint32_t numSets;
@@ -248,15 +318,17 @@ class ApproximateDedupTagArray {
         int32_t readPrevLL(int32_t tagId);
         uint32_t getValidLines();
         uint32_t countValidLines();
-        void initStats(AggregateStat* parent) {}
+        void initStats(AggregateStat* parent) {pfTracker.initStats(parent);}
         void print();
 };
 
+// Banks that share one data array (a global dedup directory) each keep their own tag array, so
+// every data line has one tag list head per bank. The counter covers the tags of all banks.
 class ApproximateDedupDataArray {
     protected:
         bool* approximateArray;
         int32_t* tagCounterArray;
-        int32_t* tagPointerArray;
+        int32_t* tagPointerArray; // numLines*banks list heads, indexed dataId*banks + bank
         DataLine* dataArray;
         ReplPolicy* rp;
         HashFamily* hf;
@@ -264,22 +336,33 @@ class ApproximateDedupDataArray {
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        uint32_t banks;
         uint32_t validLines;
         std::mt19937* RNG;
         std::uniform_int_distribution<>* DIST;
         g_vector<int32_t> freeList;
+        // Guards freeList, validLines, RNG and rp, which the banks of a global dedup directory share;
+        // the lines themselves are the directory's to lock
+        lock_t lock;
     public:
-        ApproximateDedupDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
+        ApproximateDedupDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _banks);
         ~ApproximateDedupDataArray();
         void lookup(int32_t dataId, const MemReq* req, bool updateReplacement);
-        int32_t preinsert(int32_t* tagPointer);
+        // tagPointer is set to bank's list head of the victim
+        int32_t preinsert(int32_t* tagPointer, uint32_t bank = 0);
         // Actually inserts
-        void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement);
-        void changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement);
+        void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement, uint32_t bank = 0);
+        void changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement, uint32_t bank = 0);
+        // Drops bank's list, e.g. after its tags were invalidated; frees the line if no bank is left
+        void clearListHead(int32_t dataId, uint32_t bank);
         void writeData(int32_t dataId, DataLine data, const MemReq* req, bool updateReplacement);
         bool isSame(int32_t dataId, DataLine data);
+        // returns true if any bank's tags point to dataId
+        bool isValid(int32_t dataId);
+        // returns true if a bank other than bank has tags pointing to dataId
+        bool isHeldByOtherBanks(int32_t dataId, uint32_t bank);
         // returns tagId
-        int32_t readListHead(int32_t dataId);
+        int32_t readListHead(int32_t dataId, uint32_t bank = 0);
         // returns counter
         int32_t readCounter(int32_t dataId);
         DataLine readData(int32_t dataId);
@@ -287,6 +370,11 @@ class ApproximateDedupDataArray {
         uint32_t countValidLines();
         void initStats(AggregateStat* parent) {}
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> bool isSame(int32_t dataId, DataLine data);
+        bool (ApproximateDedupDataArray::*isSameFn)(int32_t dataId, DataLine data);
 };
 
 class ApproximateDedupHashArray {
@@ -300,9 +388,12 @@ class ApproximateDedupHashArray {
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        uint32_t hashSize; // bits per data hash
+        uint32_t floatCutSize; // low-order bits dropped from approximate floats
+        uint32_t doubleCutSize; // and doubles
         ApproximateDedupDataArray* dataArray;
     public:
-        ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash);
+        ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash, uint32_t _hashSize, uint32_t _floatCutSize, uint32_t _doubleCutSize);
         ~ApproximateDedupHashArray();
         void registerDataArray(ApproximateDedupDataArray* dataArray);
         int32_t lookup(uint64_t hash, const MemReq* req, bool updateReplacement);
@@ -311,8 +402,17 @@ class ApproximateDedupHashArray {
         int32_t readDataPointer(int32_t hashId);
         void approximate(const DataLine data, DataType type);
         uint64_t hash(const DataLine data);
+        uint32_t getSet(uint64_t hash);  // the set lookup() searches for hash
+        uint32_t getNumSets();
         uint32_t countValidLines();
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> void approximate(const DataLine data, DataType type);
+        template <uint32_t LINE_SIZE> uint64_t hash(const DataLine data);
+        void (ApproximateDedupHashArray::*approximateFn)(const DataLine data, DataType type);
+        uint64_t (ApproximateDedupHashArray::*hashFn)(const DataLine data);
 };
 // Dedup End
 
@@ -326,6 +426,7 @@ class ApproximateDedupBDITagArray {
         int32_t* dataPointerArray;
         BDICompressionEncoding* compressionEncodingArray;
         ReplPolicy* rp;
+        PrefetchTracker pfTracker;
         HashFamily* hf;
         uint32_t numLines;
         uint32_t numSets;
@@ -363,7 +464,7 @@ class ApproximateDedupBDITagArray {
         uint32_t getValidLines();
         uint32_t countValidLines();
         uint32_t getDataValidSegments();
-        void initStats(AggregateStat* parent) {}
+        void initStats(AggregateStat* parent) {pfTracker.initStats(parent);}
         void print();
 };
 
@@ -406,6 +507,17 @@ class ApproximateDedupBDIDataArray : public ApproximateBDIDataArray {
         void initStats(AggregateStat* parent) {}
         uint32_t getAssoc() {return assoc;}
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> int32_t preinsert(uint16_t lineSize);
+        template <uint32_t LINE_SIZE> int32_t preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions);
+        template <uint32_t LINE_SIZE> void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
+        template <uint32_t LINE_SIZE> bool isSame(int32_t dataId, int32_t segmentId, DataLine data);
+        int32_t (ApproximateDedupBDIDataArray::*preinsertSetFn)(uint16_t lineSize);
+        int32_t (ApproximateDedupBDIDataArray::*preinsertSegmentFn)(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions);
+        void (ApproximateDedupBDIDataArray::*postinsertFn)(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
+        bool (ApproximateDedupBDIDataArray::*isSameFn)(int32_t dataId, int32_t segmentId, DataLine data);
 };
 
 class ApproximateDedupBDIHashArray {
@@ -420,9 +532,12 @@ class ApproximateDedupBDIHashArray {
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        uint32_t hashSize; // bits per data hash
+        uint32_t floatCutSize; // low-order bits dropped from approximate floats
+        uint32_t doubleCutSize; // and doubles
         ApproximateDedupBDIDataArray* dataArray;
     public:
-        ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash);
+        ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash, uint32_t _hashSize, uint32_t _floatCutSize, uint32_t _doubleCutSize);
         ~ApproximateDedupBDIHashArray();
         void registerDataArray(ApproximateDedupBDIDataArray* dataArray);
         int32_t lookup(uint64_t hash, const MemReq* req, bool updateReplacement);
@@ -435,6 +550,13 @@ class ApproximateDedupBDIHashArray {
         uint64_t hash(const DataLine data);
         uint32_t countValidLines();
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> void approximate(const DataLine data, DataType type);
+        template <uint32_t LINE_SIZE> uint64_t hash(const DataLine data);
+        void (ApproximateDedupBDIHashArray::*approximateFn)(const DataLine data, DataType type);
+        uint64_t (ApproximateDedupBDIHashArray::*hashFn)(const DataLine data);
 };
 // Dedup BDI End
 
@@ -449,6 +571,16 @@ class ApproximateNaiiveDedupBDIDataArray : public ApproximateDedupBDIDataArray {
         int32_t preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions);
         // Actually inserts
         void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> int32_t preinsert(uint16_t lineSize);
+        template <uint32_t LINE_SIZE> int32_t preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions);
+        template <uint32_t LINE_SIZE> void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
+        // These hide the base class's, as the methods above do
+        int32_t (ApproximateNaiiveDedupBDIDataArray::*preinsertSetFn)(uint16_t lineSize);
+        int32_t (ApproximateNaiiveDedupBDIDataArray::*preinsertSegmentFn)(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions);
+        void (ApproximateNaiiveDedupBDIDataArray::*postinsertFn)(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
 };
 
 // Doppelganger BDI Begin
@@ -461,6 +593,7 @@ class uniDoppelgangerBDITagArray {
         int32_t* mapPointerArray; // Or directly data array.
         int32_t* segmentPointerArray;
         ReplPolicy* rp;
+        PrefetchTracker pfTracker;
         HashFamily* hf;
         uint32_t numLines;
         uint32_t numSets;
@@ -492,7 +625,7 @@ class uniDoppelgangerBDITagArray {
         int32_t readNextLL(int32_t tagId);
         uint32_t getValidLines();
         uint32_t countValidLines();
-        void initStats(AggregateStat* parent) {}
+        void initStats(AggregateStat* parent) {pfTracker.initStats(parent);}
         void print();
 };
 
@@ -511,8 +644,9 @@ class uniDoppelgangerBDIDataArray : public ApproximateBDIDataArray {
         uint32_t setMask;
         uint32_t validSegments;
         uint32_t tagRatio;
+        uint32_t mapSize; // bits per map
     public:
-        uniDoppelgangerBDIDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _tagRatio);
+        uniDoppelgangerBDIDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _tagRatio, uint32_t _mapSize);
         ~uniDoppelgangerBDIDataArray();
         // Returns the Index of the matching map, Must find.
         int32_t lookup(uint32_t map);
@@ -537,7 +671,13 @@ class uniDoppelgangerBDIDataArray : public ApproximateBDIDataArray {
         void initStats(AggregateStat* parent) {}
         uint32_t getAssoc() {return assoc;}
         uint32_t getRatio() {return tagRatio;}
+        uint32_t getMapSize() const {return mapSize;}
         void print();
+
+    protected:
+        // Per line size, bound at construction (see LINE_SIZE_BIND)
+        template <uint32_t LINE_SIZE> uint32_t calculateMap(const DataLine data, DataType type, DataValue minValue, DataValue maxValue);
+        uint32_t (uniDoppelgangerBDIDataArray::*calculateMapFn)(const DataLine data, DataType type, DataValue minValue, DataValue maxValue);
 };
 // Doppelganger BDI End
 
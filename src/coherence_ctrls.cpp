@@ -25,21 +25,17 @@
 
 #include "coherence_ctrls.h"
 #include "cache.h"
+#include "event_recorder.h"
 #include "network.h"
+#include "timing_event.h"
+#include "zsim.h"
 
 /* Do a simple XOR block hash on address to determine its bank. Hacky for now,
  * should probably have a class that deals with this with a real hash function
  * (TODO)
  */
 uint32_t MESIBottomCC::getParentId(Address lineAddr) {
-    //Hash things a bit
-    uint32_t res = 0;
-    uint64_t tmp = lineAddr;
-    for (uint32_t i = 0; i < 4; i++) {
-        res ^= (uint32_t) ( ((uint64_t)0xffff) & tmp);
-        tmp = tmp >> 16;
-    }
-    return (res % parents.size());
+    return HashParentId(lineAddr, parents.size());
 }
 
 
@@ -47,8 +43,14 @@ void MESIBottomCC::init(const g_vector<MemObject*>& _parents, Network* network,
     parents.resize(_parents.size());
     parentRTTs.resize(_parents.size());
     for (uint32_t p = 0; p < parents.size(); p++) {
-        parents[p] = _parents[p];
-        parentRTTs[p] = (network)? network->getRTT(name, parents[p]->getName()) : 0;
+        MemObject* port = (network)? network->getPort(name, _parents[p]) : nullptr;
+        if (port) {
+            parents[p] = port;  // the port charges network latency, including contention
+            parentRTTs[p] = 0;
+        } else {
+            parents[p] = _parents[p];
+            parentRTTs[p] = (network)? network->getRTT(name, parents[p]->getName()) : 0;
+        }
     }
 }
 
@@ -73,6 +75,7 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
             }
             break;
         case M:
+        case O:
             {
                 MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/};
                 respCycle = parents[getParentId(wbLineAddr)]->access(req);
@@ -86,7 +89,48 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
     return respCycle;
 }
 
-uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags) {
+uint64_t MESIBottomCC::processEvictions(const g_vector<EvictionReq>& evictions, uint64_t cycle, uint32_t srcId) {
+    //Parents take one line per access, so each valid line still gets its own PUT, but they
+    //all go out at cycle and we leave a single record for the batch. The first writeback's record is
+    //used as is; from the second on, it grows a zero-delay fork at cycle and a join that ends with
+    //the latest response, and each writeback hangs between the two.
+    EventRecorder* evRec = zinfo->eventRecorders[srcId];
+    TimingRecord wbRecord;
+    wbRecord.clear();
+    DelayEvent* forkEv = nullptr;
+    DelayEvent* joinEv = nullptr;
+    uint64_t maxCycle = cycle;
+    for (const EvictionReq& ev : evictions) {
+        uint64_t respCycle = processEviction(ev.lineAddr, ev.lineId, ev.writeback, cycle, srcId);
+        maxCycle = MAX(respCycle, maxCycle);
+        if (!evRec || !evRec->hasRecord()) continue;
+
+        TimingRecord r = evRec->popRecord();
+        if (!wbRecord.isValid()) {
+            wbRecord = r;
+            continue;
+        }
+        if (!forkEv) {
+            forkEv = new (evRec) DelayEvent(0);
+            joinEv = new (evRec) DelayEvent(0);
+            forkEv->setMinStartCycle(cycle);
+            forkEv->addChild(wbRecord.startEvent, evRec);
+            wbRecord.endEvent->addChild(joinEv, evRec);
+            wbRecord.reqCycle = cycle;
+            wbRecord.startEvent = forkEv;
+            wbRecord.endEvent = joinEv;
+        }
+        forkEv->addChild(r.startEvent, evRec);
+        r.endEvent->addChild(joinEv, evRec);
+        wbRecord.respCycle = MAX(wbRecord.respCycle, r.respCycle);
+    }
+
+    if (joinEv) joinEv->setMinStartCycle(wbRecord.respCycle);
+    if (wbRecord.isValid()) evRec->pushRecord(wbRecord);
+    return maxCycle;
+}
+
+uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags, Address pc) {
     uint64_t respCycle = cycle;
     MESIState* state = &array[lineId];
     switch (type) {
@@ -106,7 +150,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
         case GETS:
             if (*state == I) {
                 uint32_t parentId = getParentId(lineAddr);
-                MemReq req = {lineAddr, GETS, selfId, state, cycle, &ccLock, *state, srcId, flags};
+                MemReq req = {lineAddr, GETS, selfId, state, cycle, &ccLock, *state, srcId, flags, pc};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 nextLvlReq.inc();
                 uint32_t netLat = parentRTTs[parentId];
@@ -120,12 +164,12 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
             }
             break;
         case GETX:
-            if (*state == I || *state == S) {
+            if (*state == I || *state == S || *state == O) {
                 //Profile before access, state changes
                 if (*state == I) profGETXMissIM.inc();
                 else profGETXMissSM.inc();
                 uint32_t parentId = getParentId(lineAddr);
-                MemReq req = {lineAddr, GETX, selfId, state, cycle, &ccLock, *state, srcId, flags};
+                MemReq req = {lineAddr, GETX, selfId, state, cycle, &ccLock, *state, srcId, flags, pc};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 nextLvlReq.inc();
                 uint32_t netLat = parentRTTs[parentId];
@@ -169,19 +213,30 @@ void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type,
     switch (type) {
         case INVX: //lose exclusivity
             //Hmmm, do we have to propagate loss of exclusivity down the tree? (nah, topcc will do this automatically -- it knows the final state, always!)
-            assert_msg(*state == E || *state == M, "Invalid state %s", MESIStateName(*state));
-            if (*state == M) *reqWriteback = true;
+            //An O line is not exclusive, but gets INVX when our parent itself is downgraded, and must write back
+            assert_msg(*state == E || *state == M || *state == O, "Invalid state %s", MESIStateName(*state));
+            if (*state == M || *state == O) *reqWriteback = true;
             *state = S;
             profINVX.inc();
             break;
+        case INVXO: //lose exclusivity, but keep dirty data as its owner; reqWriteback tells the parent we did
+            assert_msg(*state == E || *state == M, "Invalid state %s", MESIStateName(*state));
+            if (*state == M || *reqWriteback /*our children wrote back to us*/) {
+                *reqWriteback = true;
+                *state = O;
+            } else {
+                *state = S;
+            }
+            profINVX.inc();
+            break;
         case INV: //invalidate
             assert(*state != I);
-            if (*state == M) *reqWriteback = true;
+            if (*state == M || *state == O) *reqWriteback = true;
             *state = I;
             profINV.inc();
             break;
         case FWD: //forward
-            assert_msg(*state == S, "Invalid state %s on FWD", MESIStateName(*state));
+            assert_msg(*state == S || *state == O, "Invalid state %s on FWD", MESIStateName(*state));
             profFWD.inc();
             break;
         default: panic("!?");
@@ -205,8 +260,25 @@ uint64_t MESIBottomCC::processNonInclusiveWriteback(Address lineAddr, AccessType
 
 void MESITopCC::init(const g_vector<BaseCache*>& _children, Network* network, const char* name) {
     if (_children.size() > MAX_CACHE_CHILDREN) {
-        panic("[%s] Children size (%d) > MAX_CACHE_CHILDREN (%d)", name, (uint32_t)_children.size(), MAX_CACHE_CHILDREN);
+        panic("[%s] Children size (%d) > MAX_CACHE_CHILDREN (%d), use a sparse directory", name, (uint32_t)_children.size(), MAX_CACHE_CHILDREN);
+    }
+    initChildren(_children, network, name);
+
+    array = gm_calloc<Entry>(numLines);
+    for (uint32_t i = 0; i < numLines; i++) {
+        array[i].clear();
     }
+}
+
+void MESITopCC::initStats(AggregateStat* cacheStat) {
+    if (!moesi) return;
+    profOwnedDowngrades.init("ownDwn", "Downgrades of dirty children to O (MOESI; each avoids a writeback)");
+    profOwnerFwds.init("ownFwd", "GETS served by forwarding from the O child (MOESI)");
+    cacheStat->append(&profOwnedDowngrades);
+    cacheStat->append(&profOwnerFwds);
+}
+
+void MESITopCC::initChildren(const g_vector<BaseCache*>& _children, Network* network, const char* name) {
     children.resize(_children.size());
     childrenRTTs.resize(_children.size());
     for (uint32_t c = 0; c < children.size(); c++) {
@@ -220,7 +292,15 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
     Entry* e = &array[lineId];
 
     //Don't propagate downgrades if sharers are not exclusive.
-    if (type == INVX && !e->isExclusive()) {
+    if ((type == INVX || type == INVXO) && !e->isExclusive()) {
+        if (type == INVX && e->owner != -1) {
+            //We are being downgraded, so the owner must write its dirty data back
+            uint32_t c = e->owner;
+            InvReq req = {lineAddr, INVX, reqWriteback, cycle, srcId};
+            uint64_t respCycle = children[c]->invalidate(req) + childrenRTTs[c];
+            e->owner = -1;
+            return respCycle;
+        }
         return cycle;
     }
 
@@ -230,6 +310,19 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
         uint32_t sentInvs = 0;
         for (uint32_t c = 0; c < numChildren; c++) {
             if (e->sharers[c]) {
+                if (type == INVXO) {
+                    //A dirty sharer keeps its data and becomes the owner
+                    bool dirty = false;
+                    InvReq req = {lineAddr, type, &dirty, cycle, srcId};
+                    uint64_t respCycle = children[c]->invalidate(req) + childrenRTTs[c];
+                    maxCycle = MAX(respCycle, maxCycle);
+                    if (dirty) {
+                        e->owner = c;
+                        profOwnedDowngrades.inc();
+                    }
+                    sentInvs++;
+                    continue;
+                }
                 InvReq req = {lineAddr, type, reqWriteback, cycle, srcId};
                 uint64_t respCycle = children[c]->invalidate(req);
                 respCycle += childrenRTTs[c];
@@ -241,6 +334,7 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
         assert(sentInvs == e->numSharers);
         if (type == INV) {
             e->numSharers = 0;
+            e->owner = -1;
         } else {
             //TODO: This is kludgy -- once the sharers format is more sophisticated, handle downgrades with a different codepath
             assert(e->exclusive);
@@ -263,13 +357,43 @@ uint64_t MESITopCC::processEviction(Address wbLineAddr, uint32_t lineId, bool* r
     }
 }
 
+uint64_t MESITopCC::processEvictions(g_vector<EvictionReq>& evictions, uint64_t cycle, uint32_t srcId) {
+    if (nonInclusiveHack) {
+        for (const EvictionReq& ev : evictions) array[ev.lineId].clear();
+        return cycle;
+    }
+
+    //Walk the children once, sending each one a single message with the invalidates for all the
+    //lines it shares; as in sendInvalidates, children are invalidated in parallel and we only keep
+    //the maximum cycle
+    uint64_t maxCycle = cycle;
+    uint32_t numChildren = children.size();
+    g_vector<InvReq> reqs;
+    for (uint32_t c = 0; c < numChildren; c++) {
+        reqs.clear();
+        for (EvictionReq& ev : evictions) {
+            Entry* e = &array[ev.lineId];
+            if (!e->sharers[c]) continue;
+            reqs.push_back({ev.lineAddr, INV, &ev.writeback, cycle, srcId, false});
+            e->sharers[c] = false;
+            e->numSharers--;
+            if (e->owner == (int32_t)c) e->owner = -1;
+        }
+        if (reqs.empty()) continue;
+        uint64_t respCycle = children[c]->invalidateLines(reqs) + childrenRTTs[c];
+        maxCycle = MAX(respCycle, maxCycle);
+    }
+    for (const EvictionReq& ev : evictions) assert(array[ev.lineId].isEmpty());
+    return maxCycle;
+}
+
 uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
                                   MESIState* childState, bool* inducedWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     Entry* e = &array[lineId];
     uint64_t respCycle = cycle;
     switch (type) {
         case PUTX:
-            assert(e->isExclusive());
+            assert(e->isExclusive() || e->owner == (int32_t)childId);
             if (flags & MemReq::PUTX_KEEPEXCL) {
                 assert(e->sharers[childId]);
                 assert(*childState == M);
@@ -281,6 +405,7 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
             assert(e->sharers[childId]);
             e->sharers[childId] = false;
             e->numSharers--;
+            if (e->owner == (int32_t)childId) e->owner = -1;
             *childState = I;
             break;
         case GETS:
@@ -295,8 +420,14 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
                 assert(e->sharers[childId] == false);
 
                 if (e->isExclusive()) {
-                    //Downgrade the exclusive sharer
-                    respCycle = sendInvalidates(lineAddr, lineId, INVX, inducedWriteback, cycle, srcId);
+                    //Downgrade the exclusive sharer; with MOESI, if it is dirty it becomes the owner instead of writing back
+                    respCycle = sendInvalidates(lineAddr, lineId, moesi? INVXO : INVX, inducedWriteback, cycle, srcId);
+                } else if (e->owner != -1) {
+                    //Our copy is stale, the owner supplies the data
+                    bool unused = false;
+                    InvReq req = {lineAddr, FWD, &unused, cycle, srcId};
+                    respCycle = children[e->owner]->invalidate(req) + childrenRTTs[e->owner];
+                    profOwnerFwds.inc();
                 }
 
                 assert_msg(!e->isExclusive(), "Can't have exclusivity here. isExcl=%d excl=%d numSharers=%d", e->isExclusive(), e->exclusive, e->numSharers);
@@ -315,10 +446,17 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
                 assert_msg(!e->isExclusive(), "Spurious GETX, childId=%d numSharers=%d isExcl=%d excl=%d", childId, e->numSharers, e->isExclusive(), e->exclusive);
                 e->sharers[childId] = false;
                 e->numSharers--;
+                if (e->owner == (int32_t)childId) e->owner = -1; //the owner upgrades, keeping its dirty data
             }
 
             // Invalidate all other copies
-            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId);
+            if (moesi) {
+                //Dirty data goes to the requester, which gets the line in M, so we need not take a writeback
+                bool dirty = false;
+                respCycle = sendInvalidates(lineAddr, lineId, INV, &dirty, cycle, srcId);
+            } else {
+                respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId);
+            }
 
             // Set current sharer, mark exclusive
             e->sharers[childId] = true;
@@ -342,7 +480,299 @@ uint64_t MESITopCC::processInval(Address lineAddr, uint32_t lineId, InvType type
         return cycle;
     } else {
         //Just invalidate or downgrade down to children as needed
-        return sendInvalidates(lineAddr, lineId, type, reqWriteback, cycle, srcId);
+        //On INVXO, our children write dirty data back to us, and we become the owner
+        return sendInvalidates(lineAddr, lineId, (type == INVXO)? INVX : type, reqWriteback, cycle, srcId);
+    }
+}
+
+
+/* SparseMESITopCC implementation */
+
+SparseMESITopCC::SparseMESITopCC(uint32_t _numLines, bool _nonInclusiveHack, const SparseDirConfig& cfg)
+    : MESITopCC(_numLines, _nonInclusiveHack), dir(nullptr), lineEntries(nullptr), dirSets(cfg.ways? cfg.entries/cfg.ways : 0),
+      dirWays(cfg.ways), numPointers(cfg.pointers), groupSize(0), timestamp(0) {}
+
+void SparseMESITopCC::init(const g_vector<BaseCache*>& _children, Network* network, const char* name) {
+    if (nonInclusiveHack) panic("[%s] Sparse directories need an inclusive cache", name);
+    if (!dirWays || !dirSets) panic("[%s] Sparse directory needs at least one set and way (%d sets, %d ways)", name, dirSets, dirWays);
+    if (numPointers == 0 || numPointers > SPARSE_DIR_MAX_POINTERS) {
+        panic("[%s] Sparse directory pointers must be 1-%d, %d given", name, SPARSE_DIR_MAX_POINTERS, numPointers);
+    }
+    if (_children.size() > (1 << 16)) panic("[%s] Children size (%d) too large for sparse directory pointers", name, (uint32_t)_children.size());
+    initChildren(_children, network, name);
+    groupSize = (children.size() + 63)/64;
+
+    dir = gm_calloc<DirEntry>(dirSets*dirWays);
+    for (uint32_t i = 0; i < dirSets*dirWays; i++) dir[i].numSharers = 0;
+    lineEntries = gm_calloc<int32_t>(numLines);
+    for (uint32_t i = 0; i < numLines; i++) lineEntries[i] = -1;
+}
+
+void SparseMESITopCC::initStats(AggregateStat* cacheStat) {
+    profDirAllocs.init("dirAllocs", "Sparse directory entries allocated");
+    profDirEvictions.init("dirEvictions", "Sparse directory entries evicted with sharers");
+    profDirEvInvs.init("dirEvInvs", "Invalidates sent to children on directory evictions");
+    profCoarseEntries.init("dirCoarse", "Sparse directory entries that overflowed to a coarse vector");
+    profCoarseInvs.init("dirCoarseInvs", "Invalidates sent to non-sharers in coarse-vector groups");
+    cacheStat->append(&profDirAllocs);
+    cacheStat->append(&profDirEvictions);
+    cacheStat->append(&profDirEvInvs);
+    cacheStat->append(&profCoarseEntries);
+    cacheStat->append(&profCoarseInvs);
+}
+
+bool SparseMESITopCC::isSharer(const DirEntry* e, uint32_t c) const {
+    if (e->coarse) return e->groups & (1ul << (c/groupSize));
+    for (uint32_t i = 0; i < e->numSharers; i++) {
+        if (e->ptrs[i] == c) return true;
+    }
+    return false;
+}
+
+void SparseMESITopCC::addSharer(DirEntry* e, uint32_t c) {
+    if (!e->coarse && e->numSharers == numPointers) {
+        //Out of pointers, switch to a coarse vector
+        uint64_t groups = 0;
+        for (uint32_t i = 0; i < e->numSharers; i++) groups |= 1ul << (e->ptrs[i]/groupSize);
+        e->groups = groups;
+        e->coarse = true;
+        profCoarseEntries.inc();
+    }
+    if (e->coarse) e->groups |= 1ul << (c/groupSize);
+    else e->ptrs[e->numSharers] = c;
+    e->numSharers++;
+}
+
+void SparseMESITopCC::removeSharer(DirEntry* e, uint32_t c) {
+    assert(e->numSharers);
+    if (e->coarse) {
+        //Can't tell whether other sharers are in c's group, so its bit stays set until the entry is empty
+        if (--e->numSharers == 0) {
+            e->coarse = false;
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < e->numSharers; i++) {
+        if (e->ptrs[i] == c) {
+            e->ptrs[i] = e->ptrs[--e->numSharers];
+            return;
+        }
+    }
+    panic("Removing non-sharer %d", c);
+}
+
+void SparseMESITopCC::freeEntry(DirEntry* e) {
+    lineEntries[e->lineId] = -1;
+    e->numSharers = 0;
+    e->exclusive = false;
+    e->coarse = false;
+}
+
+SparseMESITopCC::DirEntry* SparseMESITopCC::allocEntry(Address lineAddr, uint32_t lineId, uint64_t cycle, uint32_t srcId) {
+    uint32_t set = ((lineAddr * 0x9E3779B97F4A7C15ul) >> 32) % dirSets;
+    DirEntry* first = &dir[set*dirWays];
+    DirEntry* e = first;
+    for (uint32_t w = 0; w < dirWays; w++) {
+        if (!first[w].numSharers) {
+            e = &first[w];
+            break;
+        }
+        if (first[w].lastUse < e->lastUse) e = &first[w];
+    }
+
+    if (e->numSharers) {
+        //Evict the LRU entry: its line stays here, but children lose it
+        bool writeback = false;
+        profDirEvictions.inc();
+        profDirEvInvs.inc(e->numSharers);
+        invalidateSharers(e, INV, &writeback, cycle, srcId, -1);
+        if (writeback) inducedWritebacks.push_back({e->lineAddr, e->lineId});
+        freeEntry(e);
     }
+
+    profDirAllocs.inc();
+    e->lineAddr = lineAddr;
+    e->lineId = lineId;
+    e->lastUse = timestamp;
+    lineEntries[lineId] = e - dir;
+    return e;
 }
 
+bool SparseMESITopCC::popInducedWriteback(Address* lineAddr, uint32_t* lineId) {
+    if (inducedWritebacks.empty()) return false;
+    *lineAddr = inducedWritebacks.back().lineAddr;
+    *lineId = inducedWritebacks.back().lineId;
+    inducedWritebacks.pop_back();
+    return true;
+}
+
+uint64_t SparseMESITopCC::invalidateSharers(DirEntry* e, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, int32_t skipChild) {
+    //Don't propagate downgrades if sharers are not exclusive.
+    if (type == INVX && !(e->exclusive && e->numSharers == 1)) {
+        return cycle;
+    }
+
+    uint64_t maxCycle = cycle; //as in MESITopCC, all invals are sent in parallel
+    if (!e->coarse) {
+        for (uint32_t i = 0; i < e->numSharers; i++) {
+            uint32_t c = e->ptrs[i];
+            InvReq req = {e->lineAddr, type, reqWriteback, cycle, srcId, false};
+            uint64_t respCycle = children[c]->invalidate(req) + childrenRTTs[c];
+            maxCycle = MAX(respCycle, maxCycle);
+        }
+    } else {
+        assert(type == INV);
+        uint32_t sentInvs = 0;
+        for (uint32_t g = 0; g < 64; g++) {
+            if (!(e->groups & (1ul << g))) continue;
+            uint32_t last = MIN((g + 1)*groupSize, (uint32_t)children.size());
+            for (uint32_t c = g*groupSize; c < last; c++) {
+                if ((int32_t)c == skipChild) continue;
+                InvReq req = {e->lineAddr, type, reqWriteback, cycle, srcId, true};
+                uint64_t respCycle = children[c]->invalidate(req) + childrenRTTs[c];
+                maxCycle = MAX(respCycle, maxCycle);
+                sentInvs++;
+            }
+        }
+        assert(sentInvs >= e->numSharers);
+        profCoarseInvs.inc(sentInvs - e->numSharers);
+    }
+
+    if (type == INV) {
+        e->numSharers = 0;
+        e->coarse = false;
+    } else {
+        e->exclusive = false;
+    }
+    return maxCycle;
+}
+
+uint64_t SparseMESITopCC::processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+    int32_t idx = lineEntries[lineId];
+    if (idx == -1) return cycle;
+    DirEntry* e = &dir[idx];
+    assert(e->lineAddr == wbLineAddr);
+    uint64_t respCycle = invalidateSharers(e, INV, reqWriteback, cycle, srcId, -1);
+    freeEntry(e);
+    return respCycle;
+}
+
+uint64_t SparseMESITopCC::processEvictions(g_vector<EvictionReq>& evictions, uint64_t cycle, uint32_t srcId) {
+    //As in MESITopCC, each child gets one message with all its lines. Coarse entries invalidate
+    //their whole groups, so children that don't hold a line just ack it.
+    uint64_t maxCycle = cycle;
+    uint32_t numChildren = children.size();
+    g_vector<InvReq> reqs;
+    for (uint32_t c = 0; c < numChildren; c++) {
+        reqs.clear();
+        for (EvictionReq& ev : evictions) {
+            int32_t idx = lineEntries[ev.lineId];
+            if (idx == -1) continue;
+            DirEntry* e = &dir[idx];
+            assert(e->lineAddr == ev.lineAddr);
+            if (!isSharer(e, c)) continue;
+            reqs.push_back({ev.lineAddr, INV, &ev.writeback, cycle, srcId, e->coarse});
+        }
+        if (reqs.empty()) continue;
+        uint64_t respCycle = children[c]->invalidateLines(reqs) + childrenRTTs[c];
+        maxCycle = MAX(respCycle, maxCycle);
+    }
+
+    for (EvictionReq& ev : evictions) {
+        int32_t idx = lineEntries[ev.lineId];
+        if (idx == -1) continue;
+        DirEntry* e = &dir[idx];
+        if (e->coarse) {
+            uint32_t sentInvs = 0;
+            for (uint32_t g = 0; g < 64; g++) {
+                if (e->groups & (1ul << g)) sentInvs += MIN((g + 1)*groupSize, numChildren) - g*groupSize;
+            }
+            profCoarseInvs.inc(sentInvs - e->numSharers);
+        }
+        freeEntry(e);
+    }
+    return maxCycle;
+}
+
+uint64_t SparseMESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
+                                        MESIState* childState, bool* inducedWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
+    int32_t idx = lineEntries[lineId];
+    DirEntry* e = (idx == -1)? nullptr : &dir[idx];
+    uint64_t respCycle = cycle;
+    timestamp++;
+    switch (type) {
+        case PUTX:
+            assert(e && e->exclusive && e->numSharers == 1);
+            if (flags & MemReq::PUTX_KEEPEXCL) {
+                assert(isSharer(e, childId));
+                assert(*childState == M);
+                *childState = E; //they don't hold dirty data anymore
+                break; //don't remove from sharer set. It'll keep exclusive perms.
+            }
+            //note NO break in general
+        case PUTS:
+            assert(e && isSharer(e, childId));
+            removeSharer(e, childId);
+            if (!e->numSharers) freeEntry(e);
+            *childState = I;
+            break;
+        case GETS:
+            if (!e) e = allocEntry(lineAddr, lineId, cycle, srcId);
+            if (!e->numSharers && haveExclusive && !(flags & MemReq::NOEXCL)) {
+                //Give in E state
+                e->exclusive = true;
+                addSharer(e, childId);
+                *childState = E;
+            } else {
+                //Give in S state
+                assert(e->coarse || !isSharer(e, childId));
+                if (e->exclusive && e->numSharers == 1) {
+                    //Downgrade the exclusive sharer
+                    respCycle = invalidateSharers(e, INVX, inducedWriteback, cycle, srcId, childId);
+                }
+                e->exclusive = false;
+                addSharer(e, childId);
+                *childState = S;
+            }
+            e->lastUse = timestamp;
+            break;
+        case GETX:
+            assert(haveExclusive); //the current cache better have exclusive access to this line
+            if (!e) {
+                e = allocEntry(lineAddr, lineId, cycle, srcId);
+            } else {
+                // If child is a sharer (this is an upgrade miss), take it out
+                if (*childState == S) {
+                    assert_msg(!e->exclusive && isSharer(e, childId), "Spurious GETX, childId=%d numSharers=%d excl=%d", childId, e->numSharers, e->exclusive);
+                    removeSharer(e, childId);
+                }
+                // Invalidate all other copies
+                respCycle = invalidateSharers(e, INV, inducedWriteback, cycle, srcId, childId);
+            }
+
+            // Set current sharer, mark exclusive
+            assert(e->numSharers == 0 && !e->coarse);
+            addSharer(e, childId);
+            e->exclusive = true;
+            e->lastUse = timestamp;
+            *childState = M; //give in M directly
+            break;
+
+        default: panic("!?");
+    }
+
+    return respCycle;
+}
+
+uint64_t SparseMESITopCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+    if (type == FWD) { //as in MESITopCC, we must have the line, just invLat works
+        return cycle;
+    }
+    int32_t idx = lineEntries[lineId];
+    if (idx == -1) return cycle;
+    DirEntry* e = &dir[idx];
+    //On INVXO, our children write dirty data back to us, and we become the owner
+    uint64_t respCycle = invalidateSharers(e, (type == INVXO)? INVX : type, reqWriteback, cycle, srcId, -1);
+    if (type == INV) freeEntry(e);
+    return respCycle;
+}
@@ -37,6 +37,13 @@
 
 //TODO: Now that we have a pure CC interface, the MESI controllers should go on different files.
 
+/* One line of a batched eviction (see CC::processEvictions) */
+struct EvictionReq {
+    Address lineAddr;
+    int32_t lineId;
+    bool writeback; //set by the controller if a child wrote back dirty data
+};
+
 /* Generic, integrated controller interface */
 class CC : public GlobAlloc {
     public:
@@ -49,6 +56,9 @@ class CC : public GlobAlloc {
         virtual bool startAccess(MemReq& req) = 0; //initial locking, address races; returns true if access should be skipped; may change req!
         virtual bool shouldAllocate(const MemReq& req) = 0; //called when we don't find req's lineAddr in the array
         virtual uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) = 0; //called iff shouldAllocate returns true
+        //Evicts several lines at once (e.g., all the tags sharing an evicted dedup data entry). Children are walked once, writebacks
+        //are issued in parallel, and at most one merged timing record is left in the event recorder.
+        virtual uint64_t processEvictions(const MemReq& triggerReq, g_vector<EvictionReq>& evictions, uint64_t startCycle) = 0;
         virtual uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle = nullptr) = 0;
         virtual void endAccess(const MemReq& req) = 0;
 
@@ -59,6 +69,15 @@ class CC : public GlobAlloc {
         //Repl policy interface
         virtual uint32_t numSharers(uint32_t lineId) = 0;
         virtual bool isValid(uint32_t lineId) = 0;
+
+        //Functional warming methods (fast-forward); these only update our own state, never send requests or invalidates
+        virtual void startWarm() = 0;
+        virtual void processWarmEviction(int32_t lineId) = 0;
+        virtual void processWarmAccess(AccessType type, int32_t lineId) = 0;
+        virtual void endWarm() = 0;
+
+        //Misses seen so far (for samplers that measure miss rates over windows)
+        virtual uint64_t getMisses() const {return 0;}
 };
 
 
@@ -78,6 +97,19 @@ class Network;
 
 /* NOTE: To avoid virtual function overheads, there is no BottomCC interface, since we only have a MESI controller for now */
 
+/* Hash things a bit to pick the parent (bank) a line maps to. Exposed so that
+ * fast-forward warming routes lines to the same banks as simulated accesses.
+ */
+static inline uint32_t HashParentId(Address lineAddr, uint32_t numParents) {
+    uint32_t res = 0;
+    uint64_t tmp = lineAddr;
+    for (uint32_t i = 0; i < 4; i++) {
+        res ^= (uint32_t) ( ((uint64_t)0xffff) & tmp);
+        tmp = tmp >> 16;
+    }
+    return (res % numParents);
+}
+
 class MESIBottomCC : public GlobAlloc {
     private:
         MESIState* array;
@@ -117,6 +149,10 @@ class MESIBottomCC : public GlobAlloc {
             return (state == E) || (state == M);
         }
 
+        uint64_t getMisses() const {
+            return profGETSMiss.get() + profGETXMissIM.get() + profGETXMissSM.get();
+        }
+
         void initStats(AggregateStat* parentStat) {
             profGETSHit.init("hGETS", "GETS hits");
             profGETXHit.init("hGETX", "GETX hits");
@@ -149,7 +185,9 @@ class MESIBottomCC : public GlobAlloc {
 
         uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId);
 
-        uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags);
+        uint64_t processEvictions(const g_vector<EvictionReq>& evictions, uint64_t cycle, uint32_t srcId);
+
+        uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags, Address pc);
 
         void processWritebackOnAccess(Address lineAddr, uint32_t lineId, AccessType type);
 
@@ -157,6 +195,17 @@ class MESIBottomCC : public GlobAlloc {
 
         uint64_t processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags);
 
+        //Functional warming: the line is filled from the upper level without any timing or requests
+        inline void processWarmAccess(uint32_t lineId, AccessType type) {
+            MESIState& state = array[lineId];
+            if (type == GETX) state = M;
+            else if (state == I) state = E;
+        }
+
+        inline void processWarmEviction(uint32_t lineId) {
+            array[lineId] = I; //dirty data is dropped, warming does not model writebacks
+        }
+
         inline void lock() {
             futex_lock(&ccLock);
         }
@@ -182,12 +231,14 @@ class MESITopCC : public GlobAlloc {
     private:
         struct Entry {
             uint32_t numSharers;
+            int32_t owner; //child holding the line in O, -1 if none (MOESI only)
             std::bitset<MAX_CACHE_CHILDREN> sharers;
             bool exclusive;
 
             void clear() {
                 exclusive = false;
                 numSharers = 0;
+                owner = -1;
                 sharers.reset();
             }
 
@@ -200,36 +251,45 @@ class MESITopCC : public GlobAlloc {
             }
         };
 
-        Entry* array;
+        Entry* array;  // allocated on init()
+
+    protected:
         g_vector<BaseCache*> children;
         g_vector<uint32_t> childrenRTTs;
         uint32_t numLines;
 
         bool nonInclusiveHack;
+        bool moesi; //downgraded dirty children keep their data in O, instead of writing it back
 
         PAD();
         lock_t ccLock;
         PAD();
 
-    public:
-        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack) : numLines(_numLines), nonInclusiveHack(_nonInclusiveHack) {
-            array = gm_calloc<Entry>(numLines);
-            for (uint32_t i = 0; i < numLines; i++) {
-                array[i].clear();
-            }
+    private:
+        Counter profOwnedDowngrades, profOwnerFwds;
 
+    public:
+        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack, bool _moesi = false)
+            : array(nullptr), numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), moesi(_moesi) {
             futex_init(&ccLock);
         }
 
         void init(const g_vector<BaseCache*>& _children, Network* network, const char* name);
 
+        void initStats(AggregateStat* cacheStat);
+
         uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
+        uint64_t processEvictions(g_vector<EvictionReq>& evictions, uint64_t cycle, uint32_t srcId);
+
         uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
                 MESIState* childState, bool* inducedWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
         uint64_t processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
+        // Writebacks from children caused by accesses to other lines (e.g., directory evictions), to be reflected in bcc
+        bool popInducedWriteback(Address* lineAddr, uint32_t* lineId) {return false;}
+
         inline void lock() {
             futex_lock(&ccLock);
         }
@@ -239,14 +299,109 @@ class MESITopCC : public GlobAlloc {
         }
 
         /* Replacement policy query interface */
-        inline uint32_t numSharers(uint32_t lineId) {
+        uint32_t numSharers(uint32_t lineId) {
             return array[lineId].numSharers;
         }
 
+    protected:
+        void initChildren(const g_vector<BaseCache*>& _children, Network* network, const char* name);
+
     private:
         uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 };
 
+/* Sizing of a sparse directory; entries == 0 means a full-map directory */
+struct SparseDirConfig {
+    uint32_t entries;
+    uint32_t ways;
+    uint32_t pointers;
+};
+
+#define SPARSE_DIR_MAX_POINTERS 4
+
+/* Sparse directory: instead of a full sharer bit-vector for every line, keeps
+ * set-associative entries only for the lines that children hold, so memory
+ * and the children supported no longer scale with MAX_CACHE_CHILDREN.
+ *
+ * Each entry tracks up to `pointers` sharers exactly. When more children
+ * share the line, the entry falls back to a 64-bit coarse vector, where each
+ * bit covers a group of children; invalidations then go to every child of
+ * each marked group, and children that do not hold the line just ack them.
+ *
+ * A line that needs an entry when its set is full evicts the LRU entry,
+ * invalidating that line's sharers (the line stays in this cache). As with
+ * cache evictions, these invalidations are off the critical path of the
+ * access that caused them.
+ *
+ * Only used through SparseMESICC, so its methods hide MESITopCC's instead of
+ * overriding them, and the full-map path pays no virtual calls.
+ */
+class SparseMESITopCC : public MESITopCC {
+    private:
+        struct DirEntry {
+            Address lineAddr;
+            uint64_t lastUse;
+            uint32_t lineId;
+            uint16_t numSharers;  // exact, even if coarse; 0 if the entry is free
+            bool exclusive;
+            bool coarse;
+            union {
+                uint16_t ptrs[SPARSE_DIR_MAX_POINTERS];
+                uint64_t groups;  // coarse vector, bit g covers children [g*groupSize, (g+1)*groupSize)
+            };
+        };
+
+        DirEntry* dir;
+        int32_t* lineEntries;  // lineId -> entry, -1 if no child holds the line
+        const uint32_t dirSets;
+        const uint32_t dirWays;
+        const uint32_t numPointers;
+        uint32_t groupSize;
+        uint64_t timestamp;
+
+        struct InducedWriteback {
+            Address lineAddr;
+            uint32_t lineId;
+        };
+        g_vector<InducedWriteback> inducedWritebacks;
+
+        PAD();
+        Counter profDirAllocs, profDirEvictions, profDirEvInvs;
+        Counter profCoarseEntries, profCoarseInvs;
+        PAD();
+
+    public:
+        SparseMESITopCC(uint32_t _numLines, bool _nonInclusiveHack, const SparseDirConfig& cfg);
+
+        void init(const g_vector<BaseCache*>& _children, Network* network, const char* name);
+
+        void initStats(AggregateStat* cacheStat);
+
+        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+
+        uint64_t processEvictions(g_vector<EvictionReq>& evictions, uint64_t cycle, uint32_t srcId);
+
+        uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
+                MESIState* childState, bool* inducedWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
+
+        uint64_t processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+
+        bool popInducedWriteback(Address* lineAddr, uint32_t* lineId);
+
+        uint32_t numSharers(uint32_t lineId) {
+            int32_t idx = lineEntries[lineId];
+            return (idx == -1)? 0 : dir[idx].numSharers;
+        }
+
+    private:
+        DirEntry* allocEntry(Address lineAddr, uint32_t lineId, uint64_t cycle, uint32_t srcId);
+        void freeEntry(DirEntry* e);
+        bool isSharer(const DirEntry* e, uint32_t c) const;  // conservative if coarse
+        void addSharer(DirEntry* e, uint32_t c);
+        void removeSharer(DirEntry* e, uint32_t c);
+        uint64_t invalidateSharers(DirEntry* e, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, int32_t skipChild);
+};
+
 static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIState initialState) {
     //NOTE: THIS IS THE ONLY CODE THAT SHOULD DEAL WITH RACES. tcc, bcc et al should be written as if they were race-free.
     bool skipAccess = false;
@@ -258,6 +413,9 @@ static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIStat
             if (*state == I) {
                 //If it was already invalidated (INV), just skip access altogether, we're already done
                 skipAccess = true;
+            } else if (*state == O) {
+                //We were downgraded (INVXO) but kept the dirty data, still need to do the PUTX
+                assert(type == PUTX);
             } else {
                 //We were downgraded (INVX), still need to do the PUT
                 assert(*state == S);
@@ -265,10 +423,10 @@ static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIStat
                 if (type == PUTX) type = PUTS;
             }
         } else if (type == GETX) { //...or it is a GETX
-            //In this case, the line MUST have been in S and have been INValidated
-            assert(initialState == S);
-            assert(*state == I);
-            //Do nothing. This is still a valid GETX, only it is not an upgrade miss anymore
+            //In this case, the line MUST have been in S and have been INValidated, or in O and have been invalidated or downgraded
+            assert(initialState == S || initialState == O);
+            assert(*state == I || (initialState == O && *state == S));
+            //Do nothing. This is still a valid GETX, only it is not an upgrade miss (from O) anymore
         } else { //no GETSs can race with INVs, if we are doing a GETS it's because the line was invalid to begin with!
             panic("Invalid true race happened (?)");
         }
@@ -276,10 +434,12 @@ static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIStat
     return skipAccess;
 }
 
-// Non-terminal CC; accepts GETS/X and PUTS/X accesses
-class MESICC : public CC {
-    private:
-        MESITopCC* tcc;
+// Non-terminal CC; accepts GETS/X and PUTS/X accesses. Templated on the top CC (directory)
+// so that calls to it are not virtual; MESICC and SparseMESICC below pick and build it.
+template <typename TopCC>
+class MESIBaseCC : public CC {
+    protected:
+        TopCC* tcc;
         MESIBottomCC* bcc;
         uint32_t numLines;
         bool nonInclusiveHack;
@@ -287,22 +447,21 @@ class MESICC : public CC {
 
     public:
         //Initialization
-        MESICC(uint32_t _numLines, bool _nonInclusiveHack, g_string& _name) : tcc(nullptr), bcc(nullptr),
-            numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), name(_name) {}
+        MESIBaseCC(uint32_t _numLines, bool _nonInclusiveHack, const g_string& _name)
+            : tcc(nullptr), bcc(nullptr), numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), name(_name) {}
 
         void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {
             bcc = new MESIBottomCC(numLines, childId, nonInclusiveHack);
             bcc->init(parents, network, name.c_str());
         }
 
-        void setChildren(const g_vector<BaseCache*>& children, Network* network) {
-            tcc = new MESITopCC(numLines, nonInclusiveHack);
-            tcc->init(children, network, name.c_str());
-        }
-
         void initStats(AggregateStat* cacheStat) {
-            //no tcc stats
             bcc->initStats(cacheStat);
+            tcc->initStats(cacheStat);
+        }
+
+        uint64_t getMisses() const {
+            return bcc->getMisses();
         }
 
         //Access methods
@@ -347,6 +506,12 @@ class MESICC : public CC {
             return evCycle;
         }
 
+        uint64_t processEvictions(const MemReq& triggerReq, g_vector<EvictionReq>& evictions, uint64_t startCycle) {
+            uint64_t evCycle = tcc->processEvictions(evictions, startCycle, triggerReq.srcId); //1. invalidate all lines in children at once
+            evCycle = bcc->processEvictions(evictions, evCycle, triggerReq.srcId); //2. write back all lines to upper level in parallel
+            return evCycle;
+        }
+
         uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle = nullptr) {
             uint64_t respCycle = startCycle;
             //Handle non-inclusive writebacks by bypassing
@@ -365,9 +530,10 @@ class MESICC : public CC {
                 bool isPrefetch = req.flags & MemReq::PREFETCH;
                 assert(!isPrefetch || req.type == GETS);
                 uint32_t flags = req.flags & ~MemReq::PREFETCH; //always clear PREFETCH, this flag cannot propagate up
+                if (isPrefetch) flags |= MemReq::PREFETCH_FILL; //but let upper levels know the fill is for a prefetch
 
                 //if needed, fetch line or upgrade miss from upper level
-                respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, flags);
+                respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, flags, req.pc);
                 if (getDoneCycle) *getDoneCycle = respCycle;
                 if (!isPrefetch) { //prefetches only touch bcc; the demand request from the core will pull the line to lower level
                     //At this point, the line is in a good state w.r.t. upper levels
@@ -379,6 +545,12 @@ class MESICC : public CC {
                         //Essentially, if tcc induced a writeback, bcc may need to do an E->M transition to reflect that the cache now has dirty data
                         bcc->processWritebackOnAccess(req.lineAddr, lineId, req.type);
                     }
+                    //Same for other lines whose children tcc invalidated (sparse directory evictions)
+                    Address wbLineAddr;
+                    uint32_t wbLineId;
+                    while (tcc->popInducedWriteback(&wbLineAddr, &wbLineId)) {
+                        bcc->processWritebackOnAccess(wbLineAddr, wbLineId, req.type);
+                    }
                 }
             }
             return respCycle;
@@ -400,6 +572,12 @@ class MESICC : public CC {
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            if (lineId == -1 || !bcc->isValid(lineId)) {
+                //Coarse-vector invalidate to a child that does not hold the line, just ack it
+                assert(req.coarse);
+                bcc->unlock();
+                return startCycle;
+            }
             uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId); //send invalidates or downgrades to children
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
 
@@ -410,6 +588,57 @@ class MESICC : public CC {
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return tcc->numSharers(lineId);}
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        //Warm methods
+        void startWarm() {
+            tcc->lock(); //same order as startAccess
+            bcc->lock();
+        }
+
+        void processWarmEviction(int32_t lineId) {
+            assert(tcc->numSharers(lineId) == 0); //caller must not warm-evict lines held by children
+            bcc->processWarmEviction(lineId);
+        }
+
+        void processWarmAccess(AccessType type, int32_t lineId) {
+            assert(lineId != -1);
+            bcc->processWarmAccess(lineId, type);
+        }
+
+        void endWarm() {
+            bcc->unlock();
+            tcc->unlock();
+        }
+};
+
+// Non-terminal CC with a full-map directory
+class MESICC : public MESIBaseCC<MESITopCC> {
+    private:
+        bool moesi;
+
+    public:
+        MESICC(uint32_t _numLines, bool _nonInclusiveHack, const g_string& _name, bool _moesi = false)
+            : MESIBaseCC<MESITopCC>(_numLines, _nonInclusiveHack, _name), moesi(_moesi) {}
+
+        void setChildren(const g_vector<BaseCache*>& children, Network* network) {
+            tcc = new MESITopCC(numLines, nonInclusiveHack, moesi);
+            tcc->init(children, network, name.c_str());
+        }
+};
+
+// Non-terminal CC with a sparse directory (see SparseMESITopCC)
+class SparseMESICC : public MESIBaseCC<SparseMESITopCC> {
+    private:
+        SparseDirConfig sparseDir;
+
+    public:
+        SparseMESICC(uint32_t _numLines, bool _nonInclusiveHack, const g_string& _name, const SparseDirConfig& _sparseDir)
+            : MESIBaseCC<SparseMESITopCC>(_numLines, _nonInclusiveHack, _name), sparseDir(_sparseDir) {}
+
+        void setChildren(const g_vector<BaseCache*>& children, Network* network) {
+            tcc = new SparseMESITopCC(numLines, nonInclusiveHack, sparseDir);
+            tcc->init(children, network, name.c_str());
+        }
 };
 
 // Terminal CC, i.e., without children --- accepts GETS/X, but not PUTS/X
@@ -436,6 +665,10 @@ class MESITerminalCC : public CC {
             bcc->initStats(cacheStat);
         }
 
+        uint64_t getMisses() const {
+            return bcc->getMisses();
+        }
+
         //Access methods
         bool startAccess(MemReq& req) {
             assert((req.type == GETS) || (req.type == GETX)); //no puts!
@@ -467,11 +700,15 @@ class MESITerminalCC : public CC {
             return endCycle;  // critical path unaffected, but TimingCache needs it
         }
 
+        uint64_t processEvictions(const MemReq& triggerReq, g_vector<EvictionReq>& evictions, uint64_t startCycle) {
+            return bcc->processEvictions(evictions, startCycle, triggerReq.srcId);
+        }
+
         uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle,  uint64_t* getDoneCycle = nullptr) {
             assert(lineId != -1);
             assert(!getDoneCycle);
             //if needed, fetch line or upgrade miss from upper level
-            uint64_t respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, req.flags);
+            uint64_t respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, req.flags, req.pc);
             //at this point, the line is in a good state w.r.t. upper levels
             return respCycle;
         }
@@ -490,6 +727,12 @@ class MESITerminalCC : public CC {
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            if (lineId == -1 || !bcc->isValid(lineId)) {
+                //Coarse-vector invalidate to a child that does not hold the line, just ack it
+                assert(req.coarse);
+                bcc->unlock();
+                return startCycle;
+            }
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
             bcc->unlock();
             return startCycle; //no extra delay in terminal caches
@@ -498,6 +741,24 @@ class MESITerminalCC : public CC {
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return 0;} //no sharers
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        //Warm methods
+        void startWarm() {
+            bcc->lock();
+        }
+
+        void processWarmEviction(int32_t lineId) {
+            bcc->processWarmEviction(lineId);
+        }
+
+        void processWarmAccess(AccessType type, int32_t lineId) {
+            assert(lineId != -1);
+            bcc->processWarmAccess(lineId, type);
+        }
+
+        void endWarm() {
+            bcc->unlock();
+        }
 };
 
 #endif  // COHERENCE_CTRLS_H_
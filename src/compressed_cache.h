@@ -0,0 +1,425 @@
+#ifndef COMPRESSED_CACHE_H_
+#define COMPRESSED_CACHE_H_
+
+#include "pin.H"
+#include "timing_cache.h"
+#include "stats.h"
+#include "zsim.h"
+
+/* Common base of the compressed (BDI, dedup and Doppelganger) caches. Holds
+ * their replacement policies and stats; their access path is
+ * CompressedCacheEngine below.
+ */
+class CompressedCache : public TimingCache {
+    protected:
+        // Cache stuff
+        uint32_t numTagLines;
+        uint32_t numDataLines;
+
+        ReplPolicy* tagRP;
+        ReplPolicy* dataRP;
+
+        RunningStats* crStats;
+        RunningStats* tutStats;
+        RunningStats* dutStats;
+
+        const char* statsDesc;
+
+    public:
+        CompressedCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ReplPolicy* _tagRP, ReplPolicy* _dataRP,
+                uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, const char* _statsDesc,
+                RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all)
+            : TimingCache(_numTagLines, _cc, NULL, _tagRP, _accLat, _invLat, mshrs, _accLat, ways, cands, _domain, _name, _evStats, _tag_hits, _tag_misses, _tag_all),
+              numTagLines(_numTagLines), numDataLines(_numDataLines), tagRP(_tagRP), dataRP(_dataRP),
+              crStats(_crStats), tutStats(_tutStats), dutStats(_dutStats), statsDesc(_statsDesc) {}
+
+        // Cache::warm() walks the plain tag array, which compressed caches leave NULL, so each one
+        // must bring its own. Only ApproximateBDI and ApproximateDedup do; init rejects the others
+        // (Doppelganger, BDI-dedup, ideal and naive dedup) for fast-forward warming and shadow LLCs.
+        void warm(Address lineAddr, AccessType type, DataLine data) {
+            panic("%s: functional warming is not supported by this compressed cache", name.c_str());
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* cacheStat = new AggregateStat();
+            cacheStat->init(name.c_str(), statsDesc);
+            initCacheStats(cacheStat);
+            initTimingStats(cacheStat);
+            parentStat->append(cacheStat);
+        }
+
+        // Dumps the compression ratio and array utilization samples (zsim.cpp dumps these for LLC banks, ShadowLLCs for shadow banks)
+        void dumpArrayStats() {
+            crStats->dump();
+            tutStats->dump();
+            dutStats->dump();
+        }
+
+    protected:
+        // Returns true if the line lies entirely in an approximate region, and fills in that region's type and range
+        static inline bool findApproximateRegion(Address lineAddr, DataType* type, DataValue* min = nullptr, DataValue* max = nullptr) {
+            uint64_t start = lineAddr << lineBits;
+            uint64_t end = start + zinfo->lineSize - 1;
+            for (uint32_t i = 0; i < zinfo->approximateRegions->size(); i++) {
+                const auto& region = (*zinfo->approximateRegions)[i];
+                if (start >= std::get<0>(region) && start <= std::get<1>(region) && end >= std::get<0>(region) && end <= std::get<1>(region)) {
+                    *type = std::get<2>(region);
+                    if (min) *min = std::get<3>(region);
+                    if (max) *max = std::get<4>(region);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Tie two events to an optional timing record
+        static inline void connect(EventRecorder* evRec, const TimingRecord* r, TimingEvent* startEv, TimingEvent* endEv, uint64_t startCycle, uint64_t endCycle) {
+            assert_msg(startCycle <= endCycle, "start > end? %ld %ld", startCycle, endCycle);
+            if (r) {
+                assert_msg(startCycle <= r->reqCycle, "%ld / %ld", startCycle, r->reqCycle);
+                assert_msg(r->respCycle <= endCycle, "%ld %ld %ld %ld", startCycle, r->reqCycle, r->respCycle, endCycle);
+                uint64_t upLat = r->reqCycle - startCycle;
+                uint64_t downLat = endCycle - r->respCycle;
+
+                if (upLat) {
+                    DelayEvent* dUp = new (evRec) DelayEvent(upLat);
+                    dUp->setMinStartCycle(startCycle);
+                    startEv->addChild(dUp, evRec)->addChild(r->startEvent, evRec);
+                } else {
+                    startEv->addChild(r->startEvent, evRec);
+                }
+
+                if (downLat) {
+                    DelayEvent* dDown = new (evRec) DelayEvent(downLat);
+                    dDown->setMinStartCycle(r->respCycle);
+                    r->endEvent->addChild(dDown, evRec)->addChild(endEv, evRec);
+                } else {
+                    r->endEvent->addChild(endEv, evRec);
+                }
+            } else {
+                if (startCycle == endCycle) {
+                    startEv->addChild(endEv, evRec);
+                } else {
+                    DelayEvent* dEv = new (evRec) DelayEvent(endCycle - startCycle);
+                    dEv->setMinStartCycle(startCycle);
+                    startEv->addChild(dEv, evRec)->addChild(endEv, evRec);
+                }
+            }
+        }
+};
+
+/* One access to a compressed cache on its way through CompressedCacheEngine::access() and the
+ * organization's hooks: the line's data, the writebacks the access causes, and the shape of the
+ * writeback event the hooks ask for.
+ */
+struct CompressedAccess {
+    MemReq& req;
+    EventRecorder* evRec;
+    DataLine data;
+    DataType type;
+    DataValue min, max;
+    bool approximate;
+    bool updateReplacement;
+    uint64_t respCycle;
+    uint64_t evictions; // lines this access evicted, sampled into evStats
+    int32_t victimDataId; // dedup caches: the victim tag's data line, as releaseTag found it
+
+    // A miss evicts its victim tag before the fetch, so that writeback is kept apart
+    uint64_t tagEvictCycle;
+    uint64_t tagEvDoneCycle;
+    TimingRecord tagWritebackRecord;
+
+    // Every other writeback, in issue order
+    g_vector<TimingRecord> writebackRecords;
+    g_vector<uint64_t> wbStartCycles;
+    g_vector<uint64_t> wbEndCycles;
+    uint64_t lastEvDoneCycle;
+
+    TimingRecord accessRecord; // the fetch from our parents, if any
+    TimingRecord tr;
+
+    // Set by the hooks. The MissWritebackEvent/HitWritebackEvent takes wbLat cycles (0 on a hit: no
+    // HitWritebackEvent) and starts no earlier than wbMinStartCycle. The writebacks hang off the
+    // HitEvent, or off the MissResponseEvent (the MissStartEvent if wbFanCycle is before the
+    // response), assumed to end at wbFanCycle.
+    uint32_t wbLat;
+    uint64_t wbMinStartCycle;
+    uint64_t wbFanCycle;
+
+    CompressedAccess(MemReq& _req, EventRecorder* _evRec) : req(_req), evRec(_evRec), data(gm_calloc<uint8_t>(zinfo->lineSize)), type(ZSIM_FLOAT),
+        approximate(false), updateReplacement(false), respCycle(_req.cycle), evictions(0), victimDataId(-1), tagEvictCycle(0), tagEvDoneCycle(0),
+        lastEvDoneCycle(0), wbLat(0), wbMinStartCycle(0), wbFanCycle(0) {
+        tagWritebackRecord.clear();
+        accessRecord.clear();
+        tr.clear();
+    }
+
+    ~CompressedAccess() {gm_free(data);}
+};
+
+/* Access, eviction and writeback engine of the compressed caches. C is the cache organization
+ * (CRTP), TagArrayT and DataArrayT its arrays; these carry the compressor and, with the hash array
+ * C adds, the dedup index, so no array call is virtual. Replacement stays with the arrays'
+ * ReplPolicies. The engine looks up and evicts the victim tag, fetches, builds the event graph and
+ * samples the stats; C places the line through
+ *
+ *   void fill(CompressedAccess& a, int32_t victimTagId);  // tag miss, after the fetch
+ *   void hit(CompressedAccess& a, int32_t tagId);         // tag hit, must fetch()
+ *   void sampleArrayStats();
+ *
+ * and may hide the default hooks below. C must befriend its engine.
+ */
+template <class C, class TagArrayT, class DataArrayT>
+class CompressedCacheEngine : public CompressedCache {
+    protected:
+        TagArrayT* tagArray;
+        DataArrayT* dataArray;
+
+        uint64_t tagCausedEv;
+
+    public:
+        CompressedCacheEngine(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, TagArrayT* _tagArray, DataArrayT* _dataArray, ReplPolicy* _tagRP, ReplPolicy* _dataRP,
+                uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, const char* _statsDesc,
+                RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all)
+            : CompressedCache(_numTagLines, _numDataLines, _cc, _tagRP, _dataRP, _accLat, _invLat, mshrs, ways, cands, _domain, _name, _statsDesc,
+                    _crStats, _evStats, _tutStats, _dutStats, _tag_hits, _tag_misses, _tag_all),
+              tagArray(_tagArray), dataArray(_dataArray), tagCausedEv(0) {}
+
+        uint64_t access(MemReq& req);
+
+    protected:
+        // Default hooks
+        bool needsData(const CompressedAccess& a) const {return true;} // whether to read the line's data
+        uint64_t tagEvictionCycle(const CompressedAccess& a) const {return a.respCycle + accLat;} // reads the victim's data first
+        void releaseTag(CompressedAccess& a, int32_t victimTagId) {} // after the victim tag is evicted, drops its data
+
+        // Runs the coherence side of the access on lineId at a.respCycle, and makes it the access'
+        // timing record. Returns the cycle the fetch from our parents completed.
+        uint64_t fetch(CompressedAccess& a, int32_t lineId) {
+            uint64_t getDoneCycle = a.respCycle;
+            timing("%s: doing processAccess on cycle %lu", name.c_str(), a.respCycle);
+            a.respCycle = cc->processAccess(a.req, lineId, a.respCycle, &getDoneCycle);
+            timing("%s: finished processAccess on cycle %lu", name.c_str(), a.respCycle);
+            if (a.evRec->hasRecord()) a.accessRecord = a.evRec->popRecord();
+            a.tr = {a.req.lineAddr << lineBits, a.req.cycle, a.respCycle, a.req.type, nullptr, nullptr};
+            return getDoneCycle;
+        }
+
+        // Evicts one line at evBeginCycle; returns whether it caused a writeback
+        bool evictLine(CompressedAccess& a, Address wbLineAddr, int32_t lineId, uint64_t evBeginCycle) {
+            timing("%s: evicting address %lu on cycle %lu", name.c_str(), wbLineAddr, evBeginCycle);
+            uint64_t evDoneCycle = cc->processEviction(a.req, wbLineAddr, lineId, evBeginCycle);
+            if (!a.evRec->hasRecord()) return false;
+            a.evictions++;
+            addWriteback(a, a.evRec->popRecord(), evBeginCycle, evDoneCycle);
+            return true;
+        }
+
+        // Evicts a batch of lines at evBeginCycle through bankCC (another bank's controller) or ours;
+        // returns how many went
+        uint32_t evictLines(CompressedAccess& a, g_vector<EvictionReq>& evictions, uint64_t evBeginCycle, CC* bankCC = nullptr) {
+            if (evictions.empty()) return 0;
+            timing("%s: evicting %lu lines on cycle %lu", name.c_str(), evictions.size(), evBeginCycle);
+            uint64_t evDoneCycle = (bankCC? bankCC : cc)->processEvictions(a.req, evictions, evBeginCycle);
+            a.evictions += evictions.size();
+            if (a.evRec->hasRecord()) addWriteback(a, a.evRec->popRecord(), evBeginCycle, evDoneCycle);
+            return evictions.size();
+        }
+
+        void addWriteback(CompressedAccess& a, const TimingRecord& wbRecord, uint64_t startCycle, uint64_t endCycle) {
+            a.writebackRecords.push_back(wbRecord);
+            a.wbStartCycles.push_back(startCycle);
+            a.wbEndCycles.push_back(endCycle);
+            a.lastEvDoneCycle = MAX(a.lastEvDoneCycle, endCycle);
+        }
+
+        // Segments of a dedup BDI data line (8B each)
+        uint32_t numSegments() {return dataArray->getAssoc()*zinfo->lineSize/8;}
+
+        // Dedup BDI data arrays: frees segments of data line dataId, the data array's victims first,
+        // until lineSize bytes fit next to the ownSpace bytes the line already holds there. Evicts the
+        // tags on each freed segment but keepTagId as one batch, segments accLat apart from
+        // evBeginCycle; counts the segments that evicted tags in bdiCausedEv and the tags in
+        // dedupCausedEv. Returns the first freed segment.
+        int32_t freeSegments(CompressedAccess& a, int32_t dataId, uint16_t lineSize, uint16_t ownSpace, int32_t keepTagId, uint64_t evBeginCycle,
+                uint64_t& bdiCausedEv, uint64_t& dedupCausedEv);
+
+    private:
+        void missEvents(CompressedAccess& a);
+        void hitEvents(CompressedAccess& a);
+        void connectWritebacks(CompressedAccess& a, TimingEvent* parent, TimingEvent* wbEv);
+};
+
+template <class C, class TagArrayT, class DataArrayT>
+uint64_t CompressedCacheEngine<C, TagArrayT, DataArrayT>::access(MemReq& req) {
+    C* self = static_cast<C*>(this);
+    if (tag_all) tag_all->inc();
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    assert_msg(evRec, "%s is not connected to TimingCore", name.c_str());
+
+    CompressedAccess a(req, evRec);
+    a.approximate = findApproximateRegion(req.lineAddr, &a.type, &a.min, &a.max);
+    if (self->needsData(a)) PIN_SafeCopy(a.data, (void*)(req.lineAddr << lineBits), zinfo->lineSize);
+
+    debug("%s: received %s %s req of data type %s on address %lu on cycle %lu", name.c_str(), (a.approximate? "approximate":""), AccessTypeName(req.type), DataTypeName(a.type), req.lineAddr, req.cycle);
+    timing("%s: received %s req on address %lu on cycle %lu", name.c_str(), AccessTypeName(req.type), req.lineAddr, req.cycle);
+
+    bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
+    if (likely(!skipAccess)) {
+        a.updateReplacement = (req.type == GETS) || (req.type == GETX);
+        int32_t tagId = tagArray->lookup(req.lineAddr, &req, a.updateReplacement);
+        zinfo->tagAll++;
+        // Timing: tag array access latency
+        a.respCycle += accLat;
+        timing("%s: tag accessed on cycle %lu", name.c_str(), a.respCycle);
+
+        if (tagId == -1) {
+            if (tag_misses) tag_misses->inc();
+            zinfo->tagMisses++;
+            assert(cc->shouldAllocate(req));
+            // Get the eviction candidate
+            Address wbLineAddr;
+            int32_t victimTagId = tagArray->preinsert(req.lineAddr, &req, &wbLineAddr); //find the lineId to replace
+            debug("%s: tag miss, inserting into line %i", name.c_str(), victimTagId);
+            a.tagEvictCycle = self->tagEvictionCycle(a);
+            timing("%s: tag access missed, evicting address %lu on cycle %lu", name.c_str(), wbLineAddr, a.tagEvictCycle);
+            a.tagEvDoneCycle = cc->processEviction(req, wbLineAddr, victimTagId, a.tagEvictCycle);
+            timing("%s: finished eviction on cycle %lu", name.c_str(), a.tagEvDoneCycle);
+            a.lastEvDoneCycle = a.tagEvDoneCycle;
+            self->releaseTag(a, victimTagId);
+            if (evRec->hasRecord()) {
+                debug("%s: tag miss caused eviction of address %lu", name.c_str(), wbLineAddr);
+                tagCausedEv++;
+                a.evictions++;
+                a.tagWritebackRecord = evRec->popRecord();
+            }
+
+            // Need to get the line we want
+            uint64_t getDoneCycle = fetch(a, victimTagId);
+            assert_msg(getDoneCycle == a.respCycle, "gdc %ld rc %ld", getDoneCycle, a.respCycle);
+            a.wbFanCycle = a.respCycle;
+            self->fill(a, victimTagId);
+            missEvents(a);
+        } else {
+            if (tag_hits) tag_hits->inc();
+            zinfo->tagHits++;
+            debug("%s: tag hit on line %i", name.c_str(), tagId);
+            a.wbFanCycle = req.cycle + accLat;
+            self->hit(a, tagId);
+            hitEvents(a);
+        }
+        evRec->pushRecord(a.tr);
+    }
+    cc->endAccess(req);
+
+    if (req.type != PUTS) evStats->add(a.evictions, 1);
+    self->sampleArrayStats();
+
+    assert_msg(a.respCycle >= req.cycle, "[%s] resp < req? 0x%lx type %s childState %s, respCycle %ld reqCycle %ld",
+            name.c_str(), req.lineAddr, AccessTypeName(req.type), MESIStateName(*req.state), a.respCycle, req.cycle);
+    return a.respCycle;
+}
+
+template <class C, class TagArrayT, class DataArrayT>
+void CompressedCacheEngine<C, TagArrayT, DataArrayT>::missEvents(CompressedAccess& a) {
+    const MemReq& req = a.req;
+    EventRecorder* evRec = a.evRec;
+    MissStartEvent* mse = new (evRec) MissStartEvent(this, accLat, domain);
+    MissResponseEvent* mre = new (evRec) MissResponseEvent(this, mse, domain);
+    MissWritebackEvent* mwe = new (evRec) MissWritebackEvent(this, mse, a.wbLat, domain);
+    mse->setMinStartCycle(req.cycle);
+    mre->setMinStartCycle(a.respCycle);
+    mwe->setMinStartCycle(a.wbMinStartCycle);
+    timing("%s: missStartEvent Min Start: %lu, duration: %u", name.c_str(), req.cycle, accLat);
+    timing("%s: missResponseEvent Min Start: %lu", name.c_str(), a.respCycle);
+    timing("%s: missWritebackEvent Min Start: %lu, duration: %u", name.c_str(), a.wbMinStartCycle, a.wbLat);
+
+    connect(evRec, a.accessRecord.isValid()? &a.accessRecord : nullptr, mse, mre, req.cycle + accLat, a.respCycle);
+    connectWritebacks(a, (a.wbFanCycle < a.respCycle)? (TimingEvent*)mse : mre, mwe);
+    mre->addChild(mwe, evRec);
+    if (a.tagEvDoneCycle) {
+        // The victim tag is evicted once the tag array is read, plus whatever the organization needs
+        TimingEvent* tagEv = mse;
+        if (a.tagEvictCycle > req.cycle + accLat) {
+            DelayEvent* del = new (evRec) DelayEvent(a.tagEvictCycle - (req.cycle + accLat));
+            del->setMinStartCycle(req.cycle + accLat);
+            mse->addChild(del, evRec);
+            tagEv = del;
+        }
+        connect(evRec, a.tagWritebackRecord.isValid()? &a.tagWritebackRecord : nullptr, tagEv, mwe, a.tagEvictCycle, a.tagEvDoneCycle);
+    }
+    a.tr.startEvent = mse;
+    a.tr.endEvent = mre;
+}
+
+template <class C, class TagArrayT, class DataArrayT>
+void CompressedCacheEngine<C, TagArrayT, DataArrayT>::hitEvents(CompressedAccess& a) {
+    const MemReq& req = a.req;
+    EventRecorder* evRec = a.evRec;
+    HitEvent* he = new (evRec) HitEvent(this, a.respCycle - req.cycle, domain);
+    he->setMinStartCycle(req.cycle);
+    timing("%s: hitEvent Min Start: %lu, duration: %lu", name.c_str(), req.cycle, a.respCycle - req.cycle);
+    if (a.wbLat) {
+        HitWritebackEvent* hwe = new (evRec) HitWritebackEvent(this, a.wbLat, domain);
+        hwe->setMinStartCycle(a.wbMinStartCycle);
+        timing("%s: hitWritebackEvent Min Start: %lu, duration: %u", name.c_str(), a.wbMinStartCycle, a.wbLat);
+        connectWritebacks(a, he, hwe);
+        he->addChild(hwe, evRec);
+    } else {
+        assert(a.wbStartCycles.empty());
+    }
+    a.tr.startEvent = a.tr.endEvent = he;
+}
+
+template <class C, class TagArrayT, class DataArrayT>
+void CompressedCacheEngine<C, TagArrayT, DataArrayT>::connectWritebacks(CompressedAccess& a, TimingEvent* parent, TimingEvent* wbEv) {
+    for (uint32_t i = 0; i < a.wbStartCycles.size(); i++) {
+        DelayEvent* del = new (a.evRec) DelayEvent(a.wbStartCycles[i] - a.wbFanCycle);
+        del->setMinStartCycle(a.wbFanCycle);
+        parent->addChild(del, a.evRec);
+        connect(a.evRec, a.writebackRecords[i].isValid()? &a.writebackRecords[i] : nullptr, del, wbEv, a.wbStartCycles[i], a.wbEndCycles[i]);
+    }
+}
+
+template <class C, class TagArrayT, class DataArrayT>
+int32_t CompressedCacheEngine<C, TagArrayT, DataArrayT>::freeSegments(CompressedAccess& a, int32_t dataId, uint16_t lineSize, uint16_t ownSpace, int32_t keepTagId,
+        uint64_t evBeginCycle, uint64_t& bdiCausedEv, uint64_t& dedupCausedEv) {
+    g_vector<uint32_t> keptFromEvictions;
+    g_vector<EvictionReq> evictions;
+    uint16_t freeSpace = 0;
+    do {
+        uint16_t occupiedSpace = 0;
+        for (uint32_t i = 0; i < numSegments(); i++)
+            if (dataArray->readListHead(dataId, i) != -1)
+                occupiedSpace += BDICompressionToSize(tagArray->readCompressionEncoding(dataArray->readListHead(dataId, i)), zinfo->lineSize);
+        freeSpace = dataArray->getAssoc()*zinfo->lineSize - occupiedSpace;
+        debug("%s: line now has %i segments free.", name.c_str(), freeSpace/8);
+        int32_t victimListHeadId;
+        int32_t victimSegmentId = dataArray->preinsert(dataId, &victimListHeadId, keptFromEvictions);
+        if (dataArray->readListHead(dataId, victimSegmentId) != -1) {
+            freeSpace += BDICompressionToSize(tagArray->readCompressionEncoding(dataArray->readListHead(dataId, victimSegmentId)), zinfo->lineSize);
+        }
+        debug("%s: Picked victim segment %i", name.c_str(), victimSegmentId);
+        keptFromEvictions.push_back(victimSegmentId);
+        // The segment's tags go in one batch, once it is read
+        evictions.clear();
+        while (victimListHeadId != -1) {
+            int32_t nextListHeadId = tagArray->readNextLL(victimListHeadId);
+            if (victimListHeadId != keepTagId) {
+                evictions.push_back({tagArray->readAddress(victimListHeadId), victimListHeadId, false});
+                tagArray->postinsert(0, &a.req, victimListHeadId, -1, -1, NONE, -1, false);
+            }
+            victimListHeadId = nextListHeadId;
+        }
+        if (uint32_t evicted = evictLines(a, evictions, evBeginCycle)) {
+            debug("%s: size/dedup eviction of %u tags from segment %i", name.c_str(), evicted, victimSegmentId);
+            bdiCausedEv++;
+            dedupCausedEv += evicted;
+            evBeginCycle += accLat;
+        }
+        dataArray->postinsert(-1, &a.req, 0, dataId, victimSegmentId, NULL, false);
+    } while (freeSpace + ownSpace < lineSize);
+    return keptFromEvictions[0];
+}
+
+#endif // COMPRESSED_CACHE_H_
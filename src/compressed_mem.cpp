@@ -0,0 +1,253 @@
+#include "compressed_mem.h"
+#include "bithacks.h"
+#include "event_recorder.h"
+#include "pin.H"
+#include "timing_event.h"
+#include "zsim.h"
+
+// Metadata lives in its own region of the address space, one line per page
+#define METADATA_REGION (1ul << 56)
+
+CompressedMemory::CompressedMemory(MemObject* _mem, uint32_t _lineSize, uint32_t _pageSize, uint32_t _mdEntries, uint32_t _mdWays,
+        uint32_t _burstBufferEntries, uint32_t _burstBufferLatency, g_string& _name)
+    : mem(_mem), lineSize(_lineSize), pageLines(_pageSize/_lineSize),
+      pageLineBits(ilog2(_pageSize/_lineSize)), mdSets(_mdEntries/_mdWays), mdWays(_mdWays),
+      burstBufferEntries(_burstBufferEntries), burstBufferLatency(_burstBufferLatency), name(_name)
+{
+    LINE_SIZE_SWITCH(lineSize, bdiCompressFn = &LineKernelsImpl<LINE_SIZE>::bdiCompress);
+    if (!isPow2(_pageSize) || pageLines < 8 || pageLines > 64) panic("%s: pages must have 8-64 lines and be a power of 2 in size", name.c_str());
+    if (!mdWays || !mdSets || mdSets*mdWays != _mdEntries) panic("%s: invalid metadata cache (%d entries, %d ways)", name.c_str(), _mdEntries, mdWays);
+
+    MetadataEntry invalid = {(Address)-1L, 0, false};
+    mdCache.resize(mdSets*mdWays, invalid);
+    mdTimestamp = 0;
+    burstBuffer.resize(burstBufferEntries, (Address)-1L);
+    burstBufferPos = 0;
+    compressedBytes = 0;
+    futex_init(&lock);
+    info("%s: %d-line pages, %d-entry %d-way metadata cache, %d-entry burst buffer",
+            name.c_str(), pageLines, _mdEntries, mdWays, burstBufferEntries);
+}
+
+void CompressedMemory::initStats(AggregateStat* parentStat) {
+    AggregateStat* memStats = new AggregateStat();
+    memStats->init(name.c_str(), "Compressed memory stats");
+    profReads.init("rd", "Read requests"); memStats->append(&profReads);
+    profWrites.init("wr", "Write requests"); memStats->append(&profWrites);
+    profMdHits.init("mdHits", "Metadata cache hits"); memStats->append(&profMdHits);
+    profMdMisses.init("mdMisses", "Metadata cache misses (extra memory reads)"); memStats->append(&profMdMisses);
+    profMdWritebacks.init("mdWbs", "Dirty metadata evictions (extra memory writes, not simulated)"); memStats->append(&profMdWritebacks);
+    profBurstHits.init("burstHits", "Reads served by the burst buffer (memory reads saved)"); memStats->append(&profBurstHits);
+    profPages.init("pages", "Pages touched"); memStats->append(&profPages);
+    auto cb = [this]() { return compressedBytes; };
+    LambdaStat<decltype(cb)>* cbStat = new LambdaStat<decltype(cb)>(cb);
+    cbStat->init("compressedBytes", "Footprint of touched pages (pages * pageSize uncompressed)"); memStats->append(cbStat);
+    profExceptions.init("exceptions", "Writebacks that made their line an exception"); memStats->append(&profExceptions);
+    profRelayouts.init("relayouts", "Page overflows that required a re-layout"); memStats->append(&profRelayouts);
+    profRelayoutLines.init("relayoutLines", "Lines read and written by re-layouts (not simulated)"); memStats->append(&profRelayoutLines);
+    mem->initStats(memStats);
+    parentStat->append(memStats);
+}
+
+uint16_t CompressedMemory::lineBytes(Address lineAddr) {
+    uint8_t data[128];  // largest line size the kernels support
+    // Unmapped lines read as zeros
+    memset(data, 0, lineSize);
+    PIN_SafeCopy(data, (void*)(lineAddr << lineBits), lineSize);
+    return bdiCompressFn(data);
+}
+
+// Sizes every line of the page and picks the slot size with the smallest footprint
+void CompressedMemory::layoutPage(Address page, PageInfo& pi) {
+    uint16_t sizes[64];
+    for (uint32_t i = 0; i < pageLines; i++) sizes[i] = lineBytes((page << pageLineBits) + i);
+
+    uint32_t pageSize = pageLines*lineSize;
+    pi.slotSize = lineSize;
+    pi.pageBytes = pageSize;
+    pi.exceptions = 0;
+    pi.excSlots = 0;
+    pi.excMask = 0;
+    uint32_t bestBytes = pageSize;
+    for (uint32_t slot = lineSize/4; slot < lineSize; slot *= 2) {
+        uint32_t excs = 0;
+        uint64_t mask = 0;
+        for (uint32_t i = 0; i < pageLines; i++) {
+            if (sizes[i] > slot) {
+                excs++;
+                mask |= 1ul << i;
+            }
+        }
+        uint32_t bytes = pageLines*slot + excs*lineSize;
+        if (bytes < bestBytes) {
+            bestBytes = bytes;
+            pi.slotSize = slot;
+            pi.exceptions = excs;
+            pi.excMask = mask;
+        }
+    }
+
+    if (pi.slotSize < lineSize) {
+        uint32_t sizeClass = pageSize/8;
+        while (sizeClass < bestBytes) sizeClass *= 2;
+        pi.pageBytes = sizeClass;
+        pi.excSlots = (sizeClass - pageLines*pi.slotSize)/lineSize;
+        assert(pi.excSlots >= pi.exceptions);
+    }
+}
+
+Address CompressedMemory::dramLineAddr(Address page, const PageInfo& pi, uint32_t idx) const {
+    Address base = page << pageLineBits;
+    if (pi.excMask & (1ul << idx)) {
+        // Exceptions follow the slots, in line order
+        uint32_t excIdx = __builtin_popcountl(pi.excMask & ((1ul << idx) - 1));
+        return base + (pageLines*pi.slotSize)/lineSize + excIdx;
+    } else {
+        return base + (idx*pi.slotSize)/lineSize;
+    }
+}
+
+bool CompressedMemory::mdLookup(Address page, bool write) {
+    MetadataEntry* set = &mdCache[(page % mdSets)*mdWays];
+    MetadataEntry* victim = &set[0];
+    for (uint32_t w = 0; w < mdWays; w++) {
+        if (set[w].page == page) {
+            set[w].lastUse = ++mdTimestamp;
+            set[w].dirty |= write;
+            return true;
+        }
+        if (set[w].lastUse < victim->lastUse) victim = &set[w];
+    }
+    if (victim->page != (Address)-1L && victim->dirty) profMdWritebacks.inc();
+    victim->page = page;
+    victim->lastUse = ++mdTimestamp;
+    victim->dirty = write;
+    return false;
+}
+
+bool CompressedMemory::burstLookup(Address dramLine) {
+    for (Address a : burstBuffer) {
+        if (a == dramLine) return true;
+    }
+    return false;
+}
+
+void CompressedMemory::burstInvalidate(Address dramLine) {
+    for (Address& a : burstBuffer) {
+        if (a == dramLine) a = (Address)-1L;
+    }
+}
+
+uint64_t CompressedMemory::access(MemReq& req) {
+    if (req.type == PUTS) return mem->access(req);  // no data, nothing to resize
+
+    Address lineAddr = req.lineAddr;
+    uint64_t reqCycle = req.cycle;
+    Address page = lineAddr >> pageLineBits;
+    uint32_t idx = lineAddr & (pageLines - 1);
+    bool write = (req.type == PUTX);
+
+    futex_lock(&lock);
+    auto it = pages.find(page);
+    if (it == pages.end()) {
+        PageInfo pi;
+        layoutPage(page, pi);
+        it = pages.insert(std::make_pair(page, pi)).first;
+        compressedBytes += pi.pageBytes;
+        profPages.inc();
+    }
+    PageInfo& pi = it->second;
+    bool mdHit = mdLookup(page, write);
+
+    if (write) {
+        profWrites.inc();
+        uint64_t bit = 1ul << idx;
+        if (pi.slotSize < lineSize && !(pi.excMask & bit) && lineBytes(lineAddr) > pi.slotSize) {
+            if (pi.exceptions < pi.excSlots) {
+                pi.exceptions++;
+                pi.excMask |= bit;
+                profExceptions.inc();
+            } else {
+                // Overflow: the page needs a larger size class
+                compressedBytes -= pi.pageBytes;
+                layoutPage(page, pi);
+                compressedBytes += pi.pageBytes;
+                profRelayouts.inc();
+                profRelayoutLines.inc(2*pageLines);
+                for (Address& a : burstBuffer) a = (Address)-1L;
+            }
+        }
+    } else {
+        profReads.inc();
+    }
+
+    Address dramLine = dramLineAddr(page, pi, idx);
+    bool burstHit = false;
+    if (write) {
+        burstInvalidate(dramLine);
+    } else if (burstBufferEntries && pi.slotSize < lineSize && !(pi.excMask & (1ul << idx))) {
+        // Compressed lines share DRAM lines; keep the burst for neighbors
+        burstHit = burstLookup(dramLine);
+        if (!burstHit) {
+            burstBuffer[burstBufferPos] = dramLine;
+            burstBufferPos = (burstBufferPos + 1) % burstBufferEntries;
+        }
+    }
+    futex_unlock(&lock);
+
+    if (burstHit) {
+        profBurstHits.inc();
+        *req.state = (req.type == GETX)? M : req.is(MemReq::NOEXCL)? S : E;
+        return reqCycle + burstBufferLatency;
+    }
+
+    if (mdHit) {
+        profMdHits.inc();
+    } else {
+        profMdMisses.inc();
+    }
+
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    TimingRecord mdRecord;
+    mdRecord.clear();
+    uint64_t dataCycle = reqCycle;
+    if (!mdHit) {
+        // Fetch metadata first; the data address depends on it
+        MESIState dummyState = I;
+        MemReq mdReq = {METADATA_REGION + page, GETS, req.childId, &dummyState, reqCycle, req.childLock, I, req.srcId, 0};
+        dataCycle = mem->access(mdReq);
+        if (evRec && evRec->hasRecord()) mdRecord = evRec->popRecord();
+    }
+
+    req.lineAddr = dramLine;
+    req.cycle = dataCycle;
+    uint64_t respCycle = mem->access(req);
+    req.lineAddr = lineAddr;
+    req.cycle = reqCycle;
+
+    if (mdRecord.isValid()) {
+        // Chain metadata and data accesses into a single record
+        TimingRecord tr = {lineAddr, reqCycle, respCycle, req.type, mdRecord.startEvent, nullptr};
+        if (evRec->hasRecord()) {
+            TimingRecord dataRecord = evRec->popRecord();
+            assert(dataRecord.reqCycle >= mdRecord.respCycle);
+            if (dataRecord.reqCycle > mdRecord.respCycle) {
+                DelayEvent* dEv = new (evRec) DelayEvent(dataRecord.reqCycle - mdRecord.respCycle);
+                dEv->setMinStartCycle(mdRecord.respCycle);
+                mdRecord.endEvent->addChild(dEv, evRec)->addChild(dataRecord.startEvent, evRec);
+            } else {
+                mdRecord.endEvent->addChild(dataRecord.startEvent, evRec);
+            }
+            tr.endEvent = dataRecord.endEvent;
+        } else if (respCycle > mdRecord.respCycle) {
+            DelayEvent* dEv = new (evRec) DelayEvent(respCycle - mdRecord.respCycle);
+            dEv->setMinStartCycle(mdRecord.respCycle);
+            mdRecord.endEvent->addChild(dEv, evRec);
+            tr.endEvent = dEv;
+        } else {
+            tr.endEvent = mdRecord.endEvent;
+        }
+        evRec->pushRecord(tr);
+    }
+    return respCycle;
+}
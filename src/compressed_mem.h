@@ -0,0 +1,98 @@
+#ifndef COMPRESSED_MEM_H_
+#define COMPRESSED_MEM_H_
+
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "line_kernels.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+/* Main-memory compression in the style of Linearly Compressed Pages (LCP,
+ * Pekhimenko et al., MICRO 2013), between the LLC and a memory controller.
+ *
+ * Each page is compressed on first touch: every line is sized with the BDI
+ * kernel, and the page picks the slot size (a quarter or half line, or
+ * uncompressed) that minimizes its footprint. Lines that do not fit their
+ * slot are exceptions, stored uncompressed after the slots. The page takes
+ * the smallest size class (1/8, 1/4, 1/2, or a full page) that holds it, and
+ * any space left over in the class holds future exceptions.
+ *
+ * Line i of a page lives at the page's base plus i*slot bytes, so with small
+ * slots several lines share one DRAM line: a read brings the whole DRAM line
+ * into a small burst buffer, and later reads of its neighbors are served from
+ * there (bandwidth savings). Per-page metadata (slot size, exceptions) is kept
+ * in a set-associative metadata cache; a miss reads the page's metadata from
+ * memory before the data access.
+ *
+ * Writebacks resize their line. A line that outgrows its slot becomes an
+ * exception if the page has room; otherwise the page overflows and is laid
+ * out again, which reads and writes the whole page. Re-layout traffic and
+ * metadata writebacks are counted, not simulated, as they are off the
+ * critical path of any core's request.
+ */
+class CompressedMemory : public MemObject {
+    private:
+        struct PageInfo {
+            uint16_t slotSize;   // bytes per line; lineSize if the page is uncompressed
+            uint16_t pageBytes;  // size class
+            uint16_t exceptions;
+            uint16_t excSlots;   // exceptions that fit in the size class
+            uint64_t excMask;    // lines stored as exceptions
+        };
+
+        struct MetadataEntry {
+            Address page;
+            uint64_t lastUse;
+            bool dirty;
+        };
+
+        MemObject* const mem;
+        const uint32_t lineSize;
+        uint16_t (*bdiCompressFn)(const DataLine data);  // LineKernelsImpl<lineSize>::bdiCompress
+        const uint32_t pageLines;
+        const uint32_t pageLineBits;
+        const uint32_t mdSets, mdWays;
+        const uint32_t burstBufferEntries;
+        const uint32_t burstBufferLatency;
+        const g_string name;
+
+        g_unordered_map<Address, PageInfo> pages;
+        g_vector<MetadataEntry> mdCache;
+        uint64_t mdTimestamp;
+        g_vector<Address> burstBuffer;  // DRAM lines, FIFO
+        uint32_t burstBufferPos;
+        uint64_t compressedBytes;  // over all touched pages
+
+        lock_t lock;
+
+        PAD();
+        Counter profReads, profWrites;
+        Counter profMdHits, profMdMisses, profMdWritebacks;
+        Counter profBurstHits;
+        Counter profPages;
+        Counter profExceptions, profRelayouts, profRelayoutLines;
+        PAD();
+
+    public:
+        CompressedMemory(MemObject* _mem, uint32_t _lineSize, uint32_t _pageSize, uint32_t _mdEntries, uint32_t _mdWays,
+                uint32_t _burstBufferEntries, uint32_t _burstBufferLatency, g_string& _name);
+
+        uint64_t access(MemReq& req);
+
+        const char* getName() {return name.c_str();}
+
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        void layoutPage(Address page, PageInfo& pi);
+        uint16_t lineBytes(Address lineAddr);
+        Address dramLineAddr(Address page, const PageInfo& pi, uint32_t idx) const;
+        bool mdLookup(Address page, bool write);
+        bool burstLookup(Address dramLine);
+        void burstInvalidate(Address dramLine);
+};
+
+#endif  // COMPRESSED_MEM_H_
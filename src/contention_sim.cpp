@@ -25,7 +25,9 @@
 
 #include "contention_sim.h"
 #include <algorithm>
+#include <cxxabi.h>
 #include <queue>
+#include <sched.h>
 #include <sstream>
 #include <string>
 #include <typeinfo>
@@ -58,9 +60,13 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing, uint32_t _stealSlice, bool _profileEvents, bool _radixQueues) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    workStealing = _workStealing;
+    stealSlice = _stealSlice;
+    profileEvents = _profileEvents;
+    domainsDone = 0;
     threadsDone = 0;
     limit = 0;
     lastLimit = 0;
@@ -70,18 +76,34 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     simThreads = gm_calloc<SimThreadData>(numSimThreads);
 
     for (uint32_t i = 0; i < numDomains; i++) {
-        new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
+        new (&domains[i].pq) DomainPrioQueue();
+        domains[i].pq.setRadix(_radixQueues);
+#if RECORD_DOMAIN_PQ
+        std::stringstream ss;
+        ss << "pqops-" << i << ".trace";
+        FILE* trace = fopen(ss.str().c_str(), "w");
+        if (!trace) panic("Could not open %s", ss.str().c_str());
+        domains[i].pq.setTrace(trace);
+#endif
         domains[i].curCycle = 0;
-        futex_init(&domains[i].pqLock);
+        new (&domains[i].staged) MPSCStack<TimingEvent>();
+        domains[i].profCurEvent = nullptr;
+        for (uint32_t s = 0; s < PROF_CLASS_SLOTS; s++) domains[i].profClassSlots[s] = {nullptr, 0};
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    //With work stealing, the static assignment is only each thread's initial queue
+    if (!workStealing && (numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    if (workStealing && stealSlice == 0) panic("Work stealing needs a slice of at least 1 event");
 
     for (uint32_t i = 0; i < numSimThreads; i++) {
         futex_init(&simThreads[i].wakeLock);
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
         simThreads[i].firstDomain = i*numDomains/numSimThreads;
         simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
+        futex_init(&simThreads[i].queueLock);
+        simThreads[i].domQueue = workStealing? gm_calloc<uint32_t>(numDomains) : nullptr;
+        simThreads[i].queueHead = 0;
+        simThreads[i].queueSize = 0;
     }
 
     futex_init(&waitLock);
@@ -116,6 +138,47 @@ void ContentionSim::postInit() {
     skipContention = true;
 }
 
+/* Event classes broken out by the event profiler; anything else counts as Other.
+ * Names are matched without namespaces or template arguments.
+ */
+static const char* profiledEventClasses[] = {"HitEvent", "HitWritebackEvent", "MissStartEvent", "MissResponseEvent",
+    "MissWritebackEvent", "ReplAccessEvent", "DelayEvent", "CrossingEvent", "CrossingSrcEvent", "TickEvent",
+    "TimingCoreEvent", "OOOIssueEvent", "OOODispatchEvent", "OOORespEvent", "DDRMemoryAccEvent", "RefreshEvent",
+    "SchedEvent", "WeaveMemAccEvent", "DRAMSimAccEvent", "MemAccessEventBase", "MeshTraversalEvent", "Other"};
+#define NUM_PROFILED_EVENT_CLASSES (sizeof(profiledEventClasses)/sizeof(const char*))
+
+uint32_t ContentionSim::classifyEvent(const std::type_info* ti) {
+    int status;
+    char* demangled = abi::__cxa_demangle(ti->name(), nullptr, nullptr, &status);
+    std::string name = (status == 0)? demangled : ti->name();
+    free(demangled);
+    name = name.substr(0, name.find('<'));
+    std::string::size_type nsEnd = name.rfind("::");
+    if (nsEnd != std::string::npos) name = name.substr(nsEnd + 2);
+
+    uint32_t cls = NUM_PROFILED_EVENT_CLASSES - 1;
+    for (uint32_t i = 0; i < NUM_PROFILED_EVENT_CLASSES - 1; i++) {
+        if (name == profiledEventClasses[i]) cls = i;
+    }
+    return cls;
+}
+
+uint32_t ContentionSim::eventClass(DomainData& domain, TimingEvent* te) {
+    const std::type_info* ti = &typeid(*te);
+    uint32_t slot = (((uintptr_t)ti) >> 4) & (PROF_CLASS_SLOTS - 1);
+    for (uint32_t probes = 0; probes < PROF_CLASS_SLOTS; probes++) {
+        ProfClassSlot& s = domain.profClassSlots[slot];
+        if (s.ti == ti) return s.cls;
+        if (!s.ti) { //first time this domain sees this class
+            s.ti = ti;
+            s.cls = classifyEvent(ti);
+            return s.cls;
+        }
+        slot = (slot + 1) & (PROF_CLASS_SLOTS - 1);
+    }
+    return classifyEvent(ti); //table full, slow but correct
+}
+
 void ContentionSim::initStats(AggregateStat* parentStat) {
     AggregateStat* objStat = new AggregateStat(false);
     objStat->init("contention", "Contention simulation stats");
@@ -138,8 +201,36 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
+        if (profileEvents) {
+            new (&domains[i].profEvSims) VectorCounter();
+            new (&domains[i].profEvRequeues) VectorCounter();
+            new (&domains[i].profEvNs) VectorCounter();
+            domains[i].profEvSims.init("evSims", "Events simulated, by class", NUM_PROFILED_EVENT_CLASSES, profiledEventClasses);
+            domains[i].profEvRequeues.init("evRequeues", "Events that requeued themselves, by class", NUM_PROFILED_EVENT_CLASSES, profiledEventClasses);
+            domains[i].profEvNs.init("evNs", "Host ns spent simulating events, by class", NUM_PROFILED_EVENT_CLASSES, profiledEventClasses);
+            domStat->append(&domains[i].profEvSims);
+            domStat->append(&domains[i].profEvRequeues);
+            domStat->append(&domains[i].profEvNs);
+        }
         objStat->append(domStat);
     }
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        std::stringstream ss;
+        ss << "thread-" << i;
+        AggregateStat* thStat = new AggregateStat();
+        thStat->init(gm_strdup(ss.str().c_str()), "Weave thread stats");
+        SimThreadData& th = simThreads[i];
+        new (&th.profBusy) ClockStat();
+        new (&th.profIdle) Counter();
+        new (&th.profSteals) Counter();
+        th.profBusy.init("busy", "Weave time spent simulating domains (ns)");
+        th.profIdle.init("idle", "Weave time spent waiting for work or for other threads (ns)");
+        th.profSteals.init("steals", "Domains taken from other threads' queues");
+        thStat->append(&th.profBusy);
+        thStat->append(&th.profIdle);
+        thStat->append(&th.profSteals);
+        objStat->append(thStat);
+    }
     parentStat->append(objStat);
 }
 
@@ -157,6 +248,17 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    if (workStealing) {
+        //Every thread starts the phase with its statically assigned domains
+        domainsDone = 0;
+        for (uint32_t i = 0; i < numSimThreads; i++) {
+            SimThreadData& th = simThreads[i];
+            th.queueHead = 0;
+            th.queueSize = 0;
+            for (uint32_t d = th.firstDomain; d < th.supDomain; d++) th.domQueue[th.queueSize++] = d;
+        }
+    }
+
     inCSim = true;
     __sync_synchronize();
 
@@ -168,6 +270,12 @@ void ContentionSim::simulatePhase(uint64_t limit) {
     //Sleep until phase is simulated
     futex_lock_nospin(&waitLock);
 
+    //Threads that finished early waited for the slowest one
+    uint64_t phaseEndNs = getNs();
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        simThreads[i].profIdle.inc(phaseEndNs - simThreads[i].phaseDoneNs);
+    }
+
     inCSim = false;
     __sync_synchronize();
 
@@ -195,25 +303,33 @@ void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     assert(ev->domain != -1);
     assert(ev->domain < (int32_t)numDomains);
 
-    domains[ev->domain].pq.enqueue(ev, cycle);
+    DomainData& domain = domains[ev->domain];
+    if (profileEvents && ev == domain.profCurEvent) domain.profEvRequeues.inc(domain.profCurClass);
+    domain.pq.enqueue(ev, cycle);
 }
 
 void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
     assert(!inCSim);
     assert(ev && ev->domain != -1);
     assert(ev->domain < (int32_t)numDomains);
-    uint32_t domain = ev->domain;
-
-    futex_lock(&domains[domain].pqLock);
 
     assert_msg(cycle >= lastLimit, "Enqueued (synced) event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
     assert_msg(cycle < lastLimit+10*zinfo->phaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
     ev->privCycle = cycle;
     assert(ev->numParents == 0);
-    domains[ev->domain].pq.enqueue(ev, cycle);
+    //Bound-phase threads enqueue concurrently; staging avoids serializing them on the domain's pq
+    domains[ev->domain].staged.push(ev);
+}
 
-    futex_unlock(&domains[domain].pqLock);
+void ContentionSim::drainStaged(DomainData& domain) {
+    TimingEvent* ev = domain.staged.takeAll();
+    while (ev) {
+        TimingEvent* next = ev->next;
+        ev->next = nullptr;
+        domain.pq.enqueue(ev, ev->privCycle);
+        ev = next;
+    }
 }
 
 void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
@@ -276,7 +392,14 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         }
 
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        if (workStealing) {
+            simulatePhaseStealing(thid);
+        } else {
+            simThreads[thid].profBusy.start();
+            simulatePhaseThread(thid);
+            simThreads[thid].profBusy.end();
+        }
+        simThreads[thid].phaseDoneNs = getNs();
         //info("%d --- phase end", domain);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
@@ -292,10 +415,14 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
     uint32_t numFinished = 0;
 
+    //Each domain's staged events are drained here, by the thread that owns the domain, so
+    //domains owned by different threads drain in parallel
+
     if (thDomains == 1) {
         DomainData& domain = domains[simThreads[thid].firstDomain];
         domain.profTime.start();
-        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
+        drainStaged(domain);
+        DomainPrioQueue& pq = domain.pq;
         while (pq.size() && pq.firstCycle() < limit) {
             uint64_t domCycle = domain.curCycle;
             uint64_t cycle;
@@ -305,7 +432,9 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                 domCycle = cycle;
                 domain.curCycle = cycle;
             }
+            if (profileEvents) profileEventStart(domain, te);
             te->run(cycle);
+            if (profileEvents) profileEventEnd(domain);
             uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
             assert(newCycle >= domCycle);
             if (newCycle != domCycle) domain.curCycle = newCycle;
@@ -350,7 +479,12 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
 
         std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
         for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) {
-            domPq.push(&domains[i]);
+            DomainData& domain = domains[i];
+            if (!domain.staged.empty()) {
+                drainStaged(domain);
+                domain.queuePrio = domain.pq.firstCycle(); //staged events may come before the domain's last prio
+            }
+            domPq.push(&domain);
         }
 
         std::vector<DomainData*> sq1;
@@ -363,7 +497,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
             while (domPq.size()) {
                 DomainData* domain = domPq.top();
                 domPq.pop();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+                DomainPrioQueue& pq = domain->pq;
                 if (!pq.size() || pq.firstCycle() > limit) {
                     numFinished++;
                     domain->curCycle = limit;
@@ -373,7 +507,9 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                     TimingEvent* te = pq.dequeue(cycle);
                     //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
                     if (cycle != domain->curCycle) domain->curCycle = cycle;
+                    if (profileEvents) profileEventStart(*domain, te);
                     te->run(cycle);
+                    if (profileEvents) profileEventEnd(*domain);
                     domain->curCycle = pq.size()? pq.firstCycle() : limit;
                     domain->queuePrio = domain->curCycle;
                     if (domain->prio == 0) domPq.push(domain);
@@ -384,7 +520,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
             while (stalledQueue.size()) {
                 DomainData* domain = stalledQueue.back();
                 stalledQueue.pop_back();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+                DomainPrioQueue& pq = domain->pq;
                 if (!pq.size() || pq.firstCycle() > limit) {
                     numFinished++;
                     domain->curCycle = limit;
@@ -394,7 +530,9 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                     TimingEvent* te = pq.dequeue(cycle);
                     if (cycle != domain->curCycle) domain->curCycle = cycle;
                     te->state = EV_RUNNING;
+                    if (profileEvents) profileEventStart(*domain, te);
                     te->simulate(cycle);
+                    if (profileEvents) profileEventEnd(*domain);
                     domain->curCycle = pq.size()? pq.firstCycle() : limit;
                     domain->queuePrio = domain->curCycle;
                     if (domain->prio == 0) domPq.push(domain);
@@ -410,6 +548,98 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     __sync_synchronize();
 }
 
+/* Work stealing: domains are handed out to threads in slices of up to
+ * stealSlice events. A thread runs domains from its own queue, and when that is
+ * empty, steals from the tail of other threads' queues. A domain is owned by
+ * at most one thread at a time (it is either in exactly one queue or being
+ * run), and queue locks order its hand-offs, so each domain still runs its
+ * events serially and in order. Crossings only depend on domains' curCycle,
+ * so they are unaffected by which thread runs each domain. A domain that stalls
+ * on a crossing is put back right away, so other threads can advance the domain
+ * it waits on. Events within a domain are never split across threads.
+ */
+
+void ContentionSim::pushDomain(uint32_t thid, uint32_t domain) {
+    SimThreadData& th = simThreads[thid];
+    futex_lock(&th.queueLock);
+    assert(th.queueSize < numDomains);
+    th.domQueue[(th.queueHead + th.queueSize) % numDomains] = domain;
+    th.queueSize++;
+    futex_unlock(&th.queueLock);
+}
+
+int32_t ContentionSim::popDomain(uint32_t thid, bool steal) {
+    SimThreadData& th = simThreads[thid];
+    if (!th.queueSize) return -1; //racy peek, avoids locking empty queues
+    int32_t domain = -1;
+    futex_lock(&th.queueLock);
+    if (th.queueSize) {
+        if (steal) {
+            domain = th.domQueue[(th.queueHead + th.queueSize - 1) % numDomains];
+        } else {
+            domain = th.domQueue[th.queueHead];
+            th.queueHead = (th.queueHead + 1) % numDomains;
+        }
+        th.queueSize--;
+    }
+    futex_unlock(&th.queueLock);
+    return domain;
+}
+
+bool ContentionSim::simulateDomainSlice(DomainData& domain) {
+    domain.profTime.start();
+    drainStaged(domain); //only the first slice of each phase finds staged events
+    DomainPrioQueue& pq = domain.pq;
+    uint32_t events = 0;
+    while (pq.size() && pq.firstCycle() < limit) {
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
+        assert(cycle >= domain.curCycle);
+        if (cycle != domain.curCycle) domain.curCycle = cycle;
+        if (profileEvents) profileEventStart(domain, te);
+        te->run(cycle);
+        if (profileEvents) profileEventEnd(domain);
+        domain.curCycle = pq.size()? pq.firstCycle() : limit;
+        if (++events == stealSlice || domain.prio != 0) { //slice over, or stalled on a crossing
+            domain.profTime.end();
+            return false;
+        }
+    }
+    domain.curCycle = limit;
+    domain.profTime.end();
+    return true;
+}
+
+void ContentionSim::simulatePhaseStealing(uint32_t thid) {
+    SimThreadData& th = simThreads[thid];
+    uint64_t idleStartNs = 0;
+    while (domainsDone < numDomains) {
+        int32_t domain = popDomain(thid, false);
+        for (uint32_t i = 1; domain == -1 && i < numSimThreads; i++) {
+            domain = popDomain((thid + i) % numSimThreads, true);
+            if (domain != -1) th.profSteals.inc();
+        }
+
+        if (domain == -1) {
+            if (!idleStartNs) idleStartNs = getNs();
+            sched_yield();
+            continue;
+        }
+        if (idleStartNs) {
+            th.profIdle.inc(getNs() - idleStartNs);
+            idleStartNs = 0;
+        }
+
+        th.profBusy.start();
+        bool finished = simulateDomainSlice(domains[domain]);
+        th.profBusy.end();
+        if (finished) __sync_fetch_and_add(&domainsDone, 1);
+        else pushDomain(thid, domain);
+    }
+    if (idleStartNs) th.profIdle.inc(getNs() - idleStartNs);
+    __sync_synchronize();
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
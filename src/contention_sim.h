@@ -28,12 +28,14 @@
 
 #include <functional>
 #include <stdint.h>
+#include <typeinfo>
 #include <vector>
 #include "bithacks.h"
 #include "event_recorder.h"
 #include "g_std/g_vector.h"
 #include "galloc.h"
 #include "memory_hierarchy.h"
+#include "mpsc_stack.h"
 #include "pad.h"
 #include "prio_queue.h"
 #include "profile_stats.h"
@@ -49,6 +51,22 @@ class CrossingEvent;
 
 #define PQ_BLOCKS 1024
 
+//Set to 1 to record each domain's event queue operations to pqops-<domain>.trace,
+//which pq_bench replays. Adds overhead.
+#define RECORD_DOMAIN_PQ 0
+//#define RECORD_DOMAIN_PQ 1
+
+//Domain event queues are PrioQueues (fixed blocks plus a map for far events) by
+//default, or RadixPrioQueues with sim.domainQueue = "Radix" (no horizon, better
+//for sparse domains with events scheduled far ahead, e.g., refreshes)
+typedef SelectablePrioQueue<TimingEvent, PQ_BLOCKS> DomainPrioQueueBase;
+
+#if RECORD_DOMAIN_PQ
+typedef RecordingPrioQueue<TimingEvent, DomainPrioQueueBase> DomainPrioQueue;
+#else
+typedef DomainPrioQueueBase DomainPrioQueue;
+#endif
+
 class ContentionSim : public GlobAlloc {
     private:
         struct CompareEvents : public std::binary_function<TimingEvent*, TimingEvent*, bool> {
@@ -62,13 +80,20 @@ class ContentionSim : public GlobAlloc {
 
         CrossingEventInfo* lastCrossing; //indexed by [srcId*doms*doms + srcDom*doms + dstDom]
 
+        //Event profiler memo, see eventClass(). Must exceed the number of event classes
+        #define PROF_CLASS_SLOTS 64
+        struct ProfClassSlot {
+            const std::type_info* ti;
+            uint32_t cls;
+        };
+
         struct DomainData : public GlobAlloc {
-            PrioQueue<TimingEvent, PQ_BLOCKS> pq;
+            DomainPrioQueue pq;
 
             PAD();
 
             volatile uint64_t curCycle;
-            lock_t pqLock; //used on phase 1 enqueues
+            MPSCStack<TimingEvent> staged; //phase 1 enqueues, moved to pq when the domain's weave phase starts
             //lock_t domainLock; //used by simulation thread
 
             uint32_t prio;
@@ -78,6 +103,15 @@ class ContentionSim : public GlobAlloc {
 
             ClockStat profTime;
 
+            //Event profiling (sim.profileWeaveEvents), per event class
+            TimingEvent* profCurEvent; //being simulated; if it enqueues itself, it is a requeue
+            uint32_t profCurClass;
+            uint64_t profStartNs;
+            ProfClassSlot profClassSlots[PROF_CLASS_SLOTS];
+            VectorCounter profEvSims;
+            VectorCounter profEvRequeues;
+            VectorCounter profEvNs;
+
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
             VectorCounter profIncomingCrossings;
@@ -95,6 +129,19 @@ class ContentionSim : public GlobAlloc {
             uint32_t supDomain; //supreme, ie first not included
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
+
+            //Work stealing: runnable domains owned by this thread. The owner pops
+            //from the head, thieves from the tail. Each domain is in at most one queue.
+            lock_t queueLock;
+            uint32_t* domQueue; //ring of numDomains entries
+            uint32_t queueHead;
+            uint32_t queueSize;
+
+            volatile uint64_t phaseDoneNs; //when this thread ran out of work in the current phase
+
+            ClockStat profBusy;
+            Counter profIdle;
+            Counter profSteals;
         };
 
         //RO
@@ -106,6 +153,9 @@ class ContentionSim : public GlobAlloc {
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool workStealing;
+        bool profileEvents;
+        uint32_t stealSlice; //max events a thread runs on a domain before putting it back in its queue
 
         PAD();
 
@@ -120,13 +170,15 @@ class ContentionSim : public GlobAlloc {
 
         volatile bool inCSim; //true when inside contention simulation
 
+        volatile uint32_t domainsDone; //work stealing: domains that reached the limit this phase
+
         PAD();
 
         //lock_t testLock;
         lock_t postMortemLock;
 
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing, uint32_t _stealSlice, bool _profileEvents, bool _radixQueues);
 
         void initStats(AggregateStat* parentStat);
 
@@ -162,6 +214,32 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void drainStaged(DomainData& domain);
+
+        //Event profiling
+        static uint32_t classifyEvent(const std::type_info* ti);
+
+        // Class index of te. Each domain memoizes the classes it has seen in a small open-addressed
+        // table keyed by type_info, so only the first event of each class pays for classifyEvent()
+        uint32_t eventClass(DomainData& domain, TimingEvent* te);
+
+        inline void profileEventStart(DomainData& domain, TimingEvent* te) {
+            domain.profCurEvent = te;
+            domain.profCurClass = eventClass(domain, te);
+            domain.profStartNs = getNs();
+        }
+
+        inline void profileEventEnd(DomainData& domain) {
+            domain.profEvSims.inc(domain.profCurClass);
+            domain.profEvNs.inc(domain.profCurClass, getNs() - domain.profStartNs);
+            domain.profCurEvent = nullptr;
+        }
+
+        //Work stealing
+        void simulatePhaseStealing(uint32_t thid);
+        bool simulateDomainSlice(DomainData& domain); //returns true if the domain reached the limit
+        void pushDomain(uint32_t thid, uint32_t domain);
+        int32_t popDomain(uint32_t thid, bool steal);
 
         static void SimThreadTrampoline(void* arg);
 };
@@ -50,7 +50,9 @@ struct InstrFuncPtrs {  // NOLINT(whitespace)
     void (*predLoadPtr)(THREADID, ADDRINT, BOOL);
     void (*predStorePtr)(THREADID, ADDRINT, BOOL);
     uint64_t type;
-    uint64_t pad[1];
+    // Load that also gets the PC (addr, pc). Only instrumented when an IP-indexed prefetcher needs
+    // it (zinfo->loadPcs), for both plain and executing predicated loads
+    void (*loadPcPtr)(THREADID, ADDRINT, ADDRINT);
     //NOTE: By having the struct be a power of 2 bytes, indirect calls are simpler (w/ gcc 4.4 -O3, 6->5 instructions, and those instructions are simpler)
 };
 
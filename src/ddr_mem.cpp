@@ -93,13 +93,14 @@ class RefreshEvent : public TimingEvent, public GlobAlloc {
 class SchedEvent : public TimingEvent, public GlobAlloc {
     private:
         DDRMemory* const mem;
+        const uint32_t channel;
         enum State { IDLE, QUEUED, RUNNING, ANNULLED };
         State state;
 
     public:
         SchedEvent* next;  // for event freelist
 
-        SchedEvent(DDRMemory* _mem, int32_t domain) : TimingEvent(0, 0, domain), mem(_mem) {
+        SchedEvent(DDRMemory* _mem, uint32_t _channel, int32_t domain) : TimingEvent(0, 0, domain), mem(_mem), channel(_channel) {
             setMinStartCycle(0);
             setRunning();
             hold();
@@ -114,20 +115,20 @@ class SchedEvent : public TimingEvent, public GlobAlloc {
         void simulate(uint64_t startCycle) {
             if (state == QUEUED) {
                 state = RUNNING;
-                uint64_t nextCycle = mem->tick(startCycle);
+                uint64_t nextCycle = mem->tick(channel, startCycle);
                 if (nextCycle) {
                     requeue(nextCycle);
                     state = QUEUED;
                 } else {
                     state = IDLE;
                     hold();
-                    mem->recycleEvent(this);
+                    mem->recycleEvent(channel, this);
                 }
             } else {
                 assert(state == ANNULLED);
                 state = IDLE;
                 hold();
-                mem->recycleEvent(this);
+                mem->recycleEvent(channel, this);
             }
         }
 
@@ -153,8 +154,8 @@ class SchedEvent : public TimingEvent, public GlobAlloc {
 DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
         uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
         uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-        uint32_t _domain, g_string& _name)
-    : lineSize(_lineSize), ranksPerChannel(_ranksPerChannel), banksPerRank(_banksPerRank),
+        uint32_t _domain, g_string& _name, uint32_t _numChannels, const char* _addrHash)
+    : lineSize(_lineSize), ranksPerChannel(_ranksPerChannel), banksPerRank(_banksPerRank), numChannels(_numChannels),
       controllerSysLatency(_controllerSysLatency), queueDepth(_queueDepth), rowHitLimit(_rowHitLimit),
       deferredWrites(_deferredWrites), closedPage(_closedPage), domain(_domain), name(_name)
 {
@@ -171,36 +172,54 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     postDelayRd = minRdLatency - preDelay;
     postDelayWr = 0;
 
-    rdQueue.init(queueDepth);
-    wrQueue.init(queueDepth);
+    if (!numChannels || !isPow2(numChannels)) panic("%s: channels (%d) must be a power of 2", name.c_str(), numChannels);
+    if (!isPow2(ranksPerChannel) || !isPow2(banksPerRank)) panic("%s: ranksPerChannel and banksPerRank must be powers of 2", name.c_str());
 
-    info("%s: domain %d, %d ranks/ch %d banks/rank, tech %s, boundLat %d rd / %d wr",
-            name.c_str(), domain, ranksPerChannel, banksPerRank, tech, minRdLatency, minWrLatency);
+    info("%s: domain %d, %d channels, %d ranks/ch %d banks/rank, tech %s, boundLat %d rd / %d wr",
+            name.c_str(), domain, numChannels, ranksPerChannel, banksPerRank, tech, minRdLatency, minWrLatency);
 
-    minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
+    channels.resize(numChannels);
+    for (Channel& chan : channels) {
+        chan.minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
+        chan.lastCmdWasWrite = false;
+        chan.curArrivalSeq = 0;
 
-    banks.resize(ranksPerChannel);
-    for (uint32_t i = 0; i < ranksPerChannel; i++) banks[i].resize(banksPerRank);
+        chan.rdQueue.init(queueDepth);
+        chan.wrQueue.init(queueDepth);
 
-    rankActWindows.resize(ranksPerChannel);
-    for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
+        chan.banks.resize(ranksPerChannel);
+        for (uint32_t i = 0; i < ranksPerChannel; i++) chan.banks[i].resize(banksPerRank);
+
+        chan.rankActWindows.resize(ranksPerChannel);
+        for (uint32_t i = 0; i < ranksPerChannel; i++) chan.rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
+
+        chan.nextSchedCycle = -1ul;
+        chan.nextSchedEvent = nullptr;
+        chan.eventFreelist = nullptr;
+    }
 
     // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page
     uint32_t colBits = ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
-    uint32_t bankBits = ilog2(banksPerRank);
-    uint32_t rankBits = ilog2(ranksPerChannel);
+    bankBits = ilog2(banksPerRank);
+    rankBits = ilog2(ranksPerChannel);
+    channelBits = ilog2(numChannels);
 
-    // Parse config string, has to be some combination of rank, bank, and col separated by semicolons
+    // Parse config string, has to be some combination of rank, bank, col, and (optionally) channel separated by colons
     // (row is always MSB bits, since we don't actually know how many bits it is to begin with...)
+    // If channel is not given, it takes the lowest bits, interleaving lines across channels (as SplitAddrMemory does)
     std::vector<std::string> tokens;
     Tokenize(addrMapping, tokens, ":");
-    if (tokens.size() != 3) panic("Invalid addrMapping %s, need all row/col/rank tokens separated by colons", addrMapping);
+    if (tokens.size() == 3) tokens.push_back("channel");
+    if (tokens.size() != 4) panic("Invalid addrMapping %s, need all col/rank/bank tokens (and optionally channel) separated by colons", addrMapping);
     std::reverse(tokens.begin(), tokens.end()); // want lowest bits first
 
-    colMask = rankMask = bankMask = 0;
+    colMask = rankMask = bankMask = channelMask = 0;
+    colShift = rankShift = bankShift = channelShift = 0;
     uint32_t startBit = 0;
-    auto computeShiftAndMask = [&startBit, addrMapping](const std::string& field, const uint32_t fieldBits, uint32_t& shift, uint32_t& mask) {
-        if (mask) panic("Repeated field %s in addrMapping %s", field.c_str(), addrMapping);
+    std::vector<std::string> seen;
+    auto computeShiftAndMask = [&startBit, &seen, addrMapping](const std::string& field, const uint32_t fieldBits, uint32_t& shift, uint32_t& mask) {
+        if (std::find(seen.begin(), seen.end(), field) != seen.end()) panic("Repeated field %s in addrMapping %s", field.c_str(), addrMapping);
+        seen.push_back(field);
         shift = startBit;
         mask = (1 << fieldBits) - 1;
         startBit += fieldBits;
@@ -209,20 +228,24 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
         if (t == "col")       computeShiftAndMask(t, colBits,  colShift,  colMask);
         else if (t == "rank") computeShiftAndMask(t, rankBits, rankShift, rankMask);
         else if (t == "bank") computeShiftAndMask(t, bankBits, bankShift, bankMask);
-        else panic("Invalid token %s in addrMapping %s (only row/col/rank)", t.c_str(), addrMapping);
+        else if (t == "channel") computeShiftAndMask(t, channelBits, channelShift, channelMask);
+        else panic("Invalid token %s in addrMapping %s (only col/rank/bank/channel)", t.c_str(), addrMapping);
     }
     rowShift = startBit;  // row has no mask
 
-    info("%s: Address mapping %s row %d:%ld col %d:%d rank %d:%d bank %d:%d",
-            name.c_str(), addrMapping, 63, rowShift, ilog2(colMask << colShift), colShift,
-            ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift);
+    std::string hash(_addrHash);
+    if (hash == "None") addrHash = HASH_NONE;
+    else if (hash == "Permutation") addrHash = HASH_PERMUTATION;
+    else if (hash == "XOR") addrHash = HASH_XOR;
+    else panic("%s: Invalid addrHash %s (None, Permutation, or XOR)", name.c_str(), _addrHash);
+
+    info("%s: Address mapping %s (hash %s) row %d:%ld col %d:%d rank %d:%d bank %d:%d channel %d:%d",
+            name.c_str(), addrMapping, _addrHash, 63, rowShift, ilog2(colMask << colShift), colShift,
+            ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift,
+            ilog2(channelMask << channelShift), channelShift);
 
     // Weave phase events
     new RefreshEvent(this, memToSysCycle(tREFI), domain);
-
-    nextSchedCycle = -1ul;
-    nextSchedEvent = nullptr;
-    eventFreelist = nullptr;
 }
 
 void DDRMemory::initStats(AggregateStat* parentStat) {
@@ -235,6 +258,11 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
     latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); memStats->append(&latencyHist);
+    if (numChannels > 1) {
+        profChReads.init("chRd", "Read requests per channel", numChannels); memStats->append(&profChReads);
+        profChWrites.init("chWr", "Write requests per channel", numChannels); memStats->append(&profChWrites);
+        profChBusCycles.init("chBusCycles", "Data bus busy memory cycles per channel", numChannels); memStats->append(&profChBusCycles);
+    }
     parentStat->append(memStats);
 }
 
@@ -277,20 +305,58 @@ uint64_t DDRMemory::access(MemReq& req) {
 
 /* Weave phase functionality */
 
+// XORs all bits of val, in chunks of bits, into a bits-wide value
+static inline uint32_t xorFold(uint64_t val, uint32_t bits) {
+    if (!bits) return 0;
+    uint64_t mask = (1ul << bits) - 1;
+    uint32_t res = 0;
+    while (val) {
+        res ^= val & mask;
+        val >>= bits;
+    }
+    return res;
+}
+
 //Address mapping:
-// For now, row:col:bank:rank:channel for max parallelism (same as scheme7 from DRAMSim)
-// NOTE: channel is external (from SplitAddrMem)
-// Change or reorder to define your own mappings
+// By default, row:rank:col:bank:channel (channel is lowest, so consecutive lines go to different channels)
+// Change or reorder addrMapping to define your own mappings
+// Hashing XORs the row bits into the bank, rank, and channel fields. Rows that
+// would conflict in the same bank (e.g., strided streams whose stride is a
+// multiple of the row size) then spread across banks and channels. Hashing
+// never changes the row or col, so the mapping stays one-to-one.
 DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
     AddrLoc l;
     l.col  = (lineAddr >> colShift)  & colMask;
     l.rank = (lineAddr >> rankShift) & rankMask;
     l.bank = (lineAddr >> bankShift) & bankMask;
+    l.channel = (lineAddr >> channelShift) & channelMask;
     l.row  = lineAddr >> rowShift;
 
-    //info("0x%lx r%ld:c%d b%d:r%d", lineAddr, l.row, l.col, l.bank, l.rank);
+    switch (addrHash) {
+        case HASH_NONE:
+            break;
+        case HASH_PERMUTATION:
+            {
+                // Permutation-based interleaving (Zhang et al., MICRO 2000), extended to ranks and channels
+                uint64_t rowBits = l.row;
+                l.bank ^= rowBits & bankMask;
+                rowBits >>= bankBits;
+                l.rank ^= rowBits & rankMask;
+                rowBits >>= rankBits;
+                l.channel ^= rowBits & channelMask;
+            }
+            break;
+        case HASH_XOR:
+            l.bank ^= xorFold(l.row, bankBits);
+            l.rank ^= xorFold(l.row, rankBits);
+            l.channel ^= xorFold(lineAddr >> (channelShift + channelBits), channelBits);
+            break;
+    }
+
+    //info("0x%lx r%ld:c%d b%d:r%d ch%d", lineAddr, l.row, l.col, l.bank, l.rank, l.channel);
     assert(l.rank < ranksPerChannel);
     assert(l.bank < banksPerRank);
+    assert(l.channel < numChannels);
 
     return l;
 }
@@ -299,14 +365,17 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
     DEBUG("%ld: enqueue() addr 0x%lx wr %d", memCycle, ev->getAddr(), ev->isWrite());
 
+    AddrLoc loc = mapLineAddr(ev->getAddr());
+    Channel& chan = channels[loc.channel];
+
     // Create request
     Request ovfReq;
-    bool overflow = rdQueue.full() || wrQueue.full();
+    bool overflow = chan.rdQueue.full() || chan.wrQueue.full();
     bool useWrQueue = deferredWrites && ev->isWrite();
-    Request* req = overflow? &ovfReq : useWrQueue? wrQueue.alloc() : rdQueue.alloc();
+    Request* req = overflow? &ovfReq : useWrQueue? chan.wrQueue.alloc() : chan.rdQueue.alloc();
 
     req->addr = ev->getAddr();
-    req->loc = mapLineAddr(ev->getAddr());
+    req->loc = loc;
     req->write = ev->isWrite();
 
     req->arrivalCycle = memCycle;
@@ -316,35 +385,35 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     ev->hold();
 
     if (overflow) {
-        overflowQueue.push_back(*req);
+        chan.overflowQueue.push_back(*req);
     } else {
-        queue(req, memCycle);
+        queue(chan, req, memCycle);
 
         // If needed, schedule an event to handle this new request
         if (!req->prev /* first in bank */) {
-            uint64_t minSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL);
-            if (nextSchedCycle > minSchedCycle) minSchedCycle = std::max(minSchedCycle, findMinCmdCycle(*req));
-            if (nextSchedCycle > minSchedCycle) {
-                if (nextSchedEvent) nextSchedEvent->annul();
-                if (eventFreelist) {
-                    nextSchedEvent = eventFreelist;
-                    eventFreelist = eventFreelist->next;
-                    nextSchedEvent->next = nullptr;
+            uint64_t minSchedCycle = std::max(memCycle, chan.minRespCycle - tCL - tBL);
+            if (chan.nextSchedCycle > minSchedCycle) minSchedCycle = std::max(minSchedCycle, findMinCmdCycle(chan, *req));
+            if (chan.nextSchedCycle > minSchedCycle) {
+                if (chan.nextSchedEvent) chan.nextSchedEvent->annul();
+                if (chan.eventFreelist) {
+                    chan.nextSchedEvent = chan.eventFreelist;
+                    chan.eventFreelist = chan.eventFreelist->next;
+                    chan.nextSchedEvent->next = nullptr;
                 } else {
-                    nextSchedEvent = new SchedEvent(this, domain);
+                    chan.nextSchedEvent = new SchedEvent(this, loc.channel, domain);
                 }
                 DEBUG("queued %ld", minSchedCycle);
 
                 // Under memFreq < sysFreq/2, sysToMemCycle translates back to the same memCycle
                 uint64_t enqSysCycle = std::max(matchingMemToSysCycle(minSchedCycle), sysCycle);
-                nextSchedEvent->enqueue(enqSysCycle);
-                nextSchedCycle = minSchedCycle;
+                chan.nextSchedEvent->enqueue(enqSysCycle);
+                chan.nextSchedCycle = minSchedCycle;
             }
         }
     }
 }
 
-void DDRMemory::queue(Request* req, uint64_t memCycle) {
+void DDRMemory::queue(Channel& chan, Request* req, uint64_t memCycle) {
     // If it's a write, respond to it immediately
     if (req->write) {
         auto ev = req->ev;
@@ -356,19 +425,23 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
     }
 
     req->arrivalCycle = memCycle;  // if this comes from the overflow queue, update
+    req->arrivalSeq = chan.curArrivalSeq++;
 
     // Test: Skip writes
 #if 0
     if (req->write) {
-        assert(wrQueue.size() == 1);
-        wrQueue.remove(wrQueue.begin());
+        assert(chan.wrQueue.size() == 1);
+        chan.wrQueue.remove(chan.wrQueue.begin());
         return;
     }
 #endif
 
     // Alloc in per-bank queue, in FR order
-    Bank& bank = banks[req->loc.rank][req->loc.bank];
-    InList<Request>& q = (deferredWrites && req->write)? bank.wrReqs : bank.rdReqs;
+    Bank& bank = chan.banks[req->loc.rank][req->loc.bank];
+    bool useWrQueue = deferredWrites && req->write;
+    BankQueue& bq = useWrQueue? bank.wrReqs : bank.rdReqs;
+    InList<Request>& q = bq.reqs;
+    bool wasEmpty = q.empty();
 
     // Print bak queue? Use to verify FR-FCFS
 #if 0
@@ -383,21 +456,19 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
     printQ("PRE");
 #endif
 
-    Request* m = q.back();
-    while (m) {
-        if (m->loc.row == req->loc.row) {
-            if (m->rowHitSeq < rowHitLimit) {
-                // queue after last same-row access
-                req->rowHitSeq = m->rowHitSeq + 1;
-                q.insertAfter(m, req);
-            } else {
-                // queue last to get some fairness
-                req->rowHitSeq = 0;
-                q.push_back(req);
-            }
-            break;
+    auto it = bq.rowTails.find(req->loc.row);
+    Request* m = (it != bq.rowTails.end())? it->second : nullptr;
+    if (m) {
+        assert(m->loc.row == req->loc.row);
+        if (m->rowHitSeq < rowHitLimit) {
+            // queue after last same-row access
+            req->rowHitSeq = m->rowHitSeq + 1;
+            q.insertAfter(m, req);
+        } else {
+            // queue last to get some fairness
+            req->rowHitSeq = 0;
+            q.push_back(req);
         }
-        m = m->prev;
     }
 
     // No matches...
@@ -419,31 +490,50 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
             q.push_back(req);
         }
     }
+
+    // In all cases, req is now the last queued request to its row
+    bq.rowTails[req->loc.row] = req;
+    // The bank's head only changes if the queue was empty
+    if (wasEmpty) updateBankOrder(useWrQueue? chan.wrBanks : chan.rdBanks, &bq);
 #if 0
     printQ("POST");
 #endif
 }
 
+// Keeps bankOrder sorted by the arrival order of each bank queue's head
+// request (i.e., the order a FCFS scan of all requests would find them in)
+void DDRMemory::updateBankOrder(InList<BankQueue>& bankOrder, BankQueue* bq) {
+    if (bq->owner) bankOrder.remove(bq);
+    if (bq->reqs.empty()) return;
+
+    uint64_t seq = bq->reqs.front()->arrivalSeq;
+    BankQueue* prev = bankOrder.back();
+    while (prev && prev->reqs.front()->arrivalSeq > seq) prev = prev->prev;
+    if (prev) bankOrder.insertAfter(prev, bq);
+    else bankOrder.push_front(bq);
+}
+
 // For external ticks
-uint64_t DDRMemory::tick(uint64_t sysCycle) {
+uint64_t DDRMemory::tick(uint32_t ch, uint64_t sysCycle) {
+    Channel& chan = channels[ch];
     uint64_t memCycle = sysToMemCycle(sysCycle);
-    assert_msg(memCycle == nextSchedCycle, "%ld != %ld", memCycle, nextSchedCycle);
+    assert_msg(memCycle == chan.nextSchedCycle, "%ld != %ld", memCycle, chan.nextSchedCycle);
 
-    uint64_t minSchedCycle = trySchedule(memCycle, sysCycle);
+    uint64_t minSchedCycle = trySchedule(chan, memCycle, sysCycle);
     assert(minSchedCycle >= memCycle);
-    if (!rdQueue.full() && !wrQueue.full() && !overflowQueue.empty()) {
-        Request& ovfReq = overflowQueue.front();
+    if (!chan.rdQueue.full() && !chan.wrQueue.full() && !chan.overflowQueue.empty()) {
+        Request& ovfReq = chan.overflowQueue.front();
         bool useWrQueue = deferredWrites && ovfReq.write;
-        Request* req = useWrQueue? wrQueue.alloc() : rdQueue.alloc();
+        Request* req = useWrQueue? chan.wrQueue.alloc() : chan.rdQueue.alloc();
         *req = ovfReq;
-        overflowQueue.pop_front();
+        chan.overflowQueue.pop_front();
 
-        queue(req, memCycle);
+        queue(chan, req, memCycle);
 
         // This request may be schedulable before trySchedule's minSchedCycle
         if (!req->prev /*first in bank queue*/) {
-            uint64_t minQueuedSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL);
-            if (minSchedCycle > minQueuedSchedCycle) minSchedCycle = std::max(minQueuedSchedCycle, findMinCmdCycle(*req));
+            uint64_t minQueuedSchedCycle = std::max(memCycle, chan.minRespCycle - tCL - tBL);
+            if (minSchedCycle > minQueuedSchedCycle) minSchedCycle = std::max(minQueuedSchedCycle, findMinCmdCycle(chan, *req));
             if (minSchedCycle > minQueuedSchedCycle) {
                 DEBUG("Overflowed request lowered minSchedCycle %ld -> %ld (memCycle %ld)", minSchedCycle, minQueuedSchedCycle, memCycle);
                 minSchedCycle = minQueuedSchedCycle;
@@ -451,26 +541,27 @@ uint64_t DDRMemory::tick(uint64_t sysCycle) {
         }
     }
 
-    nextSchedCycle = minSchedCycle;
-    if (nextSchedCycle == -1ul) {
-        nextSchedEvent = nullptr;
+    chan.nextSchedCycle = minSchedCycle;
+    if (chan.nextSchedCycle == -1ul) {
+        chan.nextSchedEvent = nullptr;
         return 0;
     } else {
         // sysToMemCycle translates this back to nextSchedCycle
-        uint64_t enqSysCycle = std::max(matchingMemToSysCycle(nextSchedCycle), sysCycle);
+        uint64_t enqSysCycle = std::max(matchingMemToSysCycle(chan.nextSchedCycle), sysCycle);
         return enqSysCycle;
     }
 }
 
-void DDRMemory::recycleEvent(SchedEvent* ev) {
-    assert(ev != nextSchedEvent);
+void DDRMemory::recycleEvent(uint32_t ch, SchedEvent* ev) {
+    Channel& chan = channels[ch];
+    assert(ev != chan.nextSchedEvent);
     assert(ev->next == nullptr);
-    ev->next = eventFreelist;
-    eventFreelist = ev;
+    ev->next = chan.eventFreelist;
+    chan.eventFreelist = ev;
 }
 
-uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
-    const Bank& bank = banks[r.loc.rank][r.loc.bank];
+uint64_t DDRMemory::findMinCmdCycle(const Channel& chan, const Request& r) const {
+    const Bank& bank = chan.banks[r.loc.rank][r.loc.bank];
     uint64_t minCmdCycle = std::max(r.arrivalCycle, bank.lastCmdCycle + 1);
     if (r.loc.row == bank.openRow && bank.open) {
         // Row buffer hit
@@ -484,13 +575,13 @@ uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
             preCycle = std::max(r.arrivalCycle, bank.minPreCycle);
         }
         uint64_t actCycle = std::max(r.arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
-        actCycle = std::max(actCycle, rankActWindows[r.loc.rank].minActCycle() + tFAW);
+        actCycle = std::max(actCycle, chan.rankActWindows[r.loc.rank].minActCycle() + tFAW);
         minCmdCycle = actCycle + tRCD;
     }
     return minCmdCycle;
 }
 
-uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
+uint64_t DDRMemory::trySchedule(Channel& chan, uint64_t curCycle, uint64_t sysCycle) {
     /* Implement FR-FCFS scheduling to maximize bus utilization
      *
      * This model is issue-centric: We queue our events at the appropriate
@@ -505,34 +596,31 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
      * order at *arrival* time, and we obey the appropriate timing constraints.
      */
 
-    if (rdQueue.empty() && wrQueue.empty()) return -1ul;
-    if (curCycle + tCL < minRespCycle) return minRespCycle - tCL;  // too far ahead
+    if (chan.rdQueue.empty() && chan.wrQueue.empty()) return -1ul;
+    if (curCycle + tCL < chan.minRespCycle) return chan.minRespCycle - tCL;  // too far ahead
 
     // Writes have priority if the write queue is getting full...
-    bool prioWrites = (wrQueue.size() > (3*queueDepth/4)) || (lastCmdWasWrite && wrQueue.size() > queueDepth/4);
-    bool isWriteQueue = rdQueue.empty() || prioWrites;
+    bool prioWrites = (chan.wrQueue.size() > (3*queueDepth/4)) || (chan.lastCmdWasWrite && chan.wrQueue.size() > queueDepth/4);
+    bool isWriteQueue = chan.rdQueue.empty() || prioWrites;
 
-    RequestQueue<Request>& queue = isWriteQueue? wrQueue : rdQueue;
-    assert(!queue.empty());
+    RequestQueue<Request>& queue = isWriteQueue? chan.wrQueue : chan.rdQueue;
+    InList<BankQueue>& bankOrder = isWriteQueue? chan.wrBanks : chan.rdBanks;
+    assert(!queue.empty() && !bankOrder.empty());
 
+    // Only bank queue heads can issue; visit them in FCFS order
     Request* r = nullptr;
-    RequestQueue<Request>::iterator ir = queue.begin();
+    BankQueue* bq = bankOrder.front();
     uint64_t minSchedCycle = -1ul;
-    while (ir != queue.end()) {
-        //Bank& bank = banks[(*ir)->loc.rank][(*ir)->loc.bank];
-        //if ((isWriteQueue? bank.wrReqs : bank.rdReqs).front() == *ir) {
-        if (!(*ir)->prev) {  // FASTAH!
-            uint64_t minCmdCycle = findMinCmdCycle(**ir);
-            minSchedCycle = std::min(minSchedCycle, minCmdCycle);
-            if (minCmdCycle <= curCycle) {
-                r = *ir;
-                break;
-            }
-            //DEBUG("Skipping 0x%lx, not ready %ld", (*ir)->ev->getAddr(), minCmdCycle);
-        } else {
-            //DEBUG("Skipping 0x%lx, not first", (*ir)->ev->getAddr());
+    while (bq) {
+        Request* head = bq->reqs.front();
+        uint64_t minCmdCycle = findMinCmdCycle(chan, *head);
+        minSchedCycle = std::min(minSchedCycle, minCmdCycle);
+        if (minCmdCycle <= curCycle) {
+            r = head;
+            break;
         }
-        ir.inc();
+        //DEBUG("Skipping 0x%lx, not ready %ld", head->addr, minCmdCycle);
+        bq = bq->next;
     }
 
     if (!r) {
@@ -544,14 +632,14 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         return minSchedCycle;  // no requests are ready to issue yet
     }
 
-    DEBUG("%ld : Found ready request 0x%lx %s %ld (%ld / %ld)", curCycle, r->addr, r->write? "W" : "R", r->arrivalCycle, rdQueue.size(), wrQueue.size());
+    DEBUG("%ld : Found ready request 0x%lx %s %ld (%ld / %ld)", curCycle, r->addr, r->write? "W" : "R", r->arrivalCycle, chan.rdQueue.size(), chan.wrQueue.size());
 
-    Bank& bank = banks[r->loc.rank][r->loc.bank];
+    Bank& bank = chan.banks[r->loc.rank][r->loc.bank];
 
     // Compute the minimum cycle at which the read or write command can be issued,
     // without column access or data bus constraints
-    uint64_t minCmdCycle = std::max(curCycle, minRespCycle - tCL);
-    if (lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, minRespCycle + tWTR);
+    uint64_t minCmdCycle = std::max(curCycle, chan.minRespCycle - tCL);
+    if (chan.lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, chan.minRespCycle + tWTR);
     bool rowHit = false;
     if (r->loc.row == bank.openRow && bank.open) {
         // Row buffer hit
@@ -568,22 +656,23 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         }
 
         uint64_t actCycle = std::max(r->arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
-        actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minActCycle() + tFAW);
+        actCycle = std::max(actCycle, chan.rankActWindows[r->loc.rank].minActCycle() + tFAW);
 
         // Record ACT
         bank.open = true;
         bank.openRow = r->loc.row;
         if (preIssued) bank.minPreCycle = preCycle + tRAS;
-        rankActWindows[r->loc.rank].addActivation(actCycle);
+        chan.rankActWindows[r->loc.rank].addActivation(actCycle);
         bank.lastActCycle = actCycle;
 
         minCmdCycle = std::max(minCmdCycle, actCycle + tRCD);
     }
 
     // Figure out data bus constraints, find actual time at which command is issued
-    uint64_t cmdCycle = std::max(minCmdCycle, minRespCycle - tCL);
-    minRespCycle = cmdCycle + tCL + tBL;
-    lastCmdWasWrite = r->write;
+    uint64_t cmdCycle = std::max(minCmdCycle, chan.minRespCycle - tCL);
+    chan.minRespCycle = cmdCycle + tCL + tBL;
+    chan.lastCmdWasWrite = r->write;
+    if (numChannels > 1) profChBusCycles.inc(r->loc.channel, tBL);
 
     // Record PRE
     // if closed-page, close (auto-precharge) if no more row buffer hits
@@ -592,7 +681,7 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     bank.minPreCycle = std::max(
             bank.minPreCycle,  // for mixed read and write commands, minPreCycle may not be monotonic without this
             std::max(bank.lastActCycle + tRAS,  // RAS constraint
-            r->write? minRespCycle + tWR : cmdCycle + tRTP  // read to precharge for reads, write recovery for writes
+            r->write? chan.minRespCycle + tWR : cmdCycle + tRTP  // read to precharge for reads, write recovery for writes
             ));
 
     // Record RD or WR
@@ -605,7 +694,7 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         auto ev = r->ev;
         assert(!ev->isWrite() && !r->write);  // reads only
 
-        uint64_t doneSysCycle = memToSysCycle(minRespCycle) + controllerSysLatency;
+        uint64_t doneSysCycle = memToSysCycle(chan.minRespCycle) + controllerSysLatency;
         assert(doneSysCycle >= sysCycle);
 
         ev->release();
@@ -613,48 +702,58 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 
         uint32_t scDelay = doneSysCycle - r->startSysCycle;
         profReads.inc();
+        if (numChannels > 1) profChReads.inc(r->loc.channel);
         profTotalRdLat.inc(scDelay);
         if (rowHit) profReadHits.inc();
         uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
         latencyHist.inc(bucket, 1);
     } else {
-        uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
+        uint32_t scDelay = memToSysCycle(chan.minRespCycle) + controllerSysLatency - r->startSysCycle;
         profWrites.inc();
+        if (numChannels > 1) profChWrites.inc(r->loc.channel);
         profTotalWrLat.inc(scDelay);
         if (rowHit) profWriteHits.inc();
     }
 
-    DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
+    DEBUG("Served 0x%lx lat %ld clocks", r->addr, chan.minRespCycle-curCycle);
 
     // Dequeue this req
-    queue.remove(ir);
-    (isWriteQueue? bank.wrReqs : bank.rdReqs).pop_front();
-
-    return (rdQueue.empty() && wrQueue.empty())? -1ul : minRespCycle - tCL;
+    assert(bq->reqs.front() == r);
+    bq->reqs.pop_front();
+    assert(bq->rowTails.count(r->loc.row));
+    auto it = bq->rowTails.find(r->loc.row);
+    if (it->second == r) bq->rowTails.erase(it);  // no more queued requests to this row
+    updateBankOrder(bankOrder, bq);
+    queue.remove(r);
+
+    return (chan.rdQueue.empty() && chan.wrQueue.empty())? -1ul : chan.minRespCycle - tCL;
 }
 
 void DDRMemory::refresh(uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
-    uint64_t minRefreshCycle = memCycle;
-    for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
-            minRefreshCycle = std::max(minRefreshCycle, std::max(bank.minPreCycle, bank.lastCmdCycle));
-        }
-    }
-    assert(minRefreshCycle >= memCycle);
-
-    uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
     assert(tRFC >= tRP);
-    for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
-            // Close and force the ACT to happen at least at tRFC
-            // PRE <-tRP-> ACT, so discount tRP
-            bank.minPreCycle = refreshDoneCycle - tRP;
-            bank.open = false;
+    // Channels refresh independently, but all at the same tREFI
+    for (Channel& chan : channels) {
+        uint64_t minRefreshCycle = memCycle;
+        for (auto& rankBanks : chan.banks) {
+            for (auto& bank : rankBanks) {
+                minRefreshCycle = std::max(minRefreshCycle, std::max(bank.minPreCycle, bank.lastCmdCycle));
+            }
+        }
+        assert(minRefreshCycle >= memCycle);
+
+        uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
+        for (auto& rankBanks : chan.banks) {
+            for (auto& bank : rankBanks) {
+                // Close and force the ACT to happen at least at tRFC
+                // PRE <-tRP-> ACT, so discount tRP
+                bank.minPreCycle = refreshDoneCycle - tRP;
+                bank.open = false;
+            }
         }
-    }
 
-    DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
+        DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
+    }
 }
 
 
@@ -667,7 +766,23 @@ void DDRMemory::initTech(const char* techName) {
     // tBL's below are for 64-byte lines; we adjust as needed
 
     // Please keep this orderly; go from faster to slower technologies
-    if (tech == "DDR3-1333-CL10") {
+    if (tech == "HBM2-1600") {
+        // HBM2 pseudo-channel (64 bits) at 1.6 Gbps/pin; model a stack with multiple channels
+        // Approximate: JEDEC HBM2 timings in ns (tCL/tRCD/tRP 15, tRAS 33, tFAW 20, tRFC 260, tREFI 3.9us) at tCK = 1.25ns
+        tCK = 1.25;
+        tBL = 4;
+        tCL = 12;
+        tRCD = 12;
+        tRTP = 4;
+        tRP = 12;
+        tRRD = 4;
+        tRAS = 27;
+        tFAW = 16;
+        tWTR = 6;
+        tWR = 12;
+        tRFC = 208;
+        tREFI = 3120;
+    } else if (tech == "DDR3-1333-CL10") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
         tCK = 1.5;  // ns; all other in mem cycles
         tBL = 4;
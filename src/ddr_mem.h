@@ -29,6 +29,7 @@
 #include <deque>
 
 #include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
 #include "intrusive_list.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
@@ -78,61 +79,54 @@ class ActWindow {
         inline uint32_t dec(uint32_t i) const { return i? i-1 : buf.size()-1; }
 };
 
-// Read or write queues, ordered/inserted by arrival time, out-of-order finish
+// Read or write queue entries: a fixed-size pool. Scheduling order is kept in
+// per-bank queues (see DDRMemory), so this only tracks occupancy.
 template <typename T>
 class RequestQueue {
     private:
-        struct Node : InListNode<Node> {
-            T elem;
-        };
-        InList<Node> reqList;  // FIFO
-        InList<Node> freeList; // LIFO (higher locality)
+        g_vector<T*> freeList;  // LIFO (higher locality)
+        size_t elems;
 
     public:
         void init(size_t size) {
-            assert(reqList.empty() && freeList.empty());
-            Node* buf = gm_calloc<Node>(size);
+            assert(freeList.empty());
+            T* buf = gm_calloc<T>(size);
+            freeList.reserve(size);
             for (uint32_t i = 0; i < size; i++) {
-                new (&buf[i]) Node();
+                new (&buf[i]) T();
                 freeList.push_back(&buf[i]);
             }
+            elems = 0;
         }
 
-        inline bool empty() const { return reqList.empty(); }
+        inline bool empty() const { return elems == 0; }
         inline bool full() const { return freeList.empty(); }
-        inline size_t size() const { return reqList.size(); }
+        inline size_t size() const { return elems; }
 
         inline T* alloc() {
             assert(!full());
-            Node* n = freeList.back();
+            T* e = freeList.back();
             freeList.pop_back();
-            reqList.push_back(n);
-            return &n->elem;
+            elems++;
+            return e;
         }
 
-        struct iterator {
-            Node* n;
-            explicit inline iterator(Node* _n) : n(_n) {}
-            inline void inc() {n = n->next;}  // overloading prefix/postfix too messy
-            inline T* operator*() const { return &(n->elem); }
-            inline bool operator==(const iterator& it) const { return it.n == n; }
-            inline bool operator!=(const iterator& it) const { return it.n != n; }
-        };
-
-        inline iterator begin() const {return iterator(reqList.front());}
-        inline iterator end() const {return iterator(nullptr);}
-
-        inline void remove(iterator i) {
-            assert(i.n);
-            reqList.remove(i.n);
-            freeList.push_back(i.n);
+        inline void remove(T* e) {
+            assert(elems);
+            freeList.push_back(e);
+            elems--;
         }
 };
 
 class DDRMemoryAccEvent;
 class SchedEvent;
 
-// Single-channel controller. For multiple channels, use multiple controllers.
+/* Multi-channel controller. Each channel has its own banks, request queues,
+ * data bus, and scheduler; all channels share the controller's weave domain.
+ * Channel, rank, and bank bits come from addrMapping, and can be hashed with
+ * the row bits (addrHash) to spread rows that would conflict in a bank. You can
+ * still use multiple single-channel controllers through sys.mem.controllers.
+ */
 class DDRMemory : public MemObject {
     private:
 
@@ -141,6 +135,7 @@ class DDRMemory : public MemObject {
             uint32_t bank;
             uint32_t rank;
             uint32_t col;
+            uint32_t channel;
         };
 
         struct Request : InListNode<Request> {
@@ -149,6 +144,7 @@ class DDRMemory : public MemObject {
             bool write;
 
             uint64_t rowHitSeq; // sequence number used to throttle max # row hits
+            uint64_t arrivalSeq; // order of arrival to the read or write queue (FCFS order)
 
             // Cycle accounting
             uint64_t arrivalCycle;  // in memCycles
@@ -159,6 +155,17 @@ class DDRMemory : public MemObject {
             DDRMemoryAccEvent* ev;
         };
 
+        /* Per-bank read or write queue, in FR-FCFS order. Only the head of each
+         * bank queue can issue, so the scheduler looks at bank heads, not at
+         * every queued request. rowTails indexes the last queued request to
+         * each row, so new requests find where to queue behind row hits in
+         * O(1), not by scanning the bank queue.
+         */
+        struct BankQueue : InListNode<BankQueue> {
+            InList<Request> reqs;
+            g_unordered_map<uint64_t, Request*> rowTails;
+        };
+
         struct Bank {
             uint64_t openRow;
             bool open;  // false indicates a PRE has been issued
@@ -170,23 +177,46 @@ class DDRMemory : public MemObject {
 
             uint64_t curRowHits;    // row hits on the currently opened row
 
-            InList<Request> rdReqs;
-            InList<Request> wrReqs;
+            BankQueue rdReqs;
+            BankQueue wrReqs;
         };
 
-        // Global timing constraints
-        /* We wake up at minSchedCycle, issue one or more requests, and
-         * reschedule ourselves at the new minSchedCycle if any requests remain
-         * unserved.
-         */
-        uint64_t minSchedCycle; // TODO: delayed commands still not implemented
-        // Minimum cycle at which the next response may arrive
-        // Equivalent to first cycle that the data bus can be used
-        uint64_t minRespCycle;
-        bool lastCmdWasWrite;
+        struct Channel {
+            // Minimum cycle at which the next response may arrive
+            // Equivalent to first cycle that the data bus can be used
+            uint64_t minRespCycle;
+            bool lastCmdWasWrite;
+
+            RequestQueue<Request> rdQueue, wrQueue;
+            std::deque<Request> overflowQueue;
+            uint64_t curArrivalSeq;
+
+            // Non-empty bank queues, in arrival order of their head requests;
+            // FR-FCFS picks the first one whose head can issue. The cost per
+            // issue is bounded by the number of banks, not by queueDepth.
+            InList<BankQueue> rdBanks, wrBanks;
+
+            g_vector< g_vector<Bank> > banks; // indexed by rank, bank
+            g_vector<ActWindow> rankActWindows;
+
+            // Event scheduling
+            /* We wake up at nextSchedCycle, issue one or more requests, and
+             * reschedule ourselves at the new min sched cycle if any requests
+             * remain unserved.
+             */
+            SchedEvent* nextSchedEvent;
+            uint64_t nextSchedCycle;
+            SchedEvent* eventFreelist;
+        };
+
+        enum AddrHash {
+            HASH_NONE,         // plain bit fields
+            HASH_PERMUTATION,  // bank, rank, and channel XORed with distinct slices of the low row bits
+            HASH_XOR,          // bank and rank XORed with all row bits folded; channel with all bits above it folded
+        };
 
         static const uint32_t JEDEC_BUS_WIDTH = 64;
-        const uint32_t lineSize, ranksPerChannel, banksPerRank;
+        const uint32_t lineSize, ranksPerChannel, banksPerRank, numChannels;
         const uint32_t controllerSysLatency;  // in sysCycles
         const uint32_t queueDepth;
         const uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point
@@ -211,24 +241,17 @@ class DDRMemory : public MemObject {
 
         // Address mapping information
         uint32_t colShift, colMask;
-        uint32_t rankShift, rankMask;
-        uint32_t bankShift, bankMask;
+        uint32_t rankShift, rankMask, rankBits;
+        uint32_t bankShift, bankMask, bankBits;
+        uint32_t channelShift, channelMask, channelBits;
         uint64_t rowShift;  // row's always top
+        AddrHash addrHash;
 
         uint32_t minRdLatency;
         uint32_t minWrLatency;
         uint32_t preDelay, postDelayRd, postDelayWr;
 
-        RequestQueue<Request> rdQueue, wrQueue;
-        std::deque<Request> overflowQueue;
-
-        g_vector< g_vector<Bank> > banks; // indexed by rank, bank
-        g_vector<ActWindow> rankActWindows;
-
-        // Event scheduling
-        SchedEvent* nextSchedEvent;
-        uint64_t nextSchedCycle;
-        SchedEvent* eventFreelist;
+        g_vector<Channel> channels;
 
         const g_string name;
 
@@ -239,6 +262,9 @@ class DDRMemory : public MemObject {
         Counter profReadHits, profWriteHits;  // row buffer hits
         VectorCounter latencyHist;
         static const uint32_t BINSIZE = 10, NUMBINS = 100;
+        // Per-channel stats (only registered with multiple channels)
+        VectorCounter profChReads, profChWrites;
+        VectorCounter profChBusCycles;  // data bus busy memCycles, for bandwidth utilization
         PAD();
 
         //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
@@ -261,7 +287,7 @@ class DDRMemory : public MemObject {
         DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
             uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
             uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-            uint32_t _domain, g_string& _name);
+            uint32_t _domain, g_string& _name, uint32_t _numChannels = 1, const char* _addrHash = "None");
 
         void initStats(AggregateStat* parentStat);
         const char* getName() {return name.c_str();}
@@ -274,16 +300,17 @@ class DDRMemory : public MemObject {
         void refresh(uint64_t sysCycle);
 
         // Scheduling event interface
-        uint64_t tick(uint64_t sysCycle);
-        void recycleEvent(SchedEvent* ev);
+        uint64_t tick(uint32_t ch, uint64_t sysCycle);
+        void recycleEvent(uint32_t ch, SchedEvent* ev);
 
     private:
         AddrLoc mapLineAddr(Address lineAddr);
 
-        void queue(Request* req, uint64_t memCycle);
+        void queue(Channel& chan, Request* req, uint64_t memCycle);
 
-        inline uint64_t trySchedule(uint64_t curCycle, uint64_t sysCycle);
-        uint64_t findMinCmdCycle(const Request& r) const;
+        inline uint64_t trySchedule(Channel& chan, uint64_t curCycle, uint64_t sysCycle);
+        uint64_t findMinCmdCycle(const Channel& chan, const Request& r) const;
+        void updateBankOrder(InList<BankQueue>& bankOrder, BankQueue* bq);
 
         void initTech(const char* tech);
 };
@@ -24,6 +24,7 @@
  */
 
 #include "galloc.h"
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -50,13 +51,62 @@
  */
 #define GM_BASE_ADDR ((const void*)0x00ABBA000000)
 
+/* Small allocations (up to GM_MAX_SMALL bytes) don't go through the global
+ * mspace lock. They are served from arenas, each with one freelist per size
+ * class. Arenas are refilled in batches from per-class central freelists, and
+ * the central freelists from chunks carved out of the mspace. Chunks are
+ * GM_CHUNK_BYTES-aligned and never returned to the mspace, so gm_free() finds
+ * the size class of any block through a per-chunk map of the segment.
+ *
+ * Arenas are picked by the CPU the thread runs on rather than through
+ * thread-local storage, which Pin tools can't use portably. Threads that run
+ * concurrently are on different CPUs, so they use different arenas; each
+ * arena keeps a lock for the rare case a thread is migrated or preempted
+ * mid-operation. Arenas and central lists live in the segment, so blocks can
+ * be freed from any thread or process.
+ */
+#define GM_ARENAS 256
+#define GM_CHUNK_BITS 16  // 64KB chunks
+#define GM_CHUNK_BYTES (1ul << GM_CHUNK_BITS)
+#define GM_SIZE_CLASSES 8
+#define GM_MAX_SMALL 256
+#define GM_BATCH 32  // blocks moved between an arena and the central lists at once
+
+static const uint32_t gmClassSizes[GM_SIZE_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256};  // keep 16-byte alignment
+
+struct gm_block {
+    gm_block* next;
+};
+
+struct gm_freelist {
+    gm_block* head;
+    uint32_t count;
+};
+
+struct gm_arena {
+    lock_t lock;
+    gm_freelist lists[GM_SIZE_CLASSES];
+    uint64_t allocs, frees, contended;  // protected by lock
+} ATTR_LINE_ALIGNED;
+
+struct gm_central {
+    lock_t lock;
+    gm_freelist list;
+    uint64_t contended;  // protected by lock
+} ATTR_LINE_ALIGNED;
+
 struct gm_segment {
     volatile void* base_regp; //common data structure, accessible with glob_ptr; threads poll on gm_isready to determine when everything has been initialized
     volatile void* secondary_regp; //secondary data structure, used to exchange information between harness and initializing process
     mspace mspace_ptr;
 
+    gm_arena* arenas;
+    gm_central* central;
+    uint8_t* chunkClasses;  // per chunk-sized region of the segment: size class + 1, or 0 if not a chunk
+
     PAD();
     lock_t lock;
+    uint64_t largeAllocs, largeFrees, chunks, contended;  // protected by lock
     PAD();
 };
 
@@ -106,6 +156,16 @@ int gm_init(size_t segmentSize) {
     futex_init(&GM->lock);
     assert(GM->mspace_ptr);
 
+    GM->arenas = static_cast<gm_arena*>(mspace_memalign(GM->mspace_ptr, CACHE_LINE_BYTES, GM_ARENAS*sizeof(gm_arena)));
+    GM->central = static_cast<gm_central*>(mspace_memalign(GM->mspace_ptr, CACHE_LINE_BYTES, GM_SIZE_CLASSES*sizeof(gm_central)));
+    GM->chunkClasses = static_cast<uint8_t*>(mspace_calloc(GM->mspace_ptr, (segmentSize >> GM_CHUNK_BITS) + 1, sizeof(uint8_t)));
+    if (!GM->arenas || !GM->central || !GM->chunkClasses) panic("gm_init(): Global heap segment too small");
+    memset(GM->arenas, 0, GM_ARENAS*sizeof(gm_arena));
+    memset(GM->central, 0, GM_SIZE_CLASSES*sizeof(gm_central));
+    for (uint32_t i = 0; i < GM_ARENAS; i++) futex_init(&GM->arenas[i].lock);
+    for (uint32_t c = 0; c < GM_SIZE_CLASSES; c++) futex_init(&GM->central[c].lock);
+    GM->largeAllocs = GM->largeFrees = GM->chunks = GM->contended = 0;
+
     return gm_shmid;
 }
 
@@ -121,12 +181,106 @@ void gm_attach(int shmid) {
 }
 
 
+/* Small-object arenas */
+
+// Returns true if the lock was held by someone else when we tried to acquire it
+static inline bool gm_lock(lock_t* lock) {
+    bool contended = (*lock != 0);
+    futex_lock(lock);
+    return contended;
+}
+
+static inline uint32_t gm_size_class(size_t size) {
+    uint32_t c = 0;
+    while (gmClassSizes[c] < size) c++;
+    return c;
+}
+
+static inline uint8_t& gm_chunk_class(void* ptr) {
+    return GM->chunkClasses[(reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(GM)) >> GM_CHUNK_BITS];
+}
+
+static inline gm_block* gm_pop(gm_freelist& fl) {
+    gm_block* b = fl.head;
+    fl.head = b->next;
+    fl.count--;
+    return b;
+}
+
+static inline void gm_push(gm_freelist& fl, gm_block* b) {
+    b->next = fl.head;
+    fl.head = b;
+    fl.count++;
+}
+
+static inline gm_arena* gm_cur_arena() {
+    int cpu = sched_getcpu();
+    return &GM->arenas[(cpu < 0)? 0 : cpu % GM_ARENAS];
+}
+
+// Called with the arena locked. Leaves the freelist empty if we're out of memory.
+static void gm_refill(gm_arena* arena, uint32_t c) {
+    gm_freelist& fl = arena->lists[c];
+    gm_central& central = GM->central[c];
+    if (gm_lock(&central.lock)) central.contended++;
+    if (!central.list.head) {
+        // Central list is empty, carve a new chunk into it so other arenas can share it
+        if (gm_lock(&GM->lock)) GM->contended++;
+        char* chunk = static_cast<char*>(mspace_memalign(GM->mspace_ptr, GM_CHUNK_BYTES, GM_CHUNK_BYTES));
+        if (chunk) GM->chunks++;
+        futex_unlock(&GM->lock);
+
+        if (chunk) {
+            gm_chunk_class(chunk) = c + 1;
+            uint32_t size = gmClassSizes[c];
+            uint32_t blocks = GM_CHUNK_BYTES/size;
+            for (uint32_t i = blocks; i > 0; i--) gm_push(central.list, reinterpret_cast<gm_block*>(chunk + (i - 1)*size));
+        }
+    }
+    for (uint32_t i = 0; i < GM_BATCH && central.list.head; i++) gm_push(fl, gm_pop(central.list));
+    futex_unlock(&central.lock);
+}
+
+static void* gm_small_alloc(size_t size) {
+    uint32_t c = gm_size_class(size);
+    gm_arena* arena = gm_cur_arena();
+    if (gm_lock(&arena->lock)) arena->contended++;
+    gm_freelist& fl = arena->lists[c];
+    if (!fl.head) gm_refill(arena, c);
+    gm_block* b = fl.head? gm_pop(fl) : nullptr;
+    if (b) arena->allocs++;
+    futex_unlock(&arena->lock);
+    return b;
+}
+
+static void gm_small_free(void* ptr, uint32_t c) {
+    gm_arena* arena = gm_cur_arena();
+    if (gm_lock(&arena->lock)) arena->contended++;
+    gm_freelist& fl = arena->lists[c];
+    gm_push(fl, static_cast<gm_block*>(ptr));
+    arena->frees++;
+    if (fl.count > 2*GM_BATCH) {
+        // Don't hoard blocks freed here that other arenas allocate
+        gm_central& central = GM->central[c];
+        if (gm_lock(&central.lock)) central.contended++;
+        for (uint32_t i = 0; i < GM_BATCH; i++) gm_push(central.list, gm_pop(fl));
+        futex_unlock(&central.lock);
+    }
+    futex_unlock(&arena->lock);
+}
+
 void* gm_malloc(size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    void* ptr = mspace_malloc(GM->mspace_ptr, size);
-    futex_unlock(&GM->lock);
+    void* ptr;
+    if (size <= GM_MAX_SMALL) {
+        ptr = gm_small_alloc(size);
+    } else {
+        if (gm_lock(&GM->lock)) GM->contended++;
+        ptr = mspace_malloc(GM->mspace_ptr, size);
+        GM->largeAllocs++;
+        futex_unlock(&GM->lock);
+    }
     if (!ptr) panic("gm_malloc(): Out of global heap memory, use a larger GM segment");
     return ptr;
 }
@@ -134,9 +288,16 @@ void* gm_malloc(size_t size) {
 void* __gm_calloc(size_t num, size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    void* ptr = mspace_calloc(GM->mspace_ptr, num, size);
-    futex_unlock(&GM->lock);
+    void* ptr;
+    if (num*size <= GM_MAX_SMALL && (!size || num <= GM_MAX_SMALL/size)) {  // second check catches overflow
+        ptr = gm_small_alloc(num*size);
+        if (ptr) memset(ptr, 0, num*size);
+    } else {
+        if (gm_lock(&GM->lock)) GM->contended++;
+        ptr = mspace_calloc(GM->mspace_ptr, num, size);
+        GM->largeAllocs++;
+        futex_unlock(&GM->lock);
+    }
     if (!ptr) panic("gm_calloc(): Out of global heap memory, use a larger GM segment");
     return ptr;
 }
@@ -144,8 +305,9 @@ void* __gm_calloc(size_t num, size_t size) {
 void* __gm_memalign(size_t blocksize, size_t bytes) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
+    if (gm_lock(&GM->lock)) GM->contended++;
     void* ptr = mspace_memalign(GM->mspace_ptr, blocksize, bytes);
+    GM->largeAllocs++;
     futex_unlock(&GM->lock);
     if (!ptr) panic("gm_memalign(): Out of global heap memory, use a larger GM segment");
     return ptr;
@@ -155,9 +317,32 @@ void* __gm_memalign(size_t blocksize, size_t bytes) {
 void gm_free(void* ptr) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    mspace_free(GM->mspace_ptr, ptr);
-    futex_unlock(&GM->lock);
+    if (!ptr) return;
+    uint8_t c = gm_chunk_class(ptr);
+    if (c) {
+        gm_small_free(ptr, c - 1);
+    } else {
+        if (gm_lock(&GM->lock)) GM->contended++;
+        mspace_free(GM->mspace_ptr, ptr);
+        GM->largeFrees++;
+        futex_unlock(&GM->lock);
+    }
+}
+
+void gm_get_alloc_stats(gm_alloc_stats* stats) {
+    assert(GM);
+    memset(stats, 0, sizeof(gm_alloc_stats));
+    // Racy reads, these are only informative
+    for (uint32_t i = 0; i < GM_ARENAS; i++) {
+        stats->smallAllocs += GM->arenas[i].allocs;
+        stats->smallFrees += GM->arenas[i].frees;
+        stats->arenaContended += GM->arenas[i].contended;
+    }
+    for (uint32_t c = 0; c < GM_SIZE_CLASSES; c++) stats->centralContended += GM->central[c].contended;
+    stats->largeAllocs = GM->largeAllocs;
+    stats->largeFrees = GM->largeFrees;
+    stats->chunks = GM->chunks;
+    stats->globalContended = GM->contended;
 }
 
 
@@ -196,6 +381,11 @@ void* gm_get_secondary_ptr() {
 void gm_stats() {
     assert(GM);
     mspace_malloc_stats(GM->mspace_ptr);
+    gm_alloc_stats st;
+    gm_get_alloc_stats(&st);
+    info("Global heap: %ld small allocs, %ld small frees, %ld chunks (%ld KB), %ld large allocs, %ld large frees",
+            st.smallAllocs, st.smallFrees, st.chunks, st.chunks*(GM_CHUNK_BYTES >> 10), st.largeAllocs, st.largeFrees);
+    info("Global heap: contended acquires: %ld arena, %ld central, %ld global", st.arenaContended, st.centralContended, st.globalContended);
 }
 
 bool gm_isready() {
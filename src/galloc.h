@@ -26,6 +26,7 @@
 #ifndef GALLOC_H_
 #define GALLOC_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -61,6 +62,16 @@ void* gm_get_secondary_ptr();
 
 void gm_stats();
 
+// Allocator activity since gm_init(); contended counts lock acquisitions that found the lock held
+struct gm_alloc_stats {
+    uint64_t smallAllocs, smallFrees;  // served by the per-CPU arenas
+    uint64_t largeAllocs, largeFrees;  // served by the global mspace
+    uint64_t chunks;  // carved from the mspace to refill the arenas
+    uint64_t arenaContended, centralContended, globalContended;
+};
+
+void gm_get_alloc_stats(gm_alloc_stats* stats);
+
 bool gm_isready();
 void gm_detach();
 
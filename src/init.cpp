@@ -25,6 +25,7 @@
  */
 
 #include "init.h"
+#include <fstream>
 #include <list>
 #include <sstream>
 #include <stdlib.h>
@@ -33,6 +34,7 @@
 #include <vector>
 #include "cache.h"
 #include "cache_arrays.h"
+#include "compressed_mem.h"
 #include "config.h"
 #include "constants.h"
 #include "contention_sim.h"
@@ -58,6 +60,7 @@
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
+#include "mesh_network.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
@@ -70,10 +73,12 @@
 #include "profile_stats.h"
 #include "repl_policies.h"
 #include "scheduler.h"
+#include "shadow_llc.h"
 #include "simple_core.h"
 #include "stats.h"
 #include "stats_filter.h"
 #include "str.h"
+#include "tiered_mem.h"
 #include "timing_cache.h"
 #include "timing_core.h"
 #include "timing_event.h"
@@ -90,7 +95,21 @@ extern void EndOfPhaseActions(); //in zsim.cpp
  * follow the layout of zinfo, top-down.
  */
 
-BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain) {
+/* State shared by the banks of a cache with a global dedup directory (globalDedup = true, see
+ * DedupDirectory). Each bank builds its own tag array and coherence controller; the first bank
+ * builds the data and hash arrays for all of them, and the directory the banks join.
+ */
+struct GlobalDedupState {
+    uint32_t banks;
+    ReplPolicy* dataRP;
+    ReplPolicy* hashRP;
+    ApproximateDedupDataArray* ddataArray;
+    ApproximateDedupHashArray* dhashArray;
+    DedupDirectory* dir;
+};
+
+//Shadow LLC banks (isShadow) stay out of the global LLC stat vectors; ShadowLLCs dumps their stats
+BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, bool isShadow, uint32_t domain, GlobalDedupState* gds = nullptr) {
     if (!zinfo->compressionRatioStats) zinfo->compressionRatioStats = new g_vector<RunningStats*>();
     if (!zinfo->evictionStats) zinfo->evictionStats = new g_vector<RunningStats*>();
     if (!zinfo->tagUtilizationStats) zinfo->tagUtilizationStats = new g_vector<RunningStats*>();
@@ -264,27 +283,47 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     ReplPolicy* dataRP = nullptr;
     ReplPolicy* hashRP = nullptr;
     uint32_t tagRatio = config.get<uint32_t>(prefix + "tagRatio", 1);
+    //Compressor knobs, per cache group so that shadow LLCs can sweep them (sim.* gives the defaults)
+    uint32_t hashSize = config.get<uint32_t>(prefix + "hashSize", zinfo->hashSize);
+    uint32_t mapSize = config.get<uint32_t>(prefix + "mapSize", zinfo->mapSize);
+    uint32_t floatCutSize = config.get<uint32_t>(prefix + "floatCutSize", zinfo->floatCutSize);
+    uint32_t doubleCutSize = config.get<uint32_t>(prefix + "doubleCutSize", zinfo->doubleCutSize);
     if (arrayType == "uniDoppelganger") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dataRP = new DataLRUReplPolicy(numLines);
         utagArray = new uniDoppelgangerTagArray(numLines*tagRatio, ways, tagRP, hf);
-        udataArray = new uniDoppelgangerDataArray(numLines, ways, dataRP, hf);
+        udataArray = new uniDoppelgangerDataArray(numLines, ways, dataRP, hf, mapSize);
     } else if (arrayType == "ApproximateBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dataRP = new DataLRUReplPolicy(numLines);
         atagArray = new ApproximateBDITagArray(numLines*tagRatio, ways*tagRatio, ways, tagRP, hf);
-        adataArray = new ApproximateBDIDataArray();
+        adataArray = new ApproximateBDIDataArray(floatCutSize, doubleCutSize);
     } else if (arrayType == "ApproximateDedup") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
-        dataRP = new DataLRUReplPolicy(numLines);
         dtagArray = new ApproximateDedupTagArray(numLines*tagRatio, ways, tagRP, hf);
-        ddataArray = new ApproximateDedupDataArray(numLines, ways, dataRP, hf);
-        uint32_t hashLines = config.get<uint32_t>(prefix + "hashLines", 64);
-        uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
-        hashRP = new DataLRUReplPolicy(hashLines);
-        size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
-        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
-        dhashArray = new ApproximateDedupHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression);
+        if (gds && gds->ddataArray) {
+            dataRP = gds->dataRP;
+            hashRP = gds->hashRP;
+            ddataArray = gds->ddataArray;
+            dhashArray = gds->dhashArray;
+        } else {
+            //With a global dedup directory, the first bank builds the data and hash arrays of all banks
+            uint32_t dataBanks = gds? gds->banks : 1;
+            dataRP = new DataLRUReplPolicy(numLines*dataBanks);
+            ddataArray = new ApproximateDedupDataArray(numLines*dataBanks, ways, dataRP, hf, dataBanks);
+            uint32_t hashLines = config.get<uint32_t>(prefix + "hashLines", 64)*dataBanks;
+            uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
+            hashRP = new DataLRUReplPolicy(hashLines);
+            size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
+            H3HashFamily* hashCompression = new H3HashFamily(1, hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+            dhashArray = new ApproximateDedupHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression, hashSize, floatCutSize, doubleCutSize);
+            if (gds) {
+                gds->dataRP = dataRP;
+                gds->hashRP = hashRP;
+                gds->ddataArray = ddataArray;
+                gds->dhashArray = dhashArray;
+            }
+        }
     } else if (arrayType == "ApproximateDedupBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dbtagArray = new ApproximateDedupBDITagArray(numLines*tagRatio, ways*tagRatio, tagRP, hf);
@@ -293,8 +332,8 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
         hashRP = new DataLRUReplPolicy(hashLines);
         size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
-        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
-        dbhashArray = new ApproximateDedupBDIHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression);
+        H3HashFamily* hashCompression = new H3HashFamily(1, hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        dbhashArray = new ApproximateDedupBDIHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression, hashSize, floatCutSize, doubleCutSize);
     } else if (arrayType == "ApproximateNaiiveDedupBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dbtagArray = new ApproximateDedupBDITagArray(numLines*tagRatio, ways*tagRatio, tagRP, hf);
@@ -303,13 +342,13 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
         hashRP = new DataLRUReplPolicy(hashLines);
         size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
-        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
-        dbhashArray = new ApproximateDedupBDIHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression);
+        H3HashFamily* hashCompression = new H3HashFamily(1, hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        dbhashArray = new ApproximateDedupBDIHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression, hashSize, floatCutSize, doubleCutSize);
     } else if (arrayType == "uniDoppelgangerBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dataRP = new DataLRUReplPolicy(numLines*tagRatio);
         ubtagArray = new uniDoppelgangerBDITagArray(numLines*tagRatio, ways, tagRP, hf);
-        ubdataArray = new uniDoppelgangerBDIDataArray(numLines*tagRatio, ways, dataRP, hf, tagRatio);
+        ubdataArray = new uniDoppelgangerBDIDataArray(numLines*tagRatio, ways, dataRP, hf, tagRatio, mapSize);
     } else if (arrayType == "SetAssoc") {
         array = new SetAssocArray(numLines, ways, rp, hf);
     } else if (arrayType == "Z") {
@@ -344,7 +383,29 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     if (isTerminal) {
         cc = new MESITerminalCC(numLines, name);
     } else {
-        cc = new MESICC(numLines*tagRatio, nonInclusiveHack, name);
+        // Directory: a full sharer vector per line, or sparse (see SparseMESITopCC)
+        string dirType = config.get<const char*>(prefix + "directory.type", "FullMap");
+        SparseDirConfig sparseDir = {0, 0, 0};
+        if (dirType == "Sparse") {
+            sparseDir.entries = config.get<uint32_t>(prefix + "directory.entries", numLines*tagRatio/2);
+            sparseDir.ways = config.get<uint32_t>(prefix + "directory.ways", 8);
+            sparseDir.pointers = config.get<uint32_t>(prefix + "directory.pointers", 4);
+            if (!sparseDir.ways || sparseDir.entries % sparseDir.ways != 0) {
+                panic("%s: directory.entries (%d) must be a multiple of directory.ways (%d)", name.c_str(), sparseDir.entries, sparseDir.ways);
+            }
+        } else if (dirType != "FullMap") {
+            panic("%s: Invalid directory type %s", name.c_str(), dirType.c_str());
+        }
+        // Protocol: MOESI keeps dirty lines shared by the children in O instead of writing them back here
+        string protocol = config.get<const char*>(prefix + "protocol", "MESI");
+        bool moesi = (protocol == "MOESI");
+        if (!moesi && protocol != "MESI") panic("%s: Invalid coherence protocol %s", name.c_str(), protocol.c_str());
+        if (moesi && dirType == "Sparse") panic("%s: MOESI is not supported with a sparse directory", name.c_str());
+        if (dirType == "Sparse") {
+            cc = new SparseMESICC(numLines*tagRatio, nonInclusiveHack, name, sparseDir);
+        } else {
+            cc = new MESICC(numLines*tagRatio, nonInclusiveHack, name, moesi);
+        }
     }
     rp->setCC(cc);
     if (!isTerminal) {
@@ -375,14 +436,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new uniDoppelgangerCache(numLines*tagRatio, numLines*tagRatio, cc, utagArray, udataArray, tagRP, dataRP,
                 accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "uniDoppelgangerBDI") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -398,14 +461,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new uniDoppelgangerBDICache(numLines*tagRatio, numLines, cc, ubtagArray, ubdataArray, tagRP, dataRP,
                 accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "ApproximateBDI") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -421,14 +486,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new ApproximateBDICache(numLines*tagRatio, numLines, cc, atagArray, adataArray, tagRP, dataRP,
                 accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "ApproximateDedup") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -442,16 +509,24 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             uint32_t timingCandidates = config.get<uint32_t>(prefix + "timingCandidates", candidates);
             tagRP->setCC(cc);
 
-            cache = new ApproximateDedupCache(numLines*tagRatio, numLines, cc, dtagArray, ddataArray, dhashArray, tagRP, dataRP,
+            uint32_t dataLines = numLines*(gds? gds->banks : 1); //a global dedup directory's data array holds all banks' lines
+            ApproximateDedupCache* dcache = new ApproximateDedupCache(numLines*tagRatio, dataLines, cc, dtagArray, ddataArray, dhashArray, tagRP, dataRP,
                 hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (gds) {
+                if (!gds->dir) gds->dir = new DedupDirectory(numLines, gds->banks, dhashArray->getNumSets(), config.get<uint32_t>(prefix + "dedupDirLatency", latency));
+                dcache->setDedupDirectory(gds->dir);
+            }
+            cache = dcache;
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "ApproximateIdealDedup") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -467,14 +542,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new ApproximateIdealDedupCache(numLines*tagRatio, numLines, cc, dtagArray, ddataArray, dhashArray, tagRP, dataRP,
                 hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "ApproximateDedupBDI") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -490,14 +567,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new ApproximateDedupBDICache(numLines*tagRatio, numLines, cc, dbtagArray, dbdataArray, dbhashArray, tagRP, dataRP,
                 hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "ApproximateNaiiveDedupBDI") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -513,14 +592,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new ApproximateNaiiveDedupBDICache(numLines*tagRatio, numLines, cc, dbtagArray, ndbdataArray, dbhashArray, tagRP, dataRP,
                 hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "ApproximateIdealDedupBDI") {
             g_string statName = name + g_string(" CompressionRatio");
             RunningStats* crStats = new RunningStats(statName);
@@ -536,14 +617,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
             cache = new ApproximateIdealDedupBDICache(numLines*tagRatio, numLines, cc, dbtagArray, dbdataArray, dbhashArray, tagRP, dataRP,
                 hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
-            zinfo->compressionRatioStats->push_back(crStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->tagUtilizationStats->push_back(tutStats);
-            zinfo->dataUtilizationStats->push_back(dutStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->compressionRatioStats->push_back(crStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->tagUtilizationStats->push_back(tutStats);
+                zinfo->dataUtilizationStats->push_back(dutStats);
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "Timing") {
             g_string statName = name + g_string(" EvictionsPerAccess");
             RunningStats* evStats = new RunningStats(statName);
@@ -551,11 +634,13 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             uint32_t tagLat = config.get<uint32_t>(prefix + "tagLat", 5);
             uint32_t timingCandidates = config.get<uint32_t>(prefix + "timingCandidates", candidates);
             cache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, tagLat, ways, timingCandidates, domain, name, evStats, hitStats, missStats, allStats);
-            zinfo->tagHitStats->push_back(hitStats);
-            zinfo->tagMissStats->push_back(missStats);
-            zinfo->tagAllStats->push_back(allStats);
-            zinfo->evictionStats->push_back(evStats);
-            zinfo->L3Cache->push_back(cache);
+            if (!isShadow) {
+                zinfo->tagHitStats->push_back(hitStats);
+                zinfo->tagMissStats->push_back(missStats);
+                zinfo->tagAllStats->push_back(allStats);
+                zinfo->evictionStats->push_back(evStats);
+                zinfo->L3Cache->push_back(cache);
+            }
         } else if (type == "Tracing") {
             g_string traceFile = config.get<const char*>(prefix + "traceFile","");
             if (traceFile.empty()) traceFile = g_string(zinfo->outputDir) + "/" + name + ".trace";
@@ -584,7 +669,9 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
     uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
     uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
     const char* tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see cpp file for other techs
-    const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
+    const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // row always on top; channel lowest unless given
+    uint32_t channels = config.get<uint32_t>(prefix + "channels", 1);  // channels within this controller
+    const char* addrHash = config.get<const char*>(prefix + "addrHash", "None");  // None, Permutation, or XOR (see ddr_mem.cpp)
 
     // If set, writes are deferred and bursted out to reduce WTR overheads
     bool deferWrites = config.get<bool>(prefix + "deferWrites", true);
@@ -599,16 +686,16 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
     uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
 
     auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
-            addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
+            addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name, channels, addrHash);
     return mem;
 }
 
-MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name) {
+MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name, const string& prefix = "sys.mem.") {
     //Type
-    string type = config.get<const char*>("sys.mem.type", "Simple");
+    string type = config.get<const char*>(prefix + "type", "Simple");
 
     //Latency
-    uint32_t latency = (type == "DDR")? -1 : config.get<uint32_t>("sys.mem.latency", 100);
+    uint32_t latency = (type == "DDR" || type == "Tiered")? -1 : config.get<uint32_t>(prefix + "latency", 100);
 
     MemObject* mem = nullptr;
     if (type == "Simple") {
@@ -619,30 +706,49 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         // a single CCT across the system, and we are dealing with latencies in *core* clock cycles
 
         // Peak bandwidth (in MB/s)
-        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
+        uint32_t bandwidth = config.get<uint32_t>(prefix + "bandwidth", 6400);
 
         mem = new MD1Memory(lineSize, frequency, bandwidth, latency, name);
     } else if (type == "WeaveMD1") {
-        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
-        uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", latency);
+        uint32_t bandwidth = config.get<uint32_t>(prefix + "bandwidth", 6400);
+        uint32_t boundLatency = config.get<uint32_t>(prefix + "boundLatency", latency);
         mem = new WeaveMD1Memory(lineSize, frequency, bandwidth, latency, boundLatency, domain, name);
     } else if (type == "WeaveSimple") {
-        uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", 100);
+        uint32_t boundLatency = config.get<uint32_t>(prefix + "boundLatency", 100);
         mem = new WeaveSimpleMemory(latency, boundLatency, domain, name);
     } else if (type == "DDR") {
-        mem = BuildDDRMemory(config, lineSize, frequency, domain, name, "sys.mem.");
+        mem = BuildDDRMemory(config, lineSize, frequency, domain, name, prefix);
     } else if (type == "DRAMSim") {
         uint64_t cpuFreqHz = 1000000 * frequency;
-        uint32_t capacity = config.get<uint32_t>("sys.mem.capacityMB", 16384);
-        string dramTechIni = config.get<const char*>("sys.mem.techIni");
-        string dramSystemIni = config.get<const char*>("sys.mem.systemIni");
-        string outputDir = config.get<const char*>("sys.mem.outputDir");
-        string traceName = config.get<const char*>("sys.mem.traceName");
+        uint32_t capacity = config.get<uint32_t>(prefix + "capacityMB", 16384);
+        string dramTechIni = config.get<const char*>(prefix + "techIni");
+        string dramSystemIni = config.get<const char*>(prefix + "systemIni");
+        string outputDir = config.get<const char*>(prefix + "outputDir");
+        string traceName = config.get<const char*>(prefix + "traceName");
         mem = new DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
     } else if (type == "Detailed") {
         // FIXME(dsm): Don't use a separate config file... see DDRMemory
-        g_string mcfg = config.get<const char*>("sys.mem.paramFile", "");
+        g_string mcfg = config.get<const char*>(prefix + "paramFile", "");
         mem = new MemControllerBase(mcfg, lineSize, frequency, domain, name);
+    } else if (type == "Tiered") {
+        // Near (e.g., HBM) and far (e.g., DDR) tiers are memory controllers themselves, configured under <prefix>near and <prefix>far
+        g_string nearName = name + "-near";
+        g_string farName = name + "-far";
+        MemObject* nearMem = BuildMemoryController(config, lineSize, frequency, domain, nearName, prefix + "near.");
+        MemObject* farMem = BuildMemoryController(config, lineSize, frequency, domain, farName, prefix + "far.");
+
+        uint32_t migrationPageSize = config.get<uint32_t>(prefix + "migrationPageSize", 4096);  // bytes
+        uint32_t nearCapacityMB = config.get<uint32_t>(prefix + "nearCapacityMB", 1024);
+        uint32_t epochAccesses = config.get<uint32_t>(prefix + "epochAccesses", 100000);
+        uint32_t promoteThreshold = config.get<uint32_t>(prefix + "promoteThreshold", 8);  // min accesses/epoch to promote
+        uint32_t maxMigrations = config.get<uint32_t>(prefix + "maxMigrationsPerEpoch", 64);
+        uint32_t migrationCyclesPerLine = config.get<uint32_t>(prefix + "migrationCyclesPerLine", 4);  // in sys cycles
+
+        if (!isPow2(migrationPageSize) || migrationPageSize < lineSize) panic("%s: invalid migrationPageSize %d", name.c_str(), migrationPageSize);
+        uint32_t pageBits = ilog2(migrationPageSize/lineSize);
+        uint32_t nearFrames = ((uint64_t)nearCapacityMB << 20)/migrationPageSize;
+        mem = new TieredMemory(nearMem, farMem, pageBits, nearFrames, epochAccesses, promoteThreshold, maxMigrations,
+                migrationCyclesPerLine, name);
     } else {
         panic("Invalid memory controller type %s", type.c_str());
     }
@@ -651,22 +757,37 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
 
 typedef vector<vector<BaseCache*>> CacheGroup;
 
-CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal) {
+CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal, const string& root = "sys.caches") {
     CacheGroup* cgp = new CacheGroup;
     CacheGroup& cg = *cgp;
 
-    string prefix = "sys.caches." + name + ".";
+    string prefix = root + "." + name + ".";
 
     bool isPrefetcher = config.get<bool>(prefix + "isPrefetcher", false);
     if (isPrefetcher) { //build a prefetcher group
         uint32_t prefetchers = config.get<uint32_t>(prefix + "prefetchers", 1);
+        string pfType = config.get<const char*>(prefix + "type", "Stream");
+        uint32_t degree = 0, tracked = 0, entries = 0, history = 0;
+        if (pfType == "IPStride" || pfType == "DeltaCorrelation") {
+            degree = config.get<uint32_t>(prefix + "degree", 2);
+            tracked = config.get<uint32_t>(prefix + "trackedPrefetches", 256);
+            if (pfType == "IPStride") {
+                entries = config.get<uint32_t>(prefix + "entries", 64);
+                zinfo->loadPcs = true;
+            }
+            else history = config.get<uint32_t>(prefix + "history", 64);
+        } else if (pfType != "Stream") {
+            panic("%s: Invalid prefetcher type %s", name.c_str(), pfType.c_str());
+        }
         cg.resize(prefetchers);
         for (vector<BaseCache*>& bg : cg) bg.resize(1);
         for (uint32_t i = 0; i < prefetchers; i++) {
             stringstream ss;
             ss << name << "-" << i;
             g_string pfName(ss.str().c_str());
-            cg[i][0] = new StreamPrefetcher(pfName);
+            if (pfType == "IPStride") cg[i][0] = new IPStridePrefetcher(pfName, degree, tracked, entries);
+            else if (pfType == "DeltaCorrelation") cg[i][0] = new DeltaCorrelationPrefetcher(pfName, degree, tracked, history);
+            else cg[i][0] = new StreamPrefetcher(pfName);
         }
         return cgp;
     }
@@ -682,8 +803,19 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
 
     cg.resize(caches);
     for (vector<BaseCache*>& bg : cg) bg.resize(banks);
+    bool isShadow = (root == "sys.shadows");
+
+    // Global dedup directory: the banks of each cache share one hash and data array (see DedupDirectory)
+    bool globalDedup = config.get<bool>(prefix + "globalDedup", false);
+    if (globalDedup) {
+        string type = config.get<const char*>(prefix + "type", "Simple");
+        if (type != "ApproximateDedup") panic("%s: globalDedup requires an ApproximateDedup cache, not %s", name.c_str(), type.c_str());
+        if (isTerminal) panic("%s: globalDedup is not supported on terminal caches", name.c_str());
+        if (!isPow2(banks)) panic("%s: globalDedup needs a power of 2 # banks, but you specified %d", name.c_str(), banks);
+    }
 
     for (uint32_t i = 0; i < caches; i++) {
+        GlobalDedupState gds = {banks, nullptr, nullptr, nullptr, nullptr, nullptr};
         for (uint32_t j = 0; j < banks; j++) {
             stringstream ss;
             ss << name << "-" << i;
@@ -692,7 +824,7 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
             }
             g_string bankName(ss.str().c_str());
             uint32_t domain = (i*banks + j)*zinfo->numDomains/(caches*banks); //(banks > 1)? nextDomain() : (i*banks + j)*zinfo->numDomains/(caches*banks);
-            cg[i][j] = BuildCacheBank(config, prefix, bankName, bankSize, isTerminal, domain);
+            cg[i][j] = BuildCacheBank(config, prefix, bankName, bankSize, isTerminal, isShadow, domain, (globalDedup && banks > 1)? &gds : nullptr);
         }
     }
 
@@ -715,7 +847,24 @@ static void InitSystem(Config& config) {
 
     // If a network file is specified, build a Network
     string networkFile = config.get<const char*>("sys.networkFile", "");
-    Network* network = (networkFile != "")? new Network(networkFile.c_str()) : nullptr;
+    string networkType = config.get<const char*>("sys.network.type", (networkFile != "")? "Table" : "None");
+    Network* network = nullptr;
+    MeshNetwork* mesh = nullptr;
+    if (networkType == "Table") {
+        if (networkFile == "") panic("Table network needs sys.networkFile");
+        network = new Network(networkFile.c_str());
+    } else if (networkType == "Mesh") {
+        uint32_t rows = config.get<uint32_t>("sys.network.rows");
+        uint32_t cols = config.get<uint32_t>("sys.network.cols");
+        uint32_t routerDelay = config.get<uint32_t>("sys.network.routerDelay", 2);  // router pipeline stages
+        uint32_t linkDelay = config.get<uint32_t>("sys.network.linkDelay", 1);
+        uint32_t flitBytes = config.get<uint32_t>("sys.network.flitBytes", 16);
+        uint32_t netDomain = config.get<uint32_t>("sys.network.domain", zinfo->numDomains - 1);
+        mesh = new MeshNetwork(rows, cols, routerDelay, linkDelay, flitBytes, zinfo->lineSize, netDomain);
+        network = mesh;
+    } else if (networkType != "None") {
+        panic("Invalid network type %s", networkType.c_str());
+    }
 
     // Build the caches
     vector<const char*> cacheGroupNames;
@@ -750,6 +899,14 @@ static void InitSystem(Config& config) {
     if (parentlessCacheGroups.size() != 1) panic("Only one last-level cache allowed, found: %s", Str(parentlessCacheGroups).c_str());
     string llc = parentlessCacheGroups[0];
 
+    // A global dedup directory invalidates other banks' lines while holding its lock, which is only
+    // safe if nothing above invalidates the banks, i.e., on the LLC
+    for (const char* grp : cacheGroupNames) {
+        if (grp != llc && config.get<bool>(prefix + grp + ".globalDedup", false)) {
+            panic("%s: globalDedup is only supported on the last-level cache (%s)", grp, llc.c_str());
+        }
+    }
+
     auto isTerminal = [&](string group) -> bool {
         return childMap[group].size() == 0;
     };
@@ -769,6 +926,61 @@ static void InitSystem(Config& config) {
     //Check single LLC
     if (cMap[llc]->size() != 1) panic("Last-level cache %s must have caches = 1, but %ld were specified", llc.c_str(), cMap[llc]->size());
 
+    //Fast-forward warming and shadow LLCs fill banks directly, so they must implement warm().
+    //The Doppelganger caches and the BDI, ideal and naive dedup variants do not (their warm()
+    //panics, see CompressedCache), so they are rejected here, before the simulation starts.
+    auto supportsWarm = [](const string& type) -> bool {
+        return type == "Simple" || type == "Timing" || type == "ApproximateBDI" || type == "ApproximateDedup";
+    };
+
+    if (zinfo->ffWarm) {
+        string llcType = config.get<const char*>("sys.caches." + llc + ".type", "Simple");
+        if (!supportsWarm(llcType)) {
+            panic("sim.ffWarm is not supported with %s last-level caches", llcType.c_str());
+        }
+        zinfo->ffWarmCaches = new g_vector<Cache*>();
+        for (BaseCache* llcBank : (*cMap[llc])[0]) {
+            Cache* llcCache = dynamic_cast<Cache*>(llcBank);
+            assert(llcCache);
+            zinfo->ffWarmCaches->push_back(llcCache);
+        }
+        info("Fast-forward warming enabled on %s, sampling 1/%d accesses", llc.c_str(), zinfo->ffWarmSampling);
+    }
+
+    //Shadow LLCs: each subgroup of sys.shadows is an LLC-like cache group that only sees the LLC's accesses functionally
+    vector<const char*> shadowNames;
+    if (config.exists("sys.shadows")) config.subgroups("sys.shadows", shadowNames);
+    if (shadowNames.size()) {
+        if (zinfo->traceDriven) panic("Shadow LLCs read line data from the simulated process, they are not supported in trace-driven mode");
+        zinfo->shadowLLCs = new ShadowLLCs(config.get<uint32_t>("sim.shadowQueueSize", 16384));
+        //Compressed shadows sample their array stats, which costs O(lines), once every this many replayed accesses
+        uint32_t shadowSamplePeriod = config.get<uint32_t>("sim.shadowSamplePeriod", 1000);
+        if (shadowSamplePeriod == 0) panic("sim.shadowSamplePeriod must be at least 1");
+        for (const char* sname : shadowNames) {
+            string shadow(sname);
+            string type = config.get<const char*>("sys.shadows." + shadow + ".type", "Simple");
+            if (!supportsWarm(type)) panic("Shadow LLC %s: %s caches have no warm() and are not supported", sname, type.c_str());
+            if (config.get<uint32_t>("sys.shadows." + shadow + ".caches", 1) != 1) panic("Shadow LLC %s must have caches = 1", sname);
+
+            CacheGroup* sg = BuildCacheGroup(config, shadow, false, "sys.shadows");
+            g_vector<Cache*> shadowBanks;
+            g_vector<MemObject*> noParents;
+            g_vector<BaseCache*> noChildren;
+            for (BaseCache* bank : (*sg)[0]) {
+                Cache* shadowCache = dynamic_cast<Cache*>(bank);
+                assert(shadowCache);
+                //Shadows have neither parents nor children, but their coherence controllers still need to be set up
+                shadowCache->setParents(0, noParents, nullptr);
+                shadowCache->setChildren(noChildren, nullptr);
+                shadowCache->enableWarmStats(shadowSamplePeriod);
+                shadowBanks.push_back(shadowCache);
+            }
+            zinfo->shadowLLCs->addShadow(g_string(sname), shadowBanks);
+            delete sg;
+        }
+        info("Feeding %ld shadow LLCs from %s", shadowNames.size(), llc.c_str());
+    }
+
     /* Since we have checked for no loops, parent is mandatory, and all parents are checked valid,
      * it follows that we have a fully connected tree finishing at the LLC.
      */
@@ -790,7 +1002,9 @@ static void InitSystem(Config& config) {
     }
 
     if (memControllers > 1) {
-        bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
+        // With a mesh, LLC banks should see each controller, so that requests go to its tile
+        bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", !mesh);
+        if (splitAddrs && mesh) warn("sys.mem.splitAddrs with a mesh network places all memory controllers on one tile");
         if (splitAddrs) {
             MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter");
             mems.resize(1);
@@ -798,6 +1012,49 @@ static void InitSystem(Config& config) {
         }
     }
 
+    // Memory-side compression, between the LLC and the memory controllers (see compressed_mem.h)
+    if (config.get<bool>("sys.mem.compression.enabled", false)) {
+        uint32_t pageSize = config.get<uint32_t>("sys.mem.compression.pageSize", 4096);
+        uint32_t mdEntries = config.get<uint32_t>("sys.mem.compression.metadataEntries", 512);
+        uint32_t mdWays = config.get<uint32_t>("sys.mem.compression.metadataWays", 8);
+        uint32_t burstEntries = config.get<uint32_t>("sys.mem.compression.burstBufferEntries", 16);
+        uint32_t burstLatency = config.get<uint32_t>("sys.mem.compression.burstBufferLatency", 10);  // in sys cycles
+        for (uint32_t i = 0; i < mems.size(); i++) {
+            g_string name(mems.size() == 1? "mem-compression" : (string("mem-compression-") + Str(i)).c_str());
+            mems[i] = new CompressedMemory(mems[i], zinfo->lineSize, pageSize, mdEntries, mdWays, burstEntries, burstLatency, name);
+        }
+    }
+
+    // Place caches and memory controllers on mesh tiles. By default, the banks
+    // of each cache group, and the memory controllers, are spread evenly over
+    // the tiles in order; sys.network.placementFile ("<name> <tile>" lines)
+    // overrides this for the entities it lists.
+    if (mesh) {
+        auto spread = [mesh](const vector<const char*>& names) {
+            for (uint32_t i = 0; i < names.size(); i++) mesh->place(names[i], (uint64_t)i*mesh->getTiles()/names.size());
+        };
+        for (const char* grp : cacheGroupNames) {
+            vector<const char*> bankNames;
+            for (vector<BaseCache*>& banks : *cMap[grp]) for (BaseCache* bank : banks) bankNames.push_back(bank->getName());
+            spread(bankNames);
+        }
+        vector<const char*> memNames;
+        for (MemObject* mem : mems) memNames.push_back(mem->getName());
+        spread(memNames);
+
+        string placementFile = config.get<const char*>("sys.network.placementFile", "");
+        if (placementFile != "") {
+            std::ifstream pf(placementFile.c_str());
+            if (!pf.good()) panic("Could not open mesh placement file %s", placementFile.c_str());
+            string entity;
+            uint32_t tile;
+            while (pf >> entity >> tile) {
+                if (!mesh->isPlaced(entity.c_str())) panic("Mesh placement file %s: no cache bank or memory named %s", placementFile.c_str(), entity.c_str());
+                mesh->place(entity.c_str(), tile);
+            }
+        }
+    }
+
     //Connect everything
     bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
 
@@ -848,7 +1105,11 @@ static void InitSystem(Config& config) {
 
         for (uint32_t p = 0; p < parents; p++) {
             g_vector<MemObject*> parentsVec;
-            parentsVec.insert(parentsVec.end(), parentCaches[p].begin(), parentCaches[p].end()); //BaseCache* to MemObject* is a safe cast
+            if (grp == llc && zinfo->shadowLLCs) {
+                for (BaseCache* bank : parentCaches[p]) parentsVec.push_back(new ShadowTap(bank));
+            } else {
+                parentsVec.insert(parentsVec.end(), parentCaches[p].begin(), parentCaches[p].end()); //BaseCache* to MemObject* is a safe cast
+            }
 
             uint32_t childId = 0;
             g_vector<BaseCache*> childrenVec;
@@ -965,13 +1226,18 @@ static void InitSystem(Config& config) {
                         core = new (&simpleCores[j]) SimpleCore(ic, dc, name);
                     } else if (type == "Timing") {
                         uint32_t domain = j*zinfo->numDomains/cores;
-                        TimingCore* tcore = new (&timingCores[j]) TimingCore(ic, dc, domain, name);
+                        bool batchMemOps = config.get<bool>(prefix + "batchMemOps", false); //simulate loads/stores once per BBL
+                        TimingCore* tcore = new (&timingCores[j]) TimingCore(ic, dc, domain, name, batchMemOps);
                         zinfo->eventRecorders[coreIdx] = tcore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = tcore;
                     } else {
                         assert(type == "OOO");
-                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        //SMARTS-style sampling, in instrs; 0 simulates every instruction in detail
+                        uint64_t samplingPeriod = config.get<uint64_t>(prefix + "samplingPeriod", 0);
+                        uint32_t samplingWindow = config.get<uint32_t>(prefix + "samplingWindow", 10000);
+                        uint32_t samplingWarmup = config.get<uint32_t>(prefix + "samplingWarmup", 2000);
+                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name, samplingPeriod, samplingWindow, samplingWarmup);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = ocore;
@@ -1042,6 +1308,7 @@ static void InitSystem(Config& config) {
         for (vector<BaseCache*>& banks : *cMap[group]) for (BaseCache* bank : banks) bank->initStats(groupStat);
         zinfo->rootStat->append(groupStat);
     }
+    if (zinfo->shadowLLCs) zinfo->shadowLLCs->initStats(zinfo->rootStat);
 
     //Initialize event recorders
     //for (uint32_t i = 0; i < zinfo->numCores; i++) eventRecorders[i] = new EventRecorder();
@@ -1050,6 +1317,7 @@ static void InitSystem(Config& config) {
     memStat->init("mem", "Memory controller stats");
     for (auto mem : mems) mem->initStats(memStat);
     zinfo->rootStat->append(memStat);
+    if (mesh) mesh->initStats(zinfo->rootStat);
 
     //Odds and ends: BuildCacheGroup new'd the cache groups, we need to delete them
     for (pair<string, CacheGroup*> kv : cMap) delete kv.second;
@@ -1190,7 +1458,12 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    bool weaveStealing = config.get<bool>("sim.weaveStealing", false); //let weave threads steal domains from each other
+    uint32_t weaveStealSlice = config.get<uint32_t>("sim.weaveStealSlice", 64); //events
+    bool profileWeaveEvents = config.get<bool>("sim.profileWeaveEvents", false); //per-domain simulate/requeue/time stats by event class; adds overhead
+    string domainQueue = config.get<const char*>("sim.domainQueue", "Block"); //Block (PrioQueue) or Radix (RadixPrioQueue), see pq_bench
+    if (domainQueue != "Block" && domainQueue != "Radix") panic("Invalid sim.domainQueue %s (valid: Block, Radix)", domainQueue.c_str());
+    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads, weaveStealing, weaveStealSlice, profileWeaveEvents, domainQueue == "Radix");
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
@@ -1222,6 +1495,16 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->ffReinstrument = config.get<bool>("sim.ffReinstrument", false);
     if (zinfo->ffReinstrument) warn("sim.ffReinstrument = true, switching fast-forwarding on a multi-threaded process may be unstable");
 
+    zinfo->bbvInterval = config.get<uint64_t>("sim.bbvInterval", 0);
+    zinfo->ffWarm = config.get<bool>("sim.ffWarm", false);
+    zinfo->ffWarmSampling = config.get<uint32_t>("sim.ffWarmSampling", 1);
+    zinfo->ffWarmCaches = nullptr;
+    zinfo->shadowLLCs = nullptr;
+    if (zinfo->ffWarm) {
+        if (zinfo->ffReinstrument) panic("sim.ffWarm needs memory accesses instrumented while fast-forwarding, it is incompatible with sim.ffReinstrument");
+        if (zinfo->ffWarmSampling == 0) panic("sim.ffWarmSampling must be at least 1");
+    }
+
     zinfo->registerThreads = config.get<bool>("sim.registerThreads", false);
     zinfo->globalPauseFlag = config.get<bool>("sim.startInGlobalPause", false);
 
@@ -1281,6 +1564,24 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
         zinfo->procStats = nullptr;
     }
 
+    //Global heap allocator activity; each stat reads its field from a fresh snapshot
+    AggregateStat* gmStats = new AggregateStat();
+    gmStats->init("galloc", "Global heap allocator stats");
+#define GM_STAT(field, desc) { \
+        auto f = []() { gm_alloc_stats st; gm_get_alloc_stats(&st); return st.field; }; \
+        LambdaStat<decltype(f)>* fStat = new LambdaStat<decltype(f)>(f); \
+        fStat->init(#field, desc); gmStats->append(fStat); }
+    GM_STAT(smallAllocs, "Small allocations (per-CPU arenas)");
+    GM_STAT(smallFrees, "Small frees (per-CPU arenas)");
+    GM_STAT(largeAllocs, "Large and aligned allocations (global heap)");
+    GM_STAT(largeFrees, "Large frees (global heap)");
+    GM_STAT(chunks, "Chunks carved from the global heap for the arenas");
+    GM_STAT(arenaContended, "Contended arena lock acquires");
+    GM_STAT(centralContended, "Contended central freelist lock acquires");
+    GM_STAT(globalContended, "Contended global heap lock acquires");
+#undef GM_STAT
+    zinfo->rootStat->append(gmStats);
+
     //It's a global stat, but I want it to be last...
     zinfo->profHeartbeats = new VectorCounter();
     zinfo->profHeartbeats->init("heartbeats", "Per-process heartbeats", zinfo->lineSize);
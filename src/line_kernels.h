@@ -0,0 +1,144 @@
+#ifndef LINE_KERNELS_H_
+#define LINE_KERNELS_H_
+
+#include <string.h>
+#include "bithacks.h"
+#include "hash.h"
+#include "log.h"
+#include "memory_hierarchy.h"
+#include "zsim.h"
+
+/* Per-line data kernels used by the compressed arrays (BDI compression,
+ * approximation, dedup hashing and comparison). They are templated on the line
+ * size so every loop has a fixed trip count. Array methods that use them, or
+ * that loop over the line themselves, are member templates on the line size;
+ * each array binds the instances for zinfo->lineSize to member function
+ * pointers once, at construction (LINE_SIZE_BIND), and its public methods call
+ * through them, so accesses never switch on the line size.
+ */
+
+// Runs the statement(s) with LINE_SIZE bound to lineSize as a compile-time constant
+#define LINE_SIZE_SWITCH(lineSize, ...) \
+    switch (lineSize) { \
+        case 16: {const uint32_t LINE_SIZE = 16; __VA_ARGS__;} break; \
+        case 32: {const uint32_t LINE_SIZE = 32; __VA_ARGS__;} break; \
+        case 64: {const uint32_t LINE_SIZE = 64; __VA_ARGS__;} break; \
+        case 128: {const uint32_t LINE_SIZE = 128; __VA_ARGS__;} break; \
+        default: panic("Compressed arrays support 16, 32, 64 or 128-byte lines, not %d", lineSize); \
+    }
+
+// Points fnPtr to the lineSize instance of (member) function template fn; panics on unsupported sizes
+#define LINE_SIZE_BIND(lineSize, fnPtr, fn) LINE_SIZE_SWITCH(lineSize, fnPtr = &fn<LINE_SIZE>)
+
+template <uint32_t LINE_SIZE>
+class LineKernelsImpl {
+    private:
+        static inline uint64_t absDiff(uint64_t a, uint64_t b) {
+            int64_t x = (int64_t)(a - b);
+            uint64_t t = x >> 63;
+            return (x ^ t) - t;
+        }
+
+        // Little-endian load of every STEP-byte element of the line
+        template <uint32_t STEP>
+        static inline void load(const uint8_t* line, uint64_t* values) {
+            for (uint32_t i = 0; i < LINE_SIZE/STEP; i++) {
+                uint64_t v = 0;
+                memcpy(&v, line + i*STEP, STEP);
+                values[i] = v;
+            }
+        }
+
+        template <uint32_t N>
+        static inline bool isZeroPackable(const uint64_t* values) {
+            uint64_t acc = 0;
+            for (uint32_t i = 0; i < N; i++) acc |= values[i];
+            return acc == 0;
+        }
+
+        template <uint32_t N>
+        static inline bool isSameValuePackable(const uint64_t* values) {
+            uint64_t acc = 0;
+            for (uint32_t i = 0; i < N; i++) acc |= values[0] ^ values[i];
+            return acc == 0;
+        }
+
+        // Two bases (one of them implicitly zero) + BLIMIT-byte deltas over N BSIZE-byte values
+        template <uint32_t N, uint32_t BLIMIT, uint32_t BSIZE>
+        static inline uint16_t multBaseCompression(const uint64_t* values) {
+            static_assert(BLIMIT < 8, "Deltas must be narrower than the values");
+            const uint64_t limit = (1ul << (8*BLIMIT)) - 1;
+            uint64_t mbases[2];
+            uint32_t baseCount = 1;
+            mbases[0] = 0;
+            for (uint32_t i = 0; i < N && baseCount < 2; i++) {
+                if (absDiff(mbases[0], values[i]) > limit) mbases[baseCount++] = values[i];
+            }
+            for (uint32_t i = 0; i < N; i++) {
+                bool covered = false;
+                for (uint32_t j = 0; j < baseCount; j++) covered |= absDiff(mbases[j], values[i]) <= limit;
+                if (!covered) return N*BSIZE;
+            }
+            return BLIMIT*N + BSIZE;
+        }
+
+    public:
+        static uint16_t bdiCompress(const DataLine data) {
+            const uint8_t* line = (const uint8_t*) data;
+            uint64_t values[LINE_SIZE/2];
+            uint16_t bestCSize = LINE_SIZE;
+            uint16_t currCSize = LINE_SIZE;
+
+            load<8>(line, values);
+            if (isZeroPackable<LINE_SIZE/8>(values))
+                bestCSize = 1;
+            if (isSameValuePackable<LINE_SIZE/8>(values))
+                currCSize = 8;
+            bestCSize = MIN(bestCSize, currCSize);
+            currCSize = multBaseCompression<LINE_SIZE/8, 1, 8>(values);
+            bestCSize = MIN(bestCSize, currCSize);
+            currCSize = multBaseCompression<LINE_SIZE/8, 2, 8>(values);
+            bestCSize = MIN(bestCSize, currCSize);
+            currCSize = multBaseCompression<LINE_SIZE/8, 4, 8>(values);
+            bestCSize = MIN(bestCSize, currCSize);
+
+            load<4>(line, values);
+            currCSize = multBaseCompression<LINE_SIZE/4, 1, 4>(values);
+            bestCSize = MIN(bestCSize, currCSize);
+            currCSize = multBaseCompression<LINE_SIZE/4, 2, 4>(values);
+            bestCSize = MIN(bestCSize, currCSize);
+
+            load<2>(line, values);
+            currCSize = multBaseCompression<LINE_SIZE/2, 1, 2>(values);
+            bestCSize = MIN(bestCSize, currCSize);
+            return bestCSize;
+        }
+
+        static void approximate(DataLine data, DataType type, uint32_t floatCut, uint32_t doubleCut) {
+            if (type == ZSIM_FLOAT) {
+                for (uint32_t i = 0; i < LINE_SIZE/4; i++) ((uint32_t*) data)[i] >>= floatCut;
+            } else if (type == ZSIM_DOUBLE) {
+                for (uint32_t i = 0; i < LINE_SIZE/8; i++) ((uint64_t*) data)[i] >>= doubleCut;
+            } else {
+                panic("We only approximate floats and doubles");
+            }
+        }
+
+        static bool isSame(const DataLine a, const DataLine b) {
+            uint64_t diff = 0;
+            for (uint32_t i = 0; i < LINE_SIZE/8; i++) diff |= ((const uint64_t*) a)[i] ^ ((const uint64_t*) b)[i];
+            return diff == 0;
+        }
+
+        static uint64_t xorHash(const DataLine data, HashFamily* dataHash, uint32_t bits) {
+            uint64_t XORs = 0;
+            for (uint32_t i = 0; i < LINE_SIZE/8; i++) {
+                uint64_t word;
+                memcpy(&word, (const uint8_t*) data + 8*i, 8);
+                XORs ^= dataHash->hash(0, word);
+            }
+            return (bits >= 64)? XORs : (XORs & ((1ul << bits) - 1));
+        }
+};
+
+#endif  // LINE_KERNELS_H_
@@ -26,8 +26,8 @@
 #include "memory_hierarchy.h"
 
 static const char* accessTypeNames[] = {"GETS", "GETX", "PUTS", "PUTX"};
-static const char* invTypeNames[] = {"INV", "INVX"};
-static const char* mesiStateNames[] = {"I", "S", "E", "M"};
+static const char* invTypeNames[] = {"INV", "INVX", "FWD", "INVXO"};
+static const char* mesiStateNames[] = {"I", "S", "E", "M", "O"};
 static const char* dataTypeNames[] = {"UINT8", "INT8", "UINT16", "INT16", "UINT32", "INT32", "UINT64", "INT64", "FLOAT", "DOUBLE"};
 static const char* BDICompressionNames[] = {"ZERO", "REPETITIVE", "BASE8DELTA1", "BASE8DELTA2", "BASE8DELTA4", "BASE4DELTA1", "BASE4DELTA2", "BASE2DELTA1", "NONE"};
 
@@ -56,25 +56,6 @@ const char* BDICompressionName(BDICompressionEncoding encoding) {
     return BDICompressionNames[encoding];
 }
 
-uint16_t BDICompressionToSize(BDICompressionEncoding encoding, uint32_t lineSize) {
-    switch(encoding) {
-        case ZERO:
-        case REPETITIVE:
-            return 8;
-        case BASE8DELTA1:
-            return 16;
-        case BASE4DELTA1:
-        case BASE8DELTA2:
-            return 24;
-        case BASE2DELTA1:
-        case BASE4DELTA2:
-        case BASE8DELTA4:
-            return 40;
-        default:
-            return lineSize;
-    }
-}
-
 #include <type_traits>
 
 static inline void CompileTimeAsserts() {
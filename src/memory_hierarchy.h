@@ -57,15 +57,17 @@ typedef enum {
 typedef enum {
     INV,  // fully invalidate this line
     INVX, // invalidate exclusive access to this line (lower level can still keep a non-exclusive copy)
-    FWD,  // don't invalidate, just send up the data (used by directories). Only valid on S lines.
+    FWD,  // don't invalidate, just send up the data (used by directories). Only valid on S and O lines.
+    INVXO // like INVX, but a dirty copy becomes O instead of being written back (sent by MOESI controllers)
 } InvType;
 
-/* Coherence states for the MESI protocol */
+/* Coherence states for the MESI protocol, plus MOESI's O */
 typedef enum {
     I, // invalid
     S, // shared (and clean)
     E, // exclusive and clean
-    M  // exclusive and dirty
+    M, // exclusive and dirty
+    O  // shared and dirty; this copy is responsible for the writeback (MOESI only)
 } MESIState;
 
 typedef enum {
@@ -119,7 +121,37 @@ const char* MESIStateName(MESIState s);
 const char* DataTypeName(DataType t);
 const char* BDICompressionName(BDICompressionEncoding encoding);
 
-uint16_t BDICompressionToSize(BDICompressionEncoding encoding, uint32_t lineSize);
+// Inline so that callers with a compile-time line size get a constant
+inline uint16_t BDICompressionToSize(BDICompressionEncoding encoding, uint32_t lineSize) {
+    // Base plus one delta per value, rounded up to whole 8-byte segments
+    uint32_t size;
+    switch(encoding) {
+        case ZERO:
+        case REPETITIVE:
+            return 8;
+        case BASE8DELTA1:
+            size = 8 + lineSize/8;
+            break;
+        case BASE4DELTA1:
+            size = 4 + lineSize/4;
+            break;
+        case BASE8DELTA2:
+            size = 8 + lineSize/4;
+            break;
+        case BASE2DELTA1:
+            size = 2 + lineSize/2;
+            break;
+        case BASE4DELTA2:
+            size = 4 + lineSize/2;
+            break;
+        case BASE8DELTA4:
+            size = 8 + lineSize/2;
+            break;
+        default:
+            return lineSize;
+    }
+    return (size + 7) & ~7u;
+}
 
 inline bool IsGet(AccessType t) { return t == GETS || t == GETX; }
 inline bool IsPut(AccessType t) { return t == PUTS || t == PUTX; }
@@ -148,9 +180,13 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        PREFETCH_FILL = (1<<6), //Access caused by a prefetch issued at a lower level. Set by MESICC in place of PREFETCH, and propagates up
     };
     uint32_t flags;
 
+    //PC of the load that caused this access; 0 if unknown (stores, ifetches, writebacks, prefetches)
+    Address pc;
+
     inline void set(Flag f) {flags |= f;}
     inline bool is (Flag f) const {return flags & f;}
 };
@@ -163,6 +199,8 @@ struct InvReq {
     bool* writeback;
     uint64_t cycle;
     uint32_t srcId;
+    // Sent to a whole group of a coarse sharer vector; the line may not be there
+    bool coarse;
 };
 
 /** INTERFACES **/
@@ -185,6 +223,16 @@ class BaseCache : public MemObject {
         virtual void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network) = 0;
         virtual void setChildren(const g_vector<BaseCache*>& children, Network* network) = 0;
         virtual uint64_t invalidate(const InvReq& req) = 0;
+        //Invalidates several lines with a single message (e.g., all the lines a batched eviction takes
+        //from this child); they are handled in parallel, returns the latest response cycle
+        virtual uint64_t invalidateLines(const g_vector<InvReq>& reqs) {
+            uint64_t respCycle = 0;
+            for (const InvReq& req : reqs) {
+                uint64_t cycle = invalidate(req);
+                if (cycle > respCycle) respCycle = cycle;
+            }
+            return respCycle;
+        }
 };
 
 #endif  // MEMORY_HIERARCHY_H_
@@ -0,0 +1,211 @@
+#include "mesh_network.h"
+#include <stdlib.h>
+#include "event_recorder.h"
+#include "log.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+enum MeshDir {DIR_E, DIR_W, DIR_N, DIR_S, MESH_DIRS};
+
+class MeshTraversalEvent : public TimingEvent {
+    private:
+        MeshNetwork* const net;
+        const uint32_t srcTile, dstTile;
+        const uint32_t flits;
+
+    public:
+        MeshTraversalEvent(MeshNetwork* _net, uint32_t _srcTile, uint32_t _dstTile, uint32_t _flits)
+            : TimingEvent(0, 0, _net->getDomain()), net(_net), srcTile(_srcTile), dstTile(_dstTile), flits(_flits) {}
+
+        void simulate(uint64_t startCycle) {
+            done(net->traverse(srcTile, dstTile, flits, startCycle));
+        }
+};
+
+/* Carries a child's accesses to one parent over the mesh */
+class MeshPort : public MemObject {
+    private:
+        MeshNetwork* const net;
+        MemObject* const dst;
+        const uint32_t srcTile, dstTile;
+
+    public:
+        MeshPort(MeshNetwork* _net, MemObject* _dst, uint32_t _srcTile, uint32_t _dstTile)
+            : net(_net), dst(_dst), srcTile(_srcTile), dstTile(_dstTile) {}
+
+        const char* getName() {return dst->getName();}
+
+        uint64_t access(MemReq& req) {
+            // GETs come back with data and PUTXs carry it; everything else is a single flit
+            uint32_t reqFlits = (req.type == PUTX)? net->getDataFlits() : 1;
+            uint32_t respFlits = (req.type == GETS || req.type == GETX)? net->getDataFlits() : 1;
+            uint32_t reqLat = net->zeroLoadLatency(srcTile, dstTile, reqFlits);
+            uint32_t respLat = net->zeroLoadLatency(dstTile, srcTile, respFlits);
+            net->countBoundPacket(srcTile, dstTile, reqLat);
+            net->countBoundPacket(dstTile, srcTile, respLat);
+
+            EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+            bool hadRecord = evRec && evRec->hasRecord();
+
+            uint64_t startCycle = req.cycle;
+            req.cycle = startCycle + reqLat;
+            uint64_t dstRespCycle = dst->access(req);
+            req.cycle = startCycle;
+            uint64_t respCycle = dstRespCycle + respLat;
+
+            if (evRec && !hadRecord && evRec->hasRecord()) {
+                // Wrap the parent's record with the request and response traversals
+                TimingRecord tr = evRec->popRecord();
+                assert(tr.reqCycle >= startCycle + reqLat);
+                assert(dstRespCycle >= tr.respCycle);
+
+                MeshTraversalEvent* reqEv = new (evRec) MeshTraversalEvent(net, srcTile, dstTile, reqFlits);
+                reqEv->setMinStartCycle(startCycle);
+                MeshTraversalEvent* respEv = new (evRec) MeshTraversalEvent(net, dstTile, srcTile, respFlits);
+                respEv->setMinStartCycle(dstRespCycle);
+
+                uint64_t upLat = tr.reqCycle - (startCycle + reqLat);
+                if (upLat) {
+                    DelayEvent* dUp = new (evRec) DelayEvent(upLat);
+                    dUp->setMinStartCycle(startCycle + reqLat);
+                    reqEv->addChild(dUp, evRec)->addChild(tr.startEvent, evRec);
+                } else {
+                    reqEv->addChild(tr.startEvent, evRec);
+                }
+
+                uint64_t downLat = dstRespCycle - tr.respCycle;
+                if (downLat) {
+                    DelayEvent* dDown = new (evRec) DelayEvent(downLat);
+                    dDown->setMinStartCycle(tr.respCycle);
+                    tr.endEvent->addChild(dDown, evRec)->addChild(respEv, evRec);
+                } else {
+                    tr.endEvent->addChild(respEv, evRec);
+                }
+
+                TimingRecord netTr = {tr.addr, startCycle, respCycle, tr.type, reqEv, respEv};
+                evRec->pushRecord(netTr);
+            }
+            return respCycle;
+        }
+};
+
+MeshNetwork::MeshNetwork(uint32_t _rows, uint32_t _cols, uint32_t _routerDelay, uint32_t _linkDelay, uint32_t _flitBytes,
+        uint32_t lineSize, uint32_t _domain)
+    : rows(_rows), cols(_cols), routerDelay(_routerDelay), linkDelay(_linkDelay), dataFlits(1 + (lineSize + _flitBytes - 1)/_flitBytes),
+      domain(_domain), boundPackets(0), boundHops(0), boundCycles(0)
+{
+    if (!rows || !cols) panic("Mesh network needs at least one row and column (%dx%d)", rows, cols);
+    if (!_flitBytes) panic("Mesh network flitBytes must be > 0");
+    if (domain >= zinfo->numDomains) panic("Mesh network domain %d, but there are only %d domains", domain, zinfo->numDomains);
+    linkFreeCycle.resize(rows*cols*MESH_DIRS, 0);
+    info("Mesh network: %dx%d, %d-cycle routers, %d-cycle links, %d-flit data packets, domain %d",
+            rows, cols, routerDelay, linkDelay, dataFlits, domain);
+}
+
+void MeshNetwork::place(const char* name, uint32_t tile) {
+    if (tile >= rows*cols) panic("Mesh network: %s placed on tile %d, but the mesh has %d tiles", name, tile, rows*cols);
+    tiles[name] = tile;
+}
+
+uint32_t MeshNetwork::getTile(const char* name) const {
+    std::unordered_map<std::string, uint32_t>::const_iterator it = tiles.find(name);
+    if (it == tiles.end()) panic("Mesh network: %s is not placed on any tile", name);
+    return it->second;
+}
+
+uint32_t MeshNetwork::getRTT(const char* src, const char* dst) {
+    uint32_t srcTile = getTile(src);
+    uint32_t dstTile = getTile(dst);
+    return zeroLoadLatency(srcTile, dstTile, 1) + zeroLoadLatency(dstTile, srcTile, 1);
+}
+
+MemObject* MeshNetwork::getPort(const char* src, MemObject* dst) {
+    uint32_t srcTile = getTile(src);
+    uint32_t dstTile = getTile(dst->getName());
+    if (srcTile == dstTile) return nullptr;  // same tile, getRTT() is 0
+    return new MeshPort(this, dst, srcTile, dstTile);
+}
+
+uint32_t MeshNetwork::hops(uint32_t srcTile, uint32_t dstTile) const {
+    int32_t dx = (int32_t)(srcTile % cols) - (int32_t)(dstTile % cols);
+    int32_t dy = (int32_t)(srcTile / cols) - (int32_t)(dstTile / cols);
+    return abs(dx) + abs(dy);
+}
+
+uint32_t MeshNetwork::zeroLoadLatency(uint32_t srcTile, uint32_t dstTile, uint32_t flits) const {
+    if (srcTile == dstTile) return 0;
+    uint32_t h = hops(srcTile, dstTile);
+    return (h + 1)*routerDelay + h*linkDelay + (flits - 1);
+}
+
+void MeshNetwork::countBoundPacket(uint32_t srcTile, uint32_t dstTile, uint32_t lat) {
+    __sync_fetch_and_add(&boundPackets, 1);
+    __sync_fetch_and_add(&boundHops, hops(srcTile, dstTile));
+    __sync_fetch_and_add(&boundCycles, lat);
+}
+
+uint64_t MeshNetwork::traverse(uint32_t srcTile, uint32_t dstTile, uint32_t flits, uint64_t startCycle) {
+    uint32_t x = srcTile % cols;
+    uint32_t y = srcTile / cols;
+    uint32_t dstX = dstTile % cols;
+    uint32_t dstY = dstTile / cols;
+
+    uint64_t cycle = startCycle + routerDelay;
+    uint64_t contention = 0;
+    uint32_t h = 0;
+    while (x != dstX || y != dstY) {
+        // XY routing: go along the row first, then along the column
+        uint32_t dir;
+        if (x != dstX) dir = (x < dstX)? DIR_E : DIR_W;
+        else dir = (y < dstY)? DIR_S : DIR_N;
+        uint32_t link = (y*cols + x)*MESH_DIRS + dir;
+
+        uint64_t linkCycle = MAX(cycle, linkFreeCycle[link]);
+        contention += linkCycle - cycle;
+        linkFreeCycle[link] = linkCycle + flits;
+        profLinkFlits.inc(link, flits);
+        cycle = linkCycle + linkDelay + routerDelay;
+
+        switch (dir) {
+            case DIR_E: x++; break;
+            case DIR_W: x--; break;
+            case DIR_S: y++; break;
+            case DIR_N: y--; break;
+        }
+        h++;
+    }
+
+    profPackets.inc();
+    profFlits.inc(flits);
+    profHops.inc(h);
+    profContentionCycles.inc(contention);
+    return cycle + flits - 1;
+}
+
+void MeshNetwork::initStats(AggregateStat* parentStat) {
+    AggregateStat* netStat = new AggregateStat();
+    netStat->init("net", "Mesh network stats");
+
+    ProxyStat* pBoundPackets = new ProxyStat();
+    pBoundPackets->init("boundPkts", "Packets (bound phase)", (uint64_t*)&boundPackets);
+    netStat->append(pBoundPackets);
+    ProxyStat* pBoundHops = new ProxyStat();
+    pBoundHops->init("boundHops", "Hops traversed (bound phase)", (uint64_t*)&boundHops);
+    netStat->append(pBoundHops);
+    ProxyStat* pBoundCycles = new ProxyStat();
+    pBoundCycles->init("boundLat", "Cumulative zero-load packet latency (bound phase)", (uint64_t*)&boundCycles);
+    netStat->append(pBoundCycles);
+
+    profPackets.init("pkts", "Packets simulated (weave phase)");
+    profFlits.init("flits", "Flits simulated (weave phase)");
+    profHops.init("hops", "Hops traversed (weave phase)");
+    profContentionCycles.init("contLat", "Cumulative cycles packets waited for busy links (weave phase)");
+    profLinkFlits.init("linkFlits", "Flits per directed link (tile*4 + E/W/N/S) (weave phase)", rows*cols*MESH_DIRS);
+    netStat->append(&profPackets);
+    netStat->append(&profFlits);
+    netStat->append(&profHops);
+    netStat->append(&profContentionCycles);
+    netStat->append(&profLinkFlits);
+
+    parentStat->append(netStat);
+}
@@ -0,0 +1,83 @@
+#ifndef MESH_NETWORK_H_
+#define MESH_NETWORK_H_
+
+#include <string>
+#include <unordered_map>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "network.h"
+#include "pad.h"
+#include "stats.h"
+
+/* 2D-mesh network-on-chip with dimension-order (XY) routing.
+ *
+ * Every cache bank and memory controller sits on a tile. A packet pays the
+ * router pipeline (routerDelay) at every router it crosses, linkDelay per link,
+ * and (flits - 1) cycles of serialization at the destination. Requests and
+ * acks are single-flit; packets that carry a line take
+ * 1 + lineSize/flitBytes flits.
+ *
+ * In the bound phase, accesses from a child to its parent go through a port
+ * (see getPort()) that charges the zero-load latency of the request and the
+ * response. If the parent recorded a weave-phase access, the port wraps it
+ * with request and response traversal events, simulated in the network's
+ * domain: each directed link carries one flit per cycle, and a packet waits
+ * for every link on its path to be free, so concurrent traffic delays it.
+ * Links are reserved for the whole path when the packet is injected, which
+ * approximates per-hop arbitration (a packet injected later never overtakes
+ * an earlier one on a shared link). Invalidations to children use getRTT(),
+ * i.e., zero-load latency.
+ *
+ * Use a domain no other component uses to simulate the network in parallel
+ * with them; with a shared domain, network events are serialized with that
+ * component's.
+ */
+class MeshNetwork : public Network, public GlobAlloc {
+    private:
+        const uint32_t rows, cols;
+        const uint32_t routerDelay;
+        const uint32_t linkDelay;
+        const uint32_t dataFlits;
+        const uint32_t domain;
+
+        std::unordered_map<std::string, uint32_t> tiles;  // entity -> tile; only used during initialization
+
+        g_vector<uint64_t> linkFreeCycle;  // per directed link; only used in the weave phase
+
+        // Bound phase, updated atomically
+        volatile uint64_t boundPackets, boundHops, boundCycles;
+
+        // Weave phase, only updated from the network's domain
+        PAD();
+        Counter profPackets, profFlits, profHops;
+        Counter profContentionCycles;
+        VectorCounter profLinkFlits;
+        PAD();
+
+    public:
+        MeshNetwork(uint32_t _rows, uint32_t _cols, uint32_t _routerDelay, uint32_t _linkDelay, uint32_t _flitBytes,
+                uint32_t lineSize, uint32_t _domain);
+
+        uint32_t getTiles() const {return rows*cols;}
+        void place(const char* name, uint32_t tile);
+        bool isPlaced(const char* name) const {return tiles.count(name);}
+
+        uint32_t getRTT(const char* src, const char* dst);
+        MemObject* getPort(const char* src, MemObject* dst);
+
+        void initStats(AggregateStat* parentStat);
+
+        // Used by ports and traversal events
+        uint32_t getDomain() const {return domain;}
+        uint32_t getDataFlits() const {return dataFlits;}
+        uint32_t hops(uint32_t srcTile, uint32_t dstTile) const;
+        uint32_t zeroLoadLatency(uint32_t srcTile, uint32_t dstTile, uint32_t flits) const;
+        void countBoundPacket(uint32_t srcTile, uint32_t dstTile, uint32_t lat);
+        uint64_t traverse(uint32_t srcTile, uint32_t dstTile, uint32_t flits, uint64_t startCycle);  // returns arrival cycle
+
+    private:
+        uint32_t getTile(const char* name) const;
+};
+
+#endif  // MESH_NETWORK_H_
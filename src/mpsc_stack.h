@@ -0,0 +1,53 @@
+#ifndef MPSC_STACK_H_
+#define MPSC_STACK_H_
+
+#include <stdint.h>
+#include "log.h"
+
+/* Lock-free multi-producer, single-consumer staging list for intrusive objects
+ * (T must have a T* next field that is null while not enqueued, as PrioQueue
+ * requires). Producers push with a single CAS; the consumer takes everything
+ * at once with an exchange, so there is no ABA problem (nothing is ever popped
+ * individually). takeAll() returns elements in push order, which keeps each
+ * producer's events in the order it enqueued them.
+ */
+template <typename T>
+class MPSCStack {
+    private:
+        T* volatile head;
+
+    public:
+        MPSCStack() : head(nullptr) {}
+
+        inline void push(T* obj) {
+            assert(!obj->next);
+            T* cur = head;
+            while (true) {
+                obj->next = cur;
+                T* prev = __sync_val_compare_and_swap(&head, cur, obj);
+                if (prev == cur) break;
+                cur = prev;
+            }
+        }
+
+        inline bool empty() const {
+            return head == nullptr;
+        }
+
+        //Single consumer. Returns a next-linked list in push order; the caller
+        //must clear each element's next before reusing it.
+        T* takeAll() {
+            if (!head) return nullptr;
+            T* list = __sync_lock_test_and_set(&head, (T*)nullptr);
+            T* rev = nullptr;
+            while (list) {
+                T* next = list->next;
+                list->next = rev;
+                rev = list;
+                list = next;
+            }
+            return rev;
+        }
+};
+
+#endif  // MPSC_STACK_H_
@@ -29,19 +29,33 @@
 /* Very simple fixed-delay network model. Parses a list of delays between
  * entities, then accepts queries for roundtrip times between these entities.
  * There is no contention modeling or even support for serialization latency.
- * This is a basic model that should be extended as appropriate.
+ * This is a basic model that should be extended as appropriate (see
+ * MeshNetwork for one that models contention).
  */
 
+#include <stdint.h>
 #include <string>
 #include <unordered_map>
 
+class MemObject;
+
 class Network {
     private:
         std::unordered_map<std::string, uint32_t> delayMap;
 
+    protected:
+        Network() {}
+
     public:
         explicit Network(const char* filename);
-        uint32_t getRTT(const char* src, const char* dst);
+        virtual ~Network() {}
+
+        virtual uint32_t getRTT(const char* src, const char* dst);
+
+        // Returns a MemObject that carries src's accesses to dst over the
+        // network, charging their latency; or nullptr if src reaches dst in
+        // getRTT() cycles. Fixed-delay networks always return nullptr.
+        virtual MemObject* getPort(const char* src, MemObject* dst) {return nullptr;}
 };
 
 #endif  // NETWORK_H_
@@ -59,10 +59,11 @@ void NullCore::join() {
 //Static class functions: Function pointers and trampolines
 
 InstrFuncPtrs NullCore::GetFuncPtrs() {
-    return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};
+    return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, LoadPcFunc};
 }
 
 void NullCore::LoadFunc(THREADID tid, ADDRINT addr) {}
+void NullCore::LoadPcFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {}
 void NullCore::StoreFunc(THREADID tid, ADDRINT addr) {}
 void NullCore::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {}
 void NullCore::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {}
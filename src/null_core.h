@@ -54,6 +54,7 @@ class NullCore : public Core {
         inline void bbl(BblInfo* bblInstrs);
 
         static void LoadFunc(THREADID tid, ADDRINT addr);
+        static void LoadPcFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
         static void StoreFunc(THREADID tid, ADDRINT addr);
         static void BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
         static void PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred);
@@ -25,6 +25,7 @@
 
 #include "ooo_core.h"
 #include <algorithm>
+#include <math.h>
 #include <queue>
 #include <string>
 #include "bithacks.h"
@@ -55,7 +56,9 @@
 #define ISSUES_PER_CYCLE 4
 #define RF_READS_PER_CYCLE 3
 
-OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name) {
+OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, uint64_t _samplingPeriod, uint32_t _samplingWindow, uint32_t _samplingWarmup)
+    : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name), samplingPeriod(_samplingPeriod), samplingWindow(_samplingWindow), samplingWarmup(_samplingWarmup)
+{
     decodeCycle = DECODE_STAGE;  // allow subtracting from it
     curCycle = 0;
     phaseEndCycle = zinfo->phaseLength;
@@ -74,6 +77,36 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
     instrs = uops = bbls = approxInstrs = mispredBranches = 0;
 
     for (uint32_t i = 0; i < FWD_ENTRIES; i++) fwdArray[i].set((Address)(-1L), 0);
+
+    if (samplingPeriod) {
+        if (!samplingWindow || (uint64_t)samplingWindow + samplingWarmup >= samplingPeriod) {
+            panic("%s: samplingWindow (%d) must be non-zero, and samplingWindow + samplingWarmup (%d) must be below samplingPeriod (%ld)",
+                    name.c_str(), samplingWindow, samplingWarmup, samplingPeriod);
+        }
+        // Start each period in warm mode, so the first window is measured with warm caches
+        samplingMode = SMPL_WARM;
+        samplingModeEnd = samplingPeriod - samplingWindow - samplingWarmup;
+    } else {
+        samplingMode = SMPL_MEASURE;
+        samplingModeEnd = (uint64_t)-1L;
+    }
+    warmCPI = 1.0;  // until we measure the first window
+    warmCycles = 0.0;
+    windowStartCycle = windowStartInstrs = windowStartMisses = 0;
+    smplWindows = 0;
+    smplCPISum = smplCPISqSum = smplMPKISum = smplMPKISqSum = 0.0;
+}
+
+// Sampling stats: mean and 95% confidence interval half-width, scaled by 1000
+static uint64_t SampleMean(uint64_t n, double sum) {
+    return n? (uint64_t)(1000.0*sum/n) : 0;
+}
+
+static uint64_t SampleCI(uint64_t n, double sum, double sqSum) {
+    if (n < 2) return 0;
+    double mean = sum/n;
+    double var = MAX(0.0, (sqSum - n*mean*mean)/(n - 1));
+    return (uint64_t)(1000.0*1.96*sqrt(var/n));
 }
 
 void OOOCore::initStats(AggregateStat* parentStat) {
@@ -107,6 +140,29 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     coreStat->append(approxInstrsStat);
     coreStat->append(mispredBranchesStat);
 
+    if (samplingPeriod) {
+        ProxyStat* smplWindowsStat = new ProxyStat();
+        smplWindowsStat->init("smplWindows", "Measured sampling windows", &smplWindows);
+        auto cpi = [this]() { return SampleMean(smplWindows, smplCPISum); };
+        LambdaStat<decltype(cpi)>* cpiStat = new LambdaStat<decltype(cpi)>(cpi);
+        cpiStat->init("smplCPI", "Sampled CPI (x1000)");
+        auto cpiCI = [this]() { return SampleCI(smplWindows, smplCPISum, smplCPISqSum); };
+        LambdaStat<decltype(cpiCI)>* cpiCIStat = new LambdaStat<decltype(cpiCI)>(cpiCI);
+        cpiCIStat->init("smplCPICI", "Sampled CPI 95% confidence interval half-width (x1000)");
+        auto mpki = [this]() { return SampleMean(smplWindows, smplMPKISum); };
+        LambdaStat<decltype(mpki)>* mpkiStat = new LambdaStat<decltype(mpki)>(mpki);
+        mpkiStat->init("smplMPKI", "Sampled L1D MPKI (x1000)");
+        auto mpkiCI = [this]() { return SampleCI(smplWindows, smplMPKISum, smplMPKISqSum); };
+        LambdaStat<decltype(mpkiCI)>* mpkiCIStat = new LambdaStat<decltype(mpkiCI)>(mpkiCI);
+        mpkiCIStat->init("smplMPKICI", "Sampled L1D MPKI 95% confidence interval half-width (x1000)");
+
+        coreStat->append(smplWindowsStat);
+        coreStat->append(cpiStat);
+        coreStat->append(cpiCIStat);
+        coreStat->append(mpkiStat);
+        coreStat->append(mpkiCIStat);
+    }
+
 #ifdef OOO_STALL_STATS
     profFetchStalls.init("fetchStalls",  "Fetch stalls");  coreStat->append(&profFetchStalls);
     profDecodeStalls.init("decodeStalls", "Decode stalls"); coreStat->append(&profDecodeStalls);
@@ -131,9 +187,10 @@ void OOOCore::contextSwitch(int32_t gid) {
 }
 
 
-InstrFuncPtrs OOOCore::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
+InstrFuncPtrs OOOCore::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, LoadPcFunc};}
 
-inline void OOOCore::load(Address addr) {
+inline void OOOCore::load(Address addr, Address pc) {
+    loadPcs[loads] = pc;
     loadAddrs[loads++] = addr;
 }
 
@@ -164,12 +221,22 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         return;
     }
 
+    if (samplingMode == SMPL_WARM) {
+        warmBbl(bblAddr, bblInfo);
+        if (instrs >= samplingModeEnd) samplingSwitch();
+        return;
+    }
+
     /* Simulate execution of previous BBL */
 
     uint32_t bblInstrs = prevBbl->instrs;
     DynBbl* bbl = &(prevBbl->oooBbl[0]);
     prevBbl = bblInfo;
 
+    //Loads and stores were buffered as the BBL ran; start fetching their filter cache entries
+    for (uint32_t i = 0; i < loads; i++) l1d->prefetch(loadAddrs[i]);
+    for (uint32_t i = 0; i < stores; i++) l1d->prefetch(storeAddrs[i]);
+
     uint32_t loadIdx = 0;
     uint32_t storeIdx = 0;
 
@@ -265,10 +332,11 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     // Wait for all previous store addresses to be resolved
                     dispatchCycle = MAX(lastStoreAddrCommitCycle+1, dispatchCycle);
 
+                    Address pc = loadPcs[loadIdx];
                     Address addr = loadAddrs[loadIdx++];
                     uint64_t reqSatisfiedCycle = dispatchCycle;
                     if (addr != ((Address)-1L)) {
-                        reqSatisfiedCycle = l1d->load(addr, dispatchCycle) + L1D_LAT;
+                        reqSatisfiedCycle = l1d->load(addr, dispatchCycle, pc) + L1D_LAT;
                         cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
                     }
 
@@ -440,6 +508,84 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 #endif
         decodeCycle = minFetchDecCycle;
     }
+
+    if (instrs >= samplingModeEnd) samplingSwitch();
+}
+
+/* Functional warming: loads, stores, and ifetches access the caches at
+ * curCycle (so the weave phase still sees them), and the branch predictor is
+ * trained, but there is no pipeline timing; time moves at warmCPI.
+ */
+inline void OOOCore::warmBbl(Address bblAddr, BblInfo* bblInfo) {
+    uint32_t bblInstrs = prevBbl->instrs;
+    DynBbl* bbl = &(prevBbl->oooBbl[0]);
+    prevBbl = bblInfo;
+
+    for (uint32_t i = 0; i < loads; i++) {
+        Address addr = loadAddrs[i];
+        if (addr == ((Address)-1L)) continue;
+        cRec.record(curCycle, curCycle, l1d->load(addr, curCycle, loadPcs[i]));
+    }
+    for (uint32_t i = 0; i < stores; i++) {
+        cRec.record(curCycle, curCycle, l1d->store(storeAddrs[i], curCycle));
+    }
+    loads = stores = 0;
+
+    if (branchPc && !branchPred.predict(branchPc, branchTaken)) mispredBranches++;
+    branchPc = 0;
+
+    uint32_t lineSize = 1 << lineBits;
+    Address endAddr = bblAddr + bblInfo->bytes;
+    for (Address fetchAddr = bblAddr; fetchAddr < endAddr; fetchAddr += lineSize) {
+        cRec.record(curCycle, curCycle, l1i->load(fetchAddr, curCycle));
+    }
+
+    instrs += bblInstrs;
+    uops += bbl->uops;
+    bbls++;
+    approxInstrs += bbl->approxInstrs;
+
+    warmCycles += bblInstrs*warmCPI;
+    uint64_t cycles = (uint64_t)warmCycles;
+    if (cycles) {
+        warmCycles -= cycles;
+        advance(curCycle + cycles);
+    }
+}
+
+void OOOCore::samplingSwitch() {
+    switch (samplingMode) {
+        case SMPL_WARM:
+            samplingMode = SMPL_DETAILED_WARMUP;
+            samplingModeEnd = instrs + samplingWarmup;
+            if (samplingWarmup) break;
+            // Fall through with no detailed warmup
+
+        case SMPL_DETAILED_WARMUP:
+            samplingMode = SMPL_MEASURE;
+            samplingModeEnd = instrs + samplingWindow;
+            windowStartCycle = curCycle;
+            windowStartInstrs = instrs;
+            windowStartMisses = l1d->getMisses();
+            break;
+
+        case SMPL_MEASURE:
+            {
+                uint64_t windowInstrs = instrs - windowStartInstrs;
+                double cpi = ((double)(curCycle - windowStartCycle))/windowInstrs;
+                double mpki = 1000.0*(l1d->getMisses() - windowStartMisses)/windowInstrs;
+                smplWindows++;
+                smplCPISum += cpi;
+                smplCPISqSum += cpi*cpi;
+                smplMPKISum += mpki;
+                smplMPKISqSum += mpki*mpki;
+                warmCPI = cpi;
+
+                samplingMode = SMPL_WARM;
+                samplingModeEnd = instrs + samplingPeriod - samplingWindow - samplingWarmup;
+            }
+            break;
+    }
 }
 
 // Timing simulation code
@@ -484,12 +630,13 @@ void OOOCore::advance(uint64_t targetCycle) {
 
 // Pin interface code
 
-void OOOCore::LoadFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->load(addr);}
+void OOOCore::LoadFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->load(addr, 0);}
+void OOOCore::LoadPcFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {static_cast<OOOCore*>(cores[tid])->load(addr, pc);}
 void OOOCore::StoreFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->store(addr);}
 
 void OOOCore::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {
     OOOCore* core = static_cast<OOOCore*>(cores[tid]);
-    if (pred) core->load(addr);
+    if (pred) core->load(addr, 0);
     else core->predFalseMemOp();
 }
 
@@ -372,6 +372,7 @@ class OOOCore : public Core {
 
         //Record load and store addresses
         Address loadAddrs[256];
+        Address loadPcs[256];
         Address storeAddrs[256];
         uint32_t loads;
         uint32_t stores;
@@ -434,8 +435,25 @@ class OOOCore : public Core {
 
         OOOCoreRecorder cRec;
 
+        // SMARTS-style sampling (samplingPeriod > 0): every samplingPeriod instrs, run
+        // samplingWarmup instrs in detail to warm the pipeline, then measure the next
+        // samplingWindow instrs; in between, only warm caches and the branch predictor,
+        // and advance time at the CPI of the last measured window
+        enum SamplingMode {SMPL_WARM, SMPL_DETAILED_WARMUP, SMPL_MEASURE};
+        uint64_t samplingPeriod;
+        uint32_t samplingWindow;
+        uint32_t samplingWarmup;
+        SamplingMode samplingMode;
+        uint64_t samplingModeEnd;  // instrs at which we switch modes
+        double warmCPI;
+        double warmCycles;  // fractional cycles not yet advanced in warm mode
+        uint64_t windowStartCycle, windowStartInstrs, windowStartMisses;
+        uint64_t smplWindows;
+        double smplCPISum, smplCPISqSum, smplMPKISum, smplMPKISqSum;
+
     public:
-        OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name);
+        OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name,
+                uint64_t _samplingPeriod = 0, uint32_t _samplingWindow = 10000, uint32_t _samplingWarmup = 2000);
 
         void initStats(AggregateStat* parentStat);
 
@@ -456,7 +474,7 @@ class OOOCore : public Core {
         void cSimEnd();
 
     private:
-        inline void load(Address addr);
+        inline void load(Address addr, Address pc);
         inline void store(Address addr);
 
         /* NOTE: Analysis routines cannot touch curCycle directly, must use
@@ -464,8 +482,9 @@ class OOOCore : public Core {
          * jumps.
          *
          * UPDATE: With decodeCycle, this difference is more serious. ONLY
-         * cSimStart and cSimEnd should call advance(). advance() is now meant
-         * to advance the cycle counters in the whole core in lockstep.
+         * cSimStart, cSimEnd, join, and warmBbl (sampling mode, with an empty
+         * window) should call advance(). advance() is now meant to advance
+         * the cycle counters in the whole core in lockstep.
          */
         inline void advance(uint64_t targetCycle);
 
@@ -477,7 +496,12 @@ class OOOCore : public Core {
 
         inline void bbl(Address bblAddr, BblInfo* bblInfo);
 
+        // Sampling: functional warming of the previous BBL, and mode switches
+        inline void warmBbl(Address bblAddr, BblInfo* bblInfo);
+        void samplingSwitch();
+
         static void LoadFunc(THREADID tid, ADDRINT addr);
+        static void LoadPcFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
         static void StoreFunc(THREADID tid, ADDRINT addr);
         static void PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred);
         static void PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred);
@@ -25,6 +25,7 @@
 
 #include "prefetcher.h"
 #include "bithacks.h"
+#include "zsim.h"
 
 //#define DBG(args...) info(args)
 #define DBG(args...)
@@ -187,4 +188,197 @@ uint64_t StreamPrefetcher::invalidate(const InvReq& req) {
     return child->invalidate(req);
 }
 
+uint64_t StreamPrefetcher::invalidateLines(const g_vector<InvReq>& reqs) {
+    return child->invalidateLines(reqs);
+}
+
+/* TrackedPrefetcher */
+
+TrackedPrefetcher::TrackedPrefetcher(const g_string& _name, uint32_t _degree, uint32_t _trackedPrefetches)
+    : name(_name), trackedPrefetches(_trackedPrefetches), trackedPos(0), degree(_degree), pageLineBits(12 - ilog2(zinfo->lineSize))
+{
+    if (!degree || degree > MAX_PREFETCH_DEGREE) panic("%s: degree must be between 1 and %d, got %d", name.c_str(), MAX_PREFETCH_DEGREE, degree);
+    if (!trackedPrefetches) panic("%s: must track at least one prefetch", name.c_str());
+    trackedFifo.resize(trackedPrefetches, -1L);
+}
+
+void TrackedPrefetcher::setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network) {
+    childId = _childId;
+    if (parents.size() != 1) panic("Must have one parent");
+    if (network) panic("Network not handled");
+    parent = parents[0];
+}
+
+void TrackedPrefetcher::setChildren(const g_vector<BaseCache*>& children, Network* network) {
+    if (children.size() != 1) panic("Must have one children");
+    if (network) panic("Network not handled");
+    child = children[0];
+}
+
+void TrackedPrefetcher::initStats(AggregateStat* parentStat) {
+    AggregateStat* s = new AggregateStat();
+    s->init(name.c_str(), "Prefetcher stats");
+    profAccesses.init("acc", "Demand GETS accesses"); s->append(&profAccesses);
+    profPrefetches.init("pf", "Issued prefetches"); s->append(&profPrefetches);
+    profHits.init("hit", "Demand accesses to prefetched lines (accuracy = hit/pf, coverage = hit/acc)"); s->append(&profHits);
+    profLateHits.init("lateHit", "Prefetch hits that waited for the prefetch to complete"); s->append(&profLateHits);
+    profUseless.init("useless", "Prefetches dropped from the tracking table without a demand access"); s->append(&profUseless);
+    initPredictorStats(s);
+    parentStat->append(s);
+}
+
+uint64_t TrackedPrefetcher::access(MemReq& req) {
+    uint32_t origChildId = req.childId;
+    req.childId = childId;
+
+    if (req.type != GETS) {  // other reqs ignored, including stores
+        uint64_t respCycle = parent->access(req);
+        req.childId = origChildId;
+        return respCycle;
+    }
+
+    profAccesses.inc();
+
+    uint64_t reqCycle = req.cycle;
+    uint64_t respCycle = parent->access(req);
+
+    g_unordered_map<Address, Tracked>::iterator it = tracked.find(req.lineAddr);
+    if (it != tracked.end()) {
+        profHits.inc();
+        if (it->second.respCycle > respCycle) {
+            profLateHits.inc();
+            respCycle = it->second.respCycle;
+        }
+        tracked.erase(it);  // its FIFO slot becomes stale
+    }
+
+    Address candidates[MAX_PREFETCH_DEGREE];
+    uint32_t numCandidates = train(req, candidates);
+    assert(numCandidates <= degree);
+    for (uint32_t i = 0; i < numCandidates; i++) {
+        Address pfLineAddr = candidates[i];
+        if (pfLineAddr == req.lineAddr || (pfLineAddr >> pageLineBits) != (req.lineAddr >> pageLineBits)) continue;
+        if (tracked.count(pfLineAddr)) continue;  // already prefetched
+
+        MESIState state = I;
+        MemReq pfReq = {pfLineAddr, GETS, req.childId, &state, reqCycle, req.childLock, state, req.srcId, MemReq::PREFETCH};
+        uint64_t pfRespCycle = parent->access(pfReq);
+        assert(state == I);  // prefetch access should not give us any permissions
+        profPrefetches.inc();
 
+        Address& slot = trackedFifo[trackedPos];
+        if (slot != (Address)-1L) {
+            g_unordered_map<Address, Tracked>::iterator sit = tracked.find(slot);
+            if (sit != tracked.end() && sit->second.slot == trackedPos) {
+                tracked.erase(sit);
+                profUseless.inc();
+            }
+        }
+        slot = pfLineAddr;
+        tracked[pfLineAddr] = {pfRespCycle, trackedPos};
+        trackedPos = (trackedPos + 1) % trackedPrefetches;
+    }
+
+    req.childId = origChildId;
+    return respCycle;
+}
+
+uint64_t TrackedPrefetcher::invalidate(const InvReq& req) {
+    return child->invalidate(req);
+}
+
+uint64_t TrackedPrefetcher::invalidateLines(const g_vector<InvReq>& reqs) {
+    return child->invalidateLines(reqs);
+}
+
+/* IPStridePrefetcher */
+
+IPStridePrefetcher::IPStridePrefetcher(const g_string& _name, uint32_t _degree, uint32_t _trackedPrefetches, uint32_t entries)
+    : TrackedPrefetcher(_name, _degree, _trackedPrefetches)
+{
+    if (!entries) panic("%s: IP-stride table needs at least one entry", _name.c_str());
+    Entry e;
+    e.pc = 0;
+    e.lastLineAddr = 0;
+    e.stride = 0;
+    table.resize(entries, e);
+}
+
+void IPStridePrefetcher::initPredictorStats(AggregateStat* s) {
+    profNoPC.init("noPC", "Accesses without a PC (not trained on)"); s->append(&profNoPC);
+    profTableMisses.init("tableMisses", "Accesses whose PC was not in the table"); s->append(&profTableMisses);
+    profTrained.init("trained", "Accesses whose PC had a confident stride"); s->append(&profTrained);
+}
+
+uint32_t IPStridePrefetcher::train(const MemReq& req, Address* candidates) {
+    if (!req.pc) {
+        profNoPC.inc();
+        return 0;
+    }
+
+    Entry& e = table[((req.pc >> 2) ^ (req.pc >> 12)) % table.size()];
+    if (e.pc != req.pc) {
+        profTableMisses.inc();
+        e.pc = req.pc;
+        e.lastLineAddr = req.lineAddr;
+        e.stride = 0;
+        e.conf.reset();
+        return 0;
+    }
+
+    int64_t stride = req.lineAddr - e.lastLineAddr;
+    e.lastLineAddr = req.lineAddr;
+    if (!stride) return 0;  // same line, e.g., a refetch after an invalidation
+    if (stride == e.stride) {
+        e.conf.inc();
+    } else {
+        e.conf.dec();
+        if (!e.conf.pred()) e.stride = stride;
+    }
+
+    if (!e.conf.pred()) return 0;
+    profTrained.inc();
+    for (uint32_t i = 0; i < degree; i++) candidates[i] = req.lineAddr + (i + 1)*e.stride;
+    return degree;
+}
+
+/* DeltaCorrelationPrefetcher */
+
+DeltaCorrelationPrefetcher::DeltaCorrelationPrefetcher(const g_string& _name, uint32_t _degree, uint32_t _trackedPrefetches, uint32_t historyLength)
+    : TrackedPrefetcher(_name, _degree, _trackedPrefetches), deltaPos(0), numDeltas(0), lastLineAddr(0)
+{
+    if (historyLength < 4) panic("%s: delta history must hold at least 4 deltas, got %d", _name.c_str(), historyLength);
+    deltas.resize(historyLength, 0);
+}
+
+void DeltaCorrelationPrefetcher::initPredictorStats(AggregateStat* s) {
+    profCorrelations.init("corr", "Accesses whose last two deltas matched earlier in the history"); s->append(&profCorrelations);
+}
+
+uint32_t DeltaCorrelationPrefetcher::train(const MemReq& req, Address* candidates) {
+    int64_t d = req.lineAddr - lastLineAddr;
+    bool first = (lastLineAddr == 0);
+    lastLineAddr = req.lineAddr;
+    if (first || !d) return 0;
+
+    deltas[deltaPos] = d;
+    deltaPos = (deltaPos + 1) % deltas.size();
+    if (numDeltas < deltas.size()) numDeltas++;
+    if (numDeltas < 3) return 0;
+
+    // Find the most recent earlier (d1, d0) pair, then replay the deltas that followed it
+    int64_t d0 = delta(0);
+    int64_t d1 = delta(1);
+    for (uint32_t age = 1; age + 1 < numDeltas; age++) {
+        if (delta(age) != d0 || delta(age + 1) != d1) continue;
+        profCorrelations.inc();
+        uint32_t n = 0;
+        Address addr = req.lineAddr;
+        for (int32_t next = age - 1; next >= 0 && n < degree; next--) {
+            addr += delta(next);
+            candidates[n++] = addr;
+        }
+        return n;
+    }
+    return 0;
+}
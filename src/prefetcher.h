@@ -29,6 +29,8 @@
 #include <bitset>
 #include "bithacks.h"
 #include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
 
@@ -111,6 +113,108 @@ class StreamPrefetcher : public BaseCache {
 
         uint64_t access(MemReq& req);
         uint64_t invalidate(const InvReq& req);
+        uint64_t invalidateLines(const g_vector<InvReq>& reqs);
+};
+
+#define MAX_PREFETCH_DEGREE 8
+
+/* Base for prefetchers that train a predictor on the demand GETS stream and issue whole-line prefetches
+ * (IPStridePrefetcher, DeltaCorrelationPrefetcher). Like StreamPrefetcher, it sits between a child cache and
+ * its parent, and prefetches only fill the parent.
+ *
+ * The last trackedPrefetches prefetches are remembered with their response cycle. A demand GETS to one of them
+ * is a prefetch hit, and completes no earlier than the prefetch did (a late hit if the prefetch was still in
+ * flight). Prefetches that leave the table unused are counted as useless. Accuracy is hit/pf; coverage is
+ * hit/acc, since every demand GETS that reaches us missed in the child. Prefetches stay within the demand
+ * access's 4KB page.
+ */
+class TrackedPrefetcher : public BaseCache {
+    private:
+        MemObject* parent;
+        BaseCache* child;
+        uint32_t childId;
+        g_string name;
+
+        struct Tracked {
+            uint64_t respCycle;
+            uint32_t slot;  // in trackedFifo
+        };
+
+        const uint32_t trackedPrefetches;
+        g_unordered_map<Address, Tracked> tracked;
+        g_vector<Address> trackedFifo;
+        uint32_t trackedPos;
+
+        Counter profAccesses, profPrefetches, profHits, profLateHits, profUseless;
+
+    protected:
+        const uint32_t degree;  // max prefetches per demand access
+        const uint32_t pageLineBits;
+
+        // Trains on a demand GETS; fills up to degree line addresses to prefetch and returns how many
+        virtual uint32_t train(const MemReq& req, Address* candidates) = 0;
+        virtual void initPredictorStats(AggregateStat* s) {}
+
+    public:
+        TrackedPrefetcher(const g_string& _name, uint32_t _degree, uint32_t _trackedPrefetches);
+        void initStats(AggregateStat* parentStat);
+        const char* getName() { return name.c_str();}
+        void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network);
+        void setChildren(const g_vector<BaseCache*>& children, Network* network);
+
+        uint64_t access(MemReq& req);
+        uint64_t invalidate(const InvReq& req);
+        uint64_t invalidateLines(const g_vector<InvReq>& reqs);
+};
+
+/* Per-load stride prefetcher, indexed by the PC of the load that missed in the child. An entry that sees the
+ * same non-zero stride twice in a row prefetches the next degree lines along it. Accesses without a PC
+ * (stores, ifetches) don't train it.
+ */
+class IPStridePrefetcher : public TrackedPrefetcher {
+    private:
+        struct Entry {
+            Address pc;
+            Address lastLineAddr;
+            int64_t stride;
+            SatCounter<3, 2, 0> conf;
+        };
+
+        g_vector<Entry> table;  // direct-mapped by PC
+
+        Counter profNoPC, profTableMisses, profTrained;
+
+    protected:
+        uint32_t train(const MemReq& req, Address* candidates);
+        void initPredictorStats(AggregateStat* s);
+
+    public:
+        IPStridePrefetcher(const g_string& _name, uint32_t _degree, uint32_t _trackedPrefetches, uint32_t entries);
+};
+
+/* Global-history delta-correlation prefetcher, in the style of the GHB G/DC prefetcher (Nesbit and Smith,
+ * HPCA 2004). Keeps the deltas between the last historyLength demand GETS line addresses. On each access,
+ * it looks back through the history for the most recent earlier occurrence of the last two deltas, and
+ * replays the deltas that followed it from the current address.
+ */
+class DeltaCorrelationPrefetcher : public TrackedPrefetcher {
+    private:
+        g_vector<int64_t> deltas;  // circular, oldest at deltaPos once full
+        uint32_t deltaPos;
+        uint32_t numDeltas;
+        Address lastLineAddr;
+
+        Counter profCorrelations;
+
+    protected:
+        uint32_t train(const MemReq& req, Address* candidates);
+        void initPredictorStats(AggregateStat* s);
+
+    public:
+        DeltaCorrelationPrefetcher(const g_string& _name, uint32_t _degree, uint32_t _trackedPrefetches, uint32_t historyLength);
+
+    private:
+        int64_t delta(uint32_t age) const { return deltas[(deltaPos + deltas.size() - 1 - age) % deltas.size()]; }  // age 0 is the newest
 };
 
 #endif  // PREFETCHER_H_
@@ -26,7 +26,10 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
+#include <stdio.h>
+#include <utility>
 #include "g_std/g_multimap.h"
+#include "g_std/g_vector.h"
 
 template <typename T, uint32_t B>
 class PrioQueue {
@@ -150,5 +153,151 @@ class PrioQueue {
         }
 };
 
+/* Monotone radix heap, an alternative to PrioQueue with no fixed horizon.
+ * Like PrioQueue, it requires that no element is enqueued before the last
+ * dequeued cycle, which holds for domain event queues. Bucket i > 0 holds the
+ * elements whose cycle first differs from the last dequeued cycle at bit i-1,
+ * and bucket 0 (an intrusive list, like PrioQueue's per-cycle lists) holds
+ * those at the last dequeued cycle. When bucket 0 runs out, the first
+ * non-empty bucket is split into lower buckets around its minimum; each
+ * element moves down at most 64 times in its lifetime, so push and pop are
+ * O(1) amortized regardless of how far ahead an event is scheduled. An
+ * occupancy mask finds the first non-empty bucket, and the minimum cycle is
+ * cached, so firstCycle() is O(1).
+ */
+template <typename T>
+class RadixPrioQueue {
+    typedef std::pair<uint64_t, T*> Elem;
+
+    T* head; //bucket 0, all at cycle last
+    g_vector<Elem> buckets[65]; //0 is unused
+    g_vector<Elem> refill;
+    uint64_t bucketMin[65]; //min cycle in each bucket, -1 if empty
+    uint64_t occ; //bit i-1 is 1 if buckets[i] is non-empty
+    uint64_t last; //last dequeued cycle (or refill pivot)
+    uint64_t minCycle; //valid if elems
+    uint64_t elems;
+
+    inline void push(uint64_t cycle, T* obj) {
+        if (cycle == last) {
+            assert(!obj->next);
+            obj->next = head;
+            head = obj;
+        } else {
+            uint32_t b = 64 - __builtin_clzl(cycle ^ last);
+            buckets[b].push_back(Elem(cycle, obj));
+            occ |= 1ul << (b - 1);
+            if (cycle < bucketMin[b]) bucketMin[b] = cycle;
+        }
+    }
+
+    public:
+        RadixPrioQueue() {
+            head = nullptr;
+            for (uint32_t i = 0; i < 65; i++) bucketMin[i] = -1L;
+            occ = 0;
+            last = 0;
+            minCycle = 0;
+            elems = 0;
+        }
+
+        void enqueue(T* obj, uint64_t cycle) {
+            assert(cycle >= last);
+            push(cycle, obj);
+            if (!elems || cycle < minCycle) minCycle = cycle;
+            elems++;
+        }
+
+        T* dequeue(uint64_t& deqCycle) {
+            assert(elems);
+            if (!head) {
+                uint32_t b = __builtin_ctzl(occ) + 1;
+                //All elements in b go to strictly lower buckets around the new minimum
+                last = bucketMin[b];
+                refill.swap(buckets[b]); //both keep their capacity, so steady state does not allocate
+                bucketMin[b] = -1L;
+                occ &= ~(1ul << (b - 1));
+                for (Elem& e : refill) push(e.first, e.second);
+                refill.clear();
+            }
+
+            T* obj = head;
+            head = obj->next;
+            obj->next = nullptr;
+            elems--;
+            if (elems) minCycle = head? last : bucketMin[__builtin_ctzl(occ) + 1];
+            deqCycle = last;
+            return obj;
+        }
+
+        inline uint64_t size() const {
+            return elems;
+        }
+
+        inline uint64_t firstCycle() const {
+            assert(elems);
+            return minCycle;
+        }
+};
+
+/* A PrioQueue or a RadixPrioQueue, picked at runtime (domain event queues use
+ * sim.domainQueue). Each operation takes one well-predicted branch.
+ */
+template <typename T, uint32_t B>
+class SelectablePrioQueue {
+    PrioQueue<T, B> blockPq;
+    RadixPrioQueue<T> radixPq;
+    bool radix;
+
+    public:
+        SelectablePrioQueue() : radix(false) {}
+
+        void setRadix(bool _radix) {
+            assert(!size());
+            radix = _radix;
+        }
+
+        inline void enqueue(T* obj, uint64_t cycle) {
+            if (radix) radixPq.enqueue(obj, cycle);
+            else blockPq.enqueue(obj, cycle);
+        }
+
+        inline T* dequeue(uint64_t& deqCycle) {
+            return radix? radixPq.dequeue(deqCycle) : blockPq.dequeue(deqCycle);
+        }
+
+        inline uint64_t size() const {
+            return radix? radixPq.size() : blockPq.size();
+        }
+
+        inline uint64_t firstCycle() const {
+            return radix? radixPq.firstCycle() : blockPq.firstCycle();
+        }
+};
+
+/* Wraps a queue and logs its operations to a trace ("E <cycle>" per enqueue,
+ * "D <cycle>" per dequeue), so pq_bench can replay real event streams.
+ */
+template <typename T, typename PQ>
+class RecordingPrioQueue : public PQ {
+    FILE* traceFile;
+
+    public:
+        RecordingPrioQueue() : traceFile(nullptr) {}
+
+        void setTrace(FILE* f) {traceFile = f;}
+
+        void enqueue(T* obj, uint64_t cycle) {
+            if (traceFile) fprintf(traceFile, "E %ld\n", cycle);
+            PQ::enqueue(obj, cycle);
+        }
+
+        T* dequeue(uint64_t& deqCycle) {
+            T* obj = PQ::dequeue(deqCycle);
+            if (traceFile) fprintf(traceFile, "D %ld\n", deqCycle);
+            return obj;
+        }
+};
+
 #endif  // PRIO_QUEUE_H_
 
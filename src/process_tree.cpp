@@ -32,6 +32,7 @@
 #include "constants.h"
 #include "event_queue.h"
 #include "process_stats.h"
+#include "simpoint.h"
 #include "stats.h"
 #include "zsim.h"
 
@@ -187,6 +188,21 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
         }  //  else leave mask empty, no cores
         g_vector<uint64_t> ffiPoints(ParseList<uint64_t>(config.get<const char*>(p_ss.str() +  ".ffiPoints", "")));
 
+        //SimPoint regions are simulated through FFI: fast-forward to each point, then simulate one interval
+        string simPoints = config.get<const char*>(p_ss.str() +  ".simPoints", "");
+        if (!simPoints.empty()) {
+            if (!ffiPoints.empty()) panic("%s: simPoints and ffiPoints are mutually exclusive", p_ss.str().c_str());
+            if (zinfo->simPointStats) panic("%s: only one process can be simulated by SimPoint regions", p_ss.str().c_str());
+            string simPointWeights = config.get<const char*>(p_ss.str() +  ".simPointWeights");
+            uint64_t simPointInterval = config.get<uint64_t>(p_ss.str() +  ".simPointInterval");
+            if (!simPointInterval) panic("%s: simPointInterval must be > 0", p_ss.str().c_str());
+            g_vector<double> weights;
+            ffiPoints = ParseSimPoints(simPoints, simPointWeights, simPointInterval, weights);
+            zinfo->simPointStats = new SimPointStats(procIdx, weights);
+            startFastForwarded = true;
+            info("%s: simulating %ld SimPoint regions of %ld instructions", p_ss.str().c_str(), weights.size(), simPointInterval);
+        }
+
         if (dumpInstrs) {
             if (dumpHeartbeats) warn("Dumping eventual stats on both heartbeats AND instructions; you won't be able to distinguish both!");
             auto getInstrs = [procIdx]() { return zinfo->processStats->getProcessInstrs(procIdx); };
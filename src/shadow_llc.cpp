@@ -0,0 +1,185 @@
+#include "shadow_llc.h"
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "cache.h"
+#include "coherence_ctrls.h"
+#include "compressed_cache.h"
+#include "log.h"
+#include "pin.H"
+#include "zsim.h"
+
+ShadowLLCs::ShadowLLCs(uint32_t _queueSize) : queueSize(_queueSize) {
+    if (queueSize < 2 || (queueSize & (queueSize - 1))) panic("Shadow LLC queue size must be a power of 2, not %d", queueSize);
+}
+
+void ShadowLLCs::addShadow(const g_string& name, const g_vector<Cache*>& shadowBanks) {
+    assert(shadowBanks.size());
+    names.push_back(name);
+    banks.push_back(shadowBanks);
+}
+
+void ShadowLLCs::initStats(AggregateStat* parentStat) {
+    AggregateStat* shadowsStat = new AggregateStat();
+    shadowsStat->init("shadows", "Shadow LLC stats");
+    for (uint32_t s = 0; s < banks.size(); s++) {
+        AggregateStat* groupStat = new AggregateStat(true);
+        groupStat->init(names[s].c_str(), "Cache stats");
+        for (Cache* bank : banks[s]) bank->initStats(groupStat);
+        shadowsStat->append(groupStat);
+    }
+    parentStat->append(shadowsStat);
+}
+
+void ShadowLLCs::dumpStats() {
+    for (g_vector<Cache*>& shadowBanks : banks) {
+        for (Cache* bank : shadowBanks) {
+            CompressedCache* ccache = dynamic_cast<CompressedCache*>(bank);
+            if (ccache) ccache->dumpArrayStats();
+            bank->dumpStats();
+        }
+    }
+}
+
+void ShadowLLCs::replay(uint32_t shadow, Address lineAddr, AccessType type, DataLine data) {
+    g_vector<Cache*>& shadowBanks = banks[shadow];
+    shadowBanks[HashParentId(lineAddr, shadowBanks.size())]->warm(lineAddr, type, data);
+}
+
+uint64_t ShadowTap::access(MemReq& req) {
+    if (req.type == GETS || req.type == GETX) ShadowLLCsEnqueue(req.lineAddr, req.type);
+    return bank->access(req);
+}
+
+/* Bounded MPSC ring (Vyukov-style): each slot carries a sequence number that
+ * tells producers and the consumer whose turn it is, so producers only contend
+ * on the head CAS. When the ring is full, producers wait: dropping accesses
+ * would make shadow results depend on host scheduling. Each slot also holds the
+ * line's data, copied from the application by the producer: by the time the
+ * worker replays the access, the application may have overwritten it.
+ */
+class ShadowQueue {
+    private:
+        struct Slot {
+            volatile uint64_t seq;
+            Address lineAddr;
+            AccessType type;
+            uint8_t* data; //lineSize bytes in lines
+        };
+
+        Slot* slots;
+        uint8_t* lines;
+        uint32_t lineSize;
+        uint64_t mask;
+        volatile uint64_t head; //next slot to reserve (producers)
+        volatile uint64_t retired; //entries fully replayed (consumer)
+
+    public:
+        ShadowQueue(uint32_t size, uint32_t _lineSize) : lineSize(_lineSize), mask(size - 1), head(0), retired(0) {
+            slots = new Slot[size];
+            lines = new uint8_t[(uint64_t)size*lineSize];
+            for (uint32_t i = 0; i < size; i++) {
+                slots[i].seq = i;
+                slots[i].data = &lines[(uint64_t)i*lineSize];
+            }
+        }
+
+        void push(Address lineAddr, AccessType type) {
+            uint64_t pos = head;
+            Slot* slot;
+            while (true) {
+                slot = &slots[pos & mask];
+                int64_t diff = (int64_t)(slot->seq - pos);
+                if (diff == 0) {
+                    uint64_t cur = __sync_val_compare_and_swap(&head, pos, pos + 1);
+                    if (cur == pos) break;
+                    pos = cur;
+                } else if (diff < 0) { //full, wait for the worker
+                    sched_yield();
+                    pos = head;
+                } else {
+                    pos = head;
+                }
+            }
+            slot->lineAddr = lineAddr;
+            slot->type = type;
+            memset(slot->data, 0, lineSize); //unmapped lines read as zeros
+            PIN_SafeCopy(slot->data, (void*)(lineAddr << lineBits), lineSize);
+            __sync_synchronize();
+            slot->seq = pos + 1;
+        }
+
+        //Single consumer; *data stays valid (and may be modified) until retire()
+        bool pop(Address* lineAddr, AccessType* type, DataLine* data) {
+            uint64_t pos = retired;
+            Slot* slot = &slots[pos & mask];
+            if (slot->seq != pos + 1) return false;
+            __sync_synchronize();
+            *lineAddr = slot->lineAddr;
+            *type = slot->type;
+            *data = slot->data;
+            return true;
+        }
+
+        //Called by the consumer after replaying the entry returned by pop()
+        void retire() {
+            uint64_t pos = retired;
+            slots[pos & mask].seq = pos + mask + 1;
+            __sync_synchronize();
+            retired = pos + 1;
+        }
+
+        bool drained() const {
+            return retired == head;
+        }
+};
+
+//Process-local state (plain heap, not the shared global heap)
+static ShadowQueue** shadowQueues = nullptr;
+static uint32_t numShadowQueues = 0;
+
+static void ShadowWorker(void* arg) {
+    uint32_t shadow = (uint32_t)(uintptr_t)arg;
+    ShadowQueue* q = shadowQueues[shadow];
+    uint32_t idlePolls = 0;
+    while (true) {
+        Address lineAddr;
+        AccessType type;
+        DataLine data;
+        if (q->pop(&lineAddr, &type, &data)) {
+            zinfo->shadowLLCs->replay(shadow, lineAddr, type, data);
+            q->retire();
+            idlePolls = 0;
+        } else if (++idlePolls < 1024) {
+            sched_yield();
+        } else {
+            //Back off so idle workers do not steal cycles from simulation threads
+            struct timespec tm = {0, 50*1000};
+            nanosleep(&tm, nullptr);
+        }
+    }
+}
+
+void ShadowLLCsInitProcess() {
+    if (!zinfo->shadowLLCs) return;
+    //In a forked child, the parent's queues were copied but its workers were not; start over
+    numShadowQueues = zinfo->shadowLLCs->size();
+    shadowQueues = new ShadowQueue*[numShadowQueues];
+    for (uint32_t s = 0; s < numShadowQueues; s++) {
+        shadowQueues[s] = new ShadowQueue(zinfo->shadowLLCs->getQueueSize(), zinfo->lineSize);
+    }
+    __sync_synchronize();
+    for (uint32_t s = 0; s < numShadowQueues; s++) {
+        PIN_SpawnInternalThread(ShadowWorker, (void*)(uintptr_t)s, 64*1024, nullptr);
+    }
+}
+
+void ShadowLLCsEnqueue(Address lineAddr, AccessType type) {
+    for (uint32_t s = 0; s < numShadowQueues; s++) shadowQueues[s]->push(lineAddr, type);
+}
+
+void ShadowLLCsDrain() {
+    for (uint32_t s = 0; s < numShadowQueues; s++) {
+        while (!shadowQueues[s]->drained()) sched_yield();
+    }
+}
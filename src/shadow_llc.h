@@ -0,0 +1,70 @@
+#ifndef SHADOW_LLC_H_
+#define SHADOW_LLC_H_
+
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+class Cache;
+
+/* Shadow LLCs let a single run sweep last-level cache configurations. Each
+ * shadow is a full cache group (own type, size, arrays, ...) that sees the same
+ * GETS/GETX stream as the real LLC, but only functionally, through
+ * Cache::warm(): shadows never send requests, never invalidate, and never
+ * affect timing. The real LLC is the only one that drives the simulation.
+ * Only types with a warm() can shadow (Simple, Timing, ApproximateBDI and
+ * ApproximateDedup); the Doppelganger, BDI-dedup, ideal and naive dedup caches
+ * have none and are rejected at init.
+ * Shadow banks keep their compressed-cache stats to themselves, and sample
+ * them every sim.shadowSamplePeriod replayed accesses, so groups can set their
+ * own compressor knobs (hashSize, mapSize, floatCutSize, doubleCutSize) and be
+ * compared directly.
+ *
+ * Accesses are handed off through one bounded lock-free queue per shadow to a
+ * worker thread that replays them. Each entry carries the line's data, copied
+ * from the application when the access is queued, so queues and workers are
+ * per process; the shadow caches themselves are shared like every other cache.
+ */
+class ShadowLLCs : public GlobAlloc {
+    private:
+        g_vector<g_string> names;
+        g_vector< g_vector<Cache*> > banks;
+        uint32_t queueSize; //entries per queue, power of 2
+
+    public:
+        explicit ShadowLLCs(uint32_t _queueSize);
+
+        void addShadow(const g_string& name, const g_vector<Cache*>& shadowBanks);
+        void initStats(AggregateStat* parentStat);
+        void dumpStats(); //the RunningStats of shadow banks, which are not in the global LLC vectors
+
+        uint32_t size() const { return banks.size(); }
+        uint32_t getQueueSize() const { return queueSize; }
+
+        //Called from the worker threads
+        void replay(uint32_t shadow, Address lineAddr, AccessType type, DataLine data);
+};
+
+/* Sits between the LLC's children and one real LLC bank: forwards every
+ * request untouched, queueing GETS/GETX (and their line's data) for the
+ * shadows on the way.
+ */
+class ShadowTap : public MemObject {
+    private:
+        MemObject* bank;
+
+    public:
+        explicit ShadowTap(MemObject* _bank) : bank(_bank) {}
+        uint64_t access(MemReq& req);
+        const char* getName() { return bank->getName(); }
+};
+
+//Per-process side. InitProcess allocates this process's queues and spawns its
+//workers; it must be called once at startup and again in forked children.
+void ShadowLLCsInitProcess();
+void ShadowLLCsEnqueue(Address lineAddr, AccessType type);
+void ShadowLLCsDrain(); //blocks until this process's workers have replayed everything queued
+
+#endif  // SHADOW_LLC_H_
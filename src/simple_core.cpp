@@ -47,8 +47,8 @@ uint64_t SimpleCore::getPhaseCycles() const {
     return curCycle % zinfo->phaseLength;
 }
 
-void SimpleCore::load(Address addr) {
-    curCycle = l1d->load(addr, curCycle);
+void SimpleCore::load(Address addr, Address pc) {
+    curCycle = l1d->load(addr, curCycle, pc);
 }
 
 void SimpleCore::store(Address addr) {
@@ -89,11 +89,15 @@ void SimpleCore::join() {
 //Static class functions: Function pointers and trampolines
 
 InstrFuncPtrs SimpleCore::GetFuncPtrs() {
-    return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};
+    return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, LoadPcFunc};
 }
 
 void SimpleCore::LoadFunc(THREADID tid, ADDRINT addr) {
-    static_cast<SimpleCore*>(cores[tid])->load(addr);
+    static_cast<SimpleCore*>(cores[tid])->load(addr, 0);
+}
+
+void SimpleCore::LoadPcFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    static_cast<SimpleCore*>(cores[tid])->load(addr, pc);
 }
 
 void SimpleCore::StoreFunc(THREADID tid, ADDRINT addr) {
@@ -101,7 +105,7 @@ void SimpleCore::StoreFunc(THREADID tid, ADDRINT addr) {
 }
 
 void SimpleCore::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {
-    if (pred) static_cast<SimpleCore*>(cores[tid])->load(addr);
+    if (pred) static_cast<SimpleCore*>(cores[tid])->load(addr, 0);
 }
 
 void SimpleCore::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {
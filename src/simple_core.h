@@ -59,11 +59,12 @@ class SimpleCore : public Core {
 
     protected:
         //Simulation functions
-        inline void load(Address addr);
+        inline void load(Address addr, Address pc);
         inline void store(Address addr);
         inline void bbl(Address bblAddr, BblInfo* bblInstrs);
 
         static void LoadFunc(THREADID tid, ADDRINT addr);
+        static void LoadPcFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
         static void StoreFunc(THREADID tid, ADDRINT addr);
         static void BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
         static void PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred);
@@ -0,0 +1,272 @@
+#include "simpoint.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bithacks.h"
+#include "log.h"
+#include "stats.h"
+#include "zsim.h"
+
+/* BBV collection */
+
+#define MAX_BBV_BBLS (1 << 20)
+
+//Process-local
+static std::unordered_map<ADDRINT, uint32_t> bbvIds;
+static uint64_t* bbvCounts = nullptr; //instructions executed per BBL in the current interval, protected by bbvLock
+static uint32_t bbvBbls = 0;
+static uint64_t bbvInstrs = 0; //protected by bbvLock
+static uint64_t bbvNextDump = 0;
+static lock_t bbvLock;
+static FILE* bbvFile = nullptr;
+
+/* Each thread logs the BBLs it executes privately, and merges its log into
+ * bbvCounts under bbvLock when the log fills up or when its instructions may
+ * reach the next interval boundary, so the common path has no shared writes.
+ */
+#define BBV_LOG_ENTRIES 4096
+#define BBV_FLUSH_INSTRS (64*1024) //bounds how late other threads' counts reach an interval
+
+struct BbvThreadLog {
+    uint32_t entries;
+    uint32_t instrs;
+    uint32_t flushInstrs; //merge once instrs reaches this
+    uint32_t bblIds[BBV_LOG_ENTRIES];
+    uint32_t bblInstrs[BBV_LOG_ENTRIES];
+};
+
+static BbvThreadLog* bbvLogs[MAX_THREADS]; //indexed by tid, allocated on thread start
+
+//Called with bbvLock held
+static uint32_t BbvFlushInstrs() {
+    uint64_t left = (bbvNextDump > bbvInstrs)? bbvNextDump - bbvInstrs : 1;
+    return MIN(left, (uint64_t)BBV_FLUSH_INSTRS);
+}
+
+void BbvInitProcess() {
+    if (!zinfo->bbvInterval) return;
+    //In a forked child, start a new file with the child's procIdx
+    bbvIds.clear();
+    if (!bbvCounts) bbvCounts = new uint64_t[MAX_BBV_BBLS];
+    for (uint32_t i = 0; i < MAX_BBV_BBLS; i++) bbvCounts[i] = 0;
+    bbvBbls = 0;
+    bbvInstrs = 0;
+    bbvNextDump = zinfo->bbvInterval;
+    futex_init(&bbvLock);
+    for (uint32_t t = 0; t < MAX_THREADS; t++) {
+        if (bbvLogs[t]) BbvThreadStart(t);
+    }
+
+    std::stringstream ss;
+    ss << zinfo->outputDir << "/bbv." << procIdx << ".txt";
+    bbvFile = fopen(ss.str().c_str(), "w");
+    if (!bbvFile) panic("Could not open %s", ss.str().c_str());
+    info("Collecting BBVs every %ld instructions into %s", zinfo->bbvInterval, ss.str().c_str());
+}
+
+void BbvThreadStart(uint32_t tid) {
+    if (!zinfo->bbvInterval) return;
+    if (!bbvLogs[tid]) bbvLogs[tid] = new BbvThreadLog;
+    BbvThreadLog& log = *bbvLogs[tid];
+    log.entries = 0;
+    log.instrs = 0;
+    log.flushInstrs = BbvFlushInstrs();
+}
+
+uint32_t BbvGetBblId(ADDRINT bblAddr) {
+    std::unordered_map<ADDRINT, uint32_t>::iterator it = bbvIds.find(bblAddr);
+    if (it != bbvIds.end()) return it->second;
+    if (bbvBbls == MAX_BBV_BBLS) panic("BBV: more than %d distinct BBLs", MAX_BBV_BBLS);
+    uint32_t id = bbvBbls++;
+    bbvIds[bblAddr] = id;
+    return id;
+}
+
+//Called with bbvLock held
+static void BbvDumpInterval() {
+    bool empty = true;
+    for (uint32_t i = 0; i < bbvBbls; i++) {
+        if (bbvCounts[i]) {
+            fprintf(bbvFile, "%s:%d:%ld ", empty? "T" : "", i + 1 /*SimPoint ids start at 1*/, bbvCounts[i]);
+            bbvCounts[i] = 0;
+            empty = false;
+        }
+    }
+    if (!empty) fprintf(bbvFile, "\n");
+}
+
+//Called with bbvLock held
+static void BbvMergeLog(BbvThreadLog& log) {
+    for (uint32_t e = 0; e < log.entries; e++) bbvCounts[log.bblIds[e]] += log.bblInstrs[e];
+    bbvInstrs += log.instrs;
+    log.entries = 0;
+    log.instrs = 0;
+    if (bbvInstrs >= bbvNextDump) {
+        BbvDumpInterval();
+        bbvNextDump += zinfo->bbvInterval;
+    }
+    log.flushInstrs = BbvFlushInstrs();
+}
+
+static void BbvFlushLog(BbvThreadLog& log) {
+    futex_lock(&bbvLock);
+    if (bbvFile) BbvMergeLog(log); //process may be finishing
+    futex_unlock(&bbvLock);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL BbvCount(THREADID tid, UINT32 bblId, UINT32 instrs) {
+    BbvThreadLog& log = *bbvLogs[tid];
+    if (log.entries && log.bblIds[log.entries - 1] == bblId) { //loops
+        log.bblInstrs[log.entries - 1] += instrs;
+    } else {
+        log.bblIds[log.entries] = bblId;
+        log.bblInstrs[log.entries] = instrs;
+        log.entries++;
+    }
+    log.instrs += instrs;
+    if (unlikely(log.entries == BBV_LOG_ENTRIES || log.instrs >= log.flushInstrs)) BbvFlushLog(log);
+}
+
+void BbvThreadFini(uint32_t tid) {
+    if (bbvLogs[tid] && bbvLogs[tid]->entries) BbvFlushLog(*bbvLogs[tid]);
+}
+
+void BbvFinish() {
+    if (!bbvFile) return;
+    futex_lock(&bbvLock);
+    //Threads still running may log a few more BBLs, which are dropped
+    for (uint32_t t = 0; t < MAX_THREADS; t++) {
+        if (!bbvLogs[t]) continue;
+        BbvThreadLog& log = *bbvLogs[t];
+        for (uint32_t e = 0; e < log.entries; e++) bbvCounts[log.bblIds[e]] += log.bblInstrs[e];
+        log.entries = 0;
+    }
+    BbvDumpInterval();
+    fclose(bbvFile);
+    bbvFile = nullptr;
+    futex_unlock(&bbvLock);
+}
+
+/* Weighted stats */
+
+static void SnapshotStats(Stat* s, g_vector<uint64_t>& vals) {
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        for (uint32_t i = 0; i < as->size(); i++) SnapshotStats(as->get(i), vals);
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        vals.push_back(ss->get());
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        for (uint32_t i = 0; i < vs->size(); i++) vals.push_back(vs->count(i));
+    } //histograms and others are skipped
+}
+
+static void DumpWeightedValue(const std::string& name, const g_vector<double>& weighted, const g_vector<bool>& decreased, uint32_t& idx, std::ofstream& out) {
+    out << name << " " << weighted[idx];
+    if (decreased[idx]) out << " # decreased in some region, likely not a counter";
+    out << std::endl;
+    idx++;
+}
+
+static void DumpWeightedStats(Stat* s, const std::string& prefix, const g_vector<double>& weighted, const g_vector<bool>& decreased, uint32_t& idx, std::ofstream& out) {
+    std::string name = prefix.empty()? s->name() : prefix + "." + s->name();
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        for (uint32_t i = 0; i < as->size(); i++) DumpWeightedStats(as->get(i), name, weighted, decreased, idx, out);
+    } else if (dynamic_cast<ScalarStat*>(s)) {
+        DumpWeightedValue(name, weighted, decreased, idx, out);
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        for (uint32_t i = 0; i < vs->size(); i++) DumpWeightedValue(name + "." + std::to_string(i), weighted, decreased, idx, out);
+    }
+}
+
+SimPointStats::SimPointStats(uint32_t _procIdx, const g_vector<double>& _weights)
+    : procIdx(_procIdx), weights(_weights), regionsStarted(0), regionsDone(0), inRegion(false), weightDone(0.0)
+{
+    futex_init(&lock);
+}
+
+void SimPointStats::regionStart() {
+    futex_lock(&lock);
+    assert(!inRegion);
+    if (regionsStarted < weights.size()) {
+        startSnapshot.clear();
+        SnapshotStats(zinfo->rootStat, startSnapshot);
+        if (weighted.empty()) {
+            weighted.resize(startSnapshot.size(), 0.0);
+            decreased.resize(startSnapshot.size(), false);
+        }
+        inRegion = true;
+        info("SimPoint region %d/%ld started (weight %.4f)", regionsStarted, weights.size(), weights[regionsStarted]);
+        regionsStarted++;
+    }
+    futex_unlock(&lock);
+}
+
+void SimPointStats::regionEnd() {
+    futex_lock(&lock);
+    if (inRegion) {
+        g_vector<uint64_t> endSnapshot;
+        SnapshotStats(zinfo->rootStat, endSnapshot);
+        assert(endSnapshot.size() == startSnapshot.size());
+        double w = weights[regionsDone];
+        for (uint32_t i = 0; i < endSnapshot.size(); i++) {
+            //Gauges (e.g., set() or lambda stats) can go down; take the signed delta and flag them
+            if (endSnapshot[i] < startSnapshot[i]) decreased[i] = true;
+            weighted[i] += w*((double)endSnapshot[i] - (double)startSnapshot[i]);
+        }
+        weightDone += w;
+        inRegion = false;
+        info("SimPoint region %d/%ld done", regionsDone, weights.size());
+        regionsDone++;
+    }
+    futex_unlock(&lock);
+}
+
+void SimPointStats::dump(const char* file) {
+    futex_lock(&lock);
+    if (regionsDone < weights.size()) warn("Only %d of %ld SimPoint regions finished; weighting stats by the ones that did", regionsDone, weights.size());
+    std::ofstream out(file);
+    out << "# Weighted per-interval estimates over " << regionsDone << " SimPoint regions (total weight " << weightDone << ")" << std::endl;
+    if (regionsDone) {
+        g_vector<double> normalized(weighted);
+        for (double& v : normalized) v /= weightDone;
+        uint32_t idx = 0;
+        DumpWeightedStats(zinfo->rootStat, "", normalized, decreased, idx, out);
+    }
+    out.close();
+    futex_unlock(&lock);
+}
+
+g_vector<uint64_t> ParseSimPoints(const std::string& pointsFile, const std::string& weightsFile, uint64_t interval, g_vector<double>& weights) {
+    std::unordered_map<uint32_t, double> idWeights;
+    std::ifstream wf(weightsFile.c_str());
+    if (!wf.good()) panic("Could not open SimPoint weights file %s", weightsFile.c_str());
+    double w;
+    uint32_t id;
+    while (wf >> w >> id) idWeights[id] = w;
+
+    std::vector< std::pair<uint64_t, double> > points; //interval, weight
+    std::ifstream pf(pointsFile.c_str());
+    if (!pf.good()) panic("Could not open SimPoints file %s", pointsFile.c_str());
+    uint64_t pt;
+    while (pf >> pt >> id) {
+        if (!idWeights.count(id)) panic("SimPoint %d (interval %ld) has no weight in %s", id, pt, weightsFile.c_str());
+        points.push_back(std::make_pair(pt, idWeights[id]));
+    }
+    if (points.empty()) panic("No simulation points in %s", pointsFile.c_str());
+    std::sort(points.begin(), points.end());
+
+    //Alternate fast-forward and detailed lengths, starting in fast-forward
+    g_vector<uint64_t> ffiPoints;
+    uint64_t nextInterval = 0;
+    for (auto& p : points) {
+        if (p.first < nextInterval) panic("Repeated simulation point at interval %ld", p.first);
+        ffiPoints.push_back((p.first - nextInterval)*interval);
+        ffiPoints.push_back(interval);
+        weights.push_back(p.second);
+        nextInterval = p.first + 1;
+    }
+    return ffiPoints;
+}
@@ -0,0 +1,69 @@
+#ifndef SIMPOINT_H_
+#define SIMPOINT_H_
+
+#include <stdint.h>
+#include <string>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "pin.H"
+
+class Stat;
+
+/* SimPoint support, in two parts.
+ *
+ * BBV collection (sim.bbvInterval > 0): every process writes
+ * <outputDir>/bbv.<procIdx>.txt, with one basic block vector per interval of
+ * bbvInterval instructions in SimPoint's format ("T:<bbl>:<instrs> ..."). Ids
+ * are per process, assigned by BBL address in order of first instrumentation.
+ * Counting works in and out of fast-forward, so a profiling run can be fully
+ * fast-forwarded. Threads count privately and merge into the process's vector
+ * before an interval boundary, so threads racing at a boundary may shift a few
+ * BBLs to the next interval.
+ *
+ * Region-driven simulation (processN.simPoints/simPointWeights/simPointInterval):
+ * SimPoint's .simpoints and .weights outputs are turned into FFI points, so the
+ * process fast-forwards between its simulation points and runs each one in
+ * detail. SimPointStats takes a snapshot of every stat when a region starts and
+ * adds the region's weighted delta when it ends; at the end of the simulation,
+ * <outputDir>/zsim-simpoints.out has each stat's weighted estimate for one
+ * interval. Stats that decrease during a region (gauges, not counters) are
+ * flagged there, since their deltas are not meaningful. Use sim.ffWarm to keep the LLC warm between regions.
+ */
+
+void BbvInitProcess(); //call on process start and in forked children
+void BbvThreadStart(uint32_t tid);
+void BbvThreadFini(uint32_t tid); //merges the thread's pending counts
+uint32_t BbvGetBblId(ADDRINT bblAddr); //called from instrumentation
+VOID PIN_FAST_ANALYSIS_CALL BbvCount(THREADID tid, UINT32 bblId, UINT32 instrs);
+void BbvFinish(); //writes the last, partial interval
+
+class SimPointStats : public GlobAlloc {
+    private:
+        uint32_t procIdx;
+        g_vector<double> weights; //per region, in execution order
+        uint32_t regionsStarted;
+        uint32_t regionsDone;
+        bool inRegion;
+        double weightDone;
+        g_vector<uint64_t> startSnapshot;
+        g_vector<double> weighted;
+        g_vector<bool> decreased; //stats that went down in some region, so they are not counters
+        lock_t lock;
+
+    public:
+        SimPointStats(uint32_t _procIdx, const g_vector<double>& _weights);
+
+        uint32_t getProcIdx() const {return procIdx;}
+
+        void regionStart();
+        void regionEnd();
+        void dump(const char* file);
+};
+
+//Reads SimPoint's .simpoints ("<interval> <id>") and .weights ("<weight> <id>")
+//files; returns the FFI points that simulate those intervals, and their
+//weights in execution order
+g_vector<uint64_t> ParseSimPoints(const std::string& pointsFile, const std::string& weightsFile, uint64_t interval, g_vector<double>& weights);
+
+#endif  // SIMPOINT_H_
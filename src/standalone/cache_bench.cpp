@@ -0,0 +1,243 @@
+/* Micro-benchmark for the Pin-free memory hierarchy (libzsimmem.a). Builds one
+ * LLC bank of each requested type, the same way init.cpp does with default
+ * settings, and replays a synthetic or recorded access stream through its
+ * functional path (Cache::warm()). Reports accesses per second and hit rates.
+ * Compressed caches only sample their array stats with -S (every N accesses).
+ *
+ * Synthetic line contents mix zero, narrow-delta (BDI-friendly), duplicated
+ * (dedup-friendly) and random lines, picked deterministically per address.
+ *
+ * Trace format: one access per line, "R <hex byte address>" or "W <hex byte address>".
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <utility>
+#include <vector>
+#include "approximatebdi_cache.h"
+#include "approximatededup_cache.h"
+#include "cache.h"
+#include "cache_arrays.h"
+#include "coherence_ctrls.h"
+#include "hash.h"
+#include "log.h"
+#include "repl_policies.h"
+#include "standalone/standalone_sim.h"
+#include "stats.h"
+#include "zsim.h"
+
+using std::string;
+using std::vector;
+
+typedef vector< std::pair<Address, AccessType> > AccessStream;
+
+static inline uint64_t SplitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ul;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ul;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBul;
+    return x ^ (x >> 31);
+}
+
+static size_t SyntheticReader(void* dst, const void* src, size_t size) {
+    uint64_t lineAddr = ((uint64_t)src) >> lineBits;
+    uint64_t h = SplitMix(lineAddr);
+    uint64_t* words = (uint64_t*)dst;
+    uint32_t numWords = size/8;
+    switch (h % 4) {
+        case 0: //zeros
+            memset(dst, 0, size);
+            break;
+        case 1: //one base plus narrow deltas
+            for (uint32_t i = 0; i < numWords; i++) words[i] = h + (SplitMix(h + i) & 0xff);
+            break;
+        case 2: //one of a few popular lines
+            for (uint32_t i = 0; i < numWords; i++) words[i] = SplitMix((h >> 8) % 16 + i);
+            break;
+        default: //incompressible
+            for (uint32_t i = 0; i < numWords; i++) words[i] = SplitMix(h + i);
+    }
+    return size;
+}
+
+static Cache* BuildBenchCache(const string& type, uint32_t size, uint32_t ways, uint32_t tagRatio, uint32_t hashLines) {
+    uint32_t numLines = size/zinfo->lineSize;
+    if (numLines % ways || !isPow2(numLines/ways)) panic("%s: %d lines and %d ways do not give a power-of-2 number of sets", type.c_str(), numLines, ways);
+    g_string name(type.c_str());
+    HashFamily* hf = new IdHashFamily;
+    const uint32_t latency = 10;
+    const uint32_t mshrs = 16;
+
+    if (type == "Simple") {
+        ReplPolicy* rp = new LRUReplPolicy<true>(numLines);
+        CacheArray* array = new SetAssocArray(numLines, ways, rp, hf);
+        CC* cc = new MESICC(numLines, false, name);
+        rp->setCC(cc);
+        return new Cache(numLines, cc, array, rp, latency, latency, name);
+    }
+
+    CC* cc = new MESICC(numLines*tagRatio, false, name);
+    Counter* hitStats = new Counter();
+    hitStats->init("tagHits", "Tag hits");
+    Counter* missStats = new Counter();
+    missStats->init("tagMisses", "Tag misses");
+    Counter* allStats = new Counter();
+    allStats->init("tagAll", "Tag accesses");
+    g_string crName = name + g_string(" CompressionRatio");
+    g_string evName = name + g_string(" EvictionsPerAccess");
+    g_string tutName = name + g_string(" TagArrayUtilization");
+    g_string dutName = name + g_string(" DataArrayUtilization");
+    RunningStats* crStats = new RunningStats(crName);
+    RunningStats* evStats = new RunningStats(evName);
+    RunningStats* tutStats = new RunningStats(tutName);
+    RunningStats* dutStats = new RunningStats(dutName);
+
+    ReplPolicy* tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
+    ReplPolicy* dataRP = new DataLRUReplPolicy(numLines);
+    tagRP->setCC(cc);
+    if (type == "ApproximateBDI") {
+        ApproximateBDITagArray* tagArray = new ApproximateBDITagArray(numLines*tagRatio, ways*tagRatio, ways, tagRP, hf);
+        ApproximateBDIDataArray* dataArray = new ApproximateBDIDataArray(zinfo->floatCutSize, zinfo->doubleCutSize);
+        return new ApproximateBDICache(numLines*tagRatio, numLines, cc, tagArray, dataArray, tagRP, dataRP,
+                latency, latency, mshrs, ways, ways, 0, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+    } else if (type == "ApproximateDedup") {
+        ApproximateDedupTagArray* tagArray = new ApproximateDedupTagArray(numLines*tagRatio, ways, tagRP, hf);
+        ApproximateDedupDataArray* dataArray = new ApproximateDedupDataArray(numLines, ways, dataRP, hf, 1);
+        ReplPolicy* hashRP = new DataLRUReplPolicy(hashLines);
+        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1);
+        ApproximateDedupHashArray* hashArray = new ApproximateDedupHashArray(hashLines, 8, hashRP, hf, hashCompression, zinfo->hashSize, zinfo->floatCutSize, zinfo->doubleCutSize);
+        return new ApproximateDedupCache(numLines*tagRatio, numLines, cc, tagArray, dataArray, hashArray, tagRP, dataRP, hashRP,
+                latency, latency, mshrs, ways, ways, 0, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+    }
+    panic("Invalid cache type %s (valid: Simple, ApproximateBDI, ApproximateDedup)", type.c_str());
+}
+
+static void GenerateStream(AccessStream& stream, const string& pattern, uint64_t accesses, uint64_t footprintLines, uint32_t storePct) {
+    stream.reserve(accesses);
+    uint64_t seed = 0xB4AC5B;
+    for (uint64_t i = 0; i < accesses; i++) {
+        uint64_t r = SplitMix(seed + i);
+        uint64_t line;
+        if (pattern == "seq") {
+            line = i % footprintLines;
+        } else if (pattern == "rand") {
+            line = r % footprintLines;
+        } else if (pattern == "hot") { //90% of accesses go to 10% of the footprint
+            uint64_t hotLines = MAX(footprintLines/10, 1ul);
+            line = ((r >> 32) % 10)? (r % hotLines) : (r % footprintLines);
+        } else {
+            panic("Invalid pattern %s (valid: seq, rand, hot)", pattern.c_str());
+        }
+        AccessType type = ((r >> 16) % 100 < storePct)? GETX : GETS;
+        stream.push_back(std::make_pair((Address)(line + 0x100000), type));
+    }
+}
+
+static void ReadTrace(AccessStream& stream, const char* file) {
+    FILE* f = fopen(file, "r");
+    if (!f) panic("Could not open trace %s", file);
+    char op;
+    uint64_t addr;
+    while (fscanf(f, " %c %lx", &op, &addr) == 2) {
+        if (op != 'R' && op != 'W') panic("Invalid trace entry %c 0x%lx", op, addr);
+        stream.push_back(std::make_pair((Address)(addr >> lineBits), (op == 'W')? GETX : GETS));
+    }
+    fclose(f);
+    info("Read %ld accesses from %s", stream.size(), file);
+}
+
+static uint64_t Microseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec*1000000ul + tv.tv_usec;
+}
+
+static void Usage(const char* bin) {
+    fprintf(stderr, "Usage: %s [-t type[,type...]] [-s sizeKB] [-w ways] [-r tagRatio] [-h hashLines] [-l lineSize]\n"
+            "          [-n accesses] [-f footprintKB] [-p seq|rand|hot] [-x storePct] [-S statsPeriod] [-T trace]\n", bin);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[bench] ");
+    string types = "Simple,ApproximateBDI,ApproximateDedup";
+    uint32_t sizeKB = 2048;
+    uint32_t ways = 16;
+    uint32_t tagRatio = 2;
+    uint32_t hashLines = 64*1024;
+    uint32_t lineSize = 64;
+    uint64_t accesses = 1000*1000;
+    uint64_t footprintKB = 8*1024;
+    string pattern = "rand";
+    uint32_t storePct = 25;
+    uint32_t statsPeriod = 0; //array stats cost O(lines) per sample, so they are off by default
+    const char* traceFile = nullptr;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:s:w:r:h:l:n:f:p:x:S:T:")) != -1) {
+        switch (c) {
+            case 't': types = optarg; break;
+            case 's': sizeKB = strtoul(optarg, nullptr, 0); break;
+            case 'w': ways = strtoul(optarg, nullptr, 0); break;
+            case 'r': tagRatio = strtoul(optarg, nullptr, 0); break;
+            case 'h': hashLines = strtoul(optarg, nullptr, 0); break;
+            case 'l': lineSize = strtoul(optarg, nullptr, 0); break;
+            case 'n': accesses = strtoull(optarg, nullptr, 0); break;
+            case 'f': footprintKB = strtoull(optarg, nullptr, 0); break;
+            case 'p': pattern = optarg; break;
+            case 'x': storePct = strtoul(optarg, nullptr, 0); break;
+            case 'S': statsPeriod = strtoul(optarg, nullptr, 0); break;
+            case 'T': traceFile = optarg; break;
+            default: Usage(argv[0]);
+        }
+    }
+
+    InitStandaloneSim(lineSize, 1ul << 30);
+    SetMemoryReader(SyntheticReader);
+
+    AccessStream stream;
+    if (traceFile) {
+        ReadTrace(stream, traceFile);
+    } else {
+        GenerateStream(stream, pattern, accesses, MAX(footprintKB*1024/lineSize, 1ul), storePct);
+    }
+
+    printf("%-20s %12s %12s %10s %14s\n", "type", "accesses", "hits", "hitRate", "accesses/s");
+    string::size_type start = 0;
+    while (start < types.size()) {
+        string::size_type end = types.find(',', start);
+        if (end == string::npos) end = types.size();
+        string type = types.substr(start, end - start);
+        start = end + 1;
+
+        Cache* cache = BuildBenchCache(type, sizeKB*1024, ways, tagRatio, hashLines);
+        g_vector<MemObject*> noParents;
+        g_vector<BaseCache*> noChildren;
+        cache->setParents(0, noParents, nullptr);
+        cache->setChildren(noChildren, nullptr);
+        cache->enableWarmStats(statsPeriod);
+        AggregateStat* rootStat = new AggregateStat();
+        rootStat->init("bench", "Benchmark stats");
+        cache->initStats(rootStat);
+        rootStat->makeImmutable();
+
+        uint64_t startUs = Microseconds();
+        for (auto& acc : stream) cache->warm(acc.first, acc.second);
+        uint64_t elapsedUs = MAX(Microseconds() - startUs, 1ul);
+
+        //Find warmHits among the cache's stats
+        uint64_t hits = 0;
+        AggregateStat* cacheStat = dynamic_cast<AggregateStat*>(rootStat->get(0));
+        for (uint32_t i = 0; cacheStat && i < cacheStat->size(); i++) {
+            Stat* s = cacheStat->get(i);
+            Counter* ctr = dynamic_cast<Counter*>(s);
+            if (ctr && strcmp(s->name(), "warmHits") == 0) hits = ctr->get();
+        }
+        printf("%-20s %12ld %12ld %9.2f%% %14.0f\n", type.c_str(), stream.size(), hits,
+                100.0*hits/MAX(stream.size(), 1ul), stream.size()*1e6/elapsedUs);
+    }
+    return 0;
+}
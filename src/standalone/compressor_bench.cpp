@@ -0,0 +1,311 @@
+/* Micro-benchmark for the per-line compression and hashing engines of the
+ * compressed caches, built on libzsimmem.a:
+ *  - BDI: ApproximateBDIDataArray::compress (ns/line, compression ratio, encoding histogram)
+ *  - Hash: ApproximateDedupHashArray::hash (ns/line, dedup and collision rates)
+ *  - Approximate: ApproximateDedupHashArray::approximate followed by hash (float/double only)
+ *  - Map: uniDoppelgangerDataArray::calculateMap (ns/line, dedup and collision rates)
+ *
+ * A corpus is either a raw file of lineSize-byte lines (-c, e.g. dumped from a
+ * run) or generated synthetically for a DataType (-y): a mix of zero lines,
+ * repeated lines, and smooth value sequences with small noise. A collision is
+ * a line whose key matches that of an earlier line with different contents.
+ */
+
+#include <getopt.h>
+#include <limits>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+#include "cache_arrays.h"
+#include "hash.h"
+#include "log.h"
+#include "repl_policies.h"
+#include "standalone/standalone_sim.h"
+#include "zsim.h"
+
+using std::string;
+using std::vector;
+
+static const char* dataTypeNames[] = {"uint8", "int8", "uint16", "int16", "uint32", "int32", "uint64", "int64", "float", "double"};
+
+static DataType ParseDataType(const char* str) {
+    for (uint32_t t = ZSIM_UINT8; t <= ZSIM_DOUBLE; t++) {
+        if (strcmp(str, dataTypeNames[t]) == 0) return (DataType)t;
+    }
+    panic("Invalid data type %s", str);
+}
+
+static inline uint64_t SplitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ul;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ul;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBul;
+    return x ^ (x >> 31);
+}
+
+/* Corpus: lines stored back to back, plus the value range the approximate
+ * engines need (calculateMap panics on values outside the annotation)
+ */
+struct Corpus {
+    uint32_t lineSize;
+    DataType type;
+    vector<uint8_t> bytes;
+    DataValue minValue, maxValue;
+
+    uint64_t lines() const { return bytes.size()/lineSize; }
+    DataLine line(uint64_t i) { return &bytes[i*lineSize]; }
+};
+
+template <typename T>
+static void GenerateLines(Corpus& c, uint64_t numLines) {
+    const uint32_t elems = c.lineSize/sizeof(T);
+    const bool isFloat = (c.type == ZSIM_FLOAT || c.type == ZSIM_DOUBLE);
+    // Values follow a noisy sine; unsigned integers are offset to a quarter of
+    // their range (calculateMap accumulates into int64_t)
+    const T mid = (isFloat || std::numeric_limits<T>::is_signed)? 0 : std::numeric_limits<T>::max()/4;
+    const double amplitude = isFloat? 100.0 : MIN((double)std::numeric_limits<T>::max()/4, 64.0);
+    c.bytes.resize(numLines*c.lineSize);
+    uint64_t pos = 0;
+    for (uint64_t l = 0; l < numLines; l++) {
+        uint64_t r = SplitMix(l);
+        T* vals = (T*)c.line(l);
+        uint32_t kind = r % 10;
+        if (kind == 0) { //zeros
+            memset(vals, 0, c.lineSize);
+        } else if (kind <= 2 && l > 0) { //repeat an earlier line
+            memcpy(vals, c.line((r >> 8) % l), c.lineSize);
+        } else {
+            for (uint32_t i = 0; i < elems; i++, pos++) {
+                double noise = (double)(SplitMix(r + i) % 1000)/1000.0 - 0.5;
+                double v = amplitude*sin(pos/64.0) + (isFloat? noise : 4*noise);
+                vals[i] = isFloat? (T)v : (T)(mid + (T)llround(v));
+            }
+        }
+    }
+}
+
+template <typename T>
+static void ValueRange(Corpus& c, T* minValue, T* maxValue) {
+    const T* vals = (const T*)&c.bytes[0];
+    uint64_t n = c.bytes.size()/sizeof(T);
+    *minValue = vals[0];
+    *maxValue = vals[0];
+    for (uint64_t i = 1; i < n; i++) {
+        *minValue = MIN(*minValue, vals[i]);
+        *maxValue = MAX(*maxValue, vals[i]);
+    }
+}
+
+#define DATA_TYPE_SWITCH(type, FN) \
+    switch (type) { \
+        case ZSIM_UINT8: FN(uint8_t, UINT8); break; \
+        case ZSIM_INT8: FN(int8_t, INT8); break; \
+        case ZSIM_UINT16: FN(uint16_t, UINT16); break; \
+        case ZSIM_INT16: FN(int16_t, INT16); break; \
+        case ZSIM_UINT32: FN(uint32_t, UINT32); break; \
+        case ZSIM_INT32: FN(int32_t, INT32); break; \
+        case ZSIM_UINT64: FN(uint64_t, UINT64); break; \
+        case ZSIM_INT64: FN(int64_t, INT64); break; \
+        case ZSIM_FLOAT: FN(float, FLOAT); break; \
+        case ZSIM_DOUBLE: FN(double, DOUBLE); break; \
+    }
+
+static void FinishCorpus(Corpus& c) {
+    if (!c.lines()) panic("Empty corpus");
+#define RANGE(T, F) ValueRange<T>(c, &c.minValue.F, &c.maxValue.F)
+    DATA_TYPE_SWITCH(c.type, RANGE);
+#undef RANGE
+}
+
+static void LoadCorpus(Corpus& c, const char* file) {
+    FILE* f = fopen(file, "rb");
+    if (!f) panic("Could not open corpus %s", file);
+    vector<uint8_t> buf(c.lineSize);
+    while (fread(&buf[0], 1, c.lineSize, f) == c.lineSize) c.bytes.insert(c.bytes.end(), buf.begin(), buf.end());
+    fclose(f);
+    info("Read %ld %d-byte lines from %s", c.lines(), c.lineSize, file);
+}
+
+static uint64_t Nanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ul + ts.tv_nsec;
+}
+
+/* Tracks which keys have been seen, and with what contents, to tell real
+ * duplicates from collisions
+ */
+class KeyTracker {
+    private:
+        std::unordered_map<uint64_t, uint64_t> firstLine; //key -> first line with that key
+        Corpus& corpus;
+        const vector<uint8_t>* contents; //what was keyed (approximated lines differ from the corpus)
+        uint64_t dups, collisions;
+
+    public:
+        KeyTracker(Corpus& _corpus, const vector<uint8_t>* _contents) : corpus(_corpus), contents(_contents), dups(0), collisions(0) {}
+
+        void add(uint64_t key, uint64_t line) {
+            auto it = firstLine.find(key);
+            if (it == firstLine.end()) {
+                firstLine[key] = line;
+            } else if (memcmp(&(*contents)[it->second*corpus.lineSize], &(*contents)[line*corpus.lineSize], corpus.lineSize) == 0) {
+                dups++;
+            } else {
+                collisions++;
+            }
+        }
+
+        double dupRate() const { return 100.0*dups/corpus.lines(); }
+        double collisionRate() const { return 100.0*collisions/corpus.lines(); }
+};
+
+static void PrintRow(const char* engine, double nsPerLine, const char* ratio, const KeyTracker* keys) {
+    if (keys) {
+        printf("%-12s %10.1f %8s %9.2f%% %9.2f%%\n", engine, nsPerLine, ratio, keys->dupRate(), keys->collisionRate());
+    } else {
+        printf("%-12s %10.1f %8s %10s %10s\n", engine, nsPerLine, ratio, "-", "-");
+    }
+}
+
+static void BenchBDI(Corpus& c, uint32_t repeats) {
+    ApproximateBDIDataArray bdi(zinfo->floatCutSize, zinfo->doubleCutSize);
+    uint64_t hist[NONE + 1] = {0};
+    uint64_t compressedBytes = 0;
+    for (uint64_t l = 0; l < c.lines(); l++) {
+        uint16_t size;
+        BDICompressionEncoding encoding = bdi.compress(c.line(l), &size);
+        hist[encoding]++;
+        compressedBytes += BDICompressionToSize(encoding, c.lineSize);
+    }
+
+    volatile uint32_t sink = 0;
+    uint64_t start = Nanoseconds();
+    for (uint32_t r = 0; r < repeats; r++) {
+        for (uint64_t l = 0; l < c.lines(); l++) {
+            uint16_t size;
+            sink += bdi.compress(c.line(l), &size);
+        }
+    }
+    double ns = (double)(Nanoseconds() - start)/(repeats*c.lines());
+
+    char ratio[16];
+    snprintf(ratio, sizeof(ratio), "%.2fx", (double)c.lines()*c.lineSize/MAX(compressedBytes, 1ul));
+    PrintRow("BDI", ns, ratio, nullptr);
+    for (uint32_t e = ZERO; e <= NONE; e++) {
+        printf("    %-12s %9.2f%%\n", BDICompressionName((BDICompressionEncoding)e), 100.0*hist[e]/c.lines());
+    }
+}
+
+static void BenchHash(Corpus& c, uint32_t repeats, bool approximate) {
+    ReplPolicy* rp = new DataLRUReplPolicy(64);
+    H3HashFamily* dataHash = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1);
+    ApproximateDedupHashArray hashArray(64, 8, rp, new IdHashFamily, dataHash, zinfo->hashSize, zinfo->floatCutSize, zinfo->doubleCutSize);
+
+    vector<uint8_t> keyed = c.bytes;
+    if (approximate) {
+        for (uint64_t l = 0; l < c.lines(); l++) hashArray.approximate(&keyed[l*c.lineSize], c.type);
+    }
+    KeyTracker keys(c, &keyed);
+    for (uint64_t l = 0; l < c.lines(); l++) keys.add(hashArray.hash(&keyed[l*c.lineSize]), l);
+
+    vector<uint8_t> scratch(c.lineSize);
+    volatile uint64_t sink = 0;
+    uint64_t start = Nanoseconds();
+    for (uint32_t r = 0; r < repeats; r++) {
+        for (uint64_t l = 0; l < c.lines(); l++) {
+            if (approximate) {
+                memcpy(&scratch[0], c.line(l), c.lineSize);
+                hashArray.approximate(&scratch[0], c.type);
+                sink += hashArray.hash(&scratch[0]);
+            } else {
+                sink += hashArray.hash(c.line(l));
+            }
+        }
+    }
+    double ns = (double)(Nanoseconds() - start)/(repeats*c.lines());
+    PrintRow(approximate? "Approximate" : "Hash", ns, "-", &keys);
+}
+
+static void BenchMap(Corpus& c, uint32_t repeats) {
+    ReplPolicy* rp = new DataLRUReplPolicy(64);
+    uniDoppelgangerDataArray mapArray(64, 8, rp, new IdHashFamily, zinfo->mapSize);
+
+    KeyTracker keys(c, &c.bytes);
+    for (uint64_t l = 0; l < c.lines(); l++) keys.add(mapArray.calculateMap(c.line(l), c.type, c.minValue, c.maxValue), l);
+
+    volatile uint32_t sink = 0;
+    uint64_t start = Nanoseconds();
+    for (uint32_t r = 0; r < repeats; r++) {
+        for (uint64_t l = 0; l < c.lines(); l++) sink += mapArray.calculateMap(c.line(l), c.type, c.minValue, c.maxValue);
+    }
+    double ns = (double)(Nanoseconds() - start)/(repeats*c.lines());
+    PrintRow("Map", ns, "-", &keys);
+}
+
+static void Usage(const char* bin) {
+    fprintf(stderr, "Usage: %s [-y type[,type...]] [-c corpus] [-n lines] [-l lineSize] [-r repeats] [-H hashSize] [-m mapSize]\n"
+            "  types: uint8 int8 uint16 int16 uint32 int32 uint64 int64 float double (one type with -c)\n", bin);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[bench] ");
+    string types = "int32,int64,float,double";
+    const char* corpusFile = nullptr;
+    uint64_t numLines = 64*1024;
+    uint32_t lineSize = 64;
+    uint32_t repeats = 10;
+    uint32_t hashSize = 16;
+    uint32_t mapSize = 14;
+
+    int c;
+    while ((c = getopt(argc, argv, "y:c:n:l:r:H:m:")) != -1) {
+        switch (c) {
+            case 'y': types = optarg; break;
+            case 'c': corpusFile = optarg; break;
+            case 'n': numLines = strtoull(optarg, nullptr, 0); break;
+            case 'l': lineSize = strtoul(optarg, nullptr, 0); break;
+            case 'r': repeats = MAX(strtoul(optarg, nullptr, 0), 1ul); break;
+            case 'H': hashSize = strtoul(optarg, nullptr, 0); break;
+            case 'm': mapSize = strtoul(optarg, nullptr, 0); break;
+            default: Usage(argv[0]);
+        }
+    }
+
+    InitStandaloneSim(lineSize, 1ul << 28);
+    zinfo->hashSize = hashSize;
+    zinfo->mapSize = mapSize;
+
+    string::size_type start = 0;
+    while (start < types.size()) {
+        string::size_type end = types.find(',', start);
+        if (end == string::npos) end = types.size();
+        string typeName = types.substr(start, end - start);
+        start = end + 1;
+
+        Corpus corpus;
+        corpus.lineSize = lineSize;
+        corpus.type = ParseDataType(typeName.c_str());
+        if (corpusFile) {
+            LoadCorpus(corpus, corpusFile);
+        } else {
+#define GENERATE(T, F) GenerateLines<T>(corpus, numLines)
+            DATA_TYPE_SWITCH(corpus.type, GENERATE);
+#undef GENERATE
+        }
+        FinishCorpus(corpus);
+
+        printf("\n%s corpus, %ld %d-byte lines\n", typeName.c_str(), corpus.lines(), lineSize);
+        printf("%-12s %10s %8s %10s %10s\n", "engine", "ns/line", "ratio", "dups", "collisions");
+        BenchBDI(corpus, repeats);
+        BenchHash(corpus, repeats, false);
+        if (corpus.type == ZSIM_FLOAT || corpus.type == ZSIM_DOUBLE) BenchHash(corpus, repeats, true);
+        BenchMap(corpus, repeats);
+    }
+    return 0;
+}
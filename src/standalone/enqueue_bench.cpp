@@ -0,0 +1,258 @@
+/* Contention micro-benchmark for bound-phase enqueues into domain priority
+ * queues (ContentionSim::enqueueSynced). Many producer threads, standing in for
+ * simulated cores, enqueue events into a few domains, standing in for LLC
+ * banks and memory controllers. Compares:
+ *
+ *   locked: enqueue straight into the domain's PrioQueue under a per-domain
+ *           futex lock (the old enqueueSynced)
+ *   staged: push into the domain's lock-free MPSCStack; in the weave phase,
+ *           the thread that owns each domain moves its events into the
+ *           PrioQueue (drain) before dequeuing them
+ *
+ * Each round is one bound phase followed by a weave phase, where weave
+ * threads own domains round-robin (like ContentionSim's static assignment) and
+ * dequeue all their events. Reports the bound phase's enqueues per second, the
+ * slowest weave thread's drain time, and the end-to-end time per round.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+#include "bithacks.h"
+#include "galloc.h"
+#include "locks.h"
+#include "log.h"
+#include "mpsc_stack.h"
+#include "prio_queue.h"
+#include "standalone/standalone_sim.h"
+
+using std::string;
+using std::vector;
+
+struct BenchEvent {
+    BenchEvent* next; //used by PrioQueue and MPSCStack
+    uint64_t cycle;
+};
+
+struct BenchDomain {
+    PrioQueue<BenchEvent, 1024> pq;
+    lock_t pqLock;
+    MPSCStack<BenchEvent> staged;
+    char pad[64];
+};
+
+struct BenchConfig {
+    bool staged;
+    uint32_t producers;
+    uint32_t domains;
+    uint32_t weaveThreads;
+    uint32_t eventsPerRound; //per producer
+    uint32_t rounds;
+    uint32_t phaseLength;
+    uint32_t work; //dummy work between enqueues, in loop iterations
+};
+
+static BenchConfig cfg;
+static BenchDomain* domains;
+static vector<BenchEvent*> producerEvents;
+static pthread_barrier_t barrier; //producers and main thread, bound phase start and end
+static pthread_barrier_t weaveBarrier; //weave threads and main thread, weave phase start and end
+static vector<uint64_t> weaveDrainUs; //per weave thread, this round
+static volatile uint64_t curPhaseStart;
+static volatile uint64_t sink;
+
+static inline uint64_t SplitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ul;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ul;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBul;
+    return x ^ (x >> 31);
+}
+
+static uint64_t Microseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec*1000000ul + tv.tv_usec;
+}
+
+static void* ProducerThread(void* arg) {
+    uint32_t p = (uint32_t)(uintptr_t)arg;
+    BenchEvent* events = producerEvents[p];
+    for (uint32_t r = 0; r < cfg.rounds; r++) {
+        pthread_barrier_wait(&barrier); //round start
+        uint64_t base = curPhaseStart;
+        for (uint32_t i = 0; i < cfg.eventsPerRound; i++) {
+            uint64_t h = SplitMix(((uint64_t)p << 40) + ((uint64_t)r << 20) + i);
+            BenchEvent* ev = &events[i];
+            ev->cycle = base + cfg.phaseLength + (h % cfg.phaseLength);
+            BenchDomain& dom = domains[(h >> 32) % cfg.domains];
+            if (cfg.staged) {
+                dom.staged.push(ev);
+            } else {
+                futex_lock(&dom.pqLock);
+                dom.pq.enqueue(ev, ev->cycle);
+                futex_unlock(&dom.pqLock);
+            }
+            uint64_t w = h;
+            for (uint32_t j = 0; j < cfg.work; j++) w = SplitMix(w);
+            sink = w;
+        }
+        pthread_barrier_wait(&barrier); //round end
+    }
+    return nullptr;
+}
+
+static void* WeaveThread(void* arg) {
+    uint32_t t = (uint32_t)(uintptr_t)arg;
+    for (uint32_t r = 0; r < cfg.rounds; r++) {
+        pthread_barrier_wait(&weaveBarrier); //weave start
+        uint64_t drainUs = 0;
+        for (uint32_t d = t; d < cfg.domains; d += cfg.weaveThreads) {
+            PrioQueue<BenchEvent, 1024>& pq = domains[d].pq;
+            if (cfg.staged) {
+                uint64_t startUs = Microseconds();
+                BenchEvent* ev = domains[d].staged.takeAll();
+                while (ev) {
+                    BenchEvent* next = ev->next;
+                    ev->next = nullptr;
+                    pq.enqueue(ev, ev->cycle);
+                    ev = next;
+                }
+                drainUs += Microseconds() - startUs;
+            }
+
+            //Dequeue also clears each event's next
+            uint64_t lastCycle = 0;
+            while (pq.size()) {
+                uint64_t cycle;
+                pq.dequeue(cycle);
+                if (cycle < lastCycle) panic("Events dequeued out of order (%ld after %ld)", cycle, lastCycle);
+                lastCycle = cycle;
+            }
+        }
+        weaveDrainUs[t] = drainUs;
+        pthread_barrier_wait(&weaveBarrier); //weave end
+    }
+    return nullptr;
+}
+
+static void RunBench(double& enqRate, double& drainUs, double& roundUs) {
+    domains = gm_calloc<BenchDomain>(cfg.domains);
+    for (uint32_t d = 0; d < cfg.domains; d++) {
+        new (&domains[d].pq) PrioQueue<BenchEvent, 1024>();
+        futex_init(&domains[d].pqLock);
+        new (&domains[d].staged) MPSCStack<BenchEvent>();
+    }
+    producerEvents.resize(cfg.producers);
+    for (uint32_t p = 0; p < cfg.producers; p++) {
+        producerEvents[p] = new BenchEvent[cfg.eventsPerRound];
+        memset(producerEvents[p], 0, cfg.eventsPerRound*sizeof(BenchEvent));
+    }
+
+    pthread_barrier_init(&barrier, nullptr, cfg.producers + 1);
+    pthread_barrier_init(&weaveBarrier, nullptr, cfg.weaveThreads + 1);
+    weaveDrainUs.assign(cfg.weaveThreads, 0);
+    vector<pthread_t> threads(cfg.producers);
+    for (uint32_t p = 0; p < cfg.producers; p++) {
+        pthread_create(&threads[p], nullptr, ProducerThread, (void*)(uintptr_t)p);
+    }
+    vector<pthread_t> weaveThreads(cfg.weaveThreads);
+    for (uint32_t t = 0; t < cfg.weaveThreads; t++) {
+        pthread_create(&weaveThreads[t], nullptr, WeaveThread, (void*)(uintptr_t)t);
+    }
+
+    uint64_t enqUs = 0;
+    uint64_t totalDrainUs = 0;
+    uint64_t totalUs = 0;
+    for (uint32_t r = 0; r < cfg.rounds; r++) {
+        curPhaseStart = (uint64_t)r*cfg.phaseLength;
+        __sync_synchronize();
+        uint64_t startUs = Microseconds();
+        pthread_barrier_wait(&barrier);
+        pthread_barrier_wait(&barrier);
+        uint64_t midUs = Microseconds();
+        pthread_barrier_wait(&weaveBarrier);
+        pthread_barrier_wait(&weaveBarrier);
+        uint64_t endUs = Microseconds();
+        enqUs += midUs - startUs;
+        totalUs += endUs - startUs;
+        uint64_t maxDrainUs = 0;
+        for (uint64_t us : weaveDrainUs) maxDrainUs = MAX(maxDrainUs, us);
+        totalDrainUs += maxDrainUs;
+    }
+
+    for (uint32_t p = 0; p < cfg.producers; p++) {
+        pthread_join(threads[p], nullptr);
+        delete[] producerEvents[p];
+    }
+    for (uint32_t t = 0; t < cfg.weaveThreads; t++) pthread_join(weaveThreads[t], nullptr);
+    pthread_barrier_destroy(&barrier);
+    pthread_barrier_destroy(&weaveBarrier);
+    gm_free(domains);
+
+    uint64_t totalEvents = (uint64_t)cfg.producers*cfg.eventsPerRound*cfg.rounds;
+    enqRate = totalEvents*1e6/MAX(enqUs, 1ul);
+    drainUs = (double)totalDrainUs/cfg.rounds;
+    roundUs = (double)totalUs/cfg.rounds;
+}
+
+static void Usage(const char* bin) {
+    fprintf(stderr, "Usage: %s [-m locked,staged] [-p producers] [-d domains] [-t weaveThreads]\n"
+            "          [-n eventsPerRound] [-r rounds] [-l phaseLength] [-w work]\n", bin);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[bench] ");
+    string modes = "locked,staged";
+    cfg.producers = 16;
+    cfg.domains = 4;
+    cfg.weaveThreads = 0; //one per domain
+    cfg.eventsPerRound = 20000;
+    cfg.rounds = 20;
+    cfg.phaseLength = 10000;
+    cfg.work = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "m:p:d:t:n:r:l:w:")) != -1) {
+        switch (c) {
+            case 'm': modes = optarg; break;
+            case 'p': cfg.producers = strtoul(optarg, nullptr, 0); break;
+            case 'd': cfg.domains = strtoul(optarg, nullptr, 0); break;
+            case 't': cfg.weaveThreads = strtoul(optarg, nullptr, 0); break;
+            case 'n': cfg.eventsPerRound = strtoul(optarg, nullptr, 0); break;
+            case 'r': cfg.rounds = strtoul(optarg, nullptr, 0); break;
+            case 'l': cfg.phaseLength = strtoul(optarg, nullptr, 0); break;
+            case 'w': cfg.work = strtoul(optarg, nullptr, 0); break;
+            default: Usage(argv[0]);
+        }
+    }
+    if (!cfg.producers || !cfg.domains || !cfg.phaseLength) Usage(argv[0]);
+    if (!cfg.weaveThreads || cfg.weaveThreads > cfg.domains) cfg.weaveThreads = cfg.domains;
+
+    InitStandaloneSim(64, 1ul << 30);
+
+    printf("%d producers, %d domains, %d weave threads, %d events/producer/round, %d rounds\n",
+            cfg.producers, cfg.domains, cfg.weaveThreads, cfg.eventsPerRound, cfg.rounds);
+    printf("%-8s %16s %16s %16s\n", "mode", "enqueues/s", "drainUs/round", "us/round");
+    string::size_type start = 0;
+    while (start < modes.size()) {
+        string::size_type end = modes.find(',', start);
+        if (end == string::npos) end = modes.size();
+        string mode = modes.substr(start, end - start);
+        start = end + 1;
+
+        if (mode == "locked") cfg.staged = false;
+        else if (mode == "staged") cfg.staged = true;
+        else panic("Invalid mode %s (valid: locked, staged)", mode.c_str());
+
+        double enqRate, drainUs, roundUs;
+        RunBench(enqRate, drainUs, roundUs);
+        printf("%-8s %16.0f %16.1f %16.1f\n", mode.c_str(), enqRate, drainUs, roundUs);
+    }
+    return 0;
+}
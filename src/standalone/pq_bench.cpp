@@ -0,0 +1,191 @@
+/* Micro-benchmark for domain event queues: replays a stream of enqueue and
+ * dequeue operations against PrioQueue (the default) and RadixPrioQueue, checks
+ * that both dequeue the same cycles, and reports operations per second.
+ *
+ * Streams are either recorded from zsim (build with RECORD_DOMAIN_PQ = 1 in
+ * contention_sim.h, which writes pqops-<domain>.trace files) or synthetic: each
+ * dequeued event spawns children a few cycles ahead, and a fraction of them
+ * land far ahead (e.g., refreshes or long memory queues), which is what pushes
+ * PrioQueue to its far-element map. Like the weave loop, the replay calls
+ * firstCycle() after every dequeue.
+ *
+ * PrioQueue wins on dense queues with near events (the defaults). RadixPrioQueue
+ * wins on sparse queues with far events, where PrioQueue's firstCycle() scans
+ * empty blocks and its far-element map fills up, e.g., -q 4 -f 5 -F 200000 or
+ * -q 16 -f 10 -F 1000000 (a memory controller domain with refreshes).
+ *
+ * Trace format: one operation per line, "E <cycle>" or "D <cycle>".
+ */
+
+#include <getopt.h>
+#include <queue>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+#include "bithacks.h"
+#include "log.h"
+#include "prio_queue.h"
+#include "standalone/standalone_sim.h"
+
+using std::string;
+using std::vector;
+
+struct BenchEvent {
+    BenchEvent* next; //used by PrioQueue
+};
+
+static volatile uint64_t sink;
+
+struct PQOp {
+    bool enq;
+    uint64_t cycle;
+};
+
+typedef vector<PQOp> OpStream;
+
+static inline uint64_t SplitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ul;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ul;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBul;
+    return x ^ (x >> 31);
+}
+
+static uint64_t Microseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec*1000000ul + tv.tv_usec;
+}
+
+static void GenerateStream(OpStream& ops, uint64_t numOps, uint32_t occupancy, uint32_t farPct, uint64_t farDelay) {
+    std::priority_queue<uint64_t, vector<uint64_t>, std::greater<uint64_t> > pq;
+    ops.reserve(numOps);
+    uint64_t seed = 0x9E0E;
+    uint64_t cur = 0;
+    for (uint64_t i = 0; ops.size() < numOps; i++) {
+        uint64_t r = SplitMix(seed + i);
+        if (pq.size() < occupancy || (pq.size() < 2*occupancy && (r & 1))) {
+            uint64_t delay = ((r >> 8) % 100 < farPct)? farDelay/2 + (r >> 16) % farDelay : (r >> 16) % 64;
+            ops.push_back({true, cur + delay});
+            pq.push(cur + delay);
+        } else {
+            cur = pq.top();
+            pq.pop();
+            ops.push_back({false, cur});
+        }
+    }
+    while (pq.size()) {
+        ops.push_back({false, pq.top()});
+        pq.pop();
+    }
+}
+
+static void ReadTrace(OpStream& ops, const char* file) {
+    FILE* f = fopen(file, "r");
+    if (!f) panic("Could not open trace %s", file);
+    char op;
+    uint64_t cycle;
+    while (fscanf(f, " %c %ld", &op, &cycle) == 2) {
+        if (op != 'E' && op != 'D') panic("Invalid trace entry %c %ld", op, cycle);
+        ops.push_back({op == 'E', cycle});
+    }
+    fclose(f);
+    info("Read %ld operations from %s", ops.size(), file);
+}
+
+static void WriteTrace(const OpStream& ops, const char* file) {
+    FILE* f = fopen(file, "w");
+    if (!f) panic("Could not open trace %s", file);
+    for (const PQOp& op : ops) fprintf(f, "%c %ld\n", op.enq? 'E' : 'D', op.cycle);
+    fclose(f);
+}
+
+//What domains use with sim.domainQueue = "Radix", to measure the cost of picking the queue at runtime
+class RadixSelectablePrioQueue : public SelectablePrioQueue<BenchEvent, 1024> {
+    public:
+        RadixSelectablePrioQueue() {setRadix(true);}
+};
+
+/* Recorded streams may end with events still queued (the simulation ended)
+ * and, because the trace is per domain, may start with dequeues of events
+ * enqueued before recording began; Replay skips dequeues of an empty queue.
+ */
+template <typename PQ>
+static double Replay(const OpStream& ops, vector<BenchEvent>& pool) {
+    PQ* pq = new PQ();
+    vector<BenchEvent*> freeList;
+    for (BenchEvent& ev : pool) freeList.push_back(&ev);
+
+    uint64_t firstCycles = 0;
+    uint64_t startUs = Microseconds();
+    for (const PQOp& op : ops) {
+        if (op.enq) {
+            assert(freeList.size());
+            BenchEvent* ev = freeList.back();
+            freeList.pop_back();
+            pq->enqueue(ev, op.cycle);
+        } else if (pq->size()) {
+            uint64_t cycle;
+            BenchEvent* ev = pq->dequeue(cycle);
+            if (cycle != op.cycle) panic("Dequeued cycle %ld, expected %ld", cycle, op.cycle);
+            freeList.push_back(ev);
+            //Like the weave loop, which updates the domain's cycle after every event
+            if (pq->size()) firstCycles += pq->firstCycle();
+        }
+    }
+    uint64_t elapsedUs = MAX(Microseconds() - startUs, 1ul);
+    sink = firstCycles;
+    //Leftover events are not freed one by one; the queue is leaked, as the heap is torn down at exit
+    return ops.size()*1e6/elapsedUs;
+}
+
+static void Usage(const char* bin) {
+    fprintf(stderr, "Usage: %s [-n ops] [-q occupancy] [-f farPct] [-F farDelay] [-T trace] [-o outTrace]\n", bin);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[bench] ");
+    uint64_t numOps = 20*1000*1000;
+    uint32_t occupancy = 256;
+    uint32_t farPct = 2;
+    uint64_t farDelay = 100*1000;
+    const char* traceFile = nullptr;
+    const char* outFile = nullptr;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:q:f:F:T:o:")) != -1) {
+        switch (c) {
+            case 'n': numOps = strtoull(optarg, nullptr, 0); break;
+            case 'q': occupancy = strtoul(optarg, nullptr, 0); break;
+            case 'f': farPct = strtoul(optarg, nullptr, 0); break;
+            case 'F': farDelay = strtoull(optarg, nullptr, 0); break;
+            case 'T': traceFile = optarg; break;
+            case 'o': outFile = optarg; break;
+            default: Usage(argv[0]);
+        }
+    }
+    if (!farDelay) Usage(argv[0]);
+
+    InitStandaloneSim(64, 1ul << 30);
+
+    OpStream ops;
+    if (traceFile) ReadTrace(ops, traceFile);
+    else GenerateStream(ops, numOps, occupancy, farPct, farDelay);
+    if (outFile) WriteTrace(ops, outFile);
+
+    uint64_t numEnqs = 0;
+    for (const PQOp& op : ops) numEnqs += op.enq;
+    vector<BenchEvent> pool(numEnqs);
+    for (BenchEvent& ev : pool) ev.next = nullptr;
+
+    printf("%ld operations (%ld enqueues)\n", ops.size(), numEnqs);
+    printf("%-16s %14s\n", "queue", "ops/s");
+    printf("%-16s %14.0f\n", "PrioQueue", Replay< PrioQueue<BenchEvent, 1024> >(ops, pool));
+    for (BenchEvent& ev : pool) ev.next = nullptr;
+    printf("%-16s %14.0f\n", "RadixPrioQueue", Replay< RadixPrioQueue<BenchEvent> >(ops, pool));
+    for (BenchEvent& ev : pool) ev.next = nullptr;
+    printf("%-16s %14.0f\n", "Selectable/Radix", Replay< RadixSelectablePrioQueue >(ops, pool));
+    return 0;
+}
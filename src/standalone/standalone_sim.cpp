@@ -0,0 +1,77 @@
+#include "standalone_sim.h"
+#include <string.h>
+#include "bithacks.h"
+#include "contention_sim.h"
+#include "galloc.h"
+#include "log.h"
+#include "pin.H"
+#include "zsim.h"
+
+GlobSimInfo* zinfo;
+
+uint32_t procIdx;
+uint32_t lineBits;
+Address procMask;
+
+static size_t ZeroReader(void* dst, const void* src, size_t size) {
+    memset(dst, 0, size);
+    return size;
+}
+
+static MemoryReader memoryReader = ZeroReader;
+
+// Copies between simulator buffers (e.g., cache data arrays) must not go through the reader
+static const char* heapStart;
+static const char* heapEnd;
+
+size_t PIN_SafeCopy(void* dst, const void* src, size_t size) {
+    const char* p = static_cast<const char*>(src);
+    if (p >= heapStart && p < heapEnd) {
+        memcpy(dst, src, size);
+        return size;
+    }
+    return memoryReader(dst, src, size);
+}
+
+void SetMemoryReader(MemoryReader reader) {
+    memoryReader = reader? reader : ZeroReader;
+}
+
+void InitStandaloneSim(uint32_t lineSize, size_t heapBytes) {
+    if (!isPow2(lineSize)) panic("Line size must be a power of 2, not %d", lineSize);
+    gm_init(heapBytes);
+    heapStart = static_cast<const char*>(gm_malloc(1)); //first chunk; everything below it is allocator metadata
+    heapEnd = heapStart + heapBytes;
+    zinfo = gm_calloc<GlobSimInfo>();
+    gm_set_glob_ptr(zinfo);
+
+    //Same defaults as SimInit
+    zinfo->approximateRegions = new g_vector<std::tuple<uint64_t, uint64_t, DataType, DataValue, DataValue>>();
+    zinfo->mapSize = 14;
+    zinfo->floatCutSize = 16;
+    zinfo->randomLoopTrial = 10;
+    zinfo->doubleCutSize = 32;
+    zinfo->hashSize = 16;
+    zinfo->numCores = 1;
+    zinfo->numDomains = 1;
+    zinfo->lineSize = lineSize;
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
+
+    procIdx = 0;
+    procMask = 0;
+    lineBits = ilog2(lineSize);
+}
+
+/* No weave phase without Pin threads */
+
+void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
+    panic("Timing events are not supported in the standalone memory hierarchy");
+}
+
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
+    panic("Timing events are not supported in the standalone memory hierarchy");
+}
+
+void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
+    panic("Timing events are not supported in the standalone memory hierarchy");
+}
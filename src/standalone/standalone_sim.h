@@ -0,0 +1,26 @@
+#ifndef STANDALONE_SIM_H_
+#define STANDALONE_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Process-level setup for programs linked against libzsimmem.a, the Pin-free
+ * build of the memory hierarchy (cache arrays, replacement policies,
+ * compressors, coherence controllers, caches and stats). It provides what
+ * zsim.cpp and init.cpp normally provide: the global heap, zinfo with the
+ * defaults of the sim.* knobs the caches read, and the per-process globals.
+ *
+ * Only functional paths work (arrays, Cache::warm(), stats). Timing accesses
+ * need the contention simulator, and its entry points panic here.
+ */
+
+typedef size_t (*MemoryReader)(void* dst, const void* src, size_t size);
+
+// Sets up the global heap and zinfo; call once, before building any cache
+void InitStandaloneSim(uint32_t lineSize, size_t heapBytes);
+
+// Where PIN_SafeCopy reads application data from (by default, zeros). Copies from
+// the global heap are plain memcpys, so the reader only sees simulated addresses.
+void SetMemoryReader(MemoryReader reader);
+
+#endif  // STANDALONE_SIM_H_
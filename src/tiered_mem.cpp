@@ -0,0 +1,197 @@
+#include "tiered_mem.h"
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "bithacks.h"
+#include "log.h"
+
+TieredMemory::TieredMemory(MemObject* _near, MemObject* _far, uint32_t _pageBits, uint32_t _nearFrames, uint32_t _epochAccesses,
+        uint32_t _promoteThreshold, uint32_t _maxMigrationsPerEpoch, uint32_t _migrationCyclesPerLine, g_string& _name)
+    : near(_near), far(_far), pageBits(_pageBits), nearFrames(_nearFrames), epochAccesses(_epochAccesses),
+      promoteThreshold(_promoteThreshold), maxMigrationsPerEpoch(_maxMigrationsPerEpoch),
+      migrationCyclesPerLine(_migrationCyclesPerLine), name(_name)
+{
+    if (!nearFrames) panic("%s: near memory must hold at least one page", name.c_str());
+    if (!epochAccesses) panic("%s: epochAccesses must be non-zero", name.c_str());
+    framePages.resize(nearFrames, (Address)-1L);
+    frameCounts.resize(nearFrames, 0);
+    frameEpochs.resize(nearFrames, 0);
+    freeFrames.resize(nearFrames);
+    for (uint32_t f = 0; f < nearFrames; f++) freeFrames[f] = nearFrames - 1 - f;  // lowest frames first
+    epoch = 1;  // frameEpochs start at 0, so every count starts at 0
+    epochAccessCount = 0;
+    clockHand = 0;
+    migrationBusyCycle = 0;
+    planning = false;
+    planEpoch = 0;
+    futex_init(&lock);
+    info("%s: %d near frames of %d lines, epoch %d accesses, up to %d migrations/epoch",
+            name.c_str(), nearFrames, 1 << pageBits, epochAccesses, maxMigrationsPerEpoch);
+}
+
+void TieredMemory::initStats(AggregateStat* parentStat) {
+    AggregateStat* memStats = new AggregateStat();
+    memStats->init(name.c_str(), "Tiered memory stats");
+    profNearAccesses.init("nearAcc", "Accesses served by near memory"); memStats->append(&profNearAccesses);
+    profFarAccesses.init("farAcc", "Accesses served by far memory"); memStats->append(&profFarAccesses);
+    profPromotions.init("promotions", "Pages migrated from far to near memory"); memStats->append(&profPromotions);
+    profDemotions.init("demotions", "Pages migrated from near to far memory"); memStats->append(&profDemotions);
+    profMigrationStalls.init("migStalls", "Accesses that waited for their page's migration"); memStats->append(&profMigrationStalls);
+    profMigrationStallCycles.init("migStallCycles", "Cycles accesses waited for their page's migration"); memStats->append(&profMigrationStallCycles);
+    profEpochs.init("epochs", "Migration epochs"); memStats->append(&profEpochs);
+    near->initStats(memStats);
+    far->initStats(memStats);
+    parentStat->append(memStats);
+}
+
+uint64_t TieredMemory::access(MemReq& req) {
+    Address lineAddr = req.lineAddr;
+    uint64_t reqCycle = req.cycle;
+    Address page = lineAddr >> pageBits;
+
+    futex_lock(&lock);
+    // Wait for this page's migration, if any
+    uint64_t startCycle = reqCycle;
+    if (!inFlight.empty()) {
+        auto it = inFlight.find(page);
+        if (it != inFlight.end() && it->second > startCycle) {
+            profMigrationStalls.inc();
+            profMigrationStallCycles.inc(it->second - startCycle);
+            startCycle = it->second;
+        }
+    }
+
+    auto nit = nearMap.find(page);
+    bool isNear = (nit != nearMap.end());
+    Address tierAddr;
+    if (isNear) {
+        uint32_t frame = nit->second;
+        if (frameEpochs[frame] != epoch) {
+            frameEpochs[frame] = epoch;
+            frameCounts[frame] = 0;
+            touchedFrames.push_back(frame);
+        }
+        frameCounts[frame]++;
+        tierAddr = ((Address)frame << pageBits) | (lineAddr & ((1ul << pageBits) - 1));
+        profNearAccesses.inc();
+    } else {
+        farCounts[page]++;
+        tierAddr = lineAddr;
+        profFarAccesses.inc();
+    }
+
+    bool plan = (++epochAccessCount == epochAccesses) && snapshotEpoch();
+    futex_unlock(&lock);
+
+    if (plan) planEpochMigrations(reqCycle);
+
+    req.lineAddr = tierAddr;
+    req.cycle = startCycle;
+    uint64_t respCycle = (isNear? near : far)->access(req);
+    req.lineAddr = lineAddr;
+    req.cycle = reqCycle;
+    return respCycle;
+}
+
+// Copies a page between tiers; the migration engine copies one page at a time
+void TieredMemory::migrate(Address page, uint64_t cycle) {
+    uint64_t startCycle = MAX(cycle, migrationBusyCycle);
+    uint64_t doneCycle = startCycle + ((uint64_t)migrationCyclesPerLine << pageBits);
+    migrationBusyCycle = doneCycle;
+    inFlight[page] = doneCycle;
+}
+
+bool TieredMemory::snapshotEpoch() {
+    epochAccessCount = 0;
+    bool snapshot = !planning;
+    if (snapshot) {
+        planning = true;
+        planEpoch = epoch;
+        planFarCounts.swap(farCounts);
+        planFrames.clear();
+        for (uint32_t frame : touchedFrames) planFrames.push_back(std::make_pair(frameCounts[frame], frame));
+    }
+    farCounts.clear();
+    touchedFrames.clear();
+    epoch++;
+    return snapshot;
+}
+
+void TieredMemory::planEpochMigrations(uint64_t cycle) {
+    // Hottest far pages first
+    std::vector< std::pair<uint32_t, Address> > candidates;
+    for (auto& fc : planFarCounts) {
+        if (fc.second >= promoteThreshold) candidates.push_back(std::make_pair(fc.second, fc.first));
+    }
+    planFarCounts.clear();
+    uint32_t numCandidates = MIN((uint32_t)candidates.size(), MIN(maxMigrationsPerEpoch, nearFrames));
+    std::partial_sort(candidates.begin(), candidates.begin() + numCandidates, candidates.end(),
+            std::greater< std::pair<uint32_t, Address> >());
+
+    // Coldest touched frames, in a max-heap bounded to numCandidates entries
+    std::vector< std::pair<uint32_t, uint32_t> > coldTouched;
+    for (auto& pf : planFrames) {
+        if (coldTouched.size() < numCandidates) {
+            coldTouched.push_back(pf);
+            std::push_heap(coldTouched.begin(), coldTouched.end());
+        } else if (numCandidates && pf < coldTouched.front()) {
+            std::pop_heap(coldTouched.begin(), coldTouched.end());
+            coldTouched.back() = pf;
+            std::push_heap(coldTouched.begin(), coldTouched.end());
+        }
+    }
+    std::sort_heap(coldTouched.begin(), coldTouched.end());
+    uint32_t touchedInPlan = planFrames.size();
+
+    futex_lock(&lock);
+    profEpochs.inc();
+
+    // Drop finished migrations
+    for (auto it = inFlight.begin(); it != inFlight.end();) {
+        if (it->second <= cycle) it = inFlight.erase(it);
+        else it++;
+    }
+
+    // Coldest near frames first: free frames, then frames untouched in the planned epoch
+    // (count 0), then the coldest touched ones. At most touchedInPlan + touchedFrames.size()
+    // frames have been touched since the planned epoch started, so a clock scan that long
+    // finds numCandidates untouched frames if there are that many.
+    std::vector< std::pair<uint32_t, uint32_t> > victims;  // (count, frame)
+    for (uint32_t i = freeFrames.size(); i > 0 && victims.size() < numCandidates; i--) {
+        victims.push_back(std::make_pair(0, freeFrames[i-1]));
+    }
+    uint32_t maxScan = MIN(nearFrames, numCandidates + touchedInPlan + (uint32_t)touchedFrames.size());
+    for (uint32_t scanned = 0; scanned < maxScan && victims.size() < numCandidates; scanned++) {
+        uint32_t frame = clockHand;
+        clockHand = (clockHand + 1 == nearFrames)? 0 : clockHand + 1;
+        if (framePages[frame] != (Address)-1L && frameEpochs[frame] < planEpoch) victims.push_back(std::make_pair(0, frame));
+    }
+    for (uint32_t i = 0; i < coldTouched.size() && victims.size() < numCandidates; i++) victims.push_back(coldTouched[i]);
+
+    for (uint32_t i = 0; i < victims.size(); i++) {
+        uint32_t count = candidates[i].first;
+        Address page = candidates[i].second;
+        uint32_t frame = victims[i].second;
+        Address victimPage = framePages[frame];
+
+        if (victimPage != (Address)-1L) {
+            // Both lists are sorted, so no later swap would pay off either
+            if (count <= victims[i].first) break;
+            nearMap.erase(victimPage);
+            migrate(victimPage, cycle);
+            profDemotions.inc();
+        } else {
+            assert(!freeFrames.empty() && freeFrames.back() == frame);
+            freeFrames.pop_back();
+        }
+
+        nearMap[page] = frame;
+        framePages[frame] = page;
+        if (frameEpochs[frame] == epoch) frameCounts[frame] = 0;  // the new page starts cold
+        migrate(page, cycle);
+        profPromotions.inc();
+    }
+    planning = false;
+    futex_unlock(&lock);
+}
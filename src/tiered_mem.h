@@ -0,0 +1,93 @@
+#ifndef TIERED_MEM_H_
+#define TIERED_MEM_H_
+
+#include <utility>
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+/* Two-tier memory: a small, high-bandwidth near memory (e.g., HBM) in front
+ * of a capacity far memory (e.g., DDR). Both tiers are regular memory
+ * controllers, so each keeps its own timing model and weave-phase contention.
+ *
+ * Pages start in far memory. Accesses are counted per page, and every
+ * epochAccesses accesses the hottest far pages are promoted to near memory,
+ * swapping out the coldest near pages if near memory is full. A far page is
+ * only promoted if it saw at least promoteThreshold accesses in the epoch and
+ * more than the near page it replaces. Counters restart every epoch.
+ *
+ * The access that ends an epoch snapshots its counters under the access lock,
+ * in time proportional to the pages touched in the epoch, and picks the
+ * migrations outside it. Victims come from the free frames, then from a clock
+ * scan for frames untouched in the epoch, then from a bounded heap of the
+ * coldest touched frames, so no epoch work is proportional to nearFrames. An
+ * epoch that ends while the previous one is still being planned is skipped.
+ *
+ * Far memory backs every page (it is addressed by physical line address);
+ * near memory is addressed by frame. Migrations go through a single migration
+ * engine that moves one line every migrationCyclesPerLine cycles, and a page
+ * in flight blocks its accesses until its copy is done. Migration traffic is
+ * not injected into the tiers' weave models, as it has no core to be
+ * recorded against.
+ */
+class TieredMemory : public MemObject {
+    private:
+        MemObject* const near;
+        MemObject* const far;
+        const uint32_t pageBits;  // in lines
+        const uint32_t nearFrames;
+        const uint32_t epochAccesses;
+        const uint32_t promoteThreshold;
+        const uint32_t maxMigrationsPerEpoch;
+        const uint32_t migrationCyclesPerLine;
+        const g_string name;
+
+        g_unordered_map<Address, uint32_t> nearMap;  // page -> frame
+        g_vector<Address> framePages;  // frame -> page, or -1 if free
+        g_vector<uint32_t> frameCounts;  // accesses to each frame in frameEpochs[frame]
+        g_vector<uint32_t> frameEpochs;  // epoch of each frame's count; older counts are 0
+        g_vector<uint32_t> touchedFrames;  // frames accessed in this epoch
+        g_vector<uint32_t> freeFrames;
+        g_unordered_map<Address, uint32_t> farCounts;  // accesses to each far page in this epoch
+        g_unordered_map<Address, uint64_t> inFlight;  // page -> cycle its migration finishes
+        uint32_t epoch;
+        uint32_t epochAccessCount;
+        uint32_t clockHand;  // next frame to check for an untouched victim
+        uint64_t migrationBusyCycle;  // migration engine is busy until this cycle
+
+        // Snapshot of the epoch being planned, only used by the thread that ended it
+        bool planning;
+        uint32_t planEpoch;
+        g_unordered_map<Address, uint32_t> planFarCounts;
+        g_vector< std::pair<uint32_t, uint32_t> > planFrames;  // (count, frame) of the frames touched in planEpoch
+
+        lock_t lock;
+
+        PAD();
+        Counter profNearAccesses, profFarAccesses;
+        Counter profPromotions, profDemotions;
+        Counter profMigrationStalls, profMigrationStallCycles;
+        Counter profEpochs;
+        PAD();
+
+    public:
+        TieredMemory(MemObject* _near, MemObject* _far, uint32_t _pageBits, uint32_t _nearFrames, uint32_t _epochAccesses,
+                uint32_t _promoteThreshold, uint32_t _maxMigrationsPerEpoch, uint32_t _migrationCyclesPerLine, g_string& _name);
+
+        uint64_t access(MemReq& req);
+
+        const char* getName() {return name.c_str();}
+
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        void migrate(Address page, uint64_t cycle);
+        bool snapshotEpoch();  // called with lock held; false if the previous epoch is still being planned
+        void planEpochMigrations(uint64_t cycle);  // called without lock
+};
+
+#endif  // TIERED_MEM_H_
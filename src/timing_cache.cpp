@@ -43,7 +43,11 @@ void TimingCache::initStats(AggregateStat* parentStat) {
     AggregateStat* cacheStat = new AggregateStat();
     cacheStat->init(name.c_str(), "Timing cache stats");
     initCacheStats(cacheStat);
+    initTimingStats(cacheStat);
+    parentStat->append(cacheStat);
+}
 
+void TimingCache::initTimingStats(AggregateStat* cacheStat) {
     //Stats specific to timing cache
     profOccHist.init("occHist", "Occupancy MSHR cycle histogram", numMSHRs+1);
     cacheStat->append(&profOccHist);
@@ -55,8 +59,6 @@ void TimingCache::initStats(AggregateStat* parentStat) {
     cacheStat->append(&profHitLat);
     cacheStat->append(&profMissRespLat);
     cacheStat->append(&profMissLat);
-
-    parentStat->append(cacheStat);
 }
 
 // TODO(dsm): This is copied verbatim from Cache. We should split Cache into different methods, then call those.
@@ -346,3 +348,17 @@ void TimingCache::simulateReplAccess(ReplAccessEvent* ev, uint64_t cycle) {
     }
 }
 
+void TimingCache::simulateHitWriteback(HitWritebackEvent* ev, uint64_t cycle) {
+    uint64_t lookupCycle = tryLowPrioAccess(cycle);
+    if (lookupCycle) { //success, release MSHR
+        if (!pendingQueue.empty()) {
+            for (TimingEvent* qev : pendingQueue) {
+                qev->requeue(cycle+1);
+            }
+            pendingQueue.clear();
+        }
+        ev->done(cycle);
+    } else {
+        ev->requeue(cycle+1);
+    }
+}
@@ -32,6 +32,7 @@
 #include "event_recorder.h"
 
 class HitEvent;
+class HitWritebackEvent;
 class MissStartEvent;
 class MissResponseEvent;
 class MissWritebackEvent;
@@ -72,8 +73,10 @@ class TimingCache : public Cache {
         void simulateMissResponse(MissResponseEvent* ev, uint64_t cycle, MissStartEvent* mse);
         void simulateMissWriteback(MissWritebackEvent* ev, uint64_t cycle, MissStartEvent* mse);
         void simulateReplAccess(ReplAccessEvent* ev, uint64_t cycle);
+        void simulateHitWriteback(HitWritebackEvent* ev, uint64_t cycle);
 
     protected:
+        void initTimingStats(AggregateStat* cacheStat);
         uint64_t highPrioAccess(uint64_t cycle);
         uint64_t tryLowPrioAccess(uint64_t cycle);
 };
@@ -90,6 +93,15 @@ class HitEvent : public TimingEvent {
         }
 };
 
+// Low-priority tag/data update after a hit (e.g., recompressing or rehashing a written-back line)
+class HitWritebackEvent : public TimingEvent {
+    private:
+        TimingCache* cache;
+    public:
+        HitWritebackEvent(TimingCache* _cache, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle);}
+};
+
 class MissStartEvent : public TimingEvent {
     private:
         TimingCache* cache;
@@ -30,8 +30,8 @@
 #define DEBUG_MSG(args...)
 //#define DEBUG_MSG(args...) info(args)
 
-TimingCore::TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t _domain, g_string& _name)
-    : Core(_name), l1i(_l1i), l1d(_l1d), instrs(0), curCycle(0), cRec(_domain, _name) {}
+TimingCore::TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t _domain, g_string& _name, bool _batchMemOps)
+    : Core(_name), l1i(_l1i), l1d(_l1d), instrs(0), curCycle(0), cRec(_domain, _name), batchMemOps(_batchMemOps), memOps(0) {}
 
 uint64_t TimingCore::getPhaseCycles() const {
     return curCycle % zinfo->phaseLength;
@@ -69,17 +69,19 @@ void TimingCore::contextSwitch(int32_t gid) {
 void TimingCore::join() {
     DEBUG_MSG("[%s] Joining, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
     curCycle = cRec.notifyJoin(curCycle);
+    memOps = 0; //kill lingering ops (e.g., buffered before a fast-forward)
     phaseEndCycle = zinfo->globPhaseCycles + zinfo->phaseLength;
     DEBUG_MSG("[%s] Joined, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
 }
 
 void TimingCore::leave() {
+    flushMemOps(); //they belong to the BBL before the thread left
     cRec.notifyLeave(curCycle);
 }
 
-void TimingCore::loadAndRecord(Address addr) {
+void TimingCore::loadAndRecord(Address addr, Address pc) {
     uint64_t startCycle = curCycle;
-    curCycle = l1d->load(addr, curCycle);
+    curCycle = l1d->load(addr, curCycle, pc);
     cRec.record(startCycle);
 }
 
@@ -89,6 +91,23 @@ void TimingCore::storeAndRecord(Address addr) {
     cRec.record(startCycle);
 }
 
+void TimingCore::bufferMemOp(Address addr, Address pc, bool isStore) {
+    if (memOps == sizeof(memOpBuf)/sizeof(MemOp)) flushMemOps(); //only with huge BBLs
+    memOpBuf[memOps].addr = addr;
+    memOpBuf[memOps].pc = pc;
+    memOpBuf[memOps].isStore = isStore;
+    memOps++;
+}
+
+void TimingCore::flushMemOps() {
+    for (uint32_t i = 0; i < memOps; i++) l1d->prefetch(memOpBuf[i].addr);
+    for (uint32_t i = 0; i < memOps; i++) {
+        if (memOpBuf[i].isStore) storeAndRecord(memOpBuf[i].addr);
+        else loadAndRecord(memOpBuf[i].addr, memOpBuf[i].pc);
+    }
+    memOps = 0;
+}
+
 void TimingCore::bblAndRecord(Address bblAddr, BblInfo* bblInfo) {
     instrs += bblInfo->instrs;
     curCycle += bblInfo->instrs;
@@ -103,11 +122,18 @@ void TimingCore::bblAndRecord(Address bblAddr, BblInfo* bblInfo) {
 
 
 InstrFuncPtrs TimingCore::GetFuncPtrs() {
-    return {LoadAndRecordFunc, StoreAndRecordFunc, BblAndRecordFunc, BranchFunc, PredLoadAndRecordFunc, PredStoreAndRecordFunc, FPTR_ANALYSIS, {0}};
+    if (batchMemOps) {
+        return {LoadAndBufferFunc, StoreAndBufferFunc, BblAndFlushFunc, BranchFunc, PredLoadAndBufferFunc, PredStoreAndBufferFunc, FPTR_ANALYSIS, LoadPcAndBufferFunc};
+    }
+    return {LoadAndRecordFunc, StoreAndRecordFunc, BblAndRecordFunc, BranchFunc, PredLoadAndRecordFunc, PredStoreAndRecordFunc, FPTR_ANALYSIS, LoadPcAndRecordFunc};
 }
 
 void TimingCore::LoadAndRecordFunc(THREADID tid, ADDRINT addr) {
-    static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr);
+    static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr, 0);
+}
+
+void TimingCore::LoadPcAndRecordFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr, pc);
 }
 
 void TimingCore::StoreAndRecordFunc(THREADID tid, ADDRINT addr) {
@@ -127,10 +153,35 @@ void TimingCore::BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInf
 }
 
 void TimingCore::PredLoadAndRecordFunc(THREADID tid, ADDRINT addr, BOOL pred) {
-    if (pred) static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr);
+    if (pred) static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr, 0);
 }
 
 void TimingCore::PredStoreAndRecordFunc(THREADID tid, ADDRINT addr, BOOL pred) {
     if (pred) static_cast<TimingCore*>(cores[tid])->storeAndRecord(addr);
 }
 
+void TimingCore::LoadAndBufferFunc(THREADID tid, ADDRINT addr) {
+    static_cast<TimingCore*>(cores[tid])->bufferMemOp(addr, 0, false);
+}
+
+void TimingCore::LoadPcAndBufferFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    static_cast<TimingCore*>(cores[tid])->bufferMemOp(addr, pc, false);
+}
+
+void TimingCore::StoreAndBufferFunc(THREADID tid, ADDRINT addr) {
+    static_cast<TimingCore*>(cores[tid])->bufferMemOp(addr, 0, true);
+}
+
+void TimingCore::BblAndFlushFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
+    static_cast<TimingCore*>(cores[tid])->flushMemOps(); //previous BBL's loads and stores
+    BblAndRecordFunc(tid, bblAddr, bblInfo);
+}
+
+void TimingCore::PredLoadAndBufferFunc(THREADID tid, ADDRINT addr, BOOL pred) {
+    if (pred) static_cast<TimingCore*>(cores[tid])->bufferMemOp(addr, 0, false);
+}
+
+void TimingCore::PredStoreAndBufferFunc(THREADID tid, ADDRINT addr, BOOL pred) {
+    if (pred) static_cast<TimingCore*>(cores[tid])->bufferMemOp(addr, 0, true);
+}
+
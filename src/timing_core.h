@@ -46,8 +46,21 @@ class TimingCore : public Core {
 
         CoreRecorder cRec;
 
+        //Batched mode: loads and stores are buffered and simulated at the next
+        //BBL (or when the thread leaves), in program order, saving filter cache
+        //work per Pin analysis call. Timing is the same as in unbatched mode,
+        //since the next BBL's fetch is always simulated after them.
+        struct MemOp {
+            Address addr;
+            Address pc;  // loads only
+            bool isStore;
+        };
+        bool batchMemOps;
+        uint32_t memOps;
+        MemOp memOpBuf[256];
+
     public:
-        TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t domain, g_string& _name);
+        TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t domain, g_string& _name, bool _batchMemOps = false);
         void initStats(AggregateStat* parentStat);
 
         uint64_t getInstrs() const {return instrs;}
@@ -66,17 +79,27 @@ class TimingCore : public Core {
         void cSimEnd() {curCycle = cRec.cSimEnd(curCycle);}
 
     private:
-        inline void loadAndRecord(Address addr);
+        inline void loadAndRecord(Address addr, Address pc);
         inline void storeAndRecord(Address addr);
         inline void bblAndRecord(Address bblAddr, BblInfo* bblInstrs);
         inline void record(uint64_t startCycle);
+        inline void bufferMemOp(Address addr, Address pc, bool isStore);
+        void flushMemOps();
 
         static void LoadAndRecordFunc(THREADID tid, ADDRINT addr);
+        static void LoadPcAndRecordFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
         static void StoreAndRecordFunc(THREADID tid, ADDRINT addr);
         static void BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
         static void PredLoadAndRecordFunc(THREADID tid, ADDRINT addr, BOOL pred);
         static void PredStoreAndRecordFunc(THREADID tid, ADDRINT addr, BOOL pred);
 
+        static void LoadAndBufferFunc(THREADID tid, ADDRINT addr);
+        static void LoadPcAndBufferFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
+        static void StoreAndBufferFunc(THREADID tid, ADDRINT addr);
+        static void BblAndFlushFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
+        static void PredLoadAndBufferFunc(THREADID tid, ADDRINT addr, BOOL pred);
+        static void PredStoreAndBufferFunc(THREADID tid, ADDRINT addr, BOOL pred);
+
         static void BranchFunc(THREADID, ADDRINT, BOOL, ADDRINT, ADDRINT) {}
 } ATTR_LINE_ALIGNED;
 
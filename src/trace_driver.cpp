@@ -79,8 +79,11 @@ uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType typ
     std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
     std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
     assert((it != cStore.end()));
-    *reqWriteback = (it->second == M);
-    if (type == INVX) {
+    *reqWriteback = (it->second == M || it->second == O);
+    if (type == INVXO) {
+        it->second = (it->second == M)? O : S; //a dirty line becomes owned
+        children[childId].profInvx.inc();
+    } else if (type == INVX) {
         it->second = S;
         children[childId].profInvx.inc();
     } else {
@@ -145,9 +148,9 @@ void TraceDriver::executeAccess(AccessRecord acc) {
                 std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
                 MESIState state = I;
                 if (it != cStore.end()) {
-                    if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
+                    if (!((it->second == S || it->second == O) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
                         if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                            MemReq req = {acc.lineAddr, (it->second == M || it->second == O)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
                             parent->access(req);
                             assert(it->second == I);
                         } else {
@@ -1,49 +1,32 @@
 #ifndef UNIDOPPELGANGER_CACHE_H_
 #define UNIDOPPELGANGER_CACHE_H_
 
-#include "timing_cache.h"
+#include "compressed_cache.h"
 #include "stats.h"
 
-class uHitWritebackEvent;
-
-class uniDoppelgangerCache : public TimingCache {
-    protected:
-        // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
-
-        uniDoppelgangerTagArray* tagArray;
-        uniDoppelgangerDataArray* dataArray;
-
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
-
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
+class uniDoppelgangerCache : public CompressedCacheEngine<uniDoppelgangerCache, uniDoppelgangerTagArray, uniDoppelgangerDataArray> {
+    friend class CompressedCacheEngine<uniDoppelgangerCache, uniDoppelgangerTagArray, uniDoppelgangerDataArray>;
 
     public:
         uniDoppelgangerCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, uniDoppelgangerTagArray* _tagArray, uniDoppelgangerDataArray* _dataArray,
                         ReplPolicy* tagRP, ReplPolicy* dataRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, 
                         const g_string& _name, RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
 
-        uint64_t access(MemReq& req);
-
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(uHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
 
-class uHitWritebackEvent : public TimingEvent {
-    private:
-        uniDoppelgangerCache* cache;
-        HitEvent* he;
-    public:
-        uHitWritebackEvent(uniDoppelgangerCache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Engine hooks (see CompressedCacheEngine). Exact lines keep no data, so only approximate
+        // ones are read, and their victim tag waits for the victim data read.
+        bool needsData(const CompressedAccess& a) const {return a.approximate;}
+        uint64_t tagEvictionCycle(const CompressedAccess& a) const {return a.respCycle + (a.approximate? accLat : 0);}
+        void releaseTag(CompressedAccess& a, int32_t victimTagId);
+        void fill(CompressedAccess& a, int32_t victimTagId);
+        void hit(CompressedAccess& a, int32_t tagId);
+        void sampleArrayStats();
+
+        void releaseData(int32_t tagId, const MemReq* req);  // drops tagId from its data line's list, freeing the line if it was the last
+        // Picks a victim data line for map and evicts its tags but keepTagId at evBeginCycle; returns it
+        int32_t evictDataLine(CompressedAccess& a, uint32_t map, int32_t keepTagId, uint64_t evBeginCycle);
 };
 
 #endif // UNIDOPPELGANGER_CACHE_H_
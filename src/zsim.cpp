@@ -36,6 +36,7 @@
 #include <sched.h>
 #include <sstream>
 #include <string>
+#include <string.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <sys/time.h>
@@ -57,6 +58,8 @@
 #include "process_tree.h"
 #include "profile_stats.h"
 #include "scheduler.h"
+#include "shadow_llc.h"
+#include "simpoint.h"
 #include "stats.h"
 #include "trace_driver.h"
 #include "virt/virt.h"
@@ -173,6 +176,10 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectLoadSingle(THREADID tid, ADDRINT addr) {
     fPtrs[tid].loadPtr(tid, addr);
 }
 
+VOID PIN_FAST_ANALYSIS_CALL IndirectLoadPcSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    fPtrs[tid].loadPcPtr(tid, addr, pc);
+}
+
 VOID PIN_FAST_ANALYSIS_CALL IndirectStoreSingle(THREADID tid) {
     fPtrs[tid].storePtr(tid, savedWriteAddress);
 }
@@ -189,6 +196,11 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectPredLoadSingle(THREADID tid, ADDRINT addr, B
     fPtrs[tid].predLoadPtr(tid, addr, pred);
 }
 
+VOID PIN_FAST_ANALYSIS_CALL IndirectPredLoadPcSingle(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
+    if (pred) fPtrs[tid].loadPcPtr(tid, addr, pc);
+    else fPtrs[tid].predLoadPtr(tid, addr, pred);
+}
+
 VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, BOOL pred) {
     fPtrs[tid].predStorePtr(tid, savedWriteAddress, pred);
 }
@@ -216,6 +228,11 @@ VOID JoinAndLoadSingle(THREADID tid, ADDRINT addr) {
     fPtrs[tid].loadPtr(tid, addr);
 }
 
+VOID JoinAndLoadPcSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    Join(tid);
+    fPtrs[tid].loadPcPtr(tid, addr, pc);
+}
+
 VOID JoinAndStoreSingle(THREADID tid, ADDRINT addr) {
     Join(tid);
     fPtrs[tid].storePtr(tid, addr);
@@ -246,6 +263,7 @@ VOID NOPLoadStoreSingle(THREADID tid, ADDRINT addr) {}
 VOID NOPBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {}
 VOID NOPRecordBranch(THREADID tid, ADDRINT addr, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {}
 VOID NOPPredLoadStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {}
+VOID NOPLoadPcSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {}
 
 // FF is basically NOP except for basic blocks
 VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
@@ -254,6 +272,43 @@ VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     }
 }
 
+// FF warming variants: functionally fill the LLC with a sample of the fast-forwarded accesses
+static uint32_t ffWarmCounts[MAX_THREADS];
+static uint8_t* ffWarmData[MAX_THREADS]; //per-thread line buffers (process-local heap)
+
+static inline void FFWarmAccess(THREADID tid, ADDRINT addr, AccessType type) {
+    if (++ffWarmCounts[tid] < zinfo->ffWarmSampling) return;
+    ffWarmCounts[tid] = 0;
+    Address lineAddr = procMask | (addr >> lineBits);
+    if (zinfo->shadowLLCs) ShadowLLCsEnqueue(lineAddr, type);
+    uint8_t* data = ffWarmData[tid];
+    if (unlikely(!data)) data = ffWarmData[tid] = new uint8_t[zinfo->lineSize];
+    memset(data, 0, zinfo->lineSize); //unmapped lines read as zeros
+    PIN_SafeCopy(data, (void*)(lineAddr << lineBits), zinfo->lineSize);
+    g_vector<Cache*>& banks = *zinfo->ffWarmCaches;
+    banks[HashParentId(lineAddr, banks.size())]->warm(lineAddr, type, data); //same bank a simulated access would go to
+}
+
+VOID FFWarmLoadSingle(THREADID tid, ADDRINT addr) {
+    FFWarmAccess(tid, addr, GETS);
+}
+
+VOID FFWarmLoadPcSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    FFWarmAccess(tid, addr, GETS);
+}
+
+VOID FFWarmStoreSingle(THREADID tid, ADDRINT addr) {
+    FFWarmAccess(tid, addr, GETX);
+}
+
+VOID FFWarmPredLoadSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+    if (pred) FFWarmAccess(tid, addr, GETS);
+}
+
+VOID FFWarmPredStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+    if (pred) FFWarmAccess(tid, addr, GETX);
+}
+
 // FFI is instruction-based fast-forwarding
 /* FFI works as follows: when in fast-forward, we install a special FF BBL func
  * ptr that counts instructions and checks whether we have reached the switch
@@ -295,6 +350,7 @@ VOID FFITrackNFFInterval() {
     auto ffiGet = [p, startInstrs]() { return zinfo->processStats->getProcessInstrs(p) - startInstrs; };
     auto ffiFire = [p, _ffiFFStartInstrs, _ffiPrevFFStartInstrs]() {
         info("FFI: Entering fast-forward for process %d", p);
+        if (zinfo->simPointStats && zinfo->simPointStats->getProcIdx() == p) zinfo->simPointStats->regionEnd();
         /* Note this is sufficient due to the lack of reinstruments on FF, and this way we do not need to touch global state */
         futex_lock(&zinfo->ffLock);
         assert(!zinfo->procArray[p]->isInFastForward());
@@ -350,6 +406,7 @@ VOID FFIBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
         info("FFI: Exiting fast-forward");
         ExitFastForward();
         futex_unlock(&zinfo->ffLock);
+        if (zinfo->simPointStats && zinfo->simPointStats->getProcIdx() == procIdx) zinfo->simPointStats->regionStart();
         FFITrackNFFInterval();
 
         SimThreadStart(tid);
@@ -367,15 +424,20 @@ VOID FFIEntryBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
 }
 
 // Non-analysis pointer vars
-static const InstrFuncPtrs joinPtrs = {JoinAndLoadSingle, JoinAndStoreSingle, JoinAndBasicBlock, JoinAndRecordBranch, JoinAndPredLoadSingle, JoinAndPredStoreSingle, FPTR_JOIN};
-static const InstrFuncPtrs nopPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
-static const InstrFuncPtrs retryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_RETRY};
-static const InstrFuncPtrs ffPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
+static const InstrFuncPtrs joinPtrs = {JoinAndLoadSingle, JoinAndStoreSingle, JoinAndBasicBlock, JoinAndRecordBranch, JoinAndPredLoadSingle, JoinAndPredStoreSingle, FPTR_JOIN, JoinAndLoadPcSingle};
+static const InstrFuncPtrs nopPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP, NOPLoadPcSingle};
+static const InstrFuncPtrs retryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, NOPBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_RETRY, NOPLoadPcSingle};
+static const InstrFuncPtrs ffPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP, NOPLoadPcSingle};
+
+static const InstrFuncPtrs ffiPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP, NOPLoadPcSingle};
+static const InstrFuncPtrs ffiEntryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP, NOPLoadPcSingle};
 
-static const InstrFuncPtrs ffiPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
-static const InstrFuncPtrs ffiEntryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
+static const InstrFuncPtrs ffWarmPtrs = {FFWarmLoadSingle, FFWarmStoreSingle, FFBasicBlock, NOPRecordBranch, FFWarmPredLoadSingle, FFWarmPredStoreSingle, FPTR_NOP, FFWarmLoadPcSingle};
+static const InstrFuncPtrs ffiWarmPtrs = {FFWarmLoadSingle, FFWarmStoreSingle, FFIBasicBlock, NOPRecordBranch, FFWarmPredLoadSingle, FFWarmPredStoreSingle, FPTR_NOP, FFWarmLoadPcSingle};
+static const InstrFuncPtrs ffiEntryWarmPtrs = {FFWarmLoadSingle, FFWarmStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, FFWarmPredLoadSingle, FFWarmPredStoreSingle, FPTR_NOP, FFWarmLoadPcSingle};
 
 static const InstrFuncPtrs& GetFFPtrs() {
+    if (zinfo->ffWarm) return ffiEnabled? (ffiNFF? ffiEntryWarmPtrs : ffiWarmPtrs) : ffWarmPtrs;
     return ffiEnabled? (ffiNFF? ffiEntryPtrs : ffiPtrs) : ffPtrs;
 }
 
@@ -624,7 +686,13 @@ VOID Instruction(INS ins) {
 
         for (uint8_t memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
             if (INS_MemoryOperandIsRead(ins, memOp)) {
-                if (!INS_IsPredicated(ins)) {
+                if (zinfo->loadPcs) { //IP-indexed prefetchers train on load PCs
+                    if (!INS_IsPredicated(ins)) {
+                        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) IndirectLoadPcSingle, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYOP_EA, memOp, IARG_INST_PTR, IARG_END);
+                    } else {
+                        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) IndirectPredLoadPcSingle, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYOP_EA, memOp, IARG_INST_PTR, IARG_EXECUTING, IARG_END);
+                    }
+                } else if (!INS_IsPredicated(ins)) {
                     INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYOP_EA, memOp, IARG_END);
                 } else {
                     INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYOP_EA, memOp, IARG_EXECUTING, IARG_END);
@@ -692,6 +760,14 @@ VOID Trace(TRACE trace, VOID *v) {
         }
     }
 
+    //BBV collection counts in and out of fast-forward
+    if (zinfo->bbvInterval) {
+        for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+            BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)BbvCount, IARG_FAST_ANALYSIS_CALL,
+                 IARG_THREAD_ID, IARG_UINT32, BbvGetBblId(BBL_Address(bbl)), IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+        }
+    }
+
     //Instruction instrumentation now here to ensure proper ordering
     for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
         for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
@@ -932,6 +1008,8 @@ VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v) {
      * It's here and not in main() because that way the auxiliary threads can
      * start.
      */
+    BbvThreadStart(tid);
+
     if (procTreeNode->isInPause()) {
         futex_lock(&zinfo->pauseLocks[procIdx]);  // initialize
         info("Pausing until notified");
@@ -961,6 +1039,7 @@ VOID SimThreadFini(THREADID tid) {
 
 VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
     //NOTE: Thread has no valid cid here!
+    BbvThreadFini(tid);
     if (fPtrs[tid].type == FPTR_NOP) {
         info("Shadow/NOP thread %d finished", tid);
         return;
@@ -1156,6 +1235,10 @@ VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
     //We need to launch another copy of the FF control thread
     PIN_SpawnInternalThread(FFThread, nullptr, 64*1024, nullptr);
 
+    //...and of the shadow LLC workers, which read data from this process
+    ShadowLLCsInitProcess();
+    BbvInitProcess();
+
     ThreadStart(tid, nullptr, 0, nullptr);
 }
 
@@ -1180,6 +1263,9 @@ VOID SimEnd() {
     //at this point, we're in charge of exiting our whole process, but we still need to race for the stats
 
     //per-process
+    ShadowLLCsDrain(); //so the shadow stats include every access this process made
+    BbvFinish();
+
 #ifdef BBL_PROFILING
     Decoder::dumpBblProfile();
 #endif
@@ -1200,6 +1286,11 @@ VOID SimEnd() {
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        if (zinfo->simPointStats) {
+            std::stringstream ss;
+            ss << zinfo->outputDir << "/zsim-simpoints.out";
+            zinfo->simPointStats->dump(ss.str().c_str());
+        }
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
         for(uint32_t i = 0; i < zinfo->compressionRatioStats->size(); i++) (*zinfo->compressionRatioStats)[i]->dump();
@@ -1210,6 +1301,7 @@ VOID SimEnd() {
         for(uint32_t i = 0; i < zinfo->tagMissStats->size(); i++) (*zinfo->tagMissStats)[i]->dump();
         for(uint32_t i = 0; i < zinfo->tagAllStats->size(); i++) (*zinfo->tagAllStats)[i]->dump();
         for(uint32_t i = 0; i < zinfo->L3Cache->size(); i++) (*zinfo->L3Cache)[i]->dumpStats();
+        if (zinfo->shadowLLCs) zinfo->shadowLLCs->dumpStats();
     }
 
     //Uncomment when debugging termination races, which can be rare because they are triggered by threads of a dying process
@@ -1645,6 +1737,9 @@ int main(int argc, char *argv[]) {
     //OK, screw it. Launch this on a separate thread, and forget about signals... the caller will set a shared memory var. PIN is hopeless with signal instrumentation on multithreaded processes!
     PIN_SpawnInternalThread(FFThread, nullptr, 64*1024, nullptr);
 
+    ShadowLLCsInitProcess();
+    BbvInitProcess();
+
     // Start trace-driven or exec-driven sim
     if (zinfo->traceDriven) {
         info("Running trace-driven simulation");
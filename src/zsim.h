@@ -38,6 +38,8 @@
 #include <tuple>
 
 class Cache;
+class ShadowLLCs;
+class SimPointStats;
 class Counter;
 class Core;
 class Scheduler;
@@ -185,6 +187,20 @@ struct GlobSimInfo {
 
     bool ffReinstrument; //true if we should reinstrument on ffwd, works fine with ST apps and it's faster since we run with basically no instrumentation, but it's not precise with MT apps
 
+    //Functional warming of the LLC during fast-forward
+    bool ffWarm;
+    uint32_t ffWarmSampling; //warm 1 out of every ffWarmSampling memory accesses of each thread
+    g_vector<Cache*>* ffWarmCaches; //LLC banks, indexed like MESIBottomCC::getParentId does
+
+    //Functional-only LLC configurations fed with the real LLC's access stream (nullptr if none)
+    ShadowLLCs* shadowLLCs;
+
+    //SimPoint support
+    uint64_t bbvInterval; //instructions per basic block vector, 0 if not collecting BBVs
+    SimPointStats* simPointStats; //weighted stats of the process simulated by regions (nullptr if none)
+
+    bool loadPcs; //true if some prefetcher is indexed by load PC, so loads are instrumented with their PC
+
     //fftoggle stuff
     lock_t ffToggleLocks[256]; //f*ing Pin and its f*ing inability to handle external signals...
     lock_t pauseLocks[256]; //per-process pauses